@@ -12,6 +12,7 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "FreeCamera.hpp"
+#include "GeometryPool.hpp"
 #include "GLSLShader.hpp"
 #include "Grid.hpp"
 #include "UnitCube.hpp"
@@ -241,6 +242,7 @@ void OnInit() {
 
 // release all allocated resources
 void OnShutdown() {
+  CGeometryPool::Instance().PrintStats(std::cout);
   delete g_pCommon->grid;
   delete g_pCommon->cube;
   std::cout << "Shutdown successfull" << std::endl;
@@ -293,6 +295,9 @@ void OnRender() {
   g_pCommon->P = g_pCommon->cam.GetProjectionMatrix();
   const auto MVP = g_pCommon->P * g_pCommon->MV;
 
+  // the grid and the cubes are pooled, keep their page VAO bound between them
+  CGeometryPool::Instance().BeginBatch();
+
   // render the grid object
   g_pCommon->grid->Render(glm::value_ptr(MVP));
 
@@ -313,6 +318,7 @@ void OnRender() {
   T = glm::translate(glm::mat4(1), g_pCommon->box_positions[2]);
   g_pCommon->cube->color = (g_pCommon->selected_box == 2) ? glm::vec3(0, 1, 1) : glm::vec3(0, 0, 1);
   g_pCommon->cube->Render(glm::value_ptr(MVP * T));
+  CGeometryPool::Instance().EndBatch();
 
   // swap front and back buffers to show the rendered result
   glutSwapBuffers();
@@ -1,7 +1,12 @@
 // This is an open source non-commercial project. Dear PVS-Studio, please check
 // it. PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include <algorithm>
 #include <iostream>
+#include <cmath>
 #include <cstring>
+#include <iterator>
+#include <limits>
+#include <random>
 #include <sstream>
 
 #include <GL/glew.h>
@@ -12,7 +17,14 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "GLSLShader.hpp"
+#include "AabbTree.hpp"
+#include "GLHandle.hpp"
 #include "FreeCamera.hpp"
+#include "FrustumCuller.hpp"
+#include "GpuCuller.hpp"
+#include "MultiViewCuller.hpp"
+#include "OcclusionCuller.hpp"
+#include "QueryPool.hpp"
 #include "TexturedPlane.hpp"
 
 #ifndef MAX_PATH
@@ -102,11 +114,48 @@ struct Common {
   glm::vec3 pointVertices[MAX_POINTS];
   GLuint pointVAOID, pointVBOID;
 
-  // number of points visible
-  int total_visible = 0;
-
-  // hardware query
-  GLuint query;
+  // number of points visible, from the query a few frames back
+  GLuint64 total_visible = 0;
+
+  // the displaced points in world space for the CPU culler, as spheres of
+  // radius 0
+  CFrustumCuller culler;
+  CFrustumCuller::Mask visiblePoints;
+  float pointX[MAX_POINTS], pointY[MAX_POINTS], pointZ[MAX_POINTS];
+  float pointRadius[MAX_POINTS] = {};
+
+  // the same points against both cameras in one pass, bit 0 is cam and
+  // bit 1 is world
+  CMultiViewCuller viewCuller;
+  std::vector<CMultiViewCuller::ViewMask> pointViews;
+
+  // the same points through the camera, with the plane that rejected each
+  // point last frame tested first when useCoherence is on
+  std::uint8_t pointPlanes[MAX_POINTS] = {};
+  bool useCoherence = true;
+
+  // the same points in an AABB tree, moved every frame
+  CAabbTree pointTree{0.1f};
+  int pointProxies[MAX_POINTS];
+  std::vector<std::uint32_t> treeVisible;
+
+  // GPU-driven path: the points are culled on the GPU into an instance
+  // buffer and drawn with one indirect draw of a single point mesh
+  CGpuCuller gpuCuller;
+  bool useGpuCulling = false;
+  glm::vec4 pointSpheres[MAX_POINTS];
+  GLSLShader indirectPointShader;
+  GLVertexArray indirectVAO;
+  GLBuffer indirectIndices;
+  GLTexture sphereTexture; // texture buffer view of the spheres
+
+  // the ground plane rasterized on the CPU as an occluder of the tree
+  // cull, it hides the points below it
+  COcclusionCuller occlusion;
+  bool useOcclusion = false;
+
+  // hardware queries, read back without waiting for the GPU
+  CQueryPool queries;
 
   // FPS related variables
   float start_time = 0;
@@ -213,8 +262,8 @@ void OnMouseMove(int x, int y) {
 }
 
 void OnInit() {
-  // generate hardware query
-  glGenQueries(1, &g_pCommon->query);
+  // generate hardware queries
+  g_pCommon->queries.Init(GL_PRIMITIVES_GENERATED, 4);
 
   // enable polygin line drawing mode
   glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -337,6 +386,7 @@ void OnInit() {
   // set the projection and update the camera settings
   g_pCommon->world.SetupProjection(g_pCommon->fov, (static_cast<GLfloat>(Common::WIDTH) / Common::HEIGHT), 0.1f, 100.0f);
   g_pCommon->world.Update();
+  g_pCommon->world.CalcFrustumPlanes();
 
   // assign the object cam as the current camera
   g_pCommon->pCurrentCam = &g_pCommon->cam;
@@ -388,8 +438,50 @@ void OnInit() {
       float x = i / (Common::PX - 1.0f);
       float z = j / (Common::PZ - 1.0f);
       g_pCommon->pointVertices[j * Common::PX + i] = glm::vec3(x, 0, z);
+      // same -5 to 5 range as the geometry shader
+      g_pCommon->pointX[j * Common::PX + i] = (x * 2 - 1) * 5;
+      g_pCommon->pointZ[j * Common::PX + i] = (z * 2 - 1) * 5;
     }
   }
+  for (int i = 0; i < Common::MAX_POINTS; ++i) {
+    const glm::vec3 point(g_pCommon->pointX[i],
+                          sinf(g_pCommon->pointVertices[i].x * 2 * static_cast<float>(M_PI)),
+                          g_pCommon->pointZ[i]);
+    g_pCommon->pointProxies[i] =
+        g_pCommon->pointTree.Insert(point, point, static_cast<std::uint32_t>(i));
+  }
+  g_pCommon->pointTree.Rebuild();
+  g_pCommon->occlusion.Init();
+
+  if (CGpuCuller::IsSupported()) {
+    g_pCommon->gpuCuller.Init(Common::MAX_POINTS);
+    g_pCommon->gpuCuller.SetMesh(1);
+
+    g_pCommon->indirectPointShader.LoadFromFile(GL_VERTEX_SHADER,   "shaders/points_indirect.vert");
+    g_pCommon->indirectPointShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/points.frag");
+    g_pCommon->indirectPointShader.CreateAndLinkProgram();
+    g_pCommon->indirectPointShader.Use();
+    g_pCommon->indirectPointShader.AddUniform("MVP");
+    g_pCommon->indirectPointShader.AddUniform("spheres");
+    glUniform1i(g_pCommon->indirectPointShader("spheres"), 0);
+    g_pCommon->indirectPointShader.UnUse();
+
+    // one point per visible instance, its position read from the spheres
+    const GLushort pointIndex = 0;
+    g_pCommon->indirectVAO     = GLVertexArray::Create();
+    g_pCommon->indirectIndices = GLBuffer::Create();
+    glBindVertexArray(g_pCommon->indirectVAO.Get());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_pCommon->indirectIndices.Get());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(pointIndex), &pointIndex, GL_STATIC_DRAW);
+    g_pCommon->gpuCuller.EnableInstanceAttribute(1);
+    glBindVertexArray(0);
+
+    g_pCommon->sphereTexture = GLTexture::Create();
+    glBindTexture(GL_TEXTURE_BUFFER, g_pCommon->sphereTexture.Get());
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, g_pCommon->gpuCuller.GetSphereBuffer());
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    GL_CHECK_ERRORS
+  }
   // setup point vertex array and verex buffer objects
   glGenVertexArrays(1, &g_pCommon->pointVAOID);
   glGenBuffers(1, &g_pCommon->pointVBOID);
@@ -425,7 +517,34 @@ void OnInit() {
 
 // delete all allocated objects
 void OnShutdown() {
-  glDeleteQueries(1, &g_pCommon->query);
+  g_pCommon->culler.PrintStats(std::cout);
+  g_pCommon->viewCuller.PrintStats(std::cout);
+  g_pCommon->pointTree.PrintStats(std::cout);
+  g_pCommon->occlusion.PrintStats(std::cout);
+  if (CGpuCuller::IsSupported()) {
+    g_pCommon->gpuCuller.PrintStats(std::cout);
+    g_pCommon->gpuCuller.Destroy();
+    g_pCommon->indirectPointShader.DeleteShaderProgram();
+    g_pCommon->sphereTexture.Reset();
+    g_pCommon->indirectVAO.Reset();
+    g_pCommon->indirectIndices.Reset();
+  }
+  for (const auto *camera : {&g_pCommon->cam, &g_pCommon->world}) {
+    const auto &stats = camera->GetCullStats();
+    if (stats.objects > 0) {
+      std::cout << "Camera culling: " << stats.objects << " points, "
+                << static_cast<double>(stats.planeTests) / static_cast<double>(stats.objects)
+                << " plane tests per point" << std::endl;
+    }
+    if (stats.nodes > 0) {
+      std::cout << "Tree culling: " << stats.nodes << " nodes, "
+                << static_cast<double>(stats.nodePlaneTests) / static_cast<double>(stats.nodes)
+                << " plane tests per node" << std::endl;
+    }
+  }
+
+  g_pCommon->queries.PrintStats(std::cout);
+  g_pCommon->queries.Destroy();
 
   // Destroy shader
   g_pCommon->shader.DeleteShaderProgram();
@@ -512,31 +631,118 @@ void OnRender() {
   glm::vec4 p[6];
   g_pCommon->pCurrentCam->GetFrustumPlanes(p);
 
-  // begin hardware query
-  glBeginQuery(GL_PRIMITIVES_GENERATED, g_pCommon->query);
+  // cull the same displaced points on the CPU
+  for (int i = 0; i < Common::MAX_POINTS; ++i) {
+    g_pCommon->pointY[i] = sinf(g_pCommon->pointVertices[i].x * 2 * static_cast<float>(M_PI) +
+                                g_pCommon->current_time);
+  }
+  g_pCommon->culler.SetPlanes(p);
+  g_pCommon->culler.CullSpheres({g_pCommon->pointX, g_pCommon->pointY, g_pCommon->pointZ,
+                                 g_pCommon->pointRadius, Common::MAX_POINTS},
+                                g_pCommon->visiblePoints);
+  const auto cpuVisible = CFrustumCuller::CountVisible(g_pCommon->visiblePoints);
+
+  // visible counts of both cameras from one walk over the points
+  g_pCommon->viewCuller.ClearViews();
+  g_pCommon->viewCuller.AddView(g_pCommon->cam);
+  g_pCommon->viewCuller.AddView(g_pCommon->world);
+  g_pCommon->viewCuller.CullSpheres({g_pCommon->pointX, g_pCommon->pointY, g_pCommon->pointZ,
+                                     g_pCommon->pointRadius, Common::MAX_POINTS},
+                                    g_pCommon->pointViews);
+  std::size_t viewVisible[2] = {0, 0};
+  for (const auto mask : g_pCommon->pointViews) {
+    viewVisible[0] += mask & 1U;
+    viewVisible[1] += (mask >> 1) & 1U;
+  }
 
-  // bind point shader
-  g_pCommon->pointShader.Use();
-  // set shader uniforms
-  glUniform1f(g_pCommon->pointShader("t"), g_pCommon->current_time);
-  glUniformMatrix4fv(g_pCommon->pointShader("MVP"), 1, GL_FALSE, glm::value_ptr(MVP));
-  glUniform4fv(g_pCommon->pointShader("FrustumPlanes"), 6, glm::value_ptr(p[0]));
+  // plane tests per point through the camera
+  CAbstractCamera::CullStats frameStats = g_pCommon->pCurrentCam->GetCullStats();
+  for (int i = 0; i < Common::MAX_POINTS; ++i) {
+    const glm::vec3 point(g_pCommon->pointX[i], g_pCommon->pointY[i], g_pCommon->pointZ[i]);
+    if (g_pCommon->useCoherence) {
+      g_pCommon->pCurrentCam->ClassifySphere(point, 0, g_pCommon->pointPlanes[i]);
+    } else {
+      g_pCommon->pCurrentCam->ClassifySphere(point, 0);
+    }
+  }
+  const auto planeTests =
+      g_pCommon->pCurrentCam->GetCullStats().planeTests - frameStats.planeTests;
+  const auto testsPerPoint = static_cast<double>(planeTests) / Common::MAX_POINTS;
+
+  // hierarchical cull of the moving points
+  for (int i = 0; i < Common::MAX_POINTS; ++i) {
+    const glm::vec3 point(g_pCommon->pointX[i], g_pCommon->pointY[i], g_pCommon->pointZ[i]);
+    g_pCommon->pointTree.Update(g_pCommon->pointProxies[i], point, point);
+  }
+  if (g_pCommon->useOcclusion) {
+    g_pCommon->occlusion.Begin(MVP);
+    g_pCommon->occlusion.AddOccluder(g_pCommon->vertices, g_pCommon->indices,
+                                     Common::TOTAL_INDICES);
+    g_pCommon->occlusion.Rasterize();
+  }
+  g_pCommon->pCurrentCam->SetOcclusionCuller(g_pCommon->useOcclusion ? &g_pCommon->occlusion
+                                                                     : nullptr);
+  const auto nodesBefore = g_pCommon->pointTree.GetStats().nodesVisited;
+  g_pCommon->pointTree.Cull(*g_pCommon->pCurrentCam, g_pCommon->treeVisible);
+  const auto nodesVisited = g_pCommon->pointTree.GetStats().nodesVisited - nodesBefore;
+
+  // cull the points on the GPU, outside the query so the culling stage
+  // itself is not counted
+  if (g_pCommon->useGpuCulling) {
+    for (int i = 0; i < Common::MAX_POINTS; ++i) {
+      g_pCommon->pointSpheres[i] =
+          glm::vec4(g_pCommon->pointX[i], g_pCommon->pointY[i], g_pCommon->pointZ[i], 0);
+    }
+    g_pCommon->gpuCuller.SetSpheres(g_pCommon->pointSpheres, Common::MAX_POINTS);
+    g_pCommon->gpuCuller.Cull(p);
+  }
 
-  // bind the point vertex array object
-  glBindVertexArray(g_pCommon->pointVAOID);
-  // draw points
-  glDrawArrays(GL_POINTS, 0, Common::MAX_POINTS);
+  // pick up the visible counts of earlier frames and begin hardware query
+  g_pCommon->queries.Poll();
+  const bool queried = g_pCommon->queries.Begin(
+      [](const GLuint64 visible) { g_pCommon->total_visible = visible; });
+
+  if (g_pCommon->useGpuCulling) {
+    // draw the visible points with the command the culling stage wrote
+    g_pCommon->indirectPointShader.Use();
+    glUniformMatrix4fv(g_pCommon->indirectPointShader("MVP"), 1, GL_FALSE, glm::value_ptr(MVP));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, g_pCommon->sphereTexture.Get());
+    glBindVertexArray(g_pCommon->indirectVAO.Get());
+    g_pCommon->gpuCuller.Draw(GL_POINTS, GL_UNSIGNED_SHORT);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    g_pCommon->indirectPointShader.UnUse();
+  } else {
+    // bind point shader
+    g_pCommon->pointShader.Use();
+    // set shader uniforms
+    glUniform1f(g_pCommon->pointShader("t"), g_pCommon->current_time);
+    glUniformMatrix4fv(g_pCommon->pointShader("MVP"), 1, GL_FALSE, glm::value_ptr(MVP));
+    glUniform4fv(g_pCommon->pointShader("FrustumPlanes"), 6, glm::value_ptr(p[0]));
 
-  // unbind point shader
-  g_pCommon->pointShader.UnUse();
+    // bind the point vertex array object
+    glBindVertexArray(g_pCommon->pointVAOID);
+    // draw points
+    glDrawArrays(GL_POINTS, 0, Common::MAX_POINTS);
 
-  // end hardware query
-  glEndQuery(GL_PRIMITIVES_GENERATED);
+    // unbind point shader
+    g_pCommon->pointShader.UnUse();
+  }
 
-  // check the query result to get the total number of visible points
-  GLuint res;
-  glGetQueryObjectuiv(g_pCommon->query, GL_QUERY_RESULT, &res);
-  sprintf(g_pCommon->buffer, "FPS: %3.3f :: Total visible points: %3d", static_cast<double>(g_pCommon->fps), res);
+  // end hardware query, its result is read in a later frame
+  if (queried) {
+    g_pCommon->queries.End();
+  }
+  sprintf(g_pCommon->buffer,
+          "FPS: %3.3f :: Total visible points: %3llu (CPU %s: %3zu, cam %zu / world %zu) :: "
+          "%1.2f plane tests/point%s :: BVH %3zu visible, %zu nodes%s",
+          static_cast<double>(g_pCommon->fps),
+          static_cast<unsigned long long>(g_pCommon->total_visible),
+          CFrustumCuller::PathName(g_pCommon->culler.GetPath()), cpuVisible,
+          viewVisible[0], viewVisible[1],
+          testsPerPoint, g_pCommon->useCoherence ? " (coherent)" : "",
+          g_pCommon->treeVisible.size(), nodesVisited,
+          g_pCommon->useOcclusion ? " (occlusion)" : "");
   glutSetWindowTitle(g_pCommon->buffer);
 
   // set the normal shader
@@ -610,10 +816,93 @@ void OnKey(unsigned char key, int /*x*/, int /*y*/) {
   case 'z':
     g_pCommon->cam.Lift(-g_pCommon->dt);
     break;
+  case 'c':
+    g_pCommon->useCoherence = !g_pCommon->useCoherence;
+    break;
+  case 'o':
+    g_pCommon->useOcclusion = !g_pCommon->useOcclusion;
+    break;
+  case 'g':
+    g_pCommon->useGpuCulling = !g_pCommon->useGpuCulling && CGpuCuller::IsSupported();
+    break;
+  case 'b':
+    // 1M random objects against the local camera
+    CFrustumCuller::Benchmark(g_pCommon->cam, 1000000, 10, std::cout);
+    break;
+  case 'h':
+    // 10k to 10M objects, the largest sizes take a while
+    CAabbTree::Benchmark(g_pCommon->cam, 10000000, 10, std::cout);
+    break;
   }
   glutPostRedisplay();
 }
 
+// compare the GPU culling stage with CFrustumCuller and return the exit
+// code, runs headless e.g. under Mesa llvmpipe:
+//   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./ViewFrustumCulling --verify
+int VerifyGpuCulling() {
+  if (!CGpuCuller::IsSupported()) {
+    std::cerr << "GPU culling needs OpenGL 4.0 or ARB_draw_indirect" << std::endl;
+    return 1;
+  }
+
+  // random spheres around the camera
+  std::mt19937 random(3);
+  std::uniform_real_distribution<float> offset(-10, 10);
+  std::uniform_real_distribution<float> size(0, 0.5f);
+  std::vector<glm::vec4> spheres(Common::MAX_POINTS);
+  std::vector<float> x(spheres.size()), y(spheres.size()), z(spheres.size()), r(spheres.size());
+  for (std::size_t i = 0; i < spheres.size(); ++i) {
+    spheres[i] = glm::vec4(offset(random), offset(random), offset(random), size(random));
+    x[i] = spheres[i].x;
+    y[i] = spheres[i].y;
+    z[i] = spheres[i].z;
+    r[i] = spheres[i].w;
+  }
+  const CFrustumCuller::Spheres cpuSpheres{x.data(), y.data(), z.data(), r.data(), spheres.size()};
+
+  bool passed = true;
+  for (const bool forceTransformFeedback : {false, true}) {
+    CGpuCuller culler;
+    culler.Init(Common::MAX_POINTS, forceTransformFeedback);
+    culler.SetSpheres(spheres.data(), Common::MAX_POINTS);
+    std::size_t errors = 0, borderline = 0, visible = 0;
+    for (int view = 0; view < 8; ++view) {
+      g_pCommon->cam.Rotate(view * 45.0f, 20.0f * static_cast<float>(view % 3) - 20.0f, 0);
+      g_pCommon->cam.CalcFrustumPlanes();
+      glm::vec4 p[6];
+      g_pCommon->cam.GetFrustumPlanes(p);
+
+      std::vector<GLuint> gpuVisible, cpuVisible, mismatches;
+      culler.Cull(p);
+      culler.ReadVisible(gpuVisible);
+      g_pCommon->culler.SetPlanes(p);
+      g_pCommon->culler.CullSpheresToIndices(cpuSpheres, cpuVisible);
+      std::set_symmetric_difference(gpuVisible.begin(), gpuVisible.end(), cpuVisible.begin(),
+                                    cpuVisible.end(), std::back_inserter(mismatches));
+      visible += cpuVisible.size();
+
+      // spheres touching a plane may round either way
+      for (const auto i : mismatches) {
+        float closest = std::numeric_limits<float>::max();
+        for (const auto &plane : p) {
+          const float d = glm::dot(glm::vec3(plane), glm::vec3(spheres[i])) + plane.w;
+          closest = std::min(closest, std::abs(d + spheres[i].w));
+        }
+        ++(closest < 1e-4f ? borderline : errors);
+      }
+    }
+    std::cout << "GPU culling ("
+              << (culler.GetPath() == CGpuCuller::Path::COMPUTE ? "compute shader"
+                                                                : "transform feedback")
+              << "): 8 views, " << visible << " visible, " << errors << " mismatches, "
+              << borderline << " on a plane" << std::endl;
+    passed = passed && errors == 0;
+    culler.Destroy();
+  }
+  return passed ? 0 : 1;
+}
+
 int main(int argc, char **argv) {
   Common common;
   g_pCommon = &common;
@@ -651,6 +940,12 @@ int main(int argc, char **argv) {
   // opengl initialization
   OnInit();
 
+  if (argc > 1 && std::strcmp(argv[1], "--verify") == 0) {
+    const int result = VerifyGpuCulling();
+    OnShutdown();
+    return result;
+  }
+
   // callback hooks
   glutCloseFunc(OnShutdown);
   glutDisplayFunc(OnRender);
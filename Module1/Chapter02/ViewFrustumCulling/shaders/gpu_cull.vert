@@ -0,0 +1,22 @@
+#version 330 core
+
+layout(location = 0) in vec4 vSphere;	//xyz centre and w radius
+
+//uniforms
+uniform vec4 FrustumPlanes[6];	//view frustum planes
+
+//outputs to the geometry shader
+flat out uint vInstance;
+flat out int vVisible;
+
+void main()
+{
+	//a sphere further behind any plane than its radius is outside
+	vVisible = 1;
+	for(int p=0; p < 6; p++)
+	{
+		if ((dot(FrustumPlanes[p].xyz, vSphere.xyz) + FrustumPlanes[p].w) < -vSphere.w)
+			vVisible = 0;
+	}
+	vInstance = uint(gl_VertexID);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+
+layout(location = 1) in uint vInstance;	//index of a visible point
+
+//uniforms
+uniform mat4 MVP;				//combined modelview projection matrix
+uniform samplerBuffer spheres;	//culled points, xyz position
+
+void main()
+{
+	//the culling stage already placed the point in world space
+	vec4 sphere = texelFetch(spheres, int(vInstance));
+	gl_Position = MVP*vec4(sphere.xyz,1);
+}
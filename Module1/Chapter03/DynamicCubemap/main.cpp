@@ -10,7 +10,9 @@
 
 #include "Grid.hpp"
 #include "UnitCube.hpp"
+#include "GeometryPool.hpp"
 #include "GLSLShader.hpp"
+#include "MultiViewCuller.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR);
 
@@ -72,6 +74,16 @@ struct Common {
 
   float dx = -0.1f; // direction
 
+  // bounding spheres of the cubes, culled against the six cube map faces
+  // and the camera in one pass; bit CAMERA_VIEW is the camera
+  static constexpr int NUM_CUBES = 8;
+  static constexpr int CAMERA_VIEW = 6;
+  float cubeX[NUM_CUBES], cubeY[NUM_CUBES], cubeZ[NUM_CUBES];
+  float cubeRadius[NUM_CUBES];
+  CMultiViewCuller viewCuller;
+  std::vector<CMultiViewCuller::ViewMask> cubeViews;
+  std::size_t cubesDrawn = 0, cubesCulled = 0;
+
   // constant colours array
   const glm::vec3 colors[8] = {
     glm::vec3(1, 0, 0), glm::vec3(0, 1, 0),
@@ -284,6 +296,10 @@ void OnShutdown() {
 
   glDeleteFramebuffers(1,  &g_pCommon->mFboID);
   glDeleteRenderbuffers(1, &g_pCommon->mRboID);
+
+  g_pCommon->viewCuller.PrintStats(std::cout);
+  std::cout << "Cubes drawn: " << g_pCommon->cubesDrawn << ", culled: "
+            << g_pCommon->cubesCulled << std::endl;
   std::cout << "Shutdown successfull" << std::endl;
 }
 
@@ -306,15 +322,48 @@ void OnIdle() {
   glutPostRedisplay();
 }
 
-// scene rendering function
-void DrawScene(glm::mat4 MView, glm::mat4 Proj) {
+// cube transform without the auto rotation
+glm::mat4 GetCubeTransform(const int i) {
+  const float angle = static_cast<float>(i / 8.0 * 2.0 * M_PI);
+  return glm::translate(glm::mat4(1), glm::vec3(g_pCommon->m_fRadius * cosf(angle), 0.5,
+                                                g_pCommon->m_fRadius * sinf(angle)));
+}
+
+// cull the cubes against all views at once, views[i] is projection times
+// view matrix of view i
+void CullCubes(const glm::mat4 views[Common::CAMERA_VIEW + 1]) {
+  for (int i = 0; i < Common::NUM_CUBES; i++) {
+    const glm::vec4 center = g_pCommon->mRot * GetCubeTransform(i) * glm::vec4(0, 0, 0, 1);
+    g_pCommon->cubeX[i] = center.x;
+    g_pCommon->cubeY[i] = center.y;
+    g_pCommon->cubeZ[i] = center.z;
+    // half diagonal of the unit cube
+    g_pCommon->cubeRadius[i] = 0.8660254f;
+  }
+  g_pCommon->viewCuller.ClearViews();
+  for (int view = 0; view <= Common::CAMERA_VIEW; view++) {
+    g_pCommon->viewCuller.AddView(views[view]);
+  }
+  g_pCommon->viewCuller.CullSpheres({g_pCommon->cubeX, g_pCommon->cubeY, g_pCommon->cubeZ,
+                                     g_pCommon->cubeRadius, Common::NUM_CUBES},
+                                    g_pCommon->cubeViews);
+}
+
+// scene rendering function, draws the cubes the given view sees
+void DrawScene(glm::mat4 MView, glm::mat4 Proj, const int view) {
+  // the cubes and the grid are pooled, keep their page VAO bound between them
+  CGeometryPool::Instance().BeginBatch();
+
   // for each cube
-  for (int i = 0; i < 8; i++) {
+  for (int i = 0; i < Common::NUM_CUBES; i++) {
+    if (((g_pCommon->cubeViews[static_cast<std::size_t>(i)] >> view) & 1U) == 0) {
+      ++g_pCommon->cubesCulled;
+      continue;
+    }
+    ++g_pCommon->cubesDrawn;
+
     // determine the cube's transform
-    float angle = static_cast<float>(i / 8.0 * 2.0 * M_PI);
-    glm::mat4 T = glm::translate(
-        glm::mat4(1), glm::vec3(g_pCommon->m_fRadius * cosf(angle),
-          0.5, g_pCommon->m_fRadius * sinf(angle)));
+    glm::mat4 T = GetCubeTransform(i);
 
     // get the combined modelview projection matrix
     glm::mat4 MVP = Proj * MView * g_pCommon->mRot * T;
@@ -328,6 +377,7 @@ void DrawScene(glm::mat4 MView, glm::mat4 Proj) {
 
   // render the grid object
   g_pCommon->m_pGrid->Render(glm::value_ptr(Proj * MView));
+  CGeometryPool::Instance().EndBatch();
 }
 
 // display callback function
@@ -362,6 +412,29 @@ void OnRender() {
   // amount so that the projection is clearly visible
   T = glm::translate(glm::mat4(1), -p);
 
+  // the six face views, set the virtual viewrer at the reflective object
+  // center with the cube map projection matrix
+  const glm::mat4 MV1 =
+      glm::lookAt(glm::vec3(0), glm::vec3(1, 0, 0), glm::vec3(0, -1, 0));
+  const glm::mat4 MV2 =
+      glm::lookAt(glm::vec3(0), glm::vec3(-1, 0, 0), glm::vec3(0, -1, 0));
+  const glm::mat4 MV3 =
+      glm::lookAt(glm::vec3(0), glm::vec3(0, 1, 0), glm::vec3(1, 0, 0));
+  const glm::mat4 MV4 =
+      glm::lookAt(glm::vec3(0), glm::vec3(0, -1, 0), glm::vec3(1, 0, 0));
+  const glm::mat4 MV5 =
+      glm::lookAt(glm::vec3(0), glm::vec3(0, 0, 1), glm::vec3(0, -1, 0));
+  const glm::mat4 MV6 =
+      glm::lookAt(glm::vec3(0), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0));
+
+  // one culling pass for the seven views of the frame
+  const glm::mat4 views[Common::CAMERA_VIEW + 1] = {
+      g_pCommon->mPcubemap * MV1 * T, g_pCommon->mPcubemap * MV2 * T,
+      g_pCommon->mPcubemap * MV3 * T, g_pCommon->mPcubemap * MV4 * T,
+      g_pCommon->mPcubemap * MV5 * T, g_pCommon->mPcubemap * MV6 * T,
+      g_pCommon->mP * MV};
+  CullCubes(views);
+
   // set the viewport to the size of the cube map texture
   glViewport(0, 0, Common::CUBEMAP_SIZE, Common::CUBEMAP_SIZE);
 
@@ -373,66 +446,48 @@ void OnRender() {
                          GL_TEXTURE_CUBE_MAP_POSITIVE_X, g_pCommon->mDynamicCubeMapID, 0);
   // clear the colour and depth buffers
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  // set the virtual viewrer at the reflective object center and render the
-  // scene using the cube map projection matrix and appropriate viewing settings
-  glm::mat4 MV1 =
-      glm::lookAt(glm::vec3(0), glm::vec3(1, 0, 0), glm::vec3(0, -1, 0));
-  DrawScene(MV1 * T, g_pCommon->mPcubemap);
+  // render the scene using the cube map projection matrix and face view
+  DrawScene(MV1 * T, g_pCommon->mPcubemap, 0);
 
   // set the GL_TEXTURE_CUBE_MAP_NEGATIVE_X to the colour attachment of FBO
   glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
                          GL_TEXTURE_CUBE_MAP_NEGATIVE_X, g_pCommon->mDynamicCubeMapID, 0);
   // clear the colour and depth buffers
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  // set the virtual viewrer at the reflective object center and render the
-  // scene using the cube map projection matrix and appropriate viewing settings
-  glm::mat4 MV2 =
-      glm::lookAt(glm::vec3(0), glm::vec3(-1, 0, 0), glm::vec3(0, -1, 0));
-  DrawScene(MV2 * T, g_pCommon->mPcubemap);
+  // render the scene using the cube map projection matrix and face view
+  DrawScene(MV2 * T, g_pCommon->mPcubemap, 1);
 
   // set the GL_TEXTURE_CUBE_MAP_POSITIVE_Y to the colour attachment of FBO
   glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
                          GL_TEXTURE_CUBE_MAP_POSITIVE_Y, g_pCommon->mDynamicCubeMapID, 0);
   // clear the colour and depth buffers
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  // set the virtual viewrer at the reflective object center and render the
-  // scene using the cube map projection matrix and appropriate viewing settings
-  glm::mat4 MV3 =
-      glm::lookAt(glm::vec3(0), glm::vec3(0, 1, 0), glm::vec3(1, 0, 0));
-  DrawScene(MV3 * T, g_pCommon->mPcubemap);
+  // render the scene using the cube map projection matrix and face view
+  DrawScene(MV3 * T, g_pCommon->mPcubemap, 2);
 
   // set the GL_TEXTURE_CUBE_MAP_NEGATIVE_Y to the colour attachment of FBO
   glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
                          GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, g_pCommon->mDynamicCubeMapID, 0);
   // clear the colour and depth buffers
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  // set the virtual viewrer at the reflective object center and render the
-  // scene using the cube map projection matrix and appropriate viewing settings
-  glm::mat4 MV4 =
-      glm::lookAt(glm::vec3(0), glm::vec3(0, -1, 0), glm::vec3(1, 0, 0));
-  DrawScene(MV4 * T, g_pCommon->mPcubemap);
+  // render the scene using the cube map projection matrix and face view
+  DrawScene(MV4 * T, g_pCommon->mPcubemap, 3);
 
   // set the GL_TEXTURE_CUBE_MAP_POSITIVE_Z to the colour attachment of FBO
   glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
                          GL_TEXTURE_CUBE_MAP_POSITIVE_Z, g_pCommon->mDynamicCubeMapID, 0);
   // clear the colour and depth buffers
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  // set the virtual viewrer at the reflective object center and render the
-  // scene using the cube map projection matrix and appropriate viewing settings
-  glm::mat4 MV5 =
-      glm::lookAt(glm::vec3(0), glm::vec3(0, 0, 1), glm::vec3(0, -1, 0));
-  DrawScene(MV5 * T, g_pCommon->mPcubemap);
+  // render the scene using the cube map projection matrix and face view
+  DrawScene(MV5 * T, g_pCommon->mPcubemap, 4);
 
   // set the GL_TEXTURE_CUBE_MAP_NEGATIVE_Z to the colour attachment of FBO
   glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
                          GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, g_pCommon->mDynamicCubeMapID, 0);
   // clear the colour and depth buffers
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  // set the virtual viewrer at the reflective object center and render the
-  // scene using the cube map projection matrix and appropriate viewing settings
-  glm::mat4 MV6 =
-      glm::lookAt(glm::vec3(0), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0));
-  DrawScene(MV6 * T, g_pCommon->mPcubemap);
+  // render the scene using the cube map projection matrix and face view
+  DrawScene(MV6 * T, g_pCommon->mPcubemap, 5);
 
   // unbind the FBO
   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
@@ -441,7 +496,7 @@ void OnRender() {
   glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
 
   // render scene from the camera point of view and projection matrix
-  DrawScene(MV, g_pCommon->mP);
+  DrawScene(MV, g_pCommon->mP, Common::CAMERA_VIEW);
 
   // bind the sphere vertex array object
   glBindVertexArray(g_pCommon->mSphereVAOID);
@@ -5,8 +5,11 @@ layout(location=0) in vec3 vVertex; //object space position
 //uniform
 uniform mat4 MVP;	//combined modelview projection
 
+#include "instanced_vertex.glsl"
+
 void main()
 { 
 	//multiply the combined MVP matrix with the object space position to get the clip space position 
-	gl_Position = MVP*vec4(vVertex.xyz,1);
+	gl_Position = MVP*InstancePosition(vec4(DecodePosition(vVertex),1));
+	PassInstanceColor();
 }
\ No newline at end of file
@@ -3,7 +3,10 @@
 layout(location = 0) out vec4 vFragColor;	//fragment shader output
 
 //uniform
+#include "instanced_fragment.glsl"
+#ifndef INSTANCED
 uniform vec3 vColor;	//constant colour
+#endif
 
 void main()
 {
@@ -5,9 +5,12 @@ layout(location = 0) in vec3 vVertex;  //object space vertex
 //uniform
 uniform mat4 MVP;  //combined modelview projection matrix
 
+#include "instanced_vertex.glsl"
+
 void main()
 { 	 
 	//get clipspace position by multiplying the object space vertex position with the combined modelview
 	//projection matrix
-	gl_Position = MVP*vec4(vVertex.xyz,1); 
+	gl_Position = MVP*InstancePosition(vec4(DecodePosition(vVertex),1));
+	PassInstanceColor();
 }
\ No newline at end of file
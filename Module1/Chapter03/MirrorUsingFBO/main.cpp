@@ -8,6 +8,7 @@
 
 #include "Grid.hpp"
 #include "Quad.hpp"
+#include "GeometryPool.hpp"
 #include "GLSLShader.hpp"
 #include "UnitColorCube.hpp"
 
@@ -186,7 +187,9 @@ void OnRender() {
   // clear the colour and depth buffers
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  // render scene normally
+  // render scene normally, the grid and the cube are pooled, keep their
+  // page VAO bound between them
+  CGeometryPool::Instance().BeginBatch();
   // render the grid
   g_pCommon->m_pGrid->Render(glm::value_ptr(MVP));
   g_pCommon->localR[3][1] = 0.5;
@@ -194,6 +197,7 @@ void OnRender() {
   // move the unit cube on Y axis to bring it to ground level
   // and render the cube
   g_pCommon->m_pCube->Render(glm::value_ptr(g_pCommon->P * MV * g_pCommon->localR));
+  CGeometryPool::Instance().EndBatch();
 
   // store the current modelview matrix
   glm::mat4 oldMV = MV;
@@ -218,8 +222,10 @@ void OnRender() {
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   // show the mirror from the front side only
   if (glm::dot(V, g_pCommon->m_pMirror->normal) < 0) {
+    CGeometryPool::Instance().BeginBatch();
     g_pCommon->m_pGrid->Render(glm::value_ptr(g_pCommon->P * MV));
     g_pCommon->m_pCube->Render(glm::value_ptr(g_pCommon->P * MV * g_pCommon->localR));
+    CGeometryPool::Instance().EndBatch();
   }
 
   // unbind the FBO
@@ -8,11 +8,14 @@ smooth out vec3 vColor;					//output colour to fragment shader
 //uniform 
 uniform mat4 MVP;  //combined modelview projection matrix
 
+#include "instanced_vertex.glsl"
+
 void main()
 { 	 
 	//get the clipspace position
-	gl_Position = MVP*vec4(vVertex.xyz,1);
+	gl_Position = MVP*InstancePosition(vec4(DecodePosition(vVertex),1));
+	PassInstanceColor();
 
 	//get the colour from the object space vertex position by offsetting the vertex position
-    vColor = vVertex+0.5;
+    vColor = DecodePosition(vVertex)+0.5;
 }
\ No newline at end of file
@@ -13,6 +13,8 @@
 
 #include "GLSLShader.hpp"
 #include "Grid.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformBuffer.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
 
@@ -32,6 +34,12 @@ struct Common {
   GLSLShader *pFlatShader; // we will reuse the grid shader for crosshair at
                            // light position
 
+  // per-frame camera and light data, and one per-draw slot per object
+  CUniformBuffer perFrameUBO;
+  CUniformBuffer perDrawUBO;
+  static constexpr int CUBE = 0;
+  static constexpr int SPHERE = 1;
+
   // sphere vertex array and vertex buffer object IDs
   GLuint sphereVAOID;
   GLuint sphereVerticesVBO;
@@ -57,7 +65,7 @@ struct Common {
   // Grid object
   CGrid *grid = nullptr;
 
-  glm::vec3 lightDirectionOS = glm::vec3(0, 0, 0); // objectspace light position
+  glm::vec3 lightDirectionWS = glm::vec3(0, 0, 0); // world space light direction
 
   // vertices and indices for sphere/cube
   std::vector<Vertex> vertices;
@@ -214,16 +222,16 @@ void OnMouseMove(int x, int y) {
     g_pCommon->phi += (y - g_pCommon->oldY) / 60.0f;
 
     // calculate light direction vector
-    g_pCommon->lightDirectionOS.x =
+    g_pCommon->lightDirectionWS.x =
         std::cos(g_pCommon->theta) * std::sin(g_pCommon->phi);
-    g_pCommon->lightDirectionOS.y = std::cos(g_pCommon->phi);
-    g_pCommon->lightDirectionOS.z =
+    g_pCommon->lightDirectionWS.y = std::cos(g_pCommon->phi);
+    g_pCommon->lightDirectionWS.z =
         std::sin(g_pCommon->theta) * std::sin(g_pCommon->phi);
 
     // update the light gizmo buffer object
     glBindBuffer(GL_ARRAY_BUFFER, g_pCommon->lightVerticesVBO);
     glBufferSubData(GL_ARRAY_BUFFER, sizeof(glm::vec3), sizeof(glm::vec3),
-                    &g_pCommon->lightDirectionOS.x);
+                    &g_pCommon->lightDirectionWS.x);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
   } else {
     g_pCommon->rY += (x - g_pCommon->oldX) / 5.0f;
@@ -249,15 +257,26 @@ void OnInit() {
   // add attributes and uniforms
   g_pCommon->shader.AddAttribute("vVertex");
   g_pCommon->shader.AddAttribute("vNormal");
-  g_pCommon->shader.AddUniform("MV");
-  g_pCommon->shader.AddUniform("MVP");
-  g_pCommon->shader.AddUniform("N");
-  g_pCommon->shader.AddUniform("light_direction");
-  g_pCommon->shader.AddUniform("diffuse_color");
+  // all uniforms live in the shared blocks
+  g_pCommon->shader.BindUniformBlock("PerFrame", UniformBinding::PER_FRAME);
+  g_pCommon->shader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
   g_pCommon->shader.UnUse();
 
   GL_CHECK_ERRORS;
 
+  // setup uniform buffers, the objects never move so the per-draw data is
+  // uploaded once here
+  g_pCommon->perFrameUBO.Init(sizeof(PerFrameBlock));
+  g_pCommon->perDrawUBO.Init(sizeof(PerDrawBlock), 2);
+  g_pCommon->perDrawUBO.Update(
+      PerDrawBlock{glm::translate(glm::mat4(1), glm::vec3(-1, 1, 0)),
+                   glm::vec4(1, 0, 0, 1)},
+      Common::CUBE);
+  g_pCommon->perDrawUBO.Update(
+      PerDrawBlock{glm::translate(glm::mat4(1), glm::vec3(1, 1, 0)),
+                   glm::vec4(0, 0, 1, 1)},
+      Common::SPHERE);
+
   // setup sphere geometry
   CreateSphere(1.0f, 10, 10, g_pCommon->vertices, g_pCommon->indices);
 
@@ -333,16 +352,16 @@ void OnInit() {
   GL_CHECK_ERRORS;
 
   // calculate the light direction vector using spherical coordinates
-  g_pCommon->lightDirectionOS.x =
+  g_pCommon->lightDirectionWS.x =
       std::cos(g_pCommon->theta) * std::sin(g_pCommon->phi);
-  g_pCommon->lightDirectionOS.y = std::cos(g_pCommon->phi);
-  g_pCommon->lightDirectionOS.z =
+  g_pCommon->lightDirectionWS.y = std::cos(g_pCommon->phi);
+  g_pCommon->lightDirectionWS.z =
       std::sin(g_pCommon->theta) * std::sin(g_pCommon->phi);
 
   // setup vao and vbo stuff for the light position crosshair
   glm::vec3 crossHairVertices[2];
   crossHairVertices[0] = glm::vec3(0, 0, 0);
-  crossHairVertices[1] = g_pCommon->lightDirectionOS;
+  crossHairVertices[1] = g_pCommon->lightDirectionWS;
 
   // setup vertex array object and buffer object for storing the light direction
   // as a line segment from origin
@@ -380,8 +399,10 @@ void OnInit() {
 void OnShutdown() {
   g_pCommon->pFlatShader = nullptr;
 
-  // Destroy shader
+  // Destroy shader and uniform buffers
   g_pCommon->shader.DeleteShaderProgram();
+  g_pCommon->perFrameUBO.Destroy();
+  g_pCommon->perDrawUBO.Destroy();
   // Destroy vao and vbo
   glDeleteBuffers(1, &g_pCommon->sphereVerticesVBO);
   glDeleteBuffers(1, &g_pCommon->sphereIndicesVBO);
@@ -417,56 +438,28 @@ void OnIdle() { glutPostRedisplay(); }
 void DrawScene(glm::mat4 MView, glm::mat4 Proj) {
   GL_CHECK_ERRORS;
 
+  // upload the camera and the light direction, w = 0 makes the view
+  // transform ignore the translation
+  g_pCommon->perFrameUBO.Update(
+      PerFrameBlock{MView, Proj, glm::mat4(1),
+                    glm::vec4(g_pCommon->lightDirectionWS, 0)});
+  g_pCommon->perFrameUBO.Bind(UniformBinding::PER_FRAME);
+
   // bind the current shader
   g_pCommon->shader.Use();
 
-  // bind the cube vertex array object
+  // bind the cube vertex array object and the cube's per-draw data
   glBindVertexArray(g_pCommon->cubeVAOID);
-  {
-    // set the cube's transform
-    const auto T    = glm::translate(glm::mat4(1), glm::vec3(-1, 1, 0));
-    const auto cM   = T;            // model matrix
-    const auto cMV  = MView * cM;   // modelview matrix
-    const auto cMVP = Proj * cMV;   // combined modelview projection matrix
-
-    // pass shader uniforms
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE,
-                       glm::value_ptr(cMVP));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE,
-                       glm::value_ptr(cMV));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
-                       glm::value_ptr(glm::inverseTranspose(glm::mat3(cMV))));
-
-    glUniform3f(g_pCommon->shader("diffuse_color"), 1.0f, 0.0f, 0.0f);
-    glUniform3fv(g_pCommon->shader("light_direction"), 1,
-                 &(g_pCommon->lightDirectionOS.x));
-
-    // draw triangles
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, nullptr);
-  }
+  g_pCommon->perDrawUBO.Bind(UniformBinding::PER_DRAW, Common::CUBE);
+  // draw triangles
+  glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, nullptr);
 
-  // bind the sphere vertex array object
+  // bind the sphere vertex array object and the sphere's per-draw data
   glBindVertexArray(g_pCommon->sphereVAOID);
-  {
-    // set the sphere's transform
-    const auto T = glm::translate(glm::mat4(1), glm::vec3(1, 1, 0));
-    const auto cM = T;
-    const auto cMV = MView * cM;
-    const auto cMVP = Proj * cMV;
-
-    // Pass shader uniforms
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE,
-                       glm::value_ptr(cMVP));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE,
-                       glm::value_ptr(cMV));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
-                       glm::value_ptr(glm::inverseTranspose(glm::mat3(cMV))));
-    glUniform3f(g_pCommon->shader("diffuse_color"), 0.0f, 0.0f, 1.0f);
-
-    // Draw triangles
-    glDrawElements(GL_TRIANGLES, g_pCommon->totalSphereTriangles,
-                   GL_UNSIGNED_SHORT, nullptr);
-  }
+  g_pCommon->perDrawUBO.Bind(UniformBinding::PER_DRAW, Common::SPHERE);
+  // Draw triangles
+  glDrawElements(GL_TRIANGLES, g_pCommon->totalSphereTriangles,
+                 GL_UNSIGNED_SHORT, nullptr);
 
   // unbind shader
   g_pCommon->shader.UnUse();
@@ -479,8 +472,12 @@ void DrawScene(glm::mat4 MView, glm::mat4 Proj) {
     // set shader uniform
     glUniformMatrix4fv((*g_pCommon->pFlatShader)("MVP"), 1, GL_FALSE,
                        glm::value_ptr(Proj * MView));
+    // the line has float positions, the grid's are quantized
+    RenderableObject::SetPositionDecode(*g_pCommon->pFlatShader, glm::vec3(1),
+                                        glm::vec3(0));
     // draw line segment
     glDrawArrays(GL_LINES, 0, 2);
+    g_pCommon->grid->SetPositionDecode(*g_pCommon->pFlatShader);
     // unbind flat shader
     g_pCommon->pFlatShader->UnUse();
   }
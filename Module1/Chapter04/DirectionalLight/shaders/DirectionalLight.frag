@@ -2,21 +2,33 @@
 
 layout(location=0) out vec4 vFragColor;	//fragment shader output
  
-uniform mat4 MV;				//modelview matrix
-uniform vec3 light_direction;	//light direction is in object space
-uniform vec3 diffuse_color;		//diffuse colour for surface
+//per-frame uniforms, uploaded once per frame (PerFrameBlock in Common)
+layout(std140) uniform PerFrame {
+	mat4 V;					//view matrix
+	mat4 P;					//projection matrix
+	mat4 S;					//shadow matrix, unused here
+	vec4 light_position;	//light direction in world space, w = 0
+	int  bIsLightPass;		//unused here
+};
+
+//per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//diffuse colour for surface
+	vec4 specular_color;	//unused here
+};
 
 //input from the vertex shader
 smooth in vec3 vEyeSpaceNormal;	//interpolated eye space normal      
 
 void main() { 
-	//get light direction in eye space by multiplying with the modelview matrix
-	vec4 vEyeSpaceLightDirection = MV*vec4(light_direction,0);
+	//get light direction in eye space by multiplying with the view matrix
+	vec4 vEyeSpaceLightDirection = V*light_position;
 	//normalize the light direction to get the light vector
 	vec3 L = normalize(vEyeSpaceLightDirection.xyz); 
 	//calculate the diffuse component
 	float diffuse = max(0, dot(vEyeSpaceNormal, L));	 
 	//return the product of the diffuse component with the diffuse color as the 
 	//fragment output
-	vFragColor =  diffuse*vec4(diffuse_color,1);	 
+	vFragColor =  diffuse*vec4(diffuse_color.rgb,1);	 
 }
\ No newline at end of file
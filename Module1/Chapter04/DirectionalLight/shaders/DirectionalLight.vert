@@ -3,21 +3,36 @@
 layout(location=0) in vec3 vVertex;		//per-vertex position
 layout(location=1) in vec3 vNormal;  	//per-vertex normal
  
-//uniforms				
-uniform mat4 MVP;		//combined modelview projection matrix
-uniform mat3 N;			//normal matrix
+//per-frame uniforms, uploaded once per frame (PerFrameBlock in Common)
+layout(std140) uniform PerFrame {
+	mat4 V;					//view matrix
+	mat4 P;					//projection matrix
+	mat4 S;					//shadow matrix, unused here
+	vec4 light_position;	//light direction in world space, w = 0
+	int  bIsLightPass;		//unused here
+};
+
+//per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//diffuse colour for surface
+	vec4 specular_color;	//unused here
+};
 
 //shader outputs to the fragment shader	
 smooth out vec3 vEyeSpaceNormal;		//eye space normal
 
 void main()
 { 	 
+	//the scene only uses rigid transforms so the upper 3x3 of the
+	//modelview matrix doubles as the normal matrix
+	mat4 MV = V*M;
+
 	//multiply the object space normal with the normal matrix 
 	//to get the eye space normal
-	vEyeSpaceNormal   = N*vNormal; 
+	vEyeSpaceNormal   = mat3(MV)*vNormal; 
 
 	//multiply the combiend modelview projection matrix with the object space vertex
 	//position to get the clip space position
-    gl_Position = MVP*vec4(vVertex,1); 
+    gl_Position = P*MV*vec4(vVertex,1); 
 }
- 
\ No newline at end of file
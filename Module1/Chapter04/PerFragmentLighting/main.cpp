@@ -13,6 +13,8 @@
 
 #include "Grid.hpp"
 #include "GLSLShader.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformBuffer.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
 
@@ -31,6 +33,10 @@ struct Common {
   // per-vertex lighting shader
   GLSLShader shader;
 
+  // per-frame camera and light data, and one per-draw slot per object
+  CUniformBuffer perFrameUBO;
+  CUniformBuffer perDrawUBO;
+
   // sphere vertex array and vertex buffer object IDs
   GLuint sphereVAOID;
   GLuint sphereVerticesVBO;
@@ -56,11 +62,15 @@ struct Common {
   // Grid object
   CGrid *grid = nullptr;
 
-  glm::vec3 lightPosOS = glm::vec3(0, 2, 0); // objectspace light position
+  glm::vec3 lightPosWS = glm::vec3(0, 2, 0); // world space light position
 
   // for animation of the cubes
   float dx = -0.1f;
 
+  // per-draw slots, the 8 cubes followed by the sphere
+  static constexpr int CUBES = 8;
+  static constexpr int SPHERE = CUBES;
+
   // vertices and indices for sphere/cube
   std::vector<Vertex>   vertices;
   std::vector<GLushort> indices;
@@ -236,16 +246,22 @@ void OnInit() {
   // add attributes and uniforms
   g_pCommon->shader.AddAttribute("vVertex");
   g_pCommon->shader.AddAttribute("vNormal");
-  g_pCommon->shader.AddUniform("MVP");
-  g_pCommon->shader.AddUniform("MV");
-  g_pCommon->shader.AddUniform("N");
-  g_pCommon->shader.AddUniform("light_position");
-  g_pCommon->shader.AddUniform("diffuse_color");
-  g_pCommon->shader.AddUniform("specular_color");
-  g_pCommon->shader.AddUniform("shininess");
+  // all uniforms live in the shared blocks
+  g_pCommon->shader.BindUniformBlock("PerFrame", UniformBinding::PER_FRAME);
+  g_pCommon->shader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
   g_pCommon->shader.UnUse();
   GL_CHECK_ERRORS;
 
+  // setup uniform buffers, the sphere never moves so its per-draw data is
+  // uploaded once here
+  g_pCommon->perFrameUBO.Init(sizeof(PerFrameBlock));
+  g_pCommon->perDrawUBO.Init(sizeof(PerDrawBlock), Common::CUBES + 1);
+  g_pCommon->perDrawUBO.Update(
+      PerDrawBlock{glm::translate(glm::mat4(1), glm::vec3(0, 1, 0)),
+                   glm::vec4(0.9f, 0.9f, 1.0f, 1.0f),
+                   glm::vec4(1.0f, 1.0f, 1.0f, 300.0f)},
+      Common::SPHERE);
+
   // Cerate sphere geometry
   CreateSphere(1.0f, 10, 10, g_pCommon->vertices, g_pCommon->indices);
 
@@ -329,8 +345,10 @@ void OnInit() {
 
 // release all allocated resources
 void OnShutdown() {
-  // Destroy shader
+  // Destroy shader and uniform buffers
   g_pCommon->shader.DeleteShaderProgram();
+  g_pCommon->perFrameUBO.Destroy();
+  g_pCommon->perDrawUBO.Destroy();
   // Destroy vao and vbo
   glDeleteBuffers(1,      &g_pCommon->sphereVerticesVBO);
   glDeleteBuffers(1,      &g_pCommon->sphereIndicesVBO);
@@ -362,6 +380,24 @@ void OnIdle() { glutPostRedisplay(); }
 void DrawScene(glm::mat4 View, glm::mat4 Proj) {
   GL_CHECK_ERRORS;
 
+  // the camera and the cube positions change every frame, upload them
+  // once and only select buffer ranges per draw
+  g_pCommon->perFrameUBO.Update(
+      PerFrameBlock{View, Proj, glm::mat4(1),
+                    glm::vec4(g_pCommon->lightPosWS, 1)});
+  g_pCommon->perFrameUBO.Bind(UniformBinding::PER_FRAME);
+  for (int i = 0; i < Common::CUBES; i++) {
+    const float theta = i / 8.0f * 2.f * static_cast<float>(M_PI);
+    glm::mat4 T = glm::translate(
+        glm::mat4(1), glm::vec3(g_pCommon->radius * std::cos(theta),
+          0.5f,
+          g_pCommon->radius * std::sin(theta)));
+    g_pCommon->perDrawUBO.Update(
+        PerDrawBlock{T, glm::vec4(g_pCommon->colors[i], 1),
+                     glm::vec4(1.0f, 1.0f, 1.0f, 100.0f)},
+        i);
+  }
+
   // Bind the current shader
   g_pCommon->shader.Use();
 
@@ -369,26 +405,8 @@ void DrawScene(glm::mat4 View, glm::mat4 Proj) {
   glBindVertexArray(g_pCommon->cubeVAOID);
 
   // draw the 8 cubes first
-  for (int i = 0; i < 8; i++) {
-    // set the cube's transform
-    const float theta = i / 8.0f * 2.f * static_cast<float>(M_PI);
-    glm::mat4 T = glm::translate(
-        glm::mat4(1), glm::vec3(g_pCommon->radius * std::cos(theta),
-          0.5f,
-          g_pCommon->radius * std::sin(theta)));
-    glm::mat4 M   = T;         // Model matrix
-    glm::mat4 MV  = View * M;  // ModelView matrix
-    glm::mat4 MVP = Proj * MV; // combined ModelView  Projection matrix
-
-    // pass shader uniforms
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE, glm::value_ptr(MVP));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE, glm::value_ptr(MV));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
-        glm::value_ptr(glm::inverseTranspose(glm::mat3(MV))));
-    glUniform3fv(g_pCommon->shader("diffuse_color"), 1, &(g_pCommon->colors[i].x));
-    glUniform3f(g_pCommon->shader("specular_color"), 1.0f, 1.0f, 1.0f);
-    glUniform1f(g_pCommon->shader("shininess"), 100);
-    glUniform3fv(g_pCommon->shader("light_position"), 1, &(g_pCommon->lightPosOS.x));
+  for (int i = 0; i < Common::CUBES; i++) {
+    g_pCommon->perDrawUBO.Bind(UniformBinding::PER_DRAW, i);
     // draw triangles
     glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, nullptr);
     GL_CHECK_ERRORS;
@@ -396,20 +414,7 @@ void DrawScene(glm::mat4 View, glm::mat4 Proj) {
 
   // bind the sphere vertex array object
   glBindVertexArray(g_pCommon->sphereVAOID);
-  // set the sphere's transform
-  auto T   = glm::translate(glm::mat4(1), glm::vec3(0, 1, 0));
-  auto M   = T;
-  auto MV  = View * M;
-  auto MVP = Proj * MV;
-  // pass shader uniforms
-  glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE, glm::value_ptr(MVP));
-  glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE, glm::value_ptr(MV));
-  glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
-      glm::value_ptr(glm::inverseTranspose(glm::mat3(MV))));
-  glUniform3f(g_pCommon->shader("diffuse_color"), 0.9f, 0.9f, 1.0f);
-  glUniform3f(g_pCommon->shader("specular_color"), 1.0f, 1.0f, 1.0f);
-  glUniform1f(g_pCommon->shader("shininess"), 300);
-  glUniform3fv(g_pCommon->shader("light_position"), 1, &(g_pCommon->lightPosOS.x));
+  g_pCommon->perDrawUBO.Bind(UniformBinding::PER_DRAW, Common::SPHERE);
   // draw triangles
   glDrawElements(GL_TRIANGLES, g_pCommon->totalSphereTriangles, GL_UNSIGNED_SHORT, nullptr);
 
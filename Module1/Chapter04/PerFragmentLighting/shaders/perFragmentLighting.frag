@@ -2,12 +2,21 @@
 
 layout(location = 0) out vec4 vFragColor; // fragment shader output
 
-// uniforms
-uniform mat4 MV;             // modelview matrix
-uniform vec3 light_position; // light position in object space
-uniform vec3 diffuse_color;  // diffuse colour of surface
-uniform vec3 specular_color; // specular colour of surface
-uniform float shininess;     // specular shininess
+// per-frame uniforms, uploaded once per frame (PerFrameBlock in Common)
+layout(std140) uniform PerFrame {
+  mat4 V;              // view matrix
+  mat4 P;              // projection matrix
+  mat4 S;              // shadow matrix, unused here
+  vec4 light_position; // light position in world space
+  int bIsLightPass;    // unused here
+};
+
+// per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+  mat4 M;              // model matrix
+  vec4 diffuse_color;  // diffuse colour of surface
+  vec4 specular_color; // specular colour of surface, shininess in a
+};
 
 // inputs from the vertex shader
 smooth in vec3 vEyeSpaceNormal;   // interpolated eye space normal
@@ -17,25 +26,25 @@ smooth in vec3 vEyeSpacePosition; // interpolated eye space position
 const vec3 vEyeSpaceCameraPosition = vec3(0, 0, 0);
 
 void main() {
-  // multiply the object space light position with the modelview matrix
+  // multiply the world space light position with the view matrix
   // to get the eye space light position
-  vec3 vEyeSpaceLightPosition = (MV * vec4(light_position, 1)).xyz;
+  vec3 vEyeSpaceLightPosition = (V * light_position).xyz;
 
   // normalize the eye space normal
   vec3 N = normalize(vEyeSpaceNormal);
   // get the light vector and normalize it
   vec3 L = normalize(vEyeSpaceLightPosition - vEyeSpacePosition);
   // get the view vector and normalize it
-  vec3 V = normalize(vEyeSpaceCameraPosition.xyz - vEyeSpacePosition.xyz);
+  vec3 E = normalize(vEyeSpaceCameraPosition.xyz - vEyeSpacePosition.xyz);
   // get the half vector between light and view vector and normalize it
-  vec3 H = normalize(L + V);
+  vec3 H = normalize(L + E);
   // calculate the diffuse component
   float diffuse = max(0, dot(N, L));
   // calculat the specular component
-  float specular = max(0, pow(dot(N, H), shininess));
+  float specular = max(0, pow(dot(N, H), specular_color.a));
 
   // output the sum of diffuse and specular colours with their respective
   // component as the final fragment colour
   vFragColor =
-      diffuse * vec4(diffuse_color, 1) + specular * vec4(specular_color, 1);
+      diffuse * vec4(diffuse_color.rgb, 1) + specular * vec4(specular_color.rgb, 1);
 }
@@ -3,25 +3,40 @@
 layout(location = 0) in vec3 vVertex; // per-vertex position
 layout(location = 1) in vec3 vNormal; // per-vertex normal
 
-// uniforms
-uniform mat4 MVP; // combined modelview projection matrix
-uniform mat4 MV;  // modelview matrix
-uniform mat3 N;   // normal matrix
+// per-frame uniforms, uploaded once per frame (PerFrameBlock in Common)
+layout(std140) uniform PerFrame {
+  mat4 V;              // view matrix
+  mat4 P;              // projection matrix
+  mat4 S;              // shadow matrix, unused here
+  vec4 light_position; // light position in world space
+  int bIsLightPass;    // unused here
+};
+
+// per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+  mat4 M;              // model matrix
+  vec4 diffuse_color;  // diffuse colour of surface
+  vec4 specular_color; // specular colour of surface, shininess in a
+};
 
 // shader outputs to the fragment shader
 smooth out vec3 vEyeSpaceNormal;   // eye space normal
 smooth out vec3 vEyeSpacePosition; // eye space position
 
 void main() {
+  // the scene only uses rigid transforms so the upper 3x3 of the
+  // modelview matrix doubles as the normal matrix
+  mat4 MV = V * M;
+
   // multiply the object space vertex position with the modelview matrix
   // to get the eye space vertex position
   vEyeSpacePosition = (MV * vec4(vVertex, 1)).xyz;
 
   // multiply the object space normal with the normal matrix
   // to get the eye space normal
-  vEyeSpaceNormal = N * vNormal;
+  vEyeSpaceNormal = mat3(MV) * vNormal;
 
   // multiply the combiend modelview projection matrix with the object space
   // vertex position to get the clip space position
-  gl_Position = MVP * vec4(vVertex, 1);
+  gl_Position = P * MV * vec4(vVertex, 1);
 }
@@ -20,6 +20,8 @@
 // Internal
 #include "GLSLShader.hpp"
 #include "Grid.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformBuffer.hpp"
 
 // Vertex struct with position and normal
 struct Vertex {
@@ -31,12 +33,6 @@ enum State {
   None = 0, Left, Middle, Right
 };
 
-struct Matrices {
-  glm::mat4 MVP;
-  glm::mat4 MV;
-  glm::mat4 Normal;
-};
-
 struct Common {
   // screen size
   static constexpr int WIDTH = 1024;
@@ -48,7 +44,9 @@ struct Common {
   // per-vertex lighting shader
   GLSLShader shader;
 
-  GLuint UBO = 0;
+  // per-frame camera and light data, and one per-draw slot per object
+  CUniformBuffer perFrameUBO;
+  CUniformBuffer perDrawUBO;
 
   // sphere vertex array and vertex buffer object IDs
   GLuint sphereVAOID;
@@ -79,11 +77,15 @@ struct Common {
   // Grid object
   CGrid *grid = nullptr;
 
-  glm::vec3 lightPosOS = glm::vec3(0, 2, 0); // objectspace light position
+  glm::vec3 lightPosWS = glm::vec3(0, 2, 0); // world space light position
 
   // for animation of the cubes
   float dx = -0.1f;
 
+  // per-draw slots, the 8 cubes followed by the sphere
+  static constexpr int CUBES = 8;
+  static constexpr int SPHERE = CUBES;
+
   // vertices and indices for sphere/cube
   std::vector<Vertex>   vertices;
   std::vector<GLushort> indices;
@@ -97,8 +99,6 @@ struct Common {
 };
 static Common *g_pCommon = nullptr;
 
-constexpr auto BindingPoint = 0;
-
 // add the given sphere indices to the indices vector
 inline void push_indices(int sectors, int r, int s,
                          std::vector<GLushort> &indices) {
@@ -228,15 +228,21 @@ void OnInit() {
   // add attributes and uniforms
   g_pCommon->shader.AddAttribute("vVertex");
   g_pCommon->shader.AddAttribute("vNormal");
-  //g_pCommon->shader.AddUniform("MVP");
-  //g_pCommon->shader.AddUniform("MV");
-  //g_pCommon->shader.AddUniform("N");
-  g_pCommon->shader.AddUniform("light_position");
-  g_pCommon->shader.AddUniform("diffuse_color");
-  g_pCommon->shader.AddUniform("specular_color");
-  g_pCommon->shader.AddUniform("shininess");
+  // all uniforms live in the shared blocks
+  g_pCommon->shader.BindUniformBlock("PerFrame", UniformBinding::PER_FRAME);
+  g_pCommon->shader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
   g_pCommon->shader.UnUse();
 
+  // setup uniform buffers, the sphere never moves so its per-draw data is
+  // uploaded once here
+  g_pCommon->perFrameUBO.Init(sizeof(PerFrameBlock));
+  g_pCommon->perDrawUBO.Init(sizeof(PerDrawBlock), Common::CUBES + 1);
+  g_pCommon->perDrawUBO.Update(
+      PerDrawBlock{glm::translate(glm::mat4(1), glm::vec3(0, 1, 0)),
+                   glm::vec4(0.9f, 0.9f, 1.0f, 1.0f),
+                   glm::vec4(1.0f, 1.0f, 1.0f, 300.0f)},
+      Common::SPHERE);
+
   // Cerate sphere geometry
   CreateSphere(1.0f, 10, 10, g_pCommon->vertices, g_pCommon->indices);
 
@@ -305,67 +311,36 @@ void OnInit() {
 
 // scene rendering function
 void DrawScene(glm::mat4 View, glm::mat4 Proj) {
+  // the camera and the cube positions change every frame, upload them
+  // once and only select buffer ranges per draw
+  g_pCommon->perFrameUBO.Update(
+      PerFrameBlock{View, Proj, glm::mat4(1),
+                    glm::vec4(g_pCommon->lightPosWS, 1)});
+  g_pCommon->perFrameUBO.Bind(UniformBinding::PER_FRAME);
+  for (int i = 0; i < Common::CUBES; i++) {
+    const float theta = static_cast<float>(i) / 8.0F * 2.F * glm::pi<float>();
+    glm::mat4 T = glm::translate(glm::mat4(1), glm::vec3(g_pCommon->radius * std::cos(theta), 0.5f, g_pCommon->radius * std::sin(theta)));
+    g_pCommon->perDrawUBO.Update(
+        PerDrawBlock{T, glm::vec4(g_pCommon->colors[i], 1),
+                     glm::vec4(1.0f, 1.0f, 1.0f, 100.0f)},
+        i);
+  }
+
   // Bind the current shader
   g_pCommon->shader.Use();
 
   // bind the cube vertex array object
   glBindVertexArray(g_pCommon->cubeVAOID);
 
-  const auto UBO     = g_pCommon->UBO;
-  const auto program = g_pCommon->shader._program;
-  glUniformBlockBinding(program, 0, BindingPoint);
-
   // draw the 8 cubes first
-  for (int i = 0; i < 8; i++) {
-    // set the cube's transform
-    const float theta = static_cast<float>(i) / 8.0F * 2.F * glm::pi<float>();
-    glm::mat4 T = glm::translate(glm::mat4(1), glm::vec3(g_pCommon->radius * std::cos(theta), 0.5f, g_pCommon->radius * std::sin(theta)));
-    glm::mat4 M   = T;         // Model matrix
-    glm::mat4 MV  = View * M;  // ModelView matrix
-    glm::mat4 MVP = Proj * MV; // combined ModelView  Projection matrix
-    const auto matrices = Matrices {
-      MVP,
-      MV,
-      glm::mat3(glm::inverse(MV))
-    };
-
-    // pass shader uniforms
-    {
-      glBindBuffer(GL_UNIFORM_BUFFER, UBO);
-      glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Matrices), &matrices);
-      glBindBuffer(GL_UNIFORM_BUFFER, 0);
-    }
-
-    glUniform3fv(g_pCommon->shader("diffuse_color"), 1, &(g_pCommon->colors[i].x));
-    glUniform3f(g_pCommon->shader("specular_color"), 1.0f, 1.0f, 1.0f);
-    glUniform1f(g_pCommon->shader("shininess"), 100);
-    glUniform3fv(g_pCommon->shader("light_position"), 1, &(g_pCommon->lightPosOS.x));
+  for (int i = 0; i < Common::CUBES; i++) {
+    g_pCommon->perDrawUBO.Bind(UniformBinding::PER_DRAW, i);
     // draw triangles
     glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, nullptr);
   }
   // bind the sphere vertex array object
   glBindVertexArray(g_pCommon->sphereVAOID);
-  // set the sphere's transform
-  auto T = glm::translate(glm::mat4(1), glm::vec3(0, 1, 0));
-  auto M = T;
-  auto MV = View * M;
-  auto MVP = Proj * MV;
-  const auto matrices = Matrices {
-    MVP,
-    MV,
-    glm::mat3(glm::inverse(MV))
-  };
-  // pass shader uniforms
-  {
-    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Matrices), &matrices);
-    glUniformBlockBinding(g_pCommon->shader._program, 0, BindingPoint);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-  }
-  glUniform3f(g_pCommon->shader("diffuse_color"), 0.9f, 0.9f, 1.0f);
-  glUniform3f(g_pCommon->shader("specular_color"), 1.0f, 1.0f, 1.0f);
-  glUniform1f(g_pCommon->shader("shininess"), 300);
-  glUniform3fv(g_pCommon->shader("light_position"), 1, &(g_pCommon->lightPosOS.x));
+  g_pCommon->perDrawUBO.Bind(UniformBinding::PER_DRAW, Common::SPHERE);
   // draw triangles
   glDrawElements(GL_TRIANGLES, g_pCommon->totalSphereTriangles, GL_UNSIGNED_SHORT, nullptr);
 
@@ -499,13 +474,6 @@ int main(int argc, char **argv) {
   ImGui_ImplGlfw_InitForOpenGL(pWindow, true);
   ImGui_ImplOpenGL3_Init("#version 330 core");
 
-  GLuint& UBO = g_pCommon->UBO;
-  glGenBuffers(1, &UBO);
-  glBindBuffer(GL_UNIFORM_BUFFER, UBO);
-  glBufferData(GL_UNIFORM_BUFFER, sizeof(Matrices), nullptr, GL_DYNAMIC_DRAW);
-  glBindBufferBase(GL_UNIFORM_BUFFER, BindingPoint, UBO);
-  glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
   while(!glfwWindowShouldClose(pWindow)) {
     glfwPollEvents();
 
@@ -568,8 +536,10 @@ int main(int argc, char **argv) {
     glfwSwapBuffers(pWindow);
   }
 
-  // Destroy shader
+  // Destroy shader and uniform buffers
   g_pCommon->shader.DeleteShaderProgram();
+  g_pCommon->perFrameUBO.Destroy();
+  g_pCommon->perDrawUBO.Destroy();
   // Destroy vao and vbo
   glDeleteBuffers(1, &g_pCommon->sphereVerticesVBO);
   glDeleteBuffers(1, &g_pCommon->sphereIndicesVBO);
@@ -4,9 +4,12 @@ layout (location = 0) in vec3 vVertex; //object space vertex position
 
 uniform mat4 MVP; //combined modelview projection
 
+#include "instanced_vertex.glsl"
+
 void main() {
   //get the clipspace vertex position by multiplying the object space vertex
   //position with the combined modelview project matrix
-  gl_Position = MVP * vec4(vVertex.xyz, 1);
+  gl_Position = MVP*InstancePosition(vec4(DecodePosition(vVertex),1));
+  PassInstanceColor();
 }
 
@@ -1,22 +1,23 @@
 #version 330 core
 
-#extension GL_ARB_explicit_uniform_location : enable
-
 layout(location=0) in vec3 vVertex;   //per-vertex position
 layout(location=1) in vec3 vNormal;   //per-vertex normal
 
-//uniforms
-layout(std140) uniform Matrices {
-  mat4 MVP; // combined modelview projection matrix
-  mat4 MV;  // modelview matrix
-  mat4 N;   // normal matrix
+//per-frame uniforms, uploaded once per frame (PerFrameBlock in Common)
+layout(std140) uniform PerFrame {
+  mat4 V;              //view matrix
+  mat4 P;              //projection matrix
+  mat4 S;              //shadow matrix, unused here
+  vec4 light_position; //light position in world space
+  int  bIsLightPass;   //unused here
 };
 
-uniform vec3 light_position;  //light position in object space
-uniform vec3 diffuse_color;   //diffuse colour of object
-uniform vec3 specular_color;  //specular colour of object
-
-uniform float shininess;    //specular shininess
+//per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+  mat4 M;              //model matrix
+  vec4 diffuse_color;  //diffuse colour of object
+  vec4 specular_color; //specular colour of object, shininess in a
+};
 
 //shader outputs to the fragment shader
 smooth out vec4 color;    //final diffuse colour to the fragment shader
@@ -25,9 +26,13 @@ smooth out vec4 color;    //final diffuse colour to the fragment shader
 const vec3 vEyeSpaceCameraPosition = vec3(0,0,0); //eye is at vec3(0,0,0) in eye space
 
 void main() {
-  //multiply the object space light position with the modelview matrix
+  //the scene only uses rigid transforms so the upper 3x3 of the
+  //modelview matrix doubles as the normal matrix
+  mat4 MV = V*M;
+
+  //multiply the world space light position with the view matrix
   //to get the eye space light position
-  vec4 vEyeSpaceLightPosition = MV*vec4(light_position,1);
+  vec4 vEyeSpaceLightPosition = V*light_position;
 
   //multiply the object space vertex position with the modelview matrix
   //to get the eye space vertex position
@@ -35,25 +40,25 @@ void main() {
 
   //multiply the object space normal with the normal matrix
   //to get the eye space normal
-  vec3 vEyeSpaceNormal   = normalize(glm::mat3(N) * vNormal);
+  vec3 vEyeSpaceNormal   = normalize(mat3(MV) * vNormal);
 
   //get the light vector
   vec3 L = normalize(vEyeSpaceLightPosition.xyz-vEyeSpacePosition.xyz);
   //get the view vector
-  vec3 V = normalize(vEyeSpaceCameraPosition.xyz-vEyeSpacePosition.xyz);
+  vec3 E = normalize(vEyeSpaceCameraPosition.xyz-vEyeSpacePosition.xyz);
   //get the half way vector between light and view vectors
-  vec3 H = normalize(L+V);
+  vec3 H = normalize(L+E);
 
   //calculate the diffuse and specular components
   float diffuse = max(0, dot(vEyeSpaceNormal, L));
-  float specular = max(0, pow(dot(vEyeSpaceNormal, H), shininess));
+  float specular = max(0, pow(dot(vEyeSpaceNormal, H), specular_color.a));
 
   //calculate the final colour by adding the diffuse and specular components
-  color = diffuse*vec4(diffuse_color,1) + specular*vec4(specular_color, 1);
+  color = diffuse*vec4(diffuse_color.rgb,1) + specular*vec4(specular_color.rgb, 1);
 
   //multiply the combiend modelview projection matrix with the object space vertex
   //position to get the clip space position
-  gl_Position = MVP*vec4(vVertex,1);
+  gl_Position = P*MV*vec4(vVertex,1);
 }
 
 
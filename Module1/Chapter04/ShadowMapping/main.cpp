@@ -3,6 +3,8 @@
 #include <GL/glew.h>
 
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
@@ -13,8 +15,17 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "CascadedShadowMap.hpp"
 #include "GLSLShader.hpp"
+#include "CubeShadowMap.hpp"
 #include "Grid.hpp"
+#include "OrbitCamera.hpp"
+#include "ShadowAtlas.hpp"
+#include "QueryPool.hpp"
+#include "ShadowCache.hpp"
+#include "StreamingBuffer.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformBuffer.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
 
@@ -36,6 +47,14 @@ struct Common {
   // shadowmapping and flat shader
   GLSLShader shader, flatshader;
 
+  // per-pass camera/light data, every pass writes a fresh range so the
+  // data of passes still in flight is never overwritten
+  CStreamingBuffer perFrameStream;
+  GLsizeiptr perFrameAlignment = 256; // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+  // per-object model matrix and colour, one slot per scene object
+  CUniformBuffer perDrawUBO;
+  enum { PLANE = 0, CUBE, SPHERE, TOTAL_OBJECTS };
+
   // sphere vertex array and vertex buffer object IDs
   GLuint sphereVAOID;
   GLuint sphereVerticesVBO;
@@ -82,6 +101,53 @@ struct Common {
   // FBO ID
   GLuint fboID;
 
+  // the light pass only runs when the light or a caster changed
+  CShadowCache shadowCache;
+
+  // many spot lights sharing one shadow atlas, 'a' toggles them
+  static constexpr int SPOT_LIGHTS = 16;
+  static constexpr float SPOT_RANGE = 4.0f;
+  GLSLShader atlasShader;
+  CShadowAtlas atlas;
+  CShadowCache atlasCache; // one slot per spot light
+  bool useAtlas = false;
+  glm::vec4 spotPositions[SPOT_LIGHTS];
+  glm::vec4 spotDirections[SPOT_LIGHTS];
+  glm::vec4 spotColors[SPOT_LIGHTS];
+  glm::mat4 spotViews[SPOT_LIGHTS];
+  glm::mat4 spotProjection;
+
+  // omnidirectional shadows of the light in a cube map, 'p' toggles them and
+  // 's' switches between one layered pass and one pass per face
+  enum { LAYERED = 0, SIX_PASS, CUBE_PATHS };
+  GLSLShader cubeShader, cubeDepthShader, cubeFaceShader;
+  CCubeShadowMap cubeShadow;
+  CShadowCache cubeCache; // one slot per face
+  CQueryPool cubeQueries; // GPU time of the cube shadow passes
+  bool useCube = false;
+  int cubePath = LAYERED;
+  // caster bounding spheres, one per scene object
+  float casterX[TOTAL_OBJECTS] = {0, -1, 1};
+  float casterY[TOTAL_OBJECTS] = {0, 1, 1};
+  float casterZ[TOTAL_OBJECTS] = {0, 0, 0};
+  float casterRadius[TOTAL_OBJECTS] = {70.72f, 1.7321f, 1.0f};
+  std::vector<CMultiViewCuller::ViewMask> casterFaces;
+  // per path: rendered shadow passes, their draw calls and GPU time
+  std::size_t cubePasses[CUBE_PATHS] = {0, 0};
+  std::size_t cubeDraws[CUBE_PATHS] = {0, 0};
+  std::size_t cubeTimed[CUBE_PATHS] = {0, 0};
+  GLuint64 cubeNanoseconds[CUBE_PATHS] = {0, 0};
+
+  // cascaded shadow maps of the light as a directional light, 'c' toggles
+  // them and 'v' tints the fragments by cascade
+  GLSLShader cascadeShader, cascadeDepthShader;
+  CCascadedShadowMap cascades;
+  CShadowCache cascadeCache; // one slot per cascade
+  COrbitCamera camera;
+  bool useCascades = false;
+  bool showCascades = false;
+  std::vector<CMultiViewCuller::ViewMask> casterCascades;
+
   glm::mat4 MV_L; // light modelview matrix
   glm::mat4 P_L;  // light projection matrix
   glm::mat4 B;    // light bias matrix
@@ -308,24 +374,41 @@ void OnInit() {
   // compile and link shader
   g_pCommon->shader.CreateAndLinkProgram();
   g_pCommon->shader.Use();
-  // add attributes and uniforms
-  g_pCommon->shader.AddAttribute("vVertex");
-  g_pCommon->shader.AddAttribute("vNormal");
-  g_pCommon->shader.AddUniform("MVP");
-  g_pCommon->shader.AddUniform("MV");
-  g_pCommon->shader.AddUniform("M");
-  g_pCommon->shader.AddUniform("N");
-  g_pCommon->shader.AddUniform("S");
-  g_pCommon->shader.AddUniform("light_position");
-  g_pCommon->shader.AddUniform("diffuse_color");
-  g_pCommon->shader.AddUniform("bIsLightPass");
-  g_pCommon->shader.AddUniform("shadowMap");
+  // uniforms and attributes are reflected at link time, only the uniform
+  // blocks need to be routed to their shared binding points
+  g_pCommon->shader.BindUniformBlock("PerFrame", UniformBinding::PER_FRAME);
+  g_pCommon->shader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
   // pass value of constant uniforms at initialization
   glUniform1i(g_pCommon->shader("shadowMap"), 0);
   g_pCommon->shader.UnUse();
 
   GL_CHECK_ERRORS;
 
+  // setup uniform buffers, the objects never move so the per-draw data is
+  // uploaded once here
+  // the per-frame ranges of a frame: the light, eye and cube face passes
+  // and one per spot light
+  GLint uboAlignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlignment);
+  g_pCommon->perFrameAlignment = uboAlignment;
+  const GLsizeiptr perFrameStride =
+      (static_cast<GLsizeiptr>(sizeof(PerFrameBlock)) + uboAlignment - 1) /
+      uboAlignment * uboAlignment;
+  g_pCommon->perFrameStream.Init(
+      GL_UNIFORM_BUFFER,
+      perFrameStride * (2 + CCubeShadowMap::FACES + Common::SPOT_LIGHTS));
+  g_pCommon->perDrawUBO.Init(sizeof(PerDrawBlock), Common::TOTAL_OBJECTS);
+  g_pCommon->perDrawUBO.Update(
+      PerDrawBlock{glm::mat4(1), glm::vec4(1, 1, 1, 1)}, Common::PLANE);
+  g_pCommon->perDrawUBO.Update(
+      PerDrawBlock{glm::translate(glm::mat4(1), glm::vec3(-1, 1, 0)),
+                   glm::vec4(1, 0, 0, 1)},
+      Common::CUBE);
+  g_pCommon->perDrawUBO.Update(
+      PerDrawBlock{glm::translate(glm::mat4(1), glm::vec3(1, 1, 0)),
+                   glm::vec4(0, 0, 1, 1)},
+      Common::SPHERE);
+
   // setup sphere geometry
   CreateSphere(1.0f, 10, 10, g_pCommon->vertices, g_pCommon->indices);
 
@@ -514,6 +597,107 @@ void OnInit() {
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_CULL_FACE);
 
+  g_pCommon->shadowCache.Init(1);
+
+  // load the atlas lighting shader
+  g_pCommon->atlasShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/ShadowAtlasLit.vert");
+  g_pCommon->atlasShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/ShadowAtlasLit.frag");
+  g_pCommon->atlasShader.CreateAndLinkProgram();
+  g_pCommon->atlasShader.Use();
+  g_pCommon->atlasShader.BindUniformBlock("PerFrame", UniformBinding::PER_FRAME);
+  g_pCommon->atlasShader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
+  g_pCommon->atlasShader.BindUniformBlock("ShadowAtlas", UniformBinding::ATLAS);
+  glUniform1i(g_pCommon->atlasShader("shadowAtlas"), 1);
+
+  // a ring of spot lights above the objects, each aimed at the centre
+  g_pCommon->spotProjection = glm::perspective(glm::radians(60.0f), 1.0f, 0.5f, 20.0f);
+  for (int i = 0; i < Common::SPOT_LIGHTS; ++i) {
+    const float angle = 6.2831853f * static_cast<float>(i) / Common::SPOT_LIGHTS;
+    const glm::vec3 position(5 * std::cos(angle), 3, 5 * std::sin(angle));
+    g_pCommon->spotPositions[i]  = glm::vec4(position, 1);
+    g_pCommon->spotDirections[i] = glm::vec4(glm::normalize(-position), 0);
+    g_pCommon->spotColors[i] =
+        glm::vec4(0.5f + 0.5f * std::cos(angle), 0.5f + 0.5f * std::sin(angle),
+                  0.5f - 0.5f * std::cos(angle), 1) *
+        0.25f;
+    g_pCommon->spotViews[i] = glm::lookAt(position, glm::vec3(0), glm::vec3(0, 1, 0));
+  }
+  glUniform4fv(g_pCommon->atlasShader("lightPositions"), Common::SPOT_LIGHTS,
+               glm::value_ptr(g_pCommon->spotPositions[0]));
+  glUniform4fv(g_pCommon->atlasShader("lightDirections"), Common::SPOT_LIGHTS,
+               glm::value_ptr(g_pCommon->spotDirections[0]));
+  glUniform4fv(g_pCommon->atlasShader("lightColors"), Common::SPOT_LIGHTS,
+               glm::value_ptr(g_pCommon->spotColors[0]));
+  glUniform1i(g_pCommon->atlasShader("lightCount"), Common::SPOT_LIGHTS);
+  g_pCommon->atlasShader.UnUse();
+
+  // 2048x2048 holds four of the largest tiles, so the lights share it by
+  // importance
+  g_pCommon->atlas.Init(2048, 128, 1024);
+  g_pCommon->atlasCache.Init(Common::SPOT_LIGHTS);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, g_pCommon->atlas.GetTexture());
+  glActiveTexture(GL_TEXTURE0);
+
+  // load the cube shadow shaders, the layered depth pass, the depth pass of
+  // a single face and the point light lookup
+  g_pCommon->cubeDepthShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/CubeShadowDepth.vert");
+  g_pCommon->cubeDepthShader.LoadFromFile(GL_GEOMETRY_SHADER, "shaders/CubeShadowDepth.geom");
+  g_pCommon->cubeDepthShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/CubeShadowDepth.frag");
+  g_pCommon->cubeDepthShader.CreateAndLinkProgram();
+  g_pCommon->cubeDepthShader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
+  g_pCommon->cubeDepthShader.BindUniformBlock("CubeShadow", UniformBinding::CUBE_SHADOW);
+
+  g_pCommon->cubeFaceShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/CubeShadowFace.vert");
+  g_pCommon->cubeFaceShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/CubeShadowDepth.frag");
+  g_pCommon->cubeFaceShader.CreateAndLinkProgram();
+  g_pCommon->cubeFaceShader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
+  g_pCommon->cubeFaceShader.BindUniformBlock("CubeShadow", UniformBinding::CUBE_SHADOW);
+
+  g_pCommon->cubeShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/PointLightCubeShadowed.vert");
+  g_pCommon->cubeShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/PointLightCubeShadowed.frag");
+  g_pCommon->cubeShader.CreateAndLinkProgram();
+  g_pCommon->cubeShader.Use();
+  g_pCommon->cubeShader.BindUniformBlock("PerFrame", UniformBinding::PER_FRAME);
+  g_pCommon->cubeShader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
+  g_pCommon->cubeShader.BindUniformBlock("CubeShadow", UniformBinding::CUBE_SHADOW);
+  glUniform1i(g_pCommon->cubeShader("shadowCube"), 2);
+  g_pCommon->cubeShader.UnUse();
+
+  g_pCommon->cubeShadow.Init(512);
+  g_pCommon->cubeCache.Init(CCubeShadowMap::FACES);
+  g_pCommon->cubeQueries.Init(GL_TIME_ELAPSED, 8);
+  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, g_pCommon->cubeShadow.GetTexture());
+  glActiveTexture(GL_TEXTURE0);
+
+  // load the cascade depth and lighting shaders from Common/shaders
+  g_pCommon->cascadeDepthShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/CascadeDepth.vert");
+  g_pCommon->cascadeDepthShader.LoadFromFile(GL_GEOMETRY_SHADER, "shaders/CascadeDepth.geom");
+  g_pCommon->cascadeDepthShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/CascadeDepth.frag");
+  g_pCommon->cascadeDepthShader.CreateAndLinkProgram();
+  g_pCommon->cascadeDepthShader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
+  g_pCommon->cascadeDepthShader.BindUniformBlock("Cascades", UniformBinding::CASCADES);
+
+  g_pCommon->cascadeShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/CascadedShadowMapped.vert");
+  g_pCommon->cascadeShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/CascadedShadowMapped.frag");
+  g_pCommon->cascadeShader.CreateAndLinkProgram();
+  g_pCommon->cascadeShader.Use();
+  g_pCommon->cascadeShader.BindUniformBlock("PerFrame", UniformBinding::PER_FRAME);
+  g_pCommon->cascadeShader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
+  g_pCommon->cascadeShader.BindUniformBlock("Cascades", UniformBinding::CASCADES);
+  glUniform1i(g_pCommon->cascadeShader("shadowMaps"), 3);
+  g_pCommon->cascadeShader.UnUse();
+
+  // the cascades cover the first 40 units in front of the camera
+  g_pCommon->cascades.Init(1024, CCascadedShadowMap::MAX_CASCADES);
+  g_pCommon->cascades.SetMaxDistance(40.0f);
+  g_pCommon->cascadeCache.Init(g_pCommon->cascades.GetCascadeCount());
+  glActiveTexture(GL_TEXTURE3);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, g_pCommon->cascades.GetTexture());
+  glActiveTexture(GL_TEXTURE0);
+
   std::cout << "Initialization successfull" << std::endl;
 }
 
@@ -521,6 +705,12 @@ void OnInit() {
 void OnShutdown() {
   // Destroy shader
   g_pCommon->shader.DeleteShaderProgram();
+
+  // Destroy uniform buffers
+  g_pCommon->perFrameStream.PrintStats(std::cout);
+  g_pCommon->perFrameStream.Destroy();
+  g_pCommon->perDrawUBO.Destroy();
+
   // Destroy vao and vbo
   glDeleteBuffers(1, &g_pCommon->sphereVerticesVBO);
   glDeleteBuffers(1, &g_pCommon->sphereIndicesVBO);
@@ -533,6 +723,42 @@ void OnShutdown() {
   glDeleteVertexArrays(1, &g_pCommon->lightVAOID);
   glDeleteBuffers(1, &g_pCommon->lightVerticesVBO);
 
+  g_pCommon->shadowCache.PrintStats(std::cout);
+  g_pCommon->atlas.PrintStats(std::cout);
+  g_pCommon->atlasCache.PrintStats(std::cout);
+  g_pCommon->atlas.Destroy();
+  g_pCommon->atlasShader.DeleteShaderProgram();
+
+  // single layered pass against one pass per face
+  g_pCommon->cubeShadow.PrintStats(std::cout);
+  g_pCommon->cubeCache.PrintStats(std::cout);
+  g_pCommon->cubeQueries.PrintStats(std::cout);
+  const char *pathNames[Common::CUBE_PATHS] = {"layered", "six pass"};
+  for (int path = 0; path < Common::CUBE_PATHS; ++path) {
+    const std::size_t passes = g_pCommon->cubePasses[path];
+    const std::size_t timed = g_pCommon->cubeTimed[path];
+    std::cout << "Cube shadows, " << pathNames[path] << ": " << passes << " passes, "
+              << (passes > 0 ? static_cast<double>(g_pCommon->cubeDraws[path]) /
+                                   static_cast<double>(passes)
+                             : 0.0)
+              << " draws per pass, "
+              << (timed > 0 ? static_cast<double>(g_pCommon->cubeNanoseconds[path]) /
+                                  static_cast<double>(timed) * 1e-6
+                            : 0.0)
+              << " ms per pass\n";
+  }
+  g_pCommon->cubeQueries.Destroy();
+  g_pCommon->cubeShadow.Destroy();
+  g_pCommon->cubeShader.DeleteShaderProgram();
+  g_pCommon->cubeDepthShader.DeleteShaderProgram();
+  g_pCommon->cubeFaceShader.DeleteShaderProgram();
+
+  g_pCommon->cascades.PrintStats(std::cout);
+  g_pCommon->cascadeCache.PrintStats(std::cout);
+  g_pCommon->cascades.Destroy();
+  g_pCommon->cascadeShader.DeleteShaderProgram();
+  g_pCommon->cascadeDepthShader.DeleteShaderProgram();
+
   std::cout << "Shutdown successfull" << std::endl;
 }
 
@@ -543,92 +769,234 @@ void OnResize(int w, int h) {
 
   // setup the projection matrix
   g_pCommon->P =
-      glm::perspective(45.0f, static_cast<GLfloat>(w) / h, 0.1f, 1000.f);
+      glm::perspective(glm::radians(45.0f), static_cast<GLfloat>(w) / h, 0.1f,
+                       1000.f);
+  g_pCommon->camera.SetupProjection(45.0f, static_cast<GLfloat>(w) / h, 0.1f,
+                                    1000.f);
 }
 
 // idle callback just calls the display function
 void OnIdle() { glutPostRedisplay(); }
 
-// Scene rendering function
-void DrawScene(glm::mat4 View, glm::mat4 Proj, int isLightPass = 1) {
+// Scene rendering function, with the given program or the shadow mapping
+// shader. With view masks an object is drawn into the cube faces or
+// cascades of its mask and skipped when it reaches none
+void DrawScene(const glm::mat4 &View, const glm::mat4 &Proj,
+               int isLightPass = 1, GLSLShader *program = nullptr,
+               const CMultiViewCuller::ViewMask *viewMasks = nullptr) {
   GL_CHECK_ERRORS;
 
+  // stream the camera and light data of this pass
+  PerFrameBlock frame;
+  frame.V = View;
+  frame.P = Proj;
+  frame.S = g_pCommon->S;
+  frame.lightPosition = glm::vec4(g_pCommon->lightPosOS, 1);
+  frame.isLightPass = isLightPass;
+  auto &stream = g_pCommon->perFrameStream;
+  const auto range = stream.Alloc(sizeof(PerFrameBlock), g_pCommon->perFrameAlignment);
+  std::memcpy(range.data, &frame, sizeof(frame));
+  stream.Commit();
+  glBindBufferRange(GL_UNIFORM_BUFFER, UniformBinding::PER_FRAME,
+                    stream.GetBuffer(), range.offset, sizeof(PerFrameBlock));
+
   // bind the current shader
-  g_pCommon->shader.Use();
+  GLSLShader &shader = program != nullptr ? *program : g_pCommon->shader;
+  shader.Use();
+  auto draw = [&](const int object, const GLuint vao, const GLsizei count) {
+    if (viewMasks != nullptr) {
+      if (viewMasks[object] == 0) {
+        return;
+      }
+      glUniform1i(shader("viewMask"), static_cast<GLint>(viewMasks[object]));
+    }
+    glBindVertexArray(vao);
+    g_pCommon->perDrawUBO.Bind(UniformBinding::PER_DRAW, object);
+    glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, nullptr);
+  };
   // render plane first
-  glBindVertexArray(g_pCommon->planeVAOID);
-  {
-    // set the shader uniforms
-    glUniform3fv(g_pCommon->shader("light_position"), 1,
-                 &(g_pCommon->lightPosOS.x));
-    glUniformMatrix4fv(g_pCommon->shader("S"), 1, GL_FALSE,
-                       glm::value_ptr(g_pCommon->S));
-    glUniformMatrix4fv(g_pCommon->shader("M"), 1, GL_FALSE,
-                       glm::value_ptr(glm::mat4(1)));
-    glUniform1i(g_pCommon->shader("bIsLightPass"), isLightPass);
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE,
-                       glm::value_ptr(Proj * View));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE,
-                       glm::value_ptr(View));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
-                       glm::value_ptr(glm::inverseTranspose(glm::mat3(View))));
-    glUniform3f(g_pCommon->shader("diffuse_color"), 1.0f, 1.0f, 1.0f);
-    // draw plane triangles
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr);
-  }
-
+  draw(Common::PLANE, g_pCommon->planeVAOID, 6);
   // render the cube
-  glBindVertexArray(g_pCommon->cubeVAOID);
-  {
-    // set the cube's transform
-    glm::mat4 T = glm::translate(glm::mat4(1), glm::vec3(-1, 1, 0));
-    glm::mat4 M = T;
-    glm::mat4 MV = View * M;
-    glm::mat4 MVP = Proj * MV;
-    // pass shader uniforms
-    glUniformMatrix4fv(g_pCommon->shader("S"), 1, GL_FALSE,
-                       glm::value_ptr(g_pCommon->S));
-    glUniformMatrix4fv(g_pCommon->shader("M"), 1, GL_FALSE, glm::value_ptr(M));
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE,
-                       glm::value_ptr(MVP));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE,
-                       glm::value_ptr(MV));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
-                       glm::value_ptr(glm::inverseTranspose(glm::mat3(MV))));
-    glUniform3f(g_pCommon->shader("diffuse_color"), 1.0f, 0.0f, 0.0f);
-    // draw cube triangles
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, nullptr);
-  }
+  draw(Common::CUBE, g_pCommon->cubeVAOID, 36);
   // render the sphere
-  glBindVertexArray(g_pCommon->sphereVAOID);
-  {
-    // set the sphere's transform
-    glm::mat4 T = glm::translate(glm::mat4(1), glm::vec3(1, 1, 0));
-    glm::mat4 M = T;
-    glm::mat4 MV = View * M;
-    glm::mat4 MVP = Proj * MV;
-    // set the shader uniforms
-    glUniformMatrix4fv(g_pCommon->shader("S"), 1, GL_FALSE,
-                       glm::value_ptr(g_pCommon->S));
-    glUniformMatrix4fv(g_pCommon->shader("M"), 1, GL_FALSE, glm::value_ptr(M));
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE,
-                       glm::value_ptr(MVP));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE,
-                       glm::value_ptr(MV));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
-                       glm::value_ptr(glm::inverseTranspose(glm::mat3(MV))));
-    glUniform3f(g_pCommon->shader("diffuse_color"), 0.0f, 0.0f, 1.0f);
-    // draw sphere triangles
-    glDrawElements(GL_TRIANGLES, g_pCommon->totalSphereTriangles,
-                   GL_UNSIGNED_SHORT, nullptr);
-  }
+  draw(Common::SPHERE, g_pCommon->sphereVAOID, g_pCommon->totalSphereTriangles);
 
   // unbind shader
-  g_pCommon->shader.UnUse();
+  shader.UnUse();
 
   GL_CHECK_ERRORS;
 }
 
+// Render the shadow maps of the spot lights into their atlas tiles: every
+// light visible on screen gets a tile sized by its importance, and only the
+// tiles that are new or whose light or casters changed are drawn again
+void RenderAtlas(const glm::mat4 &MV) {
+  CShadowAtlas &atlas = g_pCommon->atlas;
+  CShadowCache &cache = g_pCommon->atlasCache;
+
+  atlas.BeginFrame();
+  for (int i = 0; i < Common::SPOT_LIGHTS; ++i) {
+    const glm::vec3 position(g_pCommon->spotPositions[i]);
+    atlas.Request(i, CShadowAtlas::ScreenImportance(MV, g_pCommon->P, position,
+                                                    Common::SPOT_RANGE));
+    atlas.SetViewProjection(i, g_pCommon->spotProjection * g_pCommon->spotViews[i]);
+  }
+  atlas.Assign();
+
+  // a new tile holds no depth yet; the objects are static so their version
+  // stays 0
+  cache.Invalidate(atlas.GetChanged());
+  for (int i = 0; i < Common::SPOT_LIGHTS; ++i) {
+    cache.SetLight(i, g_pCommon->spotProjection * g_pCommon->spotViews[i]);
+  }
+  for (std::size_t object = 0; object < Common::TOTAL_OBJECTS; ++object) {
+    cache.SetCaster(object, 0, (1U << Common::SPOT_LIGHTS) - 1);
+  }
+
+  // only the lights with a tile are in use, a dirty light without one stays
+  // dirty until it gets a tile
+  CShadowCache::SlotMask active = 0, drawn = 0;
+  atlas.Begin();
+  glCullFace(GL_FRONT);
+  for (int i = 0; i < Common::SPOT_LIGHTS; ++i) {
+    if (!atlas.HasTile(i)) {
+      continue;
+    }
+    active |= 1U << i;
+    if (cache.IsDirty(i)) {
+      atlas.BeginTile(i);
+      DrawScene(g_pCommon->spotViews[i], g_pCommon->spotProjection, 1);
+      drawn |= 1U << i;
+    }
+  }
+  glCullFace(GL_BACK);
+  atlas.End();
+  glDrawBuffer(GL_BACK_LEFT);
+  glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
+  cache.EndFrame(drawn, active);
+}
+
+// Render the cube shadow map of the light, either once with the geometry
+// shader routing the culled casters to their faces, or as the reference once
+// per face with every caster. Only the faces whose casters or light changed
+// are drawn; the objects are static so their version stays 0
+void RenderCubeShadow() {
+  CCubeShadowMap &cube = g_pCommon->cubeShadow;
+  CShadowCache &cache = g_pCommon->cubeCache;
+  g_pCommon->cubeQueries.Poll();
+
+  cube.Update(g_pCommon->lightPosOS);
+  cube.CullCasters({g_pCommon->casterX, g_pCommon->casterY, g_pCommon->casterZ,
+                    g_pCommon->casterRadius, Common::TOTAL_OBJECTS},
+                   g_pCommon->casterFaces);
+  for (int face = 0; face < CCubeShadowMap::FACES; ++face) {
+    cache.SetLight(face, cube.GetBlock().viewProjection[face]);
+  }
+  for (std::size_t object = 0; object < Common::TOTAL_OBJECTS; ++object) {
+    cache.SetCaster(object, 0, g_pCommon->casterFaces[object]);
+  }
+  // the faces in use hold a caster or still have to be cleared
+  const CShadowCache::SlotMask dirty = cache.GetDirty();
+  CShadowCache::SlotMask active = dirty;
+  for (const auto mask : g_pCommon->casterFaces) {
+    active |= mask;
+  }
+  if (dirty == 0) {
+    cache.EndFrame(0, active);
+    return;
+  }
+  for (auto &mask : g_pCommon->casterFaces) {
+    mask &= dirty;
+  }
+
+  const int path = g_pCommon->cubePath;
+  const bool timed = g_pCommon->cubeQueries.Begin([path](const GLuint64 nanoseconds) {
+    g_pCommon->cubeNanoseconds[path] += nanoseconds;
+    ++g_pCommon->cubeTimed[path];
+  });
+  glCullFace(GL_FRONT);
+  std::size_t draws = 0;
+  if (path == Common::LAYERED) {
+    // one draw per caster, the geometry shader copies it to its faces
+    cube.BeginLayered(dirty);
+    DrawScene(g_pCommon->MV_L, g_pCommon->P_L, 1, &g_pCommon->cubeDepthShader,
+              g_pCommon->casterFaces.data());
+    for (const auto mask : g_pCommon->casterFaces) {
+      draws += mask != 0 ? 1 : 0;
+    }
+  } else {
+    // every caster into every face, without the culling of the layered path
+    GLSLShader &faceShader = g_pCommon->cubeFaceShader;
+    for (int face = 0; face < CCubeShadowMap::FACES; ++face) {
+      if (((dirty >> face) & 1U) == 0) {
+        continue;
+      }
+      cube.BeginFace(face);
+      faceShader.Use();
+      glUniform1i(faceShader("face"), face);
+      DrawScene(g_pCommon->MV_L, g_pCommon->P_L, 1, &faceShader);
+      draws += Common::TOTAL_OBJECTS;
+    }
+  }
+  glCullFace(GL_BACK);
+  cube.End();
+  glDrawBuffer(GL_BACK_LEFT);
+  glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
+  if (timed) {
+    g_pCommon->cubeQueries.End();
+  }
+  ++g_pCommon->cubePasses[path];
+  g_pCommon->cubeDraws[path] += draws;
+  cache.EndFrame(dirty, active);
+}
+
+// Render the cascades of the light as a directional light, shining from its
+// position towards the centre of the scene, in one layered pass. Only the
+// cascades that moved with the camera or hold a changed caster are drawn;
+// the objects are static so their version stays 0
+void RenderCascades(const glm::mat4 &MV) {
+  CCascadedShadowMap &cascades = g_pCommon->cascades;
+  CShadowCache &cache = g_pCommon->cascadeCache;
+
+  g_pCommon->camera.SetViewMatrix(MV);
+  g_pCommon->camera.CalcFrustumPlanes();
+  const glm::vec3 lightDirection =
+      glm::length(g_pCommon->lightPosOS) > 0 ? -g_pCommon->lightPosOS
+                                             : glm::vec3(0, -1, 0);
+  cascades.Update(g_pCommon->camera, lightDirection);
+  cascades.CullCasters({g_pCommon->casterX, g_pCommon->casterY, g_pCommon->casterZ,
+                        g_pCommon->casterRadius, Common::TOTAL_OBJECTS},
+                       g_pCommon->casterCascades);
+
+  const CascadeBlock &block = cascades.GetBlock();
+  for (int c = 0; c < block.count; ++c) {
+    cache.SetLight(c, block.viewProjection[c]);
+  }
+  for (std::size_t object = 0; object < Common::TOTAL_OBJECTS; ++object) {
+    cache.SetCaster(object, 0, g_pCommon->casterCascades[object]);
+  }
+  // the cascades in use hold a caster or still have to be cleared
+  const CShadowCache::SlotMask dirty = cache.GetDirty();
+  CShadowCache::SlotMask active = dirty;
+  for (const auto mask : g_pCommon->casterCascades) {
+    active |= mask;
+  }
+  if (dirty != 0) {
+    for (auto &mask : g_pCommon->casterCascades) {
+      mask &= dirty;
+    }
+    cascades.BeginLayered(dirty);
+    glCullFace(GL_FRONT);
+    DrawScene(g_pCommon->MV_L, g_pCommon->P_L, 1, &g_pCommon->cascadeDepthShader,
+              g_pCommon->casterCascades.data());
+    glCullFace(GL_BACK);
+    cascades.End();
+    glDrawBuffer(GL_BACK_LEFT);
+    glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
+  }
+  cache.EndFrame(dirty, active);
+}
+
 // display callback function
 void OnRender() {
   GL_CHECK_ERRORS;
@@ -642,30 +1010,62 @@ void OnRender() {
   glm::mat4 Rx = glm::rotate(T, g_pCommon->rX, glm::vec3(1.0f, 0.0f, 0.0f));
   glm::mat4 MV = glm::rotate(Rx, g_pCommon->rY, glm::vec3(0.0f, 1.0f, 0.0f));
 
-  // 1) Render scene from the light's POV
-  // enable rendering to FBO
-  glBindFramebuffer(GL_FRAMEBUFFER, g_pCommon->fboID);
-  // clear depth buffer
-  glClear(GL_DEPTH_BUFFER_BIT);
-  // reset viewport to the shadow map texture size
-  glViewport(0, 0, Common::SHADOWMAP_WIDTH, Common::SHADOWMAP_HEIGHT);
-
-  // enable front face culling
-  glCullFace(GL_FRONT);
-  // draw scene from the point of view of light
-  DrawScene(g_pCommon->MV_L, g_pCommon->P_L);
-  // enable back face culling
-  glCullFace(GL_BACK);
-
-  // restore normal rendering path
-  // unbind FBO, set the default back buffer and reset the viewport to screen
-  // size
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  glDrawBuffer(GL_BACK_LEFT);
-  glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
+  if (g_pCommon->useCascades) {
+    // 1) Render the cascades that changed
+    RenderCascades(MV);
+
+    // 2) Render scene from point of view of eye with the cascade lookup
+    g_pCommon->cascadeShader.Use();
+    glUniform1i(g_pCommon->cascadeShader("bShowCascades"), g_pCommon->showCascades);
+    DrawScene(MV, g_pCommon->P, 0, &g_pCommon->cascadeShader);
+  } else if (g_pCommon->useCube) {
+    // 1) Render the faces of the cube shadow map that changed
+    RenderCubeShadow();
+
+    // 2) Render scene from point of view of eye with the cube map lookup
+    DrawScene(MV, g_pCommon->P, 0, &g_pCommon->cubeShader);
+  } else if (g_pCommon->useAtlas) {
+    // 1) Render the atlas tiles of the spot lights that changed
+    RenderAtlas(MV);
+
+    // 2) Render scene from point of view of eye lit by all spot lights
+    DrawScene(MV, g_pCommon->P, 0, &g_pCommon->atlasShader);
+  } else {
+    // 1) Render scene from the light's POV, the shadow map is kept while the
+    // light and the objects do not move; the objects are static so their
+    // version stays 0
+    g_pCommon->shadowCache.SetLight(0, g_pCommon->S);
+    for (std::size_t object = 0; object < Common::TOTAL_OBJECTS; ++object) {
+      g_pCommon->shadowCache.SetCaster(object, 0, 1);
+    }
+    const CShadowCache::SlotMask dirty = g_pCommon->shadowCache.GetDirty();
+    if (dirty != 0) {
+      // enable rendering to FBO
+      glBindFramebuffer(GL_FRAMEBUFFER, g_pCommon->fboID);
+      // clear depth buffer
+      glClear(GL_DEPTH_BUFFER_BIT);
+      // reset viewport to the shadow map texture size
+      glViewport(0, 0, Common::SHADOWMAP_WIDTH, Common::SHADOWMAP_HEIGHT);
+
+      // enable front face culling
+      glCullFace(GL_FRONT);
+      // draw scene from the point of view of light
+      DrawScene(g_pCommon->MV_L, g_pCommon->P_L);
+      // enable back face culling
+      glCullFace(GL_BACK);
+
+      // restore normal rendering path
+      // unbind FBO, set the default back buffer and reset the viewport to screen
+      // size
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glDrawBuffer(GL_BACK_LEFT);
+      glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
+    }
+    g_pCommon->shadowCache.EndFrame(dirty, 1);
 
-  // 2) Render scene from point of view of eye
-  DrawScene(MV, g_pCommon->P, 0);
+    // 2) Render scene from point of view of eye
+    DrawScene(MV, g_pCommon->P, 0);
+  }
 
   // bind light gizmo vertex array object
   glBindVertexArray(g_pCommon->lightVAOID);
@@ -684,8 +1084,73 @@ void OnRender() {
   // unbind the vertex array object
   glBindVertexArray(0);
 
+  char title[128];
+  if (g_pCommon->useCascades) {
+    std::snprintf(title, sizeof(title),
+                  "Cascaded Shadow Mapping - OpenGL 3.3 :: %d cascades, %.0f "
+                  "cascade passes skipped/s",
+                  g_pCommon->cascades.GetCascadeCount(),
+                  g_pCommon->cascadeCache.GetStats().skippedPerSecond);
+  } else if (g_pCommon->useCube) {
+    const int path = g_pCommon->cubePath;
+    const std::size_t timed = g_pCommon->cubeTimed[path];
+    std::snprintf(title, sizeof(title),
+                  "Cube Shadow Map (%s) - OpenGL 3.3 :: %.3f ms per shadow pass, "
+                  "%.0f face passes skipped/s",
+                  path == Common::LAYERED ? "layered" : "six pass",
+                  timed > 0 ? static_cast<double>(g_pCommon->cubeNanoseconds[path]) /
+                                  static_cast<double>(timed) * 1e-6
+                            : 0.0,
+                  g_pCommon->cubeCache.GetStats().skippedPerSecond);
+  } else if (g_pCommon->useAtlas) {
+    std::snprintf(title, sizeof(title),
+                  "Shadow Atlas - OpenGL 3.3 :: %d spot lights, %.0f shadow passes skipped/s",
+                  Common::SPOT_LIGHTS,
+                  g_pCommon->atlasCache.GetStats().skippedPerSecond);
+  } else {
+    std::snprintf(title, sizeof(title),
+                  "Directional Light - OpenGL 3.3 :: %.0f shadow passes skipped/s",
+                  g_pCommon->shadowCache.GetStats().skippedPerSecond);
+  }
+  glutSetWindowTitle(title);
+
   // swap front and back buffers to show the rendered result
   glutSwapBuffers();
+  g_pCommon->perFrameStream.EndFrame();
+}
+
+// keyboard handler, 'a' switches to the spot lights sharing the shadow
+// atlas, 'p' to the cube shadow map of the light and 's' between its layered
+// and six pass rendering, 'c' to the cascades of the light and 'v' shows the
+// cascade of each fragment
+void OnKey(unsigned char key, int /*x*/, int /*y*/) {
+  switch (key) {
+  case 'a':
+    g_pCommon->useAtlas    = !g_pCommon->useAtlas;
+    g_pCommon->useCube     = false;
+    g_pCommon->useCascades = false;
+    break;
+  case 'p':
+    g_pCommon->useCube     = !g_pCommon->useCube;
+    g_pCommon->useAtlas    = false;
+    g_pCommon->useCascades = false;
+    break;
+  case 'c':
+    g_pCommon->useCascades = !g_pCommon->useCascades;
+    g_pCommon->useAtlas    = false;
+    g_pCommon->useCube     = false;
+    break;
+  case 'v':
+    g_pCommon->showCascades = !g_pCommon->showCascades;
+    break;
+  case 's':
+    // draw every face again so the new path is measured right away
+    g_pCommon->cubePath = g_pCommon->cubePath == Common::LAYERED ? Common::SIX_PASS
+                                                                 : Common::LAYERED;
+    g_pCommon->cubeCache.Invalidate();
+    break;
+  }
+  glutPostRedisplay();
 }
 
 int main(int argc, char **argv) {
@@ -730,6 +1195,7 @@ int main(int argc, char **argv) {
   glutReshapeFunc(OnResize);
   glutMouseFunc(OnMouseDown);
   glutMotionFunc(OnMouseMove);
+  glutKeyboardFunc(OnKey);
   glutIdleFunc(OnIdle);
 
   // mainloop call
@@ -0,0 +1,16 @@
+#version 330 core
+
+//face matrices and light (CubeShadowBlock in Common)
+layout(std140) uniform CubeShadow {
+	mat4 cube_VP[6];		//projection * view per cube face
+	vec4 cube_light;		//light position, far plane in w
+};
+
+smooth in vec3 vWorldPosition;	//world space position
+
+void main()
+{
+	//distance to the light over the far plane, the same on every face so
+	//the lookup direction alone picks the texel
+	gl_FragDepth = length(vWorldPosition - cube_light.xyz)/cube_light.w;
+}
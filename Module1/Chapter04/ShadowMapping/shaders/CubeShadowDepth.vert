@@ -0,0 +1,16 @@
+#version 330 core
+  
+layout(location=0) in vec3 vVertex;		//per-vertex position
+
+//per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//surface's diffuse colour
+	vec4 specular_color;	//specular colour, shininess in a
+};
+
+void main()
+{ 	
+	//world space position, the geometry shader applies the face matrices
+	gl_Position = M*vec4(vVertex,1);
+}
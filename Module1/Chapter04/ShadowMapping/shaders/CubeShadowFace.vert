@@ -0,0 +1,28 @@
+#version 330 core
+  
+layout(location=0) in vec3 vVertex;		//per-vertex position
+
+//the cube face of this pass
+uniform int face;
+
+//per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//surface's diffuse colour
+	vec4 specular_color;	//specular colour, shininess in a
+};
+
+//face matrices and light (CubeShadowBlock in Common)
+layout(std140) uniform CubeShadow {
+	mat4 cube_VP[6];		//projection * view per cube face
+	vec4 cube_light;		//light position, far plane in w
+};
+
+smooth out vec3 vWorldPosition;	//world space position
+
+void main()
+{ 	
+	vec4 worldPosition = M*vec4(vVertex,1);
+	vWorldPosition = worldPosition.xyz;
+	gl_Position = cube_VP[face]*worldPosition;
+}
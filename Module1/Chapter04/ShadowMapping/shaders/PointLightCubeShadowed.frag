@@ -0,0 +1,50 @@
+#version 330 core
+
+layout(location=0) out vec4 vFragColor;	//fragment shader output
+
+//uniforms
+uniform samplerCubeShadow shadowCube;	//distance to the light per direction
+
+//per-pass uniforms, shared with the vertex shader
+layout(std140) uniform PerFrame {
+	mat4 V;					//view matrix
+	mat4 P;					//projection matrix
+	mat4 S;					//shadow matrix
+	vec4 light_position;	//light position in world space
+	int  bIsLightPass;		//flag to indicate the light pass
+};
+
+//per-draw uniforms, shared with the vertex shader
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//surface's diffuse colour
+	vec4 specular_color;	//specular colour, shininess in a
+};
+
+//face matrices and light (CubeShadowBlock in Common)
+layout(std140) uniform CubeShadow {
+	mat4 cube_VP[6];		//projection * view per cube face
+	vec4 cube_light;		//light position, far plane in w
+};
+
+//inputs from the vertex shader
+smooth in vec3 vEyeSpaceNormal;		//interpolated eye space normal
+smooth in vec3 vEyeSpacePosition;	//interpolated eye space position
+smooth in vec4 vWorldSpacePosition;	//interpolated world space position
+
+const float bias = 0.005;			//depth bias in units of the far plane
+
+void main() { 
+	//get the light vector in eye space
+	vec3 L = normalize((V*light_position).xyz - vEyeSpacePosition);
+	float diffuse = max(0, dot(normalize(vEyeSpaceNormal), L));
+
+	//the light to fragment vector picks the face and texel, its length is
+	//the reference depth
+	vec3 toFragment = vWorldSpacePosition.xyz - cube_light.xyz;
+	float shadow = texture(shadowCube, vec4(toFragment, length(toFragment)/cube_light.w - bias));
+	diffuse = mix(diffuse, diffuse*shadow, 0.5);
+
+	//return the final colour by multiplying the diffuse colour with the diffuse component
+	vFragColor = diffuse*vec4(diffuse_color.rgb, 1);	 
+}
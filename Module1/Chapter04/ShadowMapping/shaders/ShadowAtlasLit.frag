@@ -0,0 +1,79 @@
+#version 330 core
+
+layout(location=0) out vec4 vFragColor;	//fragment shader output
+
+const int MAX_LIGHTS = 32;
+
+//uniforms
+uniform sampler2DShadow shadowAtlas;			//shadow maps of all lights
+uniform vec4 lightPositions[MAX_LIGHTS];		//world space spot light positions
+uniform vec4 lightDirections[MAX_LIGHTS];		//world space spot directions
+uniform vec4 lightColors[MAX_LIGHTS];			//spot light colours
+uniform int  lightCount;						//number of spot lights
+
+//per-pass uniforms, shared with the vertex shader
+layout(std140) uniform PerFrame {
+	mat4 V;					//view matrix
+	mat4 P;					//projection matrix
+	mat4 S;					//shadow matrix
+	vec4 light_position;	//light position in world space
+	int  bIsLightPass;		//flag to indicate the light pass
+};
+
+//per-draw uniforms, shared with the vertex shader
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//surface's diffuse colour
+	vec4 specular_color;	//specular colour, shininess in a
+};
+
+//tile transform table of the atlas (AtlasBlock in Common)
+layout(std140) uniform ShadowAtlas {
+	mat4 atlas_S[MAX_LIGHTS];		//bias * projection * view per light
+	vec4 atlas_tile[MAX_LIGHTS];	//xy offset, zw scale of the light's tile
+	int  atlas_count;				//lights up to the last one with a tile
+};
+
+//inputs from the vertex shader
+smooth in vec3 vEyeSpaceNormal;		//interpolated eye space normal
+smooth in vec3 vEyeSpacePosition;	//interpolated eye space position
+smooth in vec4 vWorldSpacePosition;	//interpolated world space position
+
+const float cosOuterCone = 0.866;	//cos(30 degrees), the spot half angle
+const float cosInnerCone = 0.94;
+
+//1 when lit, 0 when in the shadow of light i
+float Shadow(int i) {
+	if(i >= atlas_count || atlas_tile[i].z == 0)
+		return 1;
+	vec4 coords = atlas_S[i]*vWorldSpacePosition;
+	//behind the light or outside its frustum
+	if(coords.w <= 0)
+		return 1;
+	coords.xyz /= coords.w;
+	if(any(lessThan(coords.xy, vec2(0))) || any(greaterThan(coords.xy, vec2(1))))
+		return 1;
+	//into the tile, half a texel inside so the filter stays in the tile
+	vec2 halfTexel = 0.5/vec2(textureSize(shadowAtlas, 0));
+	vec2 uv = clamp(atlas_tile[i].xy + coords.xy*atlas_tile[i].zw,
+					atlas_tile[i].xy + halfTexel,
+					atlas_tile[i].xy + atlas_tile[i].zw - halfTexel);
+	return texture(shadowAtlas, vec3(uv, coords.z));
+}
+
+void main() { 
+	vec3 N = normalize(vEyeSpaceNormal);
+	vec3 color = vec3(0.05);
+	for(int i = 0; i < lightCount; ++i) {
+		vec3 L = (V*lightPositions[i]).xyz - vEyeSpacePosition;
+		float d = length(L);
+		L /= d;
+		//spot cone with a soft edge
+		float spot = smoothstep(cosOuterCone, cosInnerCone,
+								dot(-L, normalize(mat3(V)*lightDirections[i].xyz)));
+		float diffuse = max(0, dot(N, L)) * spot;
+		if(diffuse > 0)
+			color += diffuse * mix(0.5, 1.0, Shadow(i)) * lightColors[i].rgb;
+	}
+	vFragColor = vec4(color*diffuse_color.rgb, 1);	 
+}
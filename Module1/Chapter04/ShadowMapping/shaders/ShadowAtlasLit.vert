@@ -0,0 +1,37 @@
+#version 330 core
+  
+layout(location=0) in vec3 vVertex;		//per-vertex position
+layout(location=1) in vec3 vNormal;		//per-vertex normal
+ 
+//per-pass uniforms, uploaded once per pass (PerFrameBlock in Common)
+layout(std140) uniform PerFrame {
+	mat4 V;					//view matrix
+	mat4 P;					//projection matrix
+	mat4 S;					//shadow matrix
+	vec4 light_position;	//light position in world space
+	int  bIsLightPass;		//flag to indicate the light pass
+};
+
+//per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//surface's diffuse colour
+	vec4 specular_color;	//specular colour, shininess in a
+};
+
+//shader outputs to the fragment shader
+smooth out vec3 vEyeSpaceNormal;		//eye space normal
+smooth out vec3 vEyeSpacePosition;		//eye space position
+smooth out vec4 vWorldSpacePosition;	//world space position, for the
+										//shadow matrix of every light
+
+void main()
+{ 	
+	//the scene only uses rigid transforms so the upper 3x3 of the
+	//modelview matrix doubles as the normal matrix
+	mat4 MV = V*M;
+	vWorldSpacePosition = M*vec4(vVertex,1);
+	vEyeSpacePosition   = (V*vWorldSpacePosition).xyz; 
+	vEyeSpaceNormal     = mat3(MV)*vNormal;
+	gl_Position         = P*V*vWorldSpacePosition; 
+}
@@ -3,6 +3,8 @@
 #include <GL/glew.h>
 
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
@@ -13,8 +15,14 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "CascadedShadowMap.hpp"
 #include "GLSLShader.hpp"
 #include "Grid.hpp"
+#include "OrbitCamera.hpp"
+#include "ShadowCache.hpp"
+#include "StreamingBuffer.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformBuffer.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
 
@@ -36,6 +44,14 @@ struct Common {
   // shadowmapping and flat shader
   GLSLShader shader, flatshader;
 
+  // per-pass camera/light data, every pass writes a fresh range so the
+  // data of passes still in flight is never overwritten
+  CStreamingBuffer perFrameStream;
+  GLsizeiptr perFrameAlignment = 256; // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+  // per-object model matrix and colour, one slot per scene object
+  CUniformBuffer perDrawUBO;
+  enum { PLANE = 0, CUBE, SPHERE, TOTAL_OBJECTS };
+
   // sphere vertex array and vertex buffer object IDs
   GLuint sphereVAOID;
   GLuint sphereVerticesVBO;
@@ -87,6 +103,24 @@ struct Common {
   glm::mat4 B;    // light bias matrix
   glm::mat4 BP;   // light bias and projection matrix combined
   glm::mat4 S;    // light's combined MVPB matrix
+
+  // cascaded shadow maps of the light as a directional light, 'c' toggles
+  // them and 'v' tints the fragments by cascade
+  GLSLShader cascadeShader, cascadeDepthShader;
+  CCascadedShadowMap cascades;
+  COrbitCamera camera;
+  bool useCascades = false;
+  bool showCascades = false;
+  // caster bounding spheres, one per scene object
+  float casterX[TOTAL_OBJECTS] = {0, -1, 1};
+  float casterY[TOTAL_OBJECTS] = {0, 1, 1};
+  float casterZ[TOTAL_OBJECTS] = {0, 0, 0};
+  float casterRadius[TOTAL_OBJECTS] = {70.72f, 1.7321f, 1.0f};
+  std::vector<CMultiViewCuller::ViewMask> casterCascades;
+
+  // a cascade or the single shadow map is only rendered again when its light
+  // matrix or a caster in it changed
+  CShadowCache shadowCache, cascadeCache;
 };
 static Common *g_pCommon = nullptr;
 
@@ -308,24 +342,66 @@ void OnInit() {
   // compile and link shader
   g_pCommon->shader.CreateAndLinkProgram();
   g_pCommon->shader.Use();
-  // add attributes and uniforms
-  g_pCommon->shader.AddAttribute("vVertex");
-  g_pCommon->shader.AddAttribute("vNormal");
-  g_pCommon->shader.AddUniform("MVP");
-  g_pCommon->shader.AddUniform("MV");
-  g_pCommon->shader.AddUniform("M");
-  g_pCommon->shader.AddUniform("N");
-  g_pCommon->shader.AddUniform("S");
-  g_pCommon->shader.AddUniform("light_position");
-  g_pCommon->shader.AddUniform("diffuse_color");
-  g_pCommon->shader.AddUniform("bIsLightPass");
-  g_pCommon->shader.AddUniform("shadowMap");
+  // uniforms and attributes are reflected at link time, only the uniform
+  // blocks need to be routed to their shared binding points
+  g_pCommon->shader.BindUniformBlock("PerFrame", UniformBinding::PER_FRAME);
+  g_pCommon->shader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
   // pass value of constant uniforms at initialization
   glUniform1i(g_pCommon->shader("shadowMap"), 0);
   g_pCommon->shader.UnUse();
 
+  // load the cascade depth and lighting shaders
+  g_pCommon->cascadeDepthShader.LoadFromFile(GL_VERTEX_SHADER,
+                                             "shaders/CascadeDepth.vert");
+  g_pCommon->cascadeDepthShader.LoadFromFile(GL_GEOMETRY_SHADER,
+                                             "shaders/CascadeDepth.geom");
+  g_pCommon->cascadeDepthShader.LoadFromFile(GL_FRAGMENT_SHADER,
+                                             "shaders/CascadeDepth.frag");
+  g_pCommon->cascadeDepthShader.CreateAndLinkProgram();
+  g_pCommon->cascadeDepthShader.BindUniformBlock("PerDraw",
+                                                 UniformBinding::PER_DRAW);
+  g_pCommon->cascadeDepthShader.BindUniformBlock("Cascades",
+                                                 UniformBinding::CASCADES);
+
+  g_pCommon->cascadeShader.LoadFromFile(GL_VERTEX_SHADER,
+                                        "shaders/CascadedShadowMapped.vert");
+  g_pCommon->cascadeShader.LoadFromFile(GL_FRAGMENT_SHADER,
+                                        "shaders/CascadedShadowMapped.frag");
+  g_pCommon->cascadeShader.CreateAndLinkProgram();
+  g_pCommon->cascadeShader.Use();
+  g_pCommon->cascadeShader.BindUniformBlock("PerFrame",
+                                            UniformBinding::PER_FRAME);
+  g_pCommon->cascadeShader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
+  g_pCommon->cascadeShader.BindUniformBlock("Cascades",
+                                            UniformBinding::CASCADES);
+  glUniform1i(g_pCommon->cascadeShader("shadowMaps"), 1);
+  g_pCommon->cascadeShader.UnUse();
+
   GL_CHECK_ERRORS;
 
+  // setup uniform buffers, the objects never move so the per-draw data is
+  // uploaded once here
+  // the per-frame ranges of a frame: one per cascade and the eye pass
+  GLint uboAlignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlignment);
+  g_pCommon->perFrameAlignment = uboAlignment;
+  const GLsizeiptr perFrameStride =
+      (static_cast<GLsizeiptr>(sizeof(PerFrameBlock)) + uboAlignment - 1) /
+      uboAlignment * uboAlignment;
+  g_pCommon->perFrameStream.Init(
+      GL_UNIFORM_BUFFER, perFrameStride * (2 + CCascadedShadowMap::MAX_CASCADES));
+  g_pCommon->perDrawUBO.Init(sizeof(PerDrawBlock), Common::TOTAL_OBJECTS);
+  g_pCommon->perDrawUBO.Update(
+      PerDrawBlock{glm::mat4(1), glm::vec4(1, 1, 1, 1)}, Common::PLANE);
+  g_pCommon->perDrawUBO.Update(
+      PerDrawBlock{glm::translate(glm::mat4(1), glm::vec3(-1, 1, 0)),
+                   glm::vec4(1, 0, 0, 1)},
+      Common::CUBE);
+  g_pCommon->perDrawUBO.Update(
+      PerDrawBlock{glm::translate(glm::mat4(1), glm::vec3(1, 1, 0)),
+                   glm::vec4(0, 0, 1, 1)},
+      Common::SPHERE);
+
   // setup sphere geometry
   CreateSphere(1.0f, 10, 10, g_pCommon->vertices, g_pCommon->indices);
 
@@ -500,6 +576,13 @@ void OnInit() {
   // unbind FBO
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+  // the cascades cover the first 40 units in front of the camera
+  g_pCommon->cascades.Init(1024, CCascadedShadowMap::MAX_CASCADES);
+  g_pCommon->cascades.SetMaxDistance(40.0f);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, g_pCommon->cascades.GetTexture());
+  glActiveTexture(GL_TEXTURE0);
+
   // set the light MV, P and bias matrices
   g_pCommon->MV_L = glm::lookAt(g_pCommon->lightPosOS, glm::vec3(0, 0, 0),
                                 glm::vec3(0, 1, 0));
@@ -514,14 +597,28 @@ void OnInit() {
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_CULL_FACE);
 
+  g_pCommon->shadowCache.Init(1);
+  g_pCommon->cascadeCache.Init(g_pCommon->cascades.GetCascadeCount());
+
   std::cout << "Initialization successfull" << std::endl;
 }
 
 // Release all allocated resources
 void OnShutdown() {
   glDeleteTextures(1, &g_pCommon->shadowMapTexID);
+  g_pCommon->cascades.PrintStats(std::cout);
+  g_pCommon->cascades.Destroy();
+  g_pCommon->shadowCache.PrintStats(std::cout);
+  g_pCommon->cascadeCache.PrintStats(std::cout);
   // Destroy shader
   g_pCommon->shader.DeleteShaderProgram();
+  g_pCommon->cascadeShader.DeleteShaderProgram();
+  g_pCommon->cascadeDepthShader.DeleteShaderProgram();
+
+  // Destroy uniform buffers
+  g_pCommon->perFrameStream.PrintStats(std::cout);
+  g_pCommon->perFrameStream.Destroy();
+  g_pCommon->perDrawUBO.Destroy();
   g_pCommon->flatshader.DeleteShaderProgram();
 
   // Destroy vao and vbo
@@ -552,88 +649,60 @@ void OnResize(int w, int h) {
 
   // setup the projection matrix
   g_pCommon->P =
-      glm::perspective(45.0f, static_cast<GLfloat>(w) / h, 0.1f, 1000.f);
+      glm::perspective(glm::radians(45.0f), static_cast<GLfloat>(w) / h, 0.1f,
+                       1000.f);
+  g_pCommon->camera.SetupProjection(45.0f, static_cast<GLfloat>(w) / h, 0.1f,
+                                    1000.f);
 }
 
 // idle callback just calls the display function
 void OnIdle() { glutPostRedisplay(); }
 
-// Scene rendering function
-void DrawScene(glm::mat4 View, glm::mat4 Proj, int isLightPass = 1) {
+// Scene rendering function, with the given program or the shadow mapping
+// shader; with view masks an object is drawn into the cascades of its
+// mask and skipped when it reaches none
+void DrawScene(const glm::mat4 &View, const glm::mat4 &Proj,
+               int isLightPass = 1, GLSLShader *program = nullptr,
+               const CMultiViewCuller::ViewMask *viewMasks = nullptr) {
   GL_CHECK_ERRORS;
 
+  // stream the camera and light data of this pass
+  PerFrameBlock frame;
+  frame.V = View;
+  frame.P = Proj;
+  frame.S = g_pCommon->S;
+  frame.lightPosition = glm::vec4(g_pCommon->lightPosOS, 1);
+  frame.isLightPass = isLightPass;
+  auto &stream = g_pCommon->perFrameStream;
+  const auto range = stream.Alloc(sizeof(PerFrameBlock), g_pCommon->perFrameAlignment);
+  std::memcpy(range.data, &frame, sizeof(frame));
+  stream.Commit();
+  glBindBufferRange(GL_UNIFORM_BUFFER, UniformBinding::PER_FRAME,
+                    stream.GetBuffer(), range.offset, sizeof(PerFrameBlock));
+
   // bind the current shader
-  g_pCommon->shader.Use();
+  GLSLShader &shader = program != nullptr ? *program : g_pCommon->shader;
+  shader.Use();
+  auto draw = [&](const int object, const GLuint vao, const GLsizei count) {
+    if (viewMasks != nullptr) {
+      if (viewMasks[object] == 0) {
+        return;
+      }
+      glUniform1i(shader("viewMask"), static_cast<GLint>(viewMasks[object]));
+    }
+    glBindVertexArray(vao);
+    g_pCommon->perDrawUBO.Bind(UniformBinding::PER_DRAW, object);
+    glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, nullptr);
+  };
   // render plane first
-  glBindVertexArray(g_pCommon->planeVAOID);
-  {
-    // set the shader uniforms
-    glUniform3fv(g_pCommon->shader("light_position"), 1,
-                 &(g_pCommon->lightPosOS.x));
-    glUniformMatrix4fv(g_pCommon->shader("S"), 1, GL_FALSE,
-                       glm::value_ptr(g_pCommon->S));
-    glUniformMatrix4fv(g_pCommon->shader("M"), 1, GL_FALSE,
-                       glm::value_ptr(glm::mat4(1)));
-    glUniform1i(g_pCommon->shader("bIsLightPass"), isLightPass);
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE,
-                       glm::value_ptr(Proj * View));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE,
-                       glm::value_ptr(View));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
-                       glm::value_ptr(glm::inverseTranspose(glm::mat3(View))));
-    glUniform3f(g_pCommon->shader("diffuse_color"), 1.0f, 1.0f, 1.0f);
-    // draw plane triangles
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr);
-  }
-
+  draw(Common::PLANE, g_pCommon->planeVAOID, 6);
   // render the cube
-  glBindVertexArray(g_pCommon->cubeVAOID);
-  {
-    // set the cube's transform
-    glm::mat4 T = glm::translate(glm::mat4(1), glm::vec3(-1, 1, 0));
-    glm::mat4 M = T;
-    glm::mat4 MV = View * M;
-    glm::mat4 MVP = Proj * MV;
-    // pass shader uniforms
-    glUniformMatrix4fv(g_pCommon->shader("S"), 1, GL_FALSE,
-                       glm::value_ptr(g_pCommon->S));
-    glUniformMatrix4fv(g_pCommon->shader("M"), 1, GL_FALSE, glm::value_ptr(M));
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE,
-                       glm::value_ptr(MVP));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE,
-                       glm::value_ptr(MV));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
-                       glm::value_ptr(glm::inverseTranspose(glm::mat3(MV))));
-    glUniform3f(g_pCommon->shader("diffuse_color"), 1.0f, 0.0f, 0.0f);
-    // draw cube triangles
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, nullptr);
-  }
+  draw(Common::CUBE, g_pCommon->cubeVAOID, 36);
   // render the sphere
-  glBindVertexArray(g_pCommon->sphereVAOID);
-  {
-    // set the sphere's transform
-    glm::mat4 T = glm::translate(glm::mat4(1), glm::vec3(1, 1, 0));
-    glm::mat4 M = T;
-    glm::mat4 MV = View * M;
-    glm::mat4 MVP = Proj * MV;
-    // set the shader uniforms
-    glUniformMatrix4fv(g_pCommon->shader("S"), 1, GL_FALSE,
-                       glm::value_ptr(g_pCommon->S));
-    glUniformMatrix4fv(g_pCommon->shader("M"), 1, GL_FALSE, glm::value_ptr(M));
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE,
-                       glm::value_ptr(MVP));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE,
-                       glm::value_ptr(MV));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
-                       glm::value_ptr(glm::inverseTranspose(glm::mat3(MV))));
-    glUniform3f(g_pCommon->shader("diffuse_color"), 0.0f, 0.0f, 1.0f);
-    // draw sphere triangles
-    glDrawElements(GL_TRIANGLES, g_pCommon->totalSphereTriangles,
-                   GL_UNSIGNED_SHORT, nullptr);
-  }
+  draw(Common::SPHERE, g_pCommon->sphereVAOID, g_pCommon->totalSphereTriangles);
 
   // unbind shader
-  g_pCommon->shader.UnUse();
+  shader.UnUse();
 
   GL_CHECK_ERRORS;
 }
@@ -651,31 +720,90 @@ void OnRender() {
   auto Rx = glm::rotate(T, g_pCommon->rX, glm::vec3(1.0f, 0.0f, 0.0f));
   auto MV = glm::rotate(Rx, g_pCommon->rY, glm::vec3(0.0f, 1.0f, 0.0f));
 
-  // 1) Render scene from the light's POV
-  // enable rendering to FBO
-  glBindFramebuffer(GL_FRAMEBUFFER, g_pCommon->fboID);
-  // clear depth buffer
-  glClear(GL_DEPTH_BUFFER_BIT);
-  // reset viewport to the shadow map texture size
-  glViewport(0, 0, Common::SHADOWMAP_WIDTH, Common::SHADOWMAP_HEIGHT);
-
-  // enable front face culling
-  glCullFace(GL_FRONT);
-  // draw scene from the point of view of light
-  DrawScene(g_pCommon->MV_L, g_pCommon->P_L);
-  // enable back face culling
-  glCullFace(GL_BACK);
-
-  // restore normal rendering path
-  // unbind FBO, set the default back buffer and reset the viewport to screen
-  // size
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  glDrawBuffer(GL_BACK_LEFT);
-  glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
+  if (g_pCommon->useCascades) {
+    // 1) Render all cascades in one layered pass, the light shines from its
+    // position towards the centre of the scene
+    g_pCommon->camera.SetViewMatrix(MV);
+    g_pCommon->camera.CalcFrustumPlanes();
+    const glm::vec3 lightDirection =
+        glm::length(g_pCommon->lightPosOS) > 0 ? -g_pCommon->lightPosOS
+                                               : glm::vec3(0, -1, 0);
+    g_pCommon->cascades.Update(g_pCommon->camera, lightDirection);
+    g_pCommon->cascades.CullCasters({g_pCommon->casterX, g_pCommon->casterY,
+                                     g_pCommon->casterZ, g_pCommon->casterRadius,
+                                     Common::TOTAL_OBJECTS},
+                                    g_pCommon->casterCascades);
+
+    // only the cascades that moved or hold a changed caster are drawn, the
+    // objects are static so their version stays 0
+    CShadowCache &cache = g_pCommon->cascadeCache;
+    const CascadeBlock &block = g_pCommon->cascades.GetBlock();
+    for (int c = 0; c < block.count; ++c) {
+      cache.SetLight(c, block.viewProjection[c]);
+    }
+    for (std::size_t object = 0; object < Common::TOTAL_OBJECTS; ++object) {
+      cache.SetCaster(object, 0, g_pCommon->casterCascades[object]);
+    }
+    // the cascades in use hold a caster or still have to be cleared
+    const CShadowCache::SlotMask dirty = cache.GetDirty();
+    CShadowCache::SlotMask active = dirty;
+    for (const auto mask : g_pCommon->casterCascades) {
+      active |= mask;
+    }
+    if (dirty != 0) {
+      for (auto &mask : g_pCommon->casterCascades) {
+        mask &= dirty;
+      }
+      g_pCommon->cascades.BeginLayered(dirty);
+      glCullFace(GL_FRONT);
+      DrawScene(g_pCommon->MV_L, g_pCommon->P_L, 1, &g_pCommon->cascadeDepthShader,
+                g_pCommon->casterCascades.data());
+      glCullFace(GL_BACK);
+      g_pCommon->cascades.End();
+    }
+    cache.EndFrame(dirty, active);
+
+    // 2) Render scene from point of view of eye with the cascade lookup
+    glDrawBuffer(GL_BACK_LEFT);
+    glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
+    g_pCommon->cascadeShader.Use();
+    glUniform1i(g_pCommon->cascadeShader("bShowCascades"), g_pCommon->showCascades);
+    DrawScene(MV, g_pCommon->P, 0, &g_pCommon->cascadeShader);
+  } else {
+    // 1) Render scene from the light's POV when the light moved
+    g_pCommon->shadowCache.SetLight(0, g_pCommon->S);
+    for (std::size_t object = 0; object < Common::TOTAL_OBJECTS; ++object) {
+      g_pCommon->shadowCache.SetCaster(object, 0, 1);
+    }
+    const CShadowCache::SlotMask dirty = g_pCommon->shadowCache.GetDirty();
+    if (dirty != 0) {
+      // enable rendering to FBO
+      glBindFramebuffer(GL_FRAMEBUFFER, g_pCommon->fboID);
+      // clear depth buffer
+      glClear(GL_DEPTH_BUFFER_BIT);
+      // reset viewport to the shadow map texture size
+      glViewport(0, 0, Common::SHADOWMAP_WIDTH, Common::SHADOWMAP_HEIGHT);
+
+      // enable front face culling
+      glCullFace(GL_FRONT);
+      // draw scene from the point of view of light
+      DrawScene(g_pCommon->MV_L, g_pCommon->P_L);
+      // enable back face culling
+      glCullFace(GL_BACK);
+
+      // restore normal rendering path
+      // unbind FBO, set the default back buffer and reset the viewport to screen
+      // size
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glDrawBuffer(GL_BACK_LEFT);
+      glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
+    }
+    g_pCommon->shadowCache.EndFrame(dirty, 1);
 
-  // 2) Render scene from point of view of eye
-  glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
-  DrawScene(MV, g_pCommon->P, 0);
+    // 2) Render scene from point of view of eye
+    glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
+    DrawScene(MV, g_pCommon->P, 0);
+  }
 
   // bind light gizmo vertex array object
   glBindVertexArray(g_pCommon->lightVAOID);
@@ -694,8 +822,17 @@ void OnRender() {
   // unbind the vertex array object
   glBindVertexArray(0);
 
+  char title[128];
+  std::snprintf(title, sizeof(title), "%s - OpenGL 3.3 :: %.0f shadow passes skipped/s",
+                g_pCommon->useCascades ? "Cascaded Shadow Mapping" : "Directional Light",
+                (g_pCommon->useCascades ? g_pCommon->cascadeCache : g_pCommon->shadowCache)
+                    .GetStats()
+                    .skippedPerSecond);
+  glutSetWindowTitle(title);
+
   // swap front and back buffers to show the rendered result
   glutSwapBuffers();
+  g_pCommon->perFrameStream.EndFrame();
 }
 
 // mouse wheel scroll handler which changes the radius of the light source
@@ -726,6 +863,20 @@ void OnMouseWheel(int /*button*/, int dir, int /*x*/, int /*y*/) {
   glutPostRedisplay();
 }
 
+// keyboard handler, 'c' switches between the single shadow map and the
+// cascades, 'v' shows the cascade of each fragment
+void OnKey(unsigned char key, int /*x*/, int /*y*/) {
+  switch (key) {
+  case 'c':
+    g_pCommon->useCascades = !g_pCommon->useCascades;
+    break;
+  case 'v':
+    g_pCommon->showCascades = !g_pCommon->showCascades;
+    break;
+  }
+  glutPostRedisplay();
+}
+
 int main(int argc, char **argv) {
   Common common;
   g_pCommon = &common;
@@ -769,6 +920,7 @@ int main(int argc, char **argv) {
   glutMouseFunc(OnMouseDown);
   glutMotionFunc(OnMouseMove);
   glutMouseWheelFunc(OnMouseWheel);
+  glutKeyboardFunc(OnKey);
   glutIdleFunc(OnIdle);
 
   // mainloop call
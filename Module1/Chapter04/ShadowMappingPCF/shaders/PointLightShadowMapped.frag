@@ -3,12 +3,24 @@
 layout(location=0) out vec4 vFragColor;	//fragment shader output
 
 //uniforms
-uniform mat4 MV;					//modelview matrix
 uniform sampler2DShadow shadowMap;	//shadowmap texture
-uniform vec3 light_position;		//light position in object space
-uniform vec3 diffuse_color;			//surface's diffuse colour
-uniform bool bIsLightPass;			//flag to indicate the light pass
-									//we donot cast shadows in light pass
+
+//per-pass uniforms, shared with the vertex shader
+layout(std140) uniform PerFrame {
+	mat4 V;					//view matrix
+	mat4 P;					//projection matrix
+	mat4 S;					//shadow matrix
+	vec4 light_position;	//light position in world space
+	int  bIsLightPass;		//flag to indicate the light pass
+							//we donot cast shadows in light pass
+};
+
+//per-draw uniforms, shared with the vertex shader
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//surface's diffuse colour
+	vec4 specular_color;	//specular colour, shininess in a
+};
 
 //inputs from the vertex shader
 smooth in vec3 vEyeSpaceNormal;		//interpolated eye space normal
@@ -24,11 +36,11 @@ void main() {
 	//if this is the light pass, we donot cast shadows and simply return
 	//since we only require depth which is stored in the depth attachment
 	//of FBO
-	if(bIsLightPass)
+	if(bIsLightPass != 0)
 		return;
 		 
 	//get light position in eye space
-	vec4 vEyeSpaceLightPosition = MV*vec4(light_position,1);
+	vec4 vEyeSpaceLightPosition = V*light_position;
 	
 	//get the light vector
 	vec3 L = (vEyeSpaceLightPosition.xyz-vEyeSpacePosition);
@@ -56,5 +68,5 @@ void main() {
 	}
 
 	//return the final colour by multiplying the diffuse colour with the diffuse component
-	vFragColor = diffuse*vec4(diffuse_color, 1);	 
+	vFragColor = diffuse*vec4(diffuse_color.rgb, 1);	 
 }
\ No newline at end of file
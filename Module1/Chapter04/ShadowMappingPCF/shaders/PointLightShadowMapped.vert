@@ -3,12 +3,21 @@
 layout(location=0) in vec3 vVertex;		//per-vertex position
 layout(location=1) in vec3 vNormal;		//per-vertex normal
  
-//uniforms
-uniform mat4 MVP;	//modelview projection matrix
-uniform mat4 MV;	//modelview matrix
-uniform mat4 M;		//model matrix
-uniform mat3 N;		//normal matrix
-uniform mat4 S;		//shadow matrix
+//per-pass uniforms, uploaded once per pass (PerFrameBlock in Common)
+layout(std140) uniform PerFrame {
+	mat4 V;					//view matrix
+	mat4 P;					//projection matrix
+	mat4 S;					//shadow matrix
+	vec4 light_position;	//light position in world space
+	int  bIsLightPass;		//flag to indicate the light pass
+};
+
+//per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//surface's diffuse colour
+	vec4 specular_color;	//specular colour, shininess in a
+};
 
 //shader outputs to the fragment shader
 smooth out vec3 vEyeSpaceNormal;		//eye space normal
@@ -17,13 +26,17 @@ smooth out vec4 vShadowCoords;			//shadow coordinates
 
 void main()
 { 	
+	//the scene only uses rigid transforms so the upper 3x3 of the
+	//modelview matrix doubles as the normal matrix
+	mat4 MV = V*M;
+
 	//multiply the object space vertex position with the modelview matrix 
 	//to get the eye space vertex position
 	vEyeSpacePosition = (MV*vec4(vVertex,1)).xyz; 
 
 	//multiply the object space normal with the normal matrix 
 	//to get the eye space normal
-	vEyeSpaceNormal   = N*vNormal;
+	vEyeSpaceNormal   = mat3(MV)*vNormal;
 
 	//multiply the world space vertex position with the shadow matrix 
 	//to get the shadow coordinates
@@ -31,6 +44,5 @@ void main()
 
 	//multiply the combined modelview projection matrix with the object space vertex
 	//position to get the clip space position
-    gl_Position       = MVP*vec4(vVertex,1); 
+    gl_Position       = P*MV*vec4(vVertex,1); 
 }
- 
\ No newline at end of file
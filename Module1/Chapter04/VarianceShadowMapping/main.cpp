@@ -1,6 +1,7 @@
 #include <GL/glew.h>
 
 #include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <vector>
 
@@ -11,8 +12,13 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "CascadedShadowMap.hpp"
 #include "GLSLShader.hpp"
+#include "OrbitCamera.hpp"
+#include "ProgramCache.hpp"
+#include "QueryPool.hpp"
 #include "Grid.hpp"
+#include "ShadowCache.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
 
@@ -94,6 +100,66 @@ struct Common {
   // filtering FBO colour attachment texture
   GLuint blurTexID[2];
 
+  // the light and blur passes only run when the light moved, 'r' runs them
+  // every frame to measure the blur
+  CShadowCache shadowCache;
+  bool rebuildEveryFrame = false;
+
+  // layouts of the moments, 'f' cycles them: the variance shadow map and the
+  // exponential variance shadow map (EVSM) in full and half precision. EVSM
+  // stores exp(c*d) and -exp(-c*d) with their squares, the larger the
+  // exponent c the less light bleeds through overlapping casters, but the
+  // second moment exp(2c) has to fit the format; '+' and '-' change c.
+  enum { VSM_RGBA32F = 0, EVSM_RGBA32F, EVSM_RGBA16F, EVSM_RG16F, FORMATS };
+  struct MomentFormat {
+    const char *name;
+    GLenum internalFormat;
+    GLsizei bytesPerTexel;
+    float maxExponent; // 0 without the exponential warp
+  };
+  static constexpr MomentFormat formats[FORMATS] = {
+      {"VSM RGBA32F", GL_RGBA32F, 16, 0.0f},
+      {"EVSM RGBA32F", GL_RGBA32F, 16, 42.0f}, // exp(2c) < 3.4e38
+      {"EVSM RGBA16F", GL_RGBA16F, 8, 5.54f},  // exp(2c) < 65504
+      {"EVSM RG16F", GL_RG16F, 4, 5.54f}};     // positive moments only
+  int momentFormat = VSM_RGBA32F;
+  float exponent = 0.0f;
+  glm::vec4 border = glm::vec4(1, 0, 0, 0); // moments outside the shadow map
+  GLSLShader evsmShader;    // EVSM main shader
+  GLSLShader evsmFirstStep; // first step shader for the warped moments
+
+  // the separable blur as two fragment passes or, with a GL 4.3 context, as
+  // two compute passes that stage each row or column
+  // segment in shared memory; 'b' switches between them
+  enum { FRAGMENT_BLUR = 0, COMPUTE_BLUR, BLUR_PATHS };
+  static constexpr GLuint BLUR_TILE = 128; // local_size_x of VsmBlur.comp
+  GLSLShader blurCompute;
+  bool computeSupported = false;
+  int blurPath = FRAGMENT_BLUR;
+  // GPU time of the blur per moment format and path
+  CQueryPool blurQueries;
+  std::size_t blurTimed[FORMATS][BLUR_PATHS] = {};
+  GLuint64 blurNanoseconds[FORMATS][BLUR_PATHS] = {};
+
+  // cascaded moments of the light as a directional light, 'c' toggles them
+  // and 'v' tints the fragments by cascade. The moments of a cascade are
+  // filtered through their mipmaps only, the separable blur works on the
+  // single shadow map
+  GLSLShader cascadeShader;  // cascade lookup with the Chebyshev bound
+  GLSLShader cascadeMoments; // layered moments pass
+  CCascadedShadowMap cascades;
+  CShadowCache cascadeCache; // one slot per cascade
+  COrbitCamera camera;
+  bool useCascades = false;
+  bool showCascades = false;
+  // caster bounding spheres of the plane, cube and sphere
+  enum { PLANE = 0, CUBE, SPHERE, TOTAL_OBJECTS };
+  float casterX[TOTAL_OBJECTS] = {0, -1, 1};
+  float casterY[TOTAL_OBJECTS] = {0, 1, 1};
+  float casterZ[TOTAL_OBJECTS] = {0, 0, 0};
+  float casterRadius[TOTAL_OBJECTS] = {70.72f, 1.7321f, 1.0f};
+  std::vector<CMultiViewCuller::ViewMask> casterCascades;
+
   glm::mat4 MV_L; // light modelview matrix
   glm::mat4 P_L;  // light projection matrix
   glm::mat4 B;    // light bias matrix
@@ -305,6 +371,74 @@ void OnMouseMove(int x, int y) {
   glutPostRedisplay();
 }
 
+// Size of the moment textures of the given format in MB, the shadow map with
+// its 4 mip levels and both blur targets
+double MomentMegabytes(int format) {
+  const double texels =
+      static_cast<double>(Common::SHADOWMAP_WIDTH * Common::SHADOWMAP_HEIGHT);
+  const double mipChain = 1.0 + 1.0 / 4 + 1.0 / 16 + 1.0 / 64 + 1.0 / 256;
+  return (mipChain + 2.0) * texels * Common::formats[format].bytesPerTexel /
+         (1024.0 * 1024.0);
+}
+
+// Reallocate the shadow map and blur textures for the given moment format and
+// pass the exponential warp to the shaders; the filtered shadow map is
+// rendered again on the next frame
+void SetMoments(int format, float exponent) {
+  const Common::MomentFormat &moments = Common::formats[format];
+  g_pCommon->momentFormat = format;
+  g_pCommon->exponent = exponent;
+
+  // the moments of the far plane so clamp to border stays unshadowed
+  if (moments.maxExponent > 0) {
+    g_pCommon->border =
+        glm::vec4(std::exp(exponent), std::exp(2 * exponent),
+                  -std::exp(-exponent), std::exp(-2 * exponent));
+  } else {
+    g_pCommon->border = glm::vec4(1, 0, 0, 0);
+  }
+
+  // the shadow map on texture unit 0 and the blur targets on units 1 and 2
+  // keep their units and framebuffer attachments
+  const GLuint textures[3] = {g_pCommon->shadowMapTexID,
+                              g_pCommon->blurTexID[0],
+                              g_pCommon->blurTexID[1]};
+  for (int i = 0; i < 3; i++) {
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_2D, textures[i]);
+    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR,
+                     glm::value_ptr(g_pCommon->border));
+    glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(moments.internalFormat),
+                 Common::SHADOWMAP_WIDTH, Common::SHADOWMAP_HEIGHT, 0, GL_RGBA,
+                 GL_FLOAT, nullptr);
+  }
+  // the shadow map is mipmapped
+  glActiveTexture(GL_TEXTURE0);
+  glGenerateMipmap(GL_TEXTURE_2D);
+
+  g_pCommon->evsmFirstStep.Use();
+  glUniform1f(g_pCommon->evsmFirstStep("exponent"), exponent);
+  g_pCommon->evsmShader.Use();
+  glUniform1f(g_pCommon->evsmShader("exponent"), exponent);
+  glUniform1i(g_pCommon->evsmShader("useNegative"),
+              moments.internalFormat != GL_RG16F);
+  g_pCommon->evsmShader.UnUse();
+
+  // the cascades store the same moments, plain ones with a zero exponent
+  g_pCommon->cascades.SetMoments(moments.internalFormat, g_pCommon->border);
+  g_pCommon->cascadeMoments.Use();
+  glUniform1f(g_pCommon->cascadeMoments("exponent"), exponent);
+  g_pCommon->cascadeShader.Use();
+  glUniform1f(g_pCommon->cascadeShader("exponent"), exponent);
+  glUniform1i(g_pCommon->cascadeShader("useNegative"),
+              moments.internalFormat != GL_RG16F);
+  g_pCommon->cascadeShader.UnUse();
+
+  g_pCommon->shadowCache.Invalidate();
+  g_pCommon->cascadeCache.Invalidate();
+  GL_CHECK_ERRORS;
+}
+
 // OpenGL initialization
 void OnInit() {
   // Load the flat shader
@@ -390,6 +524,119 @@ void OnInit() {
   g_pCommon->shader.UnUse();
   GL_CHECK_ERRORS;
 
+  // load the EVSM first step shader
+  g_pCommon->evsmFirstStep.LoadFromFile(GL_VERTEX_SHADER,
+                                        "shaders/firstStep.vert");
+  g_pCommon->evsmFirstStep.LoadFromFile(GL_FRAGMENT_SHADER,
+                                        "shaders/EvsmFirstStep.frag");
+  // compile and link shader
+  g_pCommon->evsmFirstStep.CreateAndLinkProgram();
+  g_pCommon->evsmFirstStep.Use();
+  // add attributes and uniforms
+  g_pCommon->evsmFirstStep.AddAttribute("vVertex");
+  g_pCommon->evsmFirstStep.AddUniform("MVP");
+  g_pCommon->evsmFirstStep.AddUniform("exponent");
+  g_pCommon->evsmFirstStep.UnUse();
+  GL_CHECK_ERRORS;
+
+  // load the EVSM shader
+  g_pCommon->evsmShader.LoadFromFile(GL_VERTEX_SHADER,
+                                     "shaders/VarianceShadowMapping.vert");
+  g_pCommon->evsmShader.LoadFromFile(GL_FRAGMENT_SHADER,
+                                     "shaders/EvsmShadowMapping.frag");
+  // compile and link shader
+  g_pCommon->evsmShader.CreateAndLinkProgram();
+  g_pCommon->evsmShader.Use();
+  // add attributes and uniforms
+  g_pCommon->evsmShader.AddAttribute("vVertex");
+  g_pCommon->evsmShader.AddAttribute("vNormal");
+  g_pCommon->evsmShader.AddUniform("MVP");
+  g_pCommon->evsmShader.AddUniform("MV");
+  g_pCommon->evsmShader.AddUniform("M");
+  g_pCommon->evsmShader.AddUniform("N");
+  g_pCommon->evsmShader.AddUniform("S");
+  g_pCommon->evsmShader.AddUniform("light_position");
+  g_pCommon->evsmShader.AddUniform("diffuse_color");
+  g_pCommon->evsmShader.AddUniform("shadowMap");
+  g_pCommon->evsmShader.AddUniform("exponent");
+  g_pCommon->evsmShader.AddUniform("useNegative");
+  // pass value of constant uniforms at initialization
+  glUniform1i(g_pCommon->evsmShader("shadowMap"), 2);
+  g_pCommon->evsmShader.UnUse();
+  GL_CHECK_ERRORS;
+
+  // load the layered moments pass, the geometry shader routing the
+  // triangles to their cascades comes from Common/shaders
+  g_pCommon->cascadeMoments.LoadFromFile(GL_VERTEX_SHADER,
+                                         "shaders/CascadeMoments.vert");
+  g_pCommon->cascadeMoments.LoadFromFile(GL_GEOMETRY_SHADER,
+                                         "shaders/CascadeDepth.geom");
+  g_pCommon->cascadeMoments.LoadFromFile(GL_FRAGMENT_SHADER,
+                                         "shaders/CascadeMoments.frag");
+  // compile and link shader
+  g_pCommon->cascadeMoments.CreateAndLinkProgram();
+  g_pCommon->cascadeMoments.Use();
+  // add attributes and uniforms
+  g_pCommon->cascadeMoments.AddAttribute("vVertex");
+  g_pCommon->cascadeMoments.AddUniform("M");
+  g_pCommon->cascadeMoments.AddUniform("viewMask");
+  g_pCommon->cascadeMoments.AddUniform("exponent");
+  g_pCommon->cascadeMoments.BindUniformBlock("Cascades",
+                                             UniformBinding::CASCADES);
+  g_pCommon->cascadeMoments.UnUse();
+  GL_CHECK_ERRORS;
+
+  // load the cascaded variance shadow mapping shader
+  g_pCommon->cascadeShader.LoadFromFile(
+      GL_VERTEX_SHADER, "shaders/CascadedVarianceShadowMapping.vert");
+  g_pCommon->cascadeShader.LoadFromFile(
+      GL_FRAGMENT_SHADER, "shaders/CascadedVarianceShadowMapping.frag");
+  // compile and link shader
+  g_pCommon->cascadeShader.CreateAndLinkProgram();
+  g_pCommon->cascadeShader.Use();
+  // add attributes and uniforms
+  g_pCommon->cascadeShader.AddAttribute("vVertex");
+  g_pCommon->cascadeShader.AddAttribute("vNormal");
+  g_pCommon->cascadeShader.AddUniform("MVP");
+  g_pCommon->cascadeShader.AddUniform("MV");
+  g_pCommon->cascadeShader.AddUniform("M");
+  g_pCommon->cascadeShader.AddUniform("N");
+  g_pCommon->cascadeShader.AddUniform("S");
+  g_pCommon->cascadeShader.AddUniform("light_position");
+  g_pCommon->cascadeShader.AddUniform("diffuse_color");
+  g_pCommon->cascadeShader.AddUniform("shadowMaps");
+  g_pCommon->cascadeShader.AddUniform("exponent");
+  g_pCommon->cascadeShader.AddUniform("useNegative");
+  g_pCommon->cascadeShader.AddUniform("bShowCascades");
+  g_pCommon->cascadeShader.BindUniformBlock("Cascades",
+                                            UniformBinding::CASCADES);
+  // pass value of constant uniforms at initialization
+  glUniform1i(g_pCommon->cascadeShader("shadowMaps"), 3);
+  g_pCommon->cascadeShader.UnUse();
+  GL_CHECK_ERRORS;
+
+  // load the shared memory blur when the context runs #version 430 shaders,
+  // ARB_compute_shader alone does not raise the GLSL version of a 3.3 context
+  g_pCommon->computeSupported = GLEW_VERSION_4_3;
+  if (g_pCommon->computeSupported) {
+    g_pCommon->blurCompute.LoadFromFile(GL_COMPUTE_SHADER,
+                                        "shaders/VsmBlur.comp");
+    g_pCommon->blurCompute.CreateAndLinkProgram();
+    g_pCommon->blurCompute.Use();
+    g_pCommon->blurCompute.AddUniform("textureMap");
+    g_pCommon->blurCompute.AddUniform("blurredMap");
+    g_pCommon->blurCompute.AddUniform("direction");
+    g_pCommon->blurCompute.AddUniform("border");
+    // the output is bound to image unit 0
+    glUniform1i(g_pCommon->blurCompute("blurredMap"), 0);
+    g_pCommon->blurCompute.UnUse();
+    GL_CHECK_ERRORS;
+  } else {
+    std::cout << "Compute shaders are not supported, blurring with fragment "
+                 "shaders only." << std::endl;
+  }
+  g_pCommon->blurQueries.Init(GL_TIME_ELAPSED, 8);
+
   // setup sphere geometry
   CreateSphere(1.0f, 10, 10, g_pCommon->vertices, g_pCommon->indices);
 
@@ -659,6 +906,19 @@ void OnInit() {
   glEnable(GL_CULL_FACE);
   glCullFace(GL_BACK);
 
+  g_pCommon->shadowCache.Init(1);
+
+  // the cascades cover the first 40 units in front of the camera, their
+  // moments are bound to texture unit 3
+  g_pCommon->cascades.Init(Common::SHADOWMAP_WIDTH,
+                           CCascadedShadowMap::MAX_CASCADES,
+                           Common::formats[g_pCommon->momentFormat].internalFormat);
+  g_pCommon->cascades.SetMaxDistance(40.0f);
+  g_pCommon->cascadeCache.Init(g_pCommon->cascades.GetCascadeCount());
+  glActiveTexture(GL_TEXTURE3);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, g_pCommon->cascades.GetMomentTexture());
+  glActiveTexture(GL_TEXTURE0);
+
   std::cout << "Initialization successfull" << std::endl;
 }
 
@@ -673,6 +933,13 @@ void OnShutdown() {
   g_pCommon->firstStep.DeleteShaderProgram();
   g_pCommon->gaussianH_shader.DeleteShaderProgram();
   g_pCommon->gaussianV_shader.DeleteShaderProgram();
+  g_pCommon->evsmShader.DeleteShaderProgram();
+  g_pCommon->evsmFirstStep.DeleteShaderProgram();
+  if (g_pCommon->computeSupported) {
+    g_pCommon->blurCompute.DeleteShaderProgram();
+  }
+  g_pCommon->cascadeShader.DeleteShaderProgram();
+  g_pCommon->cascadeMoments.DeleteShaderProgram();
 
   // Destroy vao and vbo
   glDeleteBuffers(1, &g_pCommon->sphereVerticesVBO);
@@ -698,6 +965,30 @@ void OnShutdown() {
   glDeleteFramebuffers(1, &g_pCommon->filterFBOID);
   glDeleteRenderbuffers(1, &g_pCommon->rboID);
 
+  CProgramCache::Instance().PrintStats(std::cout);
+  g_pCommon->shadowCache.PrintStats(std::cout);
+  g_pCommon->cascades.PrintStats(std::cout);
+  g_pCommon->cascadeCache.PrintStats(std::cout);
+  g_pCommon->cascades.Destroy();
+
+  // blur time and moment memory per format against the RGBA32F fragment blur
+  g_pCommon->blurQueries.PrintStats(std::cout);
+  const char *pathNames[Common::BLUR_PATHS] = {"fragment", "compute"};
+  for (int format = 0; format < Common::FORMATS; ++format) {
+    std::cout << "Moments " << Common::formats[format].name << ": "
+              << MomentMegabytes(format) << " MB";
+    for (int path = 0; path < Common::BLUR_PATHS; ++path) {
+      const std::size_t timed = g_pCommon->blurTimed[format][path];
+      std::cout << ", " << pathNames[path] << " blur "
+                << (timed > 0 ? static_cast<double>(
+                                    g_pCommon->blurNanoseconds[format][path]) /
+                                    static_cast<double>(timed) * 1e-6
+                              : 0.0)
+                << " ms over " << timed << " blurs";
+    }
+    std::cout << "\n";
+  }
+  g_pCommon->blurQueries.Destroy();
   std::cout << "Shutdown successfull" << std::endl;
 }
 
@@ -707,22 +998,25 @@ void OnResize(int w, int h) {
 
   // setup the projection matrix
   g_pCommon->P =
-      glm::perspective(45.0f, static_cast<GLfloat>(w) / h, 0.1f, 1000.f);
+      glm::perspective(glm::radians(45.0f), static_cast<GLfloat>(w) / h, 0.1f,
+                       1000.f);
+  g_pCommon->camera.SetupProjection(45.0f, static_cast<GLfloat>(w) / h, 0.1f,
+                                    1000.f);
 }
 
 // idle callback just calls the display function
 void OnIdle() { glutPostRedisplay(); }
 
 // Scene rendering function for first pass
-void DrawSceneFirstPass(glm::mat4 View, glm::mat4 Proj) {
+void DrawSceneFirstPass(glm::mat4 View, glm::mat4 Proj, GLSLShader &program) {
   GL_CHECK_ERRORS;
   // bind the first step shader
-  g_pCommon->firstStep.Use();
+  program.Use();
   // bind the plane VAO
   glBindVertexArray(g_pCommon->planeVAOID);
   {
     // set shader uniforms
-    glUniformMatrix4fv(g_pCommon->firstStep("MVP"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("MVP"), 1, GL_FALSE,
                        glm::value_ptr(Proj * View));
     // render the plane triangles
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr);
@@ -738,7 +1032,7 @@ void DrawSceneFirstPass(glm::mat4 View, glm::mat4 Proj) {
     glm::mat4 MV = View * M;
     glm::mat4 MVP = Proj * MV;
     // set the shader uniform
-    glUniformMatrix4fv(g_pCommon->firstStep("MVP"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("MVP"), 1, GL_FALSE,
                        glm::value_ptr(MVP));
     // render the cube triangles
     glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, nullptr);
@@ -754,7 +1048,7 @@ void DrawSceneFirstPass(glm::mat4 View, glm::mat4 Proj) {
     glm::mat4 MV = View * M;
     glm::mat4 MVP = Proj * MV;
     // set the shader uniform
-    glUniformMatrix4fv(g_pCommon->firstStep("MVP"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("MVP"), 1, GL_FALSE,
                        glm::value_ptr(MVP));
     // draw the sphere triangles
     glDrawElements(GL_TRIANGLES, g_pCommon->totalSphereTriangles,
@@ -762,34 +1056,60 @@ void DrawSceneFirstPass(glm::mat4 View, glm::mat4 Proj) {
   }
 
   // unbind the first step shader
-  g_pCommon->firstStep.UnUse();
+  program.UnUse();
+  GL_CHECK_ERRORS;
+}
+
+// Scene rendering into the moments of the cascades, an object is drawn into
+// the cascades of its view mask and skipped when it reaches none
+void DrawSceneCascades(const CMultiViewCuller::ViewMask *viewMasks) {
+  GL_CHECK_ERRORS;
+  GLSLShader &program = g_pCommon->cascadeMoments;
+  program.Use();
+  auto draw = [&](const int object, const GLuint vao, const glm::mat4 &M,
+                  const GLsizei count) {
+    if (viewMasks[object] == 0) {
+      return;
+    }
+    glUniform1i(program("viewMask"), static_cast<GLint>(viewMasks[object]));
+    glUniformMatrix4fv(program("M"), 1, GL_FALSE, glm::value_ptr(M));
+    glBindVertexArray(vao);
+    glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, nullptr);
+  };
+  draw(Common::PLANE, g_pCommon->planeVAOID, glm::mat4(1), 6);
+  draw(Common::CUBE, g_pCommon->cubeVAOID,
+       glm::translate(glm::mat4(1), glm::vec3(-1, 1, 0)), 36);
+  draw(Common::SPHERE, g_pCommon->sphereVAOID,
+       glm::translate(glm::mat4(1), glm::vec3(1, 1, 0)),
+       g_pCommon->totalSphereTriangles);
+  program.UnUse();
   GL_CHECK_ERRORS;
 }
 
 // Scene rendering for final pass
-void DrawScene(glm::mat4 View, glm::mat4 Proj) {
+void DrawScene(glm::mat4 View, glm::mat4 Proj, GLSLShader &program) {
   GL_CHECK_ERRORS;
 
   // bind the variance shadow mapping shader
-  g_pCommon->shader.Use();
+  program.Use();
 
   // bind the plane VAO
   glBindVertexArray(g_pCommon->planeVAOID);
   {
     // pass the shader uniforms
-    glUniform3fv(g_pCommon->shader("light_position"), 1,
+    glUniform3fv(program("light_position"), 1,
                  &(g_pCommon->lightPosOS.x));
-    glUniformMatrix4fv(g_pCommon->shader("S"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("S"), 1, GL_FALSE,
                        glm::value_ptr(g_pCommon->S));
-    glUniformMatrix4fv(g_pCommon->shader("M"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("M"), 1, GL_FALSE,
                        glm::value_ptr(glm::mat4(1)));
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("MVP"), 1, GL_FALSE,
                        glm::value_ptr(Proj * View));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("MV"), 1, GL_FALSE,
                        glm::value_ptr(View));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
+    glUniformMatrix3fv(program("N"), 1, GL_FALSE,
                        glm::value_ptr(glm::inverseTranspose(glm::mat3(View))));
-    glUniform3f(g_pCommon->shader("diffuse_color"), 1.0f, 1.0f, 1.0f);
+    glUniform3f(program("diffuse_color"), 1.0f, 1.0f, 1.0f);
     // draw plane triangles
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr);
   }
@@ -804,16 +1124,16 @@ void DrawScene(glm::mat4 View, glm::mat4 Proj) {
     glm::mat4 MV = View * M;
     glm::mat4 MVP = Proj * MV;
     // pass the shader uniforms
-    glUniformMatrix4fv(g_pCommon->shader("S"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("S"), 1, GL_FALSE,
                        glm::value_ptr(g_pCommon->S));
-    glUniformMatrix4fv(g_pCommon->shader("M"), 1, GL_FALSE, glm::value_ptr(M));
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("M"), 1, GL_FALSE, glm::value_ptr(M));
+    glUniformMatrix4fv(program("MVP"), 1, GL_FALSE,
                        glm::value_ptr(MVP));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("MV"), 1, GL_FALSE,
                        glm::value_ptr(MV));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
+    glUniformMatrix3fv(program("N"), 1, GL_FALSE,
                        glm::value_ptr(glm::inverseTranspose(glm::mat3(MV))));
-    glUniform3f(g_pCommon->shader("diffuse_color"), 1.0f, 0.0f, 0.0f);
+    glUniform3f(program("diffuse_color"), 1.0f, 0.0f, 0.0f);
     // render cube's triangles
     glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, nullptr);
   }
@@ -827,26 +1147,144 @@ void DrawScene(glm::mat4 View, glm::mat4 Proj) {
     glm::mat4 MV = View * M;
     glm::mat4 MVP = Proj * MV;
     // set the shader uniforms
-    glUniformMatrix4fv(g_pCommon->shader("S"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("S"), 1, GL_FALSE,
                        glm::value_ptr(g_pCommon->S));
-    glUniformMatrix4fv(g_pCommon->shader("M"), 1, GL_FALSE, glm::value_ptr(M));
-    glUniformMatrix4fv(g_pCommon->shader("MVP"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("M"), 1, GL_FALSE, glm::value_ptr(M));
+    glUniformMatrix4fv(program("MVP"), 1, GL_FALSE,
                        glm::value_ptr(MVP));
-    glUniformMatrix4fv(g_pCommon->shader("MV"), 1, GL_FALSE,
+    glUniformMatrix4fv(program("MV"), 1, GL_FALSE,
                        glm::value_ptr(MV));
-    glUniformMatrix3fv(g_pCommon->shader("N"), 1, GL_FALSE,
+    glUniformMatrix3fv(program("N"), 1, GL_FALSE,
                        glm::value_ptr(glm::inverseTranspose(glm::mat3(MV))));
-    glUniform3f(g_pCommon->shader("diffuse_color"), 0.0f, 0.0f, 1.0f);
+    glUniform3f(program("diffuse_color"), 0.0f, 0.0f, 1.0f);
     // render sphere triangles
     glDrawElements(GL_TRIANGLES, g_pCommon->totalSphereTriangles,
                    GL_UNSIGNED_SHORT, nullptr);
   }
 
   // unbind the shader
-  g_pCommon->shader.UnUse();
+  program.UnUse();
   GL_CHECK_ERRORS;
 }
 
+// Separable Gaussian blur of the moments, vertically from the shadow map on
+// unit 0 into blurTexID[0] on unit 1 and horizontally from there into
+// blurTexID[1] on unit 2, the texture the main shaders sample
+void BlurMoments() {
+  const int format = g_pCommon->momentFormat;
+  const int path = g_pCommon->blurPath;
+  const bool timed =
+      g_pCommon->blurQueries.Begin([format, path](const GLuint64 nanoseconds) {
+        g_pCommon->blurNanoseconds[format][path] += nanoseconds;
+        ++g_pCommon->blurTimed[format][path];
+      });
+
+  if (path == Common::COMPUTE_BLUR) {
+    // a workgroup per BLUR_TILE texels of a column, then of a row; every
+    // texel is read once into shared memory instead of once per tap
+    GLSLShader &blur = g_pCommon->blurCompute;
+    const GLenum internalFormat = Common::formats[format].internalFormat;
+    blur.Use();
+    glUniform4fv(blur("border"), 1, glm::value_ptr(g_pCommon->border));
+
+    glUniform1i(blur("textureMap"), 0);
+    glUniform2i(blur("direction"), 0, 1);
+    glBindImageTexture(0, g_pCommon->blurTexID[0], 0, GL_FALSE, 0,
+                       GL_WRITE_ONLY, internalFormat);
+    glDispatchCompute(
+        (Common::SHADOWMAP_HEIGHT + Common::BLUR_TILE - 1) / Common::BLUR_TILE,
+        Common::SHADOWMAP_WIDTH, 1);
+    // the rows fetch what the columns stored
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    glUniform1i(blur("textureMap"), 1);
+    glUniform2i(blur("direction"), 1, 0);
+    glBindImageTexture(0, g_pCommon->blurTexID[1], 0, GL_FALSE, 0,
+                       GL_WRITE_ONLY, internalFormat);
+    glDispatchCompute(
+        (Common::SHADOWMAP_WIDTH + Common::BLUR_TILE - 1) / Common::BLUR_TILE,
+        Common::SHADOWMAP_HEIGHT, 1);
+    // and the main shader samples the rows
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    blur.UnUse();
+  } else {
+    // bind the filtering FBO
+    glBindFramebuffer(GL_FRAMEBUFFER, g_pCommon->filterFBOID);
+    // set drawing to colour attachment 0
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    // bind the fullscreen quad VAO
+    glBindVertexArray(g_pCommon->quadVAOID);
+    // use the vertical Gaussian smoothing shader
+    g_pCommon->gaussianV_shader.Use();
+    // render quad triangles
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr);
+
+    // set drawing to colour attachment 1
+    glDrawBuffer(GL_COLOR_ATTACHMENT1);
+    // use the horizontal Gaussian smoothing shader
+    g_pCommon->gaussianH_shader.Use();
+    // render quad triangles
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr);
+  }
+
+  if (timed) {
+    g_pCommon->blurQueries.End();
+  }
+}
+
+// Render the moments of the cascades of the light as a directional light,
+// shining from its position towards the centre of the scene, in one layered
+// pass and filter them through their mipmaps. Only the cascades that moved
+// with the camera or hold a changed caster are drawn; the objects are static
+// so their version stays 0
+void RenderCascades(const glm::mat4 &MV) {
+  CCascadedShadowMap &cascades = g_pCommon->cascades;
+  CShadowCache &cache = g_pCommon->cascadeCache;
+
+  g_pCommon->camera.SetViewMatrix(MV);
+  g_pCommon->camera.CalcFrustumPlanes();
+  const glm::vec3 lightDirection =
+      glm::length(g_pCommon->lightPosOS) > 0 ? -g_pCommon->lightPosOS
+                                             : glm::vec3(0, -1, 0);
+  cascades.Update(g_pCommon->camera, lightDirection);
+  cascades.CullCasters({g_pCommon->casterX, g_pCommon->casterY,
+                        g_pCommon->casterZ, g_pCommon->casterRadius,
+                        Common::TOTAL_OBJECTS},
+                       g_pCommon->casterCascades);
+
+  if (g_pCommon->rebuildEveryFrame) {
+    cache.Invalidate();
+  }
+  const CascadeBlock &block = cascades.GetBlock();
+  for (int c = 0; c < block.count; ++c) {
+    cache.SetLight(c, block.viewProjection[c]);
+  }
+  for (std::size_t object = 0; object < Common::TOTAL_OBJECTS; ++object) {
+    cache.SetCaster(object, 0, g_pCommon->casterCascades[object]);
+  }
+  // the cascades in use hold a caster or still have to be cleared
+  const CShadowCache::SlotMask dirty = cache.GetDirty();
+  CShadowCache::SlotMask active = dirty;
+  for (const auto mask : g_pCommon->casterCascades) {
+    active |= mask;
+  }
+  if (dirty != 0) {
+    for (auto &mask : g_pCommon->casterCascades) {
+      mask &= dirty;
+    }
+    cascades.BeginLayered(dirty);
+    DrawSceneCascades(g_pCommon->casterCascades.data());
+    cascades.End();
+    // the moments on texture unit 3
+    glActiveTexture(GL_TEXTURE3);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glActiveTexture(GL_TEXTURE0);
+    glDrawBuffer(GL_BACK_LEFT);
+    glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
+  }
+  cache.EndFrame(dirty, active);
+}
+
 // display callback function
 void OnRender() {
   GL_CHECK_ERRORS;
@@ -860,44 +1298,53 @@ void OnRender() {
   auto Rx = glm::rotate(T, g_pCommon->rX, glm::vec3(1.0f, 0.0f, 0.0f));
   auto MV = glm::rotate(Rx, g_pCommon->rY, glm::vec3(0.0f, 1.0f, 0.0f));
 
-  // 1) Render scene from the light's POV
-  // enable rendering to FBO
-  glBindFramebuffer(GL_FRAMEBUFFER, g_pCommon->fboID);
-  // reset viewport to the shadow map texture size
-  glViewport(0, 0, Common::SHADOWMAP_WIDTH, Common::SHADOWMAP_HEIGHT);
-  // set drawing to colour attachment 0
-  glDrawBuffer(GL_COLOR_ATTACHMENT0);
-  // clear the colour and depth buffers
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  // draw scene using the first pass shader from the point of view of light
-  DrawSceneFirstPass(g_pCommon->MV_L, g_pCommon->P_L);
+  g_pCommon->blurQueries.Poll();
+  const bool evsm = Common::formats[g_pCommon->momentFormat].maxExponent > 0;
 
-  // bind the filtering FBO
-  glBindFramebuffer(GL_FRAMEBUFFER, g_pCommon->filterFBOID);
-  // set drawing to colour attachment 0
-  glDrawBuffer(GL_COLOR_ATTACHMENT0);
-  // bind the fullscreen quad VAO
-  glBindVertexArray(g_pCommon->quadVAOID);
-  // use the vertical Gaussian smoothing shader
-  g_pCommon->gaussianV_shader.Use();
-  // render quad triangles
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr);
+  if (g_pCommon->useCascades) {
+    // 1) Render the moments of the cascades that changed
+    RenderCascades(MV);
 
-  // set drawing to colour attachment 1
-  glDrawBuffer(GL_COLOR_ATTACHMENT1);
-  // use the horizontal Gaussian smoothing shader
-  g_pCommon->gaussianH_shader.Use();
-  // render quad triangles
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr);
+    // 2) Render scene from point of view of eye with the cascade lookup
+    g_pCommon->cascadeShader.Use();
+    glUniform1i(g_pCommon->cascadeShader("bShowCascades"),
+                g_pCommon->showCascades);
+    DrawScene(MV, g_pCommon->P, g_pCommon->cascadeShader);
+  } else {
+    // 1) Render scene from the light's POV and blur it, the scene is static so
+    // the filtered shadow map is kept until the light moves
+    if (g_pCommon->rebuildEveryFrame) {
+      g_pCommon->shadowCache.Invalidate();
+    }
+    g_pCommon->shadowCache.SetLight(0, g_pCommon->S);
+    const CShadowCache::SlotMask dirty = g_pCommon->shadowCache.GetDirty();
+    if (dirty != 0) {
+      // enable rendering to FBO
+      glBindFramebuffer(GL_FRAMEBUFFER, g_pCommon->fboID);
+      // reset viewport to the shadow map texture size
+      glViewport(0, 0, Common::SHADOWMAP_WIDTH, Common::SHADOWMAP_HEIGHT);
+      // set drawing to colour attachment 0
+      glDrawBuffer(GL_COLOR_ATTACHMENT0);
+      // clear the colour and depth buffers
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      // draw scene using the first pass shader from the point of view of light
+      DrawSceneFirstPass(g_pCommon->MV_L, g_pCommon->P_L,
+                         evsm ? g_pCommon->evsmFirstStep : g_pCommon->firstStep);
+
+      BlurMoments();
+
+      // unbind the FBO
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      // restore drawing to back buffer
+      glDrawBuffer(GL_BACK_LEFT);
+      // restore the viewport to the screen size
+      glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
+    }
+    g_pCommon->shadowCache.EndFrame(dirty, 1);
 
-  // unbind the FBO
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  // restore drawing to back buffer
-  glDrawBuffer(GL_BACK_LEFT);
-  // restore the viewport to the screen size
-  glViewport(0, 0, Common::WIDTH, Common::HEIGHT);
-  // render scene normally
-  DrawScene(MV, g_pCommon->P);
+    // render scene normally
+    DrawScene(MV, g_pCommon->P, evsm ? g_pCommon->evsmShader : g_pCommon->shader);
+  }
 
   // bind light gizmo vertex array object
   glBindVertexArray(g_pCommon->lightVAOID);
@@ -915,6 +1362,33 @@ void OnRender() {
   // unbind the vertex array object
   glBindVertexArray(0);
 
+  const int format = g_pCommon->momentFormat;
+  const int path = g_pCommon->blurPath;
+  const std::size_t timed = g_pCommon->blurTimed[format][path];
+  char title[192];
+  if (g_pCommon->useCascades) {
+    std::snprintf(
+        title, sizeof(title),
+        "Cascaded Variance Shadow Mapping - OpenGL 3.3 :: %s c=%.2f, %d "
+        "cascades, %.0f cascade passes skipped/s",
+        Common::formats[format].name, static_cast<double>(g_pCommon->exponent),
+        g_pCommon->cascades.GetCascadeCount(),
+        g_pCommon->cascadeCache.GetStats().skippedPerSecond);
+  } else {
+    std::snprintf(
+        title, sizeof(title),
+        "Variance Shadow Mapping - OpenGL 3.3 :: %s c=%.2f, %.1f MB, %s blur "
+        "%.3f ms, %.0f shadow passes skipped/s",
+        Common::formats[format].name, static_cast<double>(g_pCommon->exponent),
+        MomentMegabytes(format),
+        path == Common::COMPUTE_BLUR ? "compute" : "fragment",
+        timed > 0 ? static_cast<double>(g_pCommon->blurNanoseconds[format][path]) /
+                        static_cast<double>(timed) * 1e-6
+                  : 0.0,
+        g_pCommon->shadowCache.GetStats().skippedPerSecond);
+  }
+  glutSetWindowTitle(title);
+
   // swap front and back buffers to show the rendered result
   glutSwapBuffers();
 }
@@ -944,6 +1418,45 @@ void OnMouseWheel(int /*button*/, int dir, int /*x*/, int /*y*/) {
 	glutPostRedisplay();
 }
 
+// keyboard handler, 'f' cycles the moment formats, '+' and '-' change the
+// EVSM exponent, 'b' switches the blur and 'r' blurs every frame; 'c'
+// switches to the cascades and 'v' shows the cascade of each fragment
+void OnKey(unsigned char key, int /*x*/, int /*y*/) {
+  const int format = g_pCommon->momentFormat;
+  switch (key) {
+  case 'f': {
+    const int next = (format + 1) % Common::FORMATS;
+    SetMoments(next, Common::formats[next].maxExponent);
+    break;
+  }
+  case '+':
+  case '-':
+    if (Common::formats[format].maxExponent > 0) {
+      const float step = key == '+' ? 0.5f : -0.5f;
+      SetMoments(format, glm::clamp(g_pCommon->exponent + step, 0.5f,
+                                    Common::formats[format].maxExponent));
+    }
+    break;
+  case 'b':
+    g_pCommon->blurPath = g_pCommon->blurPath == Common::FRAGMENT_BLUR &&
+                                  g_pCommon->computeSupported
+                              ? Common::COMPUTE_BLUR
+                              : Common::FRAGMENT_BLUR;
+    g_pCommon->shadowCache.Invalidate();
+    break;
+  case 'r':
+    g_pCommon->rebuildEveryFrame = !g_pCommon->rebuildEveryFrame;
+    break;
+  case 'c':
+    g_pCommon->useCascades = !g_pCommon->useCascades;
+    break;
+  case 'v':
+    g_pCommon->showCascades = !g_pCommon->showCascades;
+    break;
+  }
+  glutPostRedisplay();
+}
+
 int main(int argc, char **argv) {
   Common common;
   g_pCommon = &common;
@@ -987,6 +1500,7 @@ int main(int argc, char **argv) {
   glutMouseFunc(OnMouseDown);
   glutMotionFunc(OnMouseMove);
   glutMouseWheelFunc(OnMouseWheel);
+  glutKeyboardFunc(OnKey);
   glutIdleFunc(OnIdle);
 
   // main loop call
@@ -0,0 +1,24 @@
+#version 330 core
+
+layout(location=0) out vec4 vFragColor;		//fragment shader output
+
+//uniform
+uniform float exponent;		//exponential warp, 0 stores the plain moments
+
+void main()
+{
+	//the cascades are orthographic so the window depth is linear, add the
+	//offset of firstStep.frag to remove the shadow acne
+	float depth = gl_FragCoord.z + 0.0005;
+
+	if(exponent == 0) {
+		//store the depth and its square as first and second moment
+		vFragColor = vec4(depth, depth*depth, 0, 0);
+	} else {
+		//warp the depth in -1 to 1 range like EvsmFirstStep.frag
+		depth = clamp(depth*2.0 - 1.0, -1.0, 1.0);
+		float positive =  exp( exponent*depth);
+		float negative = -exp(-exponent*depth);
+		vFragColor = vec4(positive, positive*positive, negative, negative*negative);
+	}
+}
@@ -0,0 +1,11 @@
+#version 330 core
+  
+layout(location=0) in vec3 vVertex;		//object space vertex position
+
+uniform mat4 M;		//model matrix
+
+void main()
+{
+	//world space position, the geometry shader applies the cascade matrices
+	gl_Position = M*vec4(vVertex,1);
+}
@@ -0,0 +1,79 @@
+#version 330 core
+
+layout(location=0) out vec4 vFragColor;	//fragment shader output
+
+//shader uniforms
+uniform mat4 MV;					//modelview matrix
+uniform sampler2DArray shadowMaps;	//moments, one layer per cascade
+uniform vec3 light_position;		//light position in object space
+uniform vec3 diffuse_color;			//surface's diffuse colour
+uniform float exponent;				//exponential warp of CascadeMoments.frag, 0 for VSM
+uniform bool useNegative;			//the moments hold the negative warp too
+uniform bool bShowCascades;			//tint the fragments by cascade
+
+//cascade matrices and splits (CascadeBlock in Common)
+layout(std140) uniform Cascades {
+	mat4 cascade_VP[4];		//light projection * view per cascade
+	mat4 cascade_S[4];		//bias * projection * view per cascade
+	vec4 cascade_splits;	//far view space depth of each cascade
+	int  cascade_count;		//number of cascades in use
+};
+
+//inputs from the vertex shader
+smooth in vec3 vEyeSpaceNormal;		//interpolated eye space normal
+smooth in vec3 vEyeSpacePosition;	//interpolated eye space position
+smooth in vec4 vWorldSpacePosition;	//interpolated world space position
+
+const vec3 cascadeColors[4] = vec3[4](vec3(1,0.5,0.5), vec3(0.5,1,0.5),
+									 vec3(0.5,0.5,1), vec3(1,1,0.5));
+
+//Chebyshev upper bound of the share of light reaching the depth
+float chebyshev(vec2 moments, float depth, float minVariance)
+{
+	if(depth <= moments.x)
+		return 1.0;
+	float var = max(moments.y - moments.x*moments.x, minVariance);
+	float mD = depth - moments.x;
+	return var/(var + mD*mD);
+}
+
+void main() {
+	//the light is directional, towards the scene centre; the objects are
+	//only translated so the upper 3x3 of MV is the view rotation
+	vec3 L = normalize(mat3(MV)*light_position);
+	float diffuse = max(0, dot(normalize(vEyeSpaceNormal), L));
+
+	//first cascade whose far split is beyond the fragment
+	float depth = -vEyeSpacePosition.z;
+	int cascade = 0;
+	while(cascade < cascade_count && depth > cascade_splits[cascade])
+		++cascade;
+
+	vec3 tint = vec3(1);
+	if(cascade < cascade_count) {
+		vec4 coords = cascade_S[cascade]*vWorldSpacePosition;
+		vec4 moments = texture(shadowMaps, vec3(coords.xy, float(cascade)));
+
+		float p_max;
+		if(exponent == 0) {
+			p_max = chebyshev(moments.xy, coords.z, 0.00002);
+		} else {
+			//warp the depth the same way as the moments
+			float d = clamp(coords.z*2.0 - 1.0, -1.0, 1.0);
+			float positive =  exp( exponent*d);
+			float negative = -exp(-exponent*d);
+			p_max = chebyshev(moments.xy, positive,
+							  0.00002*exponent*exponent*positive*positive);
+			if(useNegative) {
+				p_max = min(p_max, chebyshev(moments.zw, negative,
+								  0.00002*exponent*exponent*negative*negative));
+			}
+		}
+		diffuse *= max(p_max, 0.2);
+		if(bShowCascades)
+			tint = cascadeColors[cascade];
+	}
+
+	//return the final colour by multiplying the diffuse colour with the diffuse component
+	vFragColor = diffuse*vec4(diffuse_color*tint, 1);
+}
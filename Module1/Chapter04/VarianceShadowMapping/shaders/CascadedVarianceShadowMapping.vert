@@ -0,0 +1,26 @@
+#version 330 core
+  
+layout(location=0) in vec3 vVertex;			 	//per-vertex position
+layout(location=1) in vec3 vNormal;  		 	//per-vertex normal
+
+//shader uniforms
+uniform mat4 MVP;	//modelview projection matrix
+uniform mat4 MV;	//modelview matrix
+uniform mat4 M;		//model matrix
+uniform mat3 N;		//normal matrix
+
+//shader outputs to the fragment shader
+smooth out vec3 vEyeSpaceNormal;		//eye space normal
+smooth out vec3 vEyeSpacePosition;		//eye space position
+smooth out vec4 vWorldSpacePosition;	//world space position for the cascade lookup
+
+void main()
+{ 	
+	vWorldSpacePosition = M*vec4(vVertex,1);
+	vEyeSpacePosition   = (MV*vec4(vVertex,1)).xyz; 
+	vEyeSpaceNormal     = N*vNormal;
+
+	//multiply the combined modelview projection matrix with the object space vertex
+	//position to get the clip space position
+	gl_Position         = MVP*vec4(vVertex,1); 
+}
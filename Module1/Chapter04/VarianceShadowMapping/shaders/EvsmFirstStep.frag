@@ -0,0 +1,29 @@
+#version 330 core
+
+layout(location=0) out vec4 vFragColor;		//fragment shader output
+
+//uniform
+uniform float exponent;		//exponential warp, the larger the less light bleeding
+
+//input from the vertex shader
+smooth in vec4 clipSpacePos;	//clip space vertex position
+
+void main()
+{
+	//do homogeneous division
+	vec3 pos = clipSpacePos.xyz/clipSpacePos.w;
+
+	//add some offset to remove the shadow acne
+	pos.z += 0.001;
+
+	//get depth in -1 to 1 range, the range the exponent is chosen for
+	float depth = clamp(pos.z, -1.0, 1.0);
+
+	//warp the depth with a positive and a negative exponential
+	float positive =  exp( exponent*depth);
+	float negative = -exp(-exponent*depth);
+
+	//store the first and second moment of both warped depths, a two channel
+	//target only keeps the positive ones
+	vFragColor = vec4(positive, positive*positive, negative, negative*negative);
+}
@@ -0,0 +1,79 @@
+#version 330 core
+
+layout(location=0) out vec4 vFragColor;	//fragment shader output
+
+//shader uniforms
+uniform mat4 MV;					//modelview matrix
+uniform sampler2D  shadowMap;		//shadowmap texture with the warped moments
+uniform vec3 light_position;		//light position in object space
+uniform vec3 diffuse_color;			//surface's diffuse colour
+uniform float exponent;				//exponential warp of EvsmFirstStep
+uniform bool useNegative;			//the shadow map holds the negative moments too
+
+//inputs from the vertex shader
+smooth in vec3 vEyeSpaceNormal;		//interpolated eye space normal
+smooth in vec3 vEyeSpacePosition;	//interpolated eye space position
+smooth in vec4 vShadowCoords;		//interpolated shadow coordinates
+
+//shader constants
+const float k0 = 1.0;	//constant attenuation
+const float k1 = 0.0;	//linear attenuation
+const float k2 = 0.0;	//quadratic attenuation
+
+//Chebyshev upper bound of the share of light reaching the warped depth
+float chebyshev(vec2 moments, float depth, float minVariance)
+{
+	if(depth <= moments.x)
+		return 1.0;
+	float var = max(moments.y - moments.x*moments.x, minVariance);
+	float mD = depth - moments.x;
+	return var/(var + mD*mD);
+}
+
+void main() {
+
+	//get light position in eye space
+	vec4 vEyeSpaceLightPosition = (MV*vec4(light_position,1));
+
+	//get the light vector
+	vec3 L = (vEyeSpaceLightPosition.xyz-vEyeSpacePosition);
+
+	//get the distance of the light source
+	float d = length(L);
+
+	//normalize the light vector
+ 	L = normalize(L);
+
+	//calculate the diffuse component and apply light attenuation
+	float attenuationAmount = 1.0/(k0 + (k1*d) + (k2*d*d));
+	float diffuse = max(0, dot(vEyeSpaceNormal, L)) * attenuationAmount;
+
+	//only the forward half of the light casts shadows
+	if(vShadowCoords.w>1) {
+
+		//divide the shadow coordinate by homogeneous coordinate
+		vec3 uv = vShadowCoords.xyz/vShadowCoords.w;
+
+		//warp the depth in -1 to 1 range the same way as the moments
+		float depth = clamp(uv.z*2.0 - 1.0, -1.0, 1.0);
+		float positive =  exp( exponent*depth);
+		float negative = -exp(-exponent*depth);
+
+		//read the warped moments from the shadow map texture
+		vec4 moments = texture(shadowMap, uv.xy);
+
+		//the variance bias of VarianceShadowMapping.frag scaled by the slope
+		//of the warp
+		float p_max = chebyshev(moments.xy, positive,
+								0.00002*exponent*exponent*positive*positive);
+		if(useNegative) {
+			p_max = min(p_max, chebyshev(moments.zw, negative,
+								0.00002*exponent*exponent*negative*negative));
+		}
+
+		//darken the diffuse component by the smaller of both bounds
+		diffuse *= max(p_max, 0.2);
+	}
+	//return the final colour by multiplying the diffuse colour with the diffuse component
+	vFragColor = diffuse*vec4(diffuse_color, 1);
+}
@@ -27,5 +27,5 @@ void main()
 	}
 	  
 	//return the filtered colour as fragment output
-    vFragColor =  vec4(color.xy,0,0);	
+    vFragColor =  color;	
 }
\ No newline at end of file
@@ -1,15 +1,18 @@
 #include "3ds.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "MeshOptimizer.hpp"
+
 bool C3dsLoader::Load3DS(const std::string &filename,
-                         std::vector<C3dsMesh *> &meshes,
+                         std::vector<C3dsMesh> &meshes,
                          std::vector<glm::vec3> &vertices,
                          std::vector<glm::vec3> &normals,
                          std::vector<glm::vec2> &uvs, std::vector<Face> &faces,
                          std::vector<unsigned short> &/*indices*/,
-                         std::vector<Material *> &materials) {
+                         std::vector<Material> &materials) {
   std::ifstream infile(filename, std::ios::in | std::ios::binary);
 
   if (infile.bad()) {
@@ -57,9 +60,9 @@ bool C3dsLoader::Load3DS(const std::string &filename,
         totalFaces += pMesh->faces.size();
         totalVertices += pMesh->vertices.size();
       }
-      pMesh = new C3dsMesh(name);
-
-      meshes.push_back(pMesh);
+      // the current mesh, valid until the next one is added
+      meshes.emplace_back(name);
+      pMesh = &meshes.back();
     } break;
 
     case 0x4100:
@@ -99,8 +102,8 @@ bool C3dsLoader::Load3DS(const std::string &filename,
       // find the material in the materials list
       Material *pMat = 0;
       for (size_t i = 0; i < materials.size(); i++) {
-        if (name.compare(materials[i]->name) == 0) {
-          pMat = materials[i];
+        if (name.compare(materials[i].name) == 0) {
+          pMat = &materials[i];
           break;
         }
       }
@@ -164,9 +167,8 @@ bool C3dsLoader::Load3DS(const std::string &filename,
     case 0xa34A: // Mask for self illum. map
     case 0xa34C: // Mask for reflection map
     {
-      pMaterial->textureMaps.push_back(new TextureMap());
-      pCurrentTextureMap =
-          pMaterial->textureMaps[pMaterial->textureMaps.size() - 1];
+      pMaterial->textureMaps.emplace_back();
+      pCurrentTextureMap = &pMaterial->textureMaps.back();
     } break;
 
     case 0xa300: // Mapping filename
@@ -237,8 +239,8 @@ bool C3dsLoader::Load3DS(const std::string &filename,
         infile.read(&c, 1);
         name.push_back(c);
       }
-      materials.push_back(new Material(name));
-      pMaterial = materials[materials.size() - 1];
+      materials.emplace_back(name);
+      pMaterial = &materials.back();
     } break;
 
     case 0xa010: {
@@ -299,22 +301,22 @@ bool C3dsLoader::Load3DS(const std::string &filename,
 
   // check if there is any material with 0 size face_ids meaning it is not used
   // then delete it
-  size_t total = materials.size();
-  for (size_t i = 0; i < total; i++) {
-    if (materials[i]->face_ids.size() == 0)
-      materials.erase(materials.begin() + i);
-  }
+  materials.erase(std::remove_if(materials.begin(), materials.end(),
+                                 [](const Material &material) {
+                                   return material.face_ids.empty();
+                                 }),
+                  materials.end());
 
   // create the super list of attributes
   for (size_t i = 0; i < meshes.size(); i++) {
-    for (size_t j = 0; j < meshes[i]->vertices.size(); j++)
-      vertices.push_back(meshes[i]->vertices[j]);
+    for (size_t j = 0; j < meshes[i].vertices.size(); j++)
+      vertices.push_back(meshes[i].vertices[j]);
 
-    for (size_t j = 0; j < meshes[i]->uvs.size(); j++)
-      uvs.push_back(meshes[i]->uvs[j]);
+    for (size_t j = 0; j < meshes[i].uvs.size(); j++)
+      uvs.push_back(meshes[i].uvs[j]);
 
-    for (size_t j = 0; j < meshes[i]->faces.size(); j++) {
-      faces.push_back(meshes[i]->faces[j]);
+    for (size_t j = 0; j < meshes[i].faces.size(); j++) {
+      faces.push_back(meshes[i].faces[j]);
     }
   }
 
@@ -339,12 +341,63 @@ bool C3dsLoader::Load3DS(const std::string &filename,
   }
 
   for (size_t i = 0; i < materials.size(); i++) {
-    Material *pMat = materials[i];
+    Material *pMat = &materials[i];
     for (size_t j = 0; j < pMat->face_ids.size(); j++) {
       pMat->sub_indices.push_back(faces[pMat->face_ids[j]].a);
       pMat->sub_indices.push_back(faces[pMat->face_ids[j]].b);
       pMat->sub_indices.push_back(faces[pMat->face_ids[j]].c);
     }
   }
+
+  // reorder for the post-transform cache and vertex fetch; the viewer draws
+  // the faces when there is at most one material, otherwise the material
+  // ranges
+  std::vector<GLuint> optimized;
+  std::vector<CMeshOptimizer::Range> ranges;
+  if (materials.size() <= 1) {
+    for (const auto &f : faces) {
+      optimized.insert(optimized.end(), {f.a, f.b, f.c});
+    }
+    ranges.push_back({0, optimized.size()});
+  } else {
+    for (const auto &material : materials) {
+      ranges.push_back({optimized.size(), material.sub_indices.size()});
+      optimized.insert(optimized.end(), material.sub_indices.begin(),
+                       material.sub_indices.end());
+    }
+  }
+  const auto remap = CMeshOptimizer::Optimize(
+      optimized, ranges, vertices.data(), vertices.size(), filename.c_str(),
+      std::cout);
+
+  if (materials.size() <= 1) {
+    for (size_t j = 0; j < faces.size(); j++) {
+      faces[j].a = static_cast<unsigned short>(optimized[3 * j]);
+      faces[j].b = static_cast<unsigned short>(optimized[3 * j + 1]);
+      faces[j].c = static_cast<unsigned short>(optimized[3 * j + 2]);
+    }
+    // a single material keeps its indices, they only follow the vertices
+    for (auto &material : materials) {
+      for (auto &index : material.sub_indices) {
+        index = static_cast<unsigned short>(remap[index]);
+      }
+    }
+  } else {
+    for (size_t i = 0; i < materials.size(); i++) {
+      std::copy(optimized.begin() + ranges[i].first,
+                optimized.begin() + ranges[i].first + ranges[i].count,
+                materials[i].sub_indices.begin());
+    }
+    for (auto &f : faces) {
+      f.a = static_cast<unsigned short>(remap[f.a]);
+      f.b = static_cast<unsigned short>(remap[f.b]);
+      f.c = static_cast<unsigned short>(remap[f.c]);
+    }
+  }
+  CMeshOptimizer::Remap(vertices, remap);
+  CMeshOptimizer::Remap(normals, remap);
+  if (uvs.size() == vertices.size()) {
+    CMeshOptimizer::Remap(uvs, remap);
+  }
   return true;
 }
@@ -51,7 +51,7 @@ public:
   float shininess_strength;
   float transparency_percent, transparency_falloff, reflection_blur_percent,
       self_illum;
-  std::vector<TextureMap *> textureMaps;
+  std::vector<TextureMap> textureMaps;
   std::vector<int> face_ids;
   std::vector<unsigned short> sub_indices;
   int offset;
@@ -64,14 +64,6 @@ public:
     transform = glm::mat4(1);
   }
 
-  ~C3dsMesh() {
-    vertices.clear();
-    uvs.clear();
-    faces.clear();
-    smoothing_groups.clear();
-    normals.clear();
-  }
-
   std::string name;
   std::vector<glm::vec3> vertices;
   std::vector<glm::vec2> uvs;
@@ -83,9 +75,10 @@ public:
 
 class C3dsLoader {
 public:
-  bool Load3DS(const std::string &filename, std::vector<C3dsMesh *> &meshes,
+  // meshes and materials are appended by value
+  bool Load3DS(const std::string &filename, std::vector<C3dsMesh> &meshes,
                std::vector<glm::vec3> &vertices,
                std::vector<glm::vec3> &normals, std::vector<glm::vec2> &uvs,
                std::vector<Face> &faces, std::vector<unsigned short> &indices,
-               std::vector<Material *> &materials);
+               std::vector<Material> &materials);
 };
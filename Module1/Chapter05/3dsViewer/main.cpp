@@ -4,7 +4,9 @@
 #include <GL/freeglut.h>
 // STL
 #include <iostream>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 // GLM
 #include <glm/glm.hpp>
@@ -15,7 +17,9 @@
 #include <SOIL.h>
 // Internal
 #include "3ds.hpp"
+#include "GLHandle.hpp"
 #include "GLSLShader.hpp"
+#include "RenderQueue.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
 
@@ -30,24 +34,22 @@ GLSLShader shader, flatShader;
 static const std::string mesh_filename = "media/blocks.3ds";
 // 3dsloader instance
 static C3dsLoader loader;
-// IDs for vertex array and buffer object
+// vertex array and buffer objects
 // here we will load each attribute in a separate buffer object
-GLuint vaoID;         // mesh vertex array object
-GLuint vboVerticesID; // mesh vertices buffer object
-GLuint vboUVsID;      // mesh texture coordinates buffer object
-GLuint vboNormalsID;  // mesh normals buffer object
-GLuint vboIndicesID;  // mesh indices element array buffer object
+GLVertexArray vao;    // mesh vertex array object
+GLBuffer vboVertices; // mesh vertices buffer object
+GLBuffer vboUVs;      // mesh texture coordinates buffer object
+GLBuffer vboNormals;  // mesh normals buffer object
+GLBuffer vboIndices;  // mesh indices element array buffer object
 
 // projection and modelview matrices
 glm::mat4 P = glm::mat4(1);
 glm::mat4 MV = glm::mat4(1);
 
-std::vector<C3dsMesh *> meshes;    // vector of meshes in 3DS file
-std::vector<Material *> materials; // vector of materials
-std::map<std::string, GLuint>
-    textureMaps; // map of texture filename and OpenGL texture ID
-typedef std::map<std::string, GLuint>::iterator
-    iter;                            // iterator for texture map
+std::vector<C3dsMesh> meshes;    // vector of meshes in 3DS file
+std::vector<Material> materials; // vector of materials
+std::map<std::string, GLTexture>
+    textureMaps; // map of texture filename and OpenGL texture
 std::vector<glm::vec3> vertices;     // mesh vertices
 std::vector<glm::vec3> normals;      // mesh normals
 std::vector<glm::vec2> uvs;          // mesh texture coordinates
@@ -63,10 +65,35 @@ float theta = 2.0f;
 float phi = 2.0f;
 float radius = 70;
 
-// light crosshair gizmo vetex array and buffer object IDs
-GLuint lightVAOID;
-GLuint lightVerticesVBO;
+// light crosshair gizmo vetex array and buffer object
+GLVertexArray lightVAO;
+GLBuffer lightVertices;
 glm::vec3 lightPosOS = glm::vec3(0, 2, 0); // objectspace light position
+
+// per material uniforms, copied into the render queue with each packet
+struct MaterialUniforms {
+  float hasTexture;
+  glm::vec3 diffuse;
+};
+
+// one queued draw per material, its range of the mesh element buffer
+struct MaterialDraw {
+  GLuint texture;
+  std::size_t firstIndex;
+  GLsizei count;
+  glm::vec3 centroid; // objectspace, for the front to back depth
+  MaterialUniforms uniforms;
+};
+std::vector<MaterialDraw> materialDraws;
+
+// sorts the material draws and skips redundant texture binds
+CRenderQueue renderQueue;
+
+void SetMaterialUniforms(GLSLShader &program, const void *uniforms) {
+  const auto *material = static_cast<const MaterialUniforms *>(uniforms);
+  glUniform1f(program("hasTexture"), material->hasTexture);
+  glUniform3fv(program("diffuse_color"), 1, &(material->diffuse.x));
+}
 }                                         // namespace
 
 // mouse click handler
@@ -126,18 +153,17 @@ void OnInit() {
   // loop through all materials
   for (size_t k = 0; k < materials.size(); k++) {
     // loop through all material texturemaps
-    for (size_t m = 0; m < materials[k]->textureMaps.size(); m++) {
-      GLuint id = 0;
+    for (size_t m = 0; m < materials[k].textureMaps.size(); m++) {
       // generate the OpenGL texture and set texture parameters
-      glGenTextures(1, &id);
-      glBindTexture(GL_TEXTURE_2D, id);
+      GLTexture texture = GLTexture::Create();
+      glBindTexture(GL_TEXTURE_2D, texture.Get());
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
       int texture_width = 0, texture_height = 0, channels = 0;
 
-      const auto &filename = materials[k]->textureMaps[m]->filename;
+      const auto &filename = materials[k].textureMaps[m].filename;
       std::string full_filename = mesh_path;
       full_filename.append(filename);
 
@@ -184,8 +210,8 @@ void OnInit() {
       // free SOIL image data
       SOIL_free_image_data(pData);
 
-      // store texture id in map
-      textureMaps[filename] = id;
+      // store texture in map
+      textureMaps[filename] = std::move(texture);
     }
   }
 
@@ -227,16 +253,16 @@ void OnInit() {
 
   // setup the vertex array object and vertex buffer object for the mesh
   // geometry handling
-  glGenVertexArrays(1, &vaoID);
-  glGenBuffers(1, &vboVerticesID);
-  glGenBuffers(1, &vboUVsID);
-  glGenBuffers(1, &vboNormalsID);
-  glGenBuffers(1, &vboIndicesID);
+  vao         = GLVertexArray::Create();
+  vboVertices = GLBuffer::Create();
+  vboUVs      = GLBuffer::Create();
+  vboNormals  = GLBuffer::Create();
+  vboIndices  = GLBuffer::Create();
 
   // get the mesh bounding box
   glm::vec3 min = glm::vec3(1000.0f), max = glm::vec3(-1000);
   for (size_t j = 0; j < meshes.size(); j++) {
-    C3dsMesh *pMesh = meshes[j];
+    const C3dsMesh *pMesh = &meshes[j];
     for (size_t i = 0; i < pMesh->vertices.size(); i++) {
       min = glm::min(pMesh->vertices[i], min);
       max = glm::max(pMesh->vertices[i], max);
@@ -249,8 +275,8 @@ void OnInit() {
   dist = -(r + (r * .5f));
 
   // bind mesh vertex array object
-  glBindVertexArray(vaoID);
-  glBindBuffer(GL_ARRAY_BUFFER, vboVerticesID);
+  glBindVertexArray(vao.Get());
+  glBindBuffer(GL_ARRAY_BUFFER, vboVertices.Get());
   // pass mesh vertices data to buffer object
   glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertices.size(),
                &(vertices[0].x), GL_STATIC_DRAW);
@@ -264,7 +290,7 @@ void OnInit() {
 
   // bind the texture coordinate buffer object and pass the texture coordinate
   // to buffer object
-  glBindBuffer(GL_ARRAY_BUFFER, vboUVsID);
+  glBindBuffer(GL_ARRAY_BUFFER, vboUVs.Get());
   glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * uvs.size(), &(uvs[0].x),
                GL_STATIC_DRAW);
 
@@ -276,7 +302,7 @@ void OnInit() {
   GL_CHECK_ERRORS;
 
   // bind the normals buffer object and pass the normals to buffer object
-  glBindBuffer(GL_ARRAY_BUFFER, vboNormalsID);
+  glBindBuffer(GL_ARRAY_BUFFER, vboNormals.Get());
   glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * normals.size(),
                &(normals[0].x), GL_STATIC_DRAW);
 
@@ -288,23 +314,52 @@ void OnInit() {
   GL_CHECK_ERRORS;
 
   // if we have a single material, it means the 3ds model contains one mesh
-  // we therefore load it into an element array buffer
+  // and the faces are its indices, otherwise the submesh indices of all
+  // materials are stored one after the other so that every material is a
+  // range of one element array buffer
+  std::vector<GLushort> elements;
   if (materials.size() == 1) {
-    // pass indices to the element array buffer if there is a single material
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIndicesID);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * 3 * faces.size(),
-                 0, GL_STATIC_DRAW);
-
-    // fill the element array buffer memory with the indices array
-    GLushort *pIndices = static_cast<GLushort *>(
-        glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY));
     for (size_t i = 0; i < faces.size(); i++) {
-      *(pIndices++) = faces[i].a;
-      *(pIndices++) = faces[i].b;
-      *(pIndices++) = faces[i].c;
+      elements.push_back(faces[i].a);
+      elements.push_back(faces[i].b);
+      elements.push_back(faces[i].c);
     }
-    glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
   }
+  for (size_t i = 0; i < materials.size(); i++) {
+    MaterialDraw draw;
+    draw.texture = 0;
+    if (!materials[i].textureMaps.empty()) {
+      draw.texture =
+          textureMaps[materials[i].textureMaps[0].filename].Get();
+    }
+    draw.uniforms.hasTexture = draw.texture != 0 ? 1.0f : 0.0f;
+    draw.uniforms.diffuse =
+        glm::vec3(materials[i].diffuse[0], materials[i].diffuse[1],
+                  materials[i].diffuse[2]);
+    if (materials.size() == 1) {
+      draw.firstIndex = 0;
+    } else {
+      draw.firstIndex = elements.size();
+      elements.insert(elements.end(), materials[i].sub_indices.begin(),
+                      materials[i].sub_indices.end());
+    }
+    draw.count = static_cast<GLsizei>(elements.size() - draw.firstIndex);
+
+    // the centroid of the referenced vertices orders the opaque draws
+    draw.centroid = glm::vec3(0);
+    for (size_t k = draw.firstIndex; k < elements.size(); k++) {
+      draw.centroid += vertices[elements[k]];
+    }
+    if (draw.count > 0) {
+      draw.centroid /= static_cast<float>(draw.count);
+    }
+    materialDraws.push_back(draw);
+  }
+
+  // pass indices to the element array buffer
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIndices.Get());
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * elements.size(),
+               elements.data(), GL_STATIC_DRAW);
 
   GL_CHECK_ERRORS;
 
@@ -318,11 +373,11 @@ void OnInit() {
   crossHairVertices[5] = glm::vec3(0, 0, 0.5f);
 
   // setup light gizmo vertex array and vertex buffer object IDs
-  glGenVertexArrays(1, &lightVAOID);
-  glGenBuffers(1, &lightVerticesVBO);
-  glBindVertexArray(lightVAOID);
+  lightVAO      = GLVertexArray::Create();
+  lightVertices = GLBuffer::Create();
+  glBindVertexArray(lightVAO.Get());
   // pass crosshair vertices to the buffer object
-  glBindBuffer(GL_ARRAY_BUFFER, lightVerticesVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, lightVertices.Get());
   glBufferData(GL_ARRAY_BUFFER, sizeof(crossHairVertices),
                &(crossHairVertices[0].x), GL_STATIC_DRAW);
 
@@ -348,7 +403,22 @@ void OnInit() {
 }
 
 // release all allocated resources
-void OnShutdown() {}
+void OnShutdown() {
+  // output the state changes saved by the render queue
+  renderQueue.PrintStats(std::cout);
+
+  // the handles are globals, release them while the context is current
+  textureMaps.clear();
+  vboVertices.Reset();
+  vboUVs.Reset();
+  vboNormals.Reset();
+  vboIndices.Reset();
+  vao.Reset();
+  lightVertices.Reset();
+  lightVAO.Reset();
+  shader.DeleteShaderProgram();
+  flatShader.DeleteShaderProgram();
+}
 
 // resize event handler
 void OnResize(int w, int h) {
@@ -371,8 +441,6 @@ void OnRender() {
 
   GL_CHECK_ERRORS;
 
-  // bind the mesh vertex array object
-  glBindVertexArray(vaoID);
   {
     // bind the mesh rendering shader
     shader.Use();
@@ -383,60 +451,33 @@ void OnRender() {
     glUniformMatrix4fv(shader("P"), 1, GL_FALSE, glm::value_ptr(P));
     glUniform3fv(shader("light_position"), 1, &(lightPosOS.x));
 
-    // if we have a single material, we render the whole mesh in a single call
-    if (materials.size() == 1) {
-      GLint whichID[1];
-      glGetIntegerv(GL_TEXTURE_BINDING_2D, whichID);
-      // if the material has texturemaps and it is not bound already
-      // bind it and set the hasTexture variable to 1
-      if (textureMaps.size() > 0) {
-        if (static_cast<uint32_t>(whichID[0]) != textureMaps[materials[0]->textureMaps[0]->filename]) {
-          glBindTexture(GL_TEXTURE_2D,
-                        textureMaps[materials[0]->textureMaps[0]->filename]);
-          glUniform1f(shader("hasTexture"), 1.0);
-        }
-      } else {
-        // otherwise set hasTexture as 0 and use the material diffuse colour
-        glUniform1f(shader("hasTexture"), 0.0);
-        glUniform3fv(shader("diffuse_color"), 1, materials[0]->diffuse);
-      }
-      // draw mesh triangles in a single call
-      glDrawElements(GL_TRIANGLES, meshes[0]->faces.size() * 3,
-                     GL_UNSIGNED_SHORT, 0);
-    } else {
-      // otherwise we render the submeshes by material
-      for (size_t i = 0; i < materials.size(); i++) {
-        GLint whichID[1];
-        glGetIntegerv(GL_TEXTURE_BINDING_2D, whichID);
-        // if the material has texturemaps and it is not bound already
-        // bind it and set the hasTexture variable to 1
-        if (materials[i]->textureMaps.size() > 0) {
-          if (static_cast<uint32_t>(whichID[0]) !=
-              textureMaps[materials[i]->textureMaps[0]->filename]) {
-            glBindTexture(GL_TEXTURE_2D,
-                          textureMaps[materials[i]->textureMaps[0]->filename]);
-          }
-          glUniform1f(shader("hasTexture"), 1.0);
-        } else {
-          // otherwise set hasTexture as 0
-          glUniform1f(shader("hasTexture"), 0.0);
-        }
-        // pass the diffuse colour uniform to the material's diffuse color
-        glUniform3fv(shader("diffuse_color"), 1, materials[i]->diffuse);
-        // draw triangles using the submesh indices
-        glDrawElements(GL_TRIANGLES, materials[i]->sub_indices.size(),
-                       GL_UNSIGNED_SHORT, &(materials[i]->sub_indices[0]));
-      }
-    }
-    // unbind shader
+    // unbind shader, the queue binds it again for the material draws
     shader.UnUse();
+
+    // submit one draw per material, the queue sorts them by texture and
+    // front to back, binds each texture once and merges the draws that
+    // share a texture and material uniforms
+    for (const auto &material : materialDraws) {
+      CRenderQueue::DrawCall draw;
+      draw.program     = &shader;
+      draw.vao         = vao.Get();
+      draw.texture     = material.texture;
+      draw.indexType   = GL_UNSIGNED_SHORT;
+      draw.count       = material.count;
+      draw.firstIndex  = material.firstIndex;
+      draw.setUniforms = SetMaterialUniforms;
+      const float depth = -(MV * glm::vec4(material.centroid, 1)).z;
+      renderQueue.Submit(CRenderQueue::PASS_OPAQUE, draw, depth,
+                         material.uniforms);
+    }
+    renderQueue.Execute();
   }
 
   // disable depth testing
   glDisable(GL_DEPTH_TEST);
 
   // draw light gizmo
-  glBindVertexArray(lightVAOID);
+  glBindVertexArray(lightVAO.Get());
   {
     // set the modelling transform for the light crosshair gizmo
     glm::mat4 T = glm::translate(glm::mat4(1), lightPosOS);
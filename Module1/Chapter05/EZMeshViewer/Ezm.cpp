@@ -1,10 +1,13 @@
 // STL
+#include <algorithm>
 #include <map>
 #include <string>
 #include <fstream>
+#include <iostream>
 // Internal
 #include "Ezm.hpp"
 #include "MeshImport.h"
+#include "MeshOptimizer.hpp"
 // 3rdParty
 #include "3rdParty/pugi_xml/pugixml.hpp"
 #include "3rdParty/pugi_xml/pugiconfig.hpp"
@@ -220,5 +223,30 @@ bool EzmLoader::Load(const std::string &filename,
     }
   }
 
+  // reorder every submesh for the post-transform cache, then all vertices
+  // into the order the submeshes first use them
+  if (!vertices.empty()) {
+    std::vector<GLuint> optimized;
+    std::vector<CMeshOptimizer::Range> ranges;
+    for (const auto &submesh : submeshes) {
+      ranges.push_back({optimized.size(), submesh.indices.size()});
+      optimized.insert(optimized.end(), submesh.indices.begin(),
+                       submesh.indices.end());
+    }
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+      positions[i] = vertices[i].pos;
+    }
+    const auto remap = CMeshOptimizer::Optimize(
+        optimized, ranges, positions.data(), positions.size(),
+        filename.c_str(), std::cout);
+    for (size_t i = 0; i < submeshes.size(); i++) {
+      std::copy(optimized.begin() + ranges[i].first,
+                optimized.begin() + ranges[i].first + ranges[i].count,
+                submeshes[i].indices.begin());
+    }
+    CMeshOptimizer::Remap(vertices, remap);
+  }
+
   return true;
 }
@@ -1,7 +1,9 @@
 // STL
 #include <fstream>
+#include <iostream>
 #include <sstream>
 // Internal
+#include "MeshOptimizer.hpp"
 #include "Obj.hpp"
 
 // removes leacing and trailing spaces
@@ -19,7 +21,7 @@ std::string trim(const std::string &str,
 
 // reads materail libray (.MTL) file
 bool ReadMaterialLibrary(const std::string &filename,
-                         vector<Material *> &materials) {
+                         vector<Material> &materials) {
   ifstream fp(filename.c_str(), ios::in);
   if (!fp)
     return false;
@@ -44,9 +46,10 @@ bool ReadMaterialLibrary(const std::string &filename,
 
     if (prefix.compare("newmtl") == 0) // if we have a newmtl block
     {
-      pMat = new Material();
+      // stays valid until the next newmtl block adds a material
+      materials.emplace_back();
+      pMat = &materials.back();
       pMat->name = line.substr(space_index + 1);
-      materials.push_back(pMat);
     }
 
     else if (prefix.compare("Ns") == 0) {
@@ -115,9 +118,9 @@ bool ReadMaterialLibrary(const std::string &filename,
   return true;
 }
 
-bool ObjLoader::Load(const string &filename, vector<Mesh *> &meshes,
+bool ObjLoader::Load(const string &filename, vector<Mesh> &meshes,
                      vector<Vertex> &verts, vector<unsigned short> &indices,
-                     vector<Material *> &materials) {
+                     vector<Material> &materials) {
   ifstream fp(filename.c_str(), ios::in);
   if (!fp)
     return false;
@@ -167,8 +170,8 @@ bool ObjLoader::Load(const string &filename, vector<Mesh *> &meshes,
     if (prefix.compare("v") == 0) // if we have a vertex
     {
       if (isNewMesh) {
-        mesh = new Mesh();
-        meshes.push_back(mesh);
+        meshes.emplace_back();
+        mesh = &meshes.back();
         isNewMesh = false;
       }
 
@@ -278,15 +281,15 @@ bool ObjLoader::Load(const string &filename, vector<Mesh *> &meshes,
       total_triangles++;
 
       if (mesh->material_index != -1) {
-        materials[mesh->material_index]->sub_indices.push_back(f.a);
-        materials[mesh->material_index]->sub_indices.push_back(f.b);
-        materials[mesh->material_index]->sub_indices.push_back(f.c);
-        materials[mesh->material_index]->sub_indices.push_back(f.d);
-        materials[mesh->material_index]->sub_indices.push_back(f.e);
-        materials[mesh->material_index]->sub_indices.push_back(f.f);
-        materials[mesh->material_index]->sub_indices.push_back(f.g);
-        materials[mesh->material_index]->sub_indices.push_back(f.h);
-        materials[mesh->material_index]->sub_indices.push_back(f.i);
+        materials[mesh->material_index].sub_indices.push_back(f.a);
+        materials[mesh->material_index].sub_indices.push_back(f.b);
+        materials[mesh->material_index].sub_indices.push_back(f.c);
+        materials[mesh->material_index].sub_indices.push_back(f.d);
+        materials[mesh->material_index].sub_indices.push_back(f.e);
+        materials[mesh->material_index].sub_indices.push_back(f.f);
+        materials[mesh->material_index].sub_indices.push_back(f.g);
+        materials[mesh->material_index].sub_indices.push_back(f.h);
+        materials[mesh->material_index].sub_indices.push_back(f.i);
       }
 
       if (count == 4) {
@@ -311,15 +314,15 @@ bool ObjLoader::Load(const string &filename, vector<Mesh *> &meshes,
 
         total_triangles++;
         if (mesh->material_index != -1) {
-          materials[mesh->material_index]->sub_indices.push_back(f.a);
-          materials[mesh->material_index]->sub_indices.push_back(f.b);
-          materials[mesh->material_index]->sub_indices.push_back(f.c);
-          materials[mesh->material_index]->sub_indices.push_back(f.d);
-          materials[mesh->material_index]->sub_indices.push_back(f.e);
-          materials[mesh->material_index]->sub_indices.push_back(f.f);
-          materials[mesh->material_index]->sub_indices.push_back(f.g);
-          materials[mesh->material_index]->sub_indices.push_back(f.h);
-          materials[mesh->material_index]->sub_indices.push_back(f.i);
+          materials[mesh->material_index].sub_indices.push_back(f.a);
+          materials[mesh->material_index].sub_indices.push_back(f.b);
+          materials[mesh->material_index].sub_indices.push_back(f.c);
+          materials[mesh->material_index].sub_indices.push_back(f.d);
+          materials[mesh->material_index].sub_indices.push_back(f.e);
+          materials[mesh->material_index].sub_indices.push_back(f.f);
+          materials[mesh->material_index].sub_indices.push_back(f.g);
+          materials[mesh->material_index].sub_indices.push_back(f.h);
+          materials[mesh->material_index].sub_indices.push_back(f.i);
         }
       }
     }
@@ -337,7 +340,7 @@ bool ObjLoader::Load(const string &filename, vector<Mesh *> &meshes,
       string material_name = line.substr(space_index + 1);
       int index = -1;
       for (size_t i = 0; i < materials.size(); i++) {
-        if (materials[i]->name.compare(material_name) == 0) {
+        if (materials[i].name.compare(material_name) == 0) {
           index = i;
           break;
         }
@@ -359,7 +362,7 @@ bool ObjLoader::Load(const string &filename, vector<Mesh *> &meshes,
 
   // sort meshes by material
   for (size_t i = 0; i < materials.size(); i++) {
-    Material *pMat = materials[i];
+    Material *pMat = &materials[i];
     pMat->offset = count;
     for (size_t j = 0; j < pMat->sub_indices.size(); j += 9) {
       verts[count].pos = vertices[pMat->sub_indices[j]];
@@ -383,6 +386,30 @@ bool ObjLoader::Load(const string &filename, vector<Mesh *> &meshes,
     sub_count = 0;
   }
 
+  // every triangle corner is its own vertex so far; weld the shared ones,
+  // then reorder each material range for the post-transform cache
+  const auto welded = CMeshOptimizer::Weld(verts);
+  std::vector<GLuint> optimized(indices.size());
+  for (size_t i = 0; i < indices.size(); i++) {
+    optimized[i] = welded[indices[i]];
+  }
+  std::vector<CMeshOptimizer::Range> ranges;
+  for (const auto &material : materials) {
+    ranges.push_back({static_cast<size_t>(material.offset),
+                      static_cast<size_t>(material.count)});
+  }
+  std::vector<glm::vec3> positions(verts.size());
+  for (size_t i = 0; i < verts.size(); i++) {
+    positions[i] = verts[i].pos;
+  }
+  const auto remap =
+      CMeshOptimizer::Optimize(optimized, ranges, positions.data(),
+                               positions.size(), filename.c_str(), std::cout);
+  CMeshOptimizer::Remap(verts, remap);
+  for (size_t i = 0; i < indices.size(); i++) {
+    indices[i] = static_cast<unsigned short>(optimized[i]);
+  }
+
   // copy the contents into a linear array without material sorting
   /*
   for(size_t i=0;i<inds.size();i+=9) {
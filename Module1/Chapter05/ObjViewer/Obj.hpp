@@ -44,7 +44,8 @@ public:
 
 class ObjLoader {
 public:
-  bool Load(const string &filename, vector<Mesh *> &meshes,
+  // meshes and materials are appended by value
+  bool Load(const string &filename, vector<Mesh> &meshes,
             vector<Vertex> &verts, vector<unsigned short> &inds,
-            vector<Material *> &materials);
+            vector<Material> &materials);
 };
@@ -3,6 +3,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <string>
+#include <utility>
 #include <vector>
 // GLEW
 #include <GL/glew.h>
@@ -15,8 +16,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 // Internal
+#include "GLHandle.hpp"
 #include "GLSLShader.hpp"
+#include "IndirectDraw.hpp"
 #include "Obj.hpp"
+#include "VertexFormat.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
 
@@ -28,10 +32,10 @@ const int HEIGHT = 960;
 // mesh rendering shader and flat shader
 GLSLShader shader, flatShader;
 
-// IDs for vertex array and buffer object
-GLuint vaoID;
-GLuint vboVerticesID;
-GLuint vboIndicesID;
+// vertex array and buffer objects
+GLVertexArray vao;
+GLBuffer vboVertices;
+GLBuffer vboIndices;
 
 // projection and modelview matrices
 glm::mat4 P = glm::mat4(1);
@@ -41,15 +45,29 @@ const std::string mesh_filename = "media/blocks.obj";
 
 // Objloader instance
 ObjLoader obj;
-std::vector<Mesh *> meshes;          // all meshes
-std::vector<Material *> materials;   // all materials
+std::vector<Mesh> meshes;            // all meshes
+std::vector<Material> materials;     // all materials
 std::vector<unsigned short> indices; // all mesh indices
 std::vector<Vertex> vertices;        // all mesh vertices
-std::vector<GLuint> textures;        // all textures
-
-// light crosshair gizmo vetex array and buffer object IDs
-GLuint lightVAOID;
-GLuint lightVerticesVBO;
+std::vector<GLTexture> textures;     // all textures
+
+// packed layout of the mesh vertices on the GPU: unorm16 positions,
+// octahedral normals and unorm16 UVs in one interleaved stream
+CVertexFormat vertexFormat;
+GLenum indexType = GL_UNSIGNED_SHORT;
+glm::vec4 uvTransform = glm::vec4(1, 1, 0, 0); // maps packed UVs back
+glm::vec3 positionScale  = glm::vec3(1);       // maps packed positions back
+glm::vec3 positionOffset = glm::vec3(0);
+
+// materials grouped by their diffuse texture (0 for none), every group is
+// drawn with one multi-draw whatever the number of its materials
+std::vector<GLuint> groupTextures;
+std::vector<std::vector<size_t>> groupMaterials;
+CIndirectDraw indirectDraw;
+
+// light crosshair gizmo vetex array and buffer object
+GLVertexArray lightVAO;
+GLBuffer lightVertices;
 
 glm::vec3 lightPosOS = glm::vec3(0, 2, 0); // objectspace light position
 
@@ -138,18 +156,17 @@ void OnInit() {
   // load material textures
   for (size_t k = 0; k < materials.size(); k++) {
     // if the diffuse texture name is not empty
-    if (materials[k]->map_Kd != "") {
+    if (materials[k].map_Kd != "") {
       // generate a new OpenGL array texture
-      GLuint id = 0;
-      glGenTextures(1, &id);
-      glBindTexture(GL_TEXTURE_2D, id);
+      GLTexture texture = GLTexture::Create();
+      glBindTexture(GL_TEXTURE_2D, texture.Get());
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
       int texture_width = 0, texture_height = 0, channels = 0;
 
-      const string &filename = materials[k]->map_Kd;
+      const string &filename = materials[k].map_Kd;
 
       std::string full_filename = mesh_path;
       full_filename.append(filename);
@@ -195,9 +212,23 @@ void OnInit() {
       // release the SOIL image data
       SOIL_free_image_data(pData);
 
-      // add loaded texture ID to vector
-      textures.push_back(id);
+      // add loaded texture to vector
+      textures.push_back(std::move(texture));
+    }
+  }
+
+  // group the materials by texture, in order of first use
+  for (size_t k = 0, texture = 0; k < materials.size(); k++) {
+    const GLuint id =
+        (materials[k].map_Kd != "") ? textures[texture++].Get() : 0;
+    size_t group = 0;
+    while (group < groupTextures.size() && groupTextures[group] != id)
+      group++;
+    if (group == groupTextures.size()) {
+      groupTextures.push_back(id);
+      groupMaterials.emplace_back();
     }
+    groupMaterials[group].push_back(k);
   }
   GL_CHECK_ERRORS;
 
@@ -213,7 +244,9 @@ void OnInit() {
   flatShader.UnUse();
 
   // load mesh rendering shader
-  shader.LoadFromFile(GL_VERTEX_SHADER, "shaders/shader.vert");
+  // the submeshes read their draw data by gl_DrawID
+  shader.LoadFromFile(GL_VERTEX_SHADER, "shaders/shader.vert",
+                      CIndirectDraw::GetDefines());
   shader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/shader.frag");
   // compile and link shader
   shader.CreateAndLinkProgram();
@@ -226,8 +259,10 @@ void OnInit() {
   shader.AddUniform("N");
   shader.AddUniform("P");
   shader.AddUniform("textureMap");
-  shader.AddUniform("useDefault");
   shader.AddUniform("light_position");
+  shader.AddUniform("uvTransform");
+  shader.AddUniform("positionScale");
+  shader.AddUniform("positionOffset");
   shader.AddUniform("diffuse_color");
   // set values of constant uniforms as initialization
   glUniform1i(shader("textureMap"), 0);
@@ -237,49 +272,64 @@ void OnInit() {
 
   // setup the vertex array object and vertex buffer object for the mesh
   // geometry handling
-  glGenVertexArrays(1, &vaoID);
-  glGenBuffers(1, &vboVerticesID);
-  glGenBuffers(1, &vboIndicesID);
+  vao         = GLVertexArray::Create();
+  vboVertices = GLBuffer::Create();
+  vboIndices  = GLBuffer::Create();
 
   // here we are using interleaved attributes so we can just push data to one
   // buffer object and then assign different atribute pointer to identofy the
   // different attributes
-  glBindVertexArray(vaoID);
-  glBindBuffer(GL_ARRAY_BUFFER, vboVerticesID);
-  // pass mesh vertices
-  glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(),
-               &(vertices[0].pos.x), GL_STATIC_DRAW);
-  GL_CHECK_ERRORS;
-  // enable vertex attribute array for vertex position
-  glEnableVertexAttribArray(shader["vVertex"]);
-  glVertexAttribPointer(shader["vVertex"], 3, GL_FLOAT, GL_FALSE,
-                        sizeof(Vertex), 0);
+  // pack the loaded vertices, the shader decodes normals and UVs
+  std::vector<glm::vec3> positions, normals;
+  std::vector<glm::vec2> uvs;
+  for (const auto &vertex : vertices) {
+    positions.push_back(vertex.pos);
+    normals.push_back(vertex.normal);
+    uvs.push_back(vertex.uv);
+  }
+  // positions are quantized over the mesh bounds, the shader maps them back
+  vertexFormat.position = CVertexFormat::Position::UNORM16;
+  vertexFormat.normal = CVertexFormat::Normal::OCT_SNORM16;
+  vertexFormat.uv     = CVertexFormat::UV::UNORM16;
+  const std::vector<GLuint> wideIndices(indices.begin(), indices.end());
+  const auto packed =
+      vertexFormat.Pack(positions.data(), normals.data(), uvs.data(),
+                        vertices.size(), wideIndices.data(), wideIndices.size());
+  indexType   = packed.indexType;
+  uvTransform = packed.uvTransform;
+  positionScale  = packed.positionScale;
+  positionOffset = packed.positionOffset;
+
+  // report the savings against the loader's Vertex layout
+  CVertexFormat loaded;
+  loaded.normal = CVertexFormat::Normal::FLOAT3;
+  loaded.uv     = CVertexFormat::UV::FLOAT2;
+  CVertexFormat::PrintReport(std::cout, "Mesh", vertices.size(),
+                             indices.size(), loaded, GL_UNSIGNED_SHORT,
+                             vertexFormat, indexType);
+
+  glBindVertexArray(vao.Get());
+  glBindBuffer(GL_ARRAY_BUFFER, vboVertices.Get());
+  // pass packed mesh vertices
+  glBufferData(GL_ARRAY_BUFFER,
+               static_cast<GLsizeiptr>(packed.streams[0].size()),
+               packed.streams[0].data(), GL_STATIC_DRAW);
   GL_CHECK_ERRORS;
-  // enable vertex attribute array for vertex normal
-  glEnableVertexAttribArray(shader["vNormal"]);
-  glVertexAttribPointer(
-      shader["vNormal"], 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-      reinterpret_cast<const GLvoid *>(offsetof(Vertex, normal)));
-
+  // enable the vertex attribute arrays of the packed layout
+  vertexFormat.SetAttributes({vboVertices.Get()});
   GL_CHECK_ERRORS;
-  // enable vertex attribute array for vertex texture coordinates
-  glEnableVertexAttribArray(shader["vUV"]);
-  glVertexAttribPointer(shader["vUV"], 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                        reinterpret_cast<const GLvoid *>(offsetof(Vertex, uv)));
 
-  GL_CHECK_ERRORS;
-
-  // if we have a single material, it means the 3ds model contains one mesh
-  // we therefore load it into an element array buffer
-  if (materials.size() == 1) {
-    // pass indices to the element array buffer if there is a single material
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIndicesID);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indices.size(),
-                 &(indices[0]), GL_STATIC_DRAW);
-  }
+  // pass indices to the element array buffer, the submeshes are ranges of it
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIndices.Get());
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               static_cast<GLsizeiptr>(packed.indices.size()),
+               packed.indices.data(), GL_STATIC_DRAW);
   GL_CHECK_ERRORS;
   glBindVertexArray(0);
 
+  // one command per material
+  indirectDraw.Init(static_cast<GLsizei>(materials.size()));
+
   // setup vao and vbo stuff for the light position crosshair
   glm::vec3 crossHairVertices[6];
   crossHairVertices[0] = glm::vec3(-0.5f, 0, 0);
@@ -290,11 +340,11 @@ void OnInit() {
   crossHairVertices[5] = glm::vec3(0, 0, 0.5f);
 
   // setup light gizmo vertex array and vertex buffer object IDs
-  glGenVertexArrays(1, &lightVAOID);
-  glGenBuffers(1, &lightVerticesVBO);
-  glBindVertexArray(lightVAOID);
+  lightVAO      = GLVertexArray::Create();
+  lightVertices = GLBuffer::Create();
+  glBindVertexArray(lightVAO.Get());
 
-  glBindBuffer(GL_ARRAY_BUFFER, lightVerticesVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, lightVertices.Get());
   // pass crosshair vertices to the buffer object
   glBufferData(GL_ARRAY_BUFFER, sizeof(crossHairVertices),
                &(crossHairVertices[0].x), GL_STATIC_DRAW);
@@ -339,7 +389,7 @@ void OnRender() {
   const auto MV = glm::rotate(Rx, rY, glm::vec3(0.0f, 1.0f, 0.0f));
 
   // bind the mesh vertex array object
-  glBindVertexArray(vaoID);
+  glBindVertexArray(vao.Get());
   {
     // bind the mesh rendering shader
     shader.Use();
@@ -349,29 +399,27 @@ void OnRender() {
                        glm::value_ptr(glm::inverseTranspose(glm::mat3(MV))));
     glUniformMatrix4fv(shader("P"), 1, GL_FALSE, glm::value_ptr(P));
     glUniform3fv(shader("light_position"), 1, &(lightPosOS.x));
-
-    // loop through all materials
-    for (size_t i = 0; i < materials.size(); i++) {
-      Material *pMat = materials[i];
-      // if material texture filename is not empty
-      // dont use the default colour
-      if (pMat->map_Kd != "") {
-        glUniform1f(shader("useDefault"), 0.0);
-        GLint whichID[1];
-        glGetIntegerv(GL_TEXTURE_BINDING_2D, whichID);
-        if (static_cast<uint32_t>(whichID[0]) != textures[i])
-          glBindTexture(GL_TEXTURE_2D, textures[i]);
-      } else
-        // otherwise we have no texture, we use a default colour
-        glUniform1f(shader("useDefault"), 1.0);
-
-      // if we have a single material, we render the whole mesh in a single call
-      if (materials.size() == 1)
-        glDrawElements(GL_TRIANGLES, static_cast<int>(indices.size()), GL_UNSIGNED_SHORT, 0);
-      else
-        // otherwise we render the submesh
-        glDrawElements(GL_TRIANGLES, pMat->count, GL_UNSIGNED_SHORT,
-                       reinterpret_cast<const GLvoid *>(&indices[static_cast<size_t>(pMat->offset)]));
+    glUniform4fv(shader("uvTransform"), 1, glm::value_ptr(uvTransform));
+    glUniform3fv(shader("positionScale"), 1, glm::value_ptr(positionScale));
+    glUniform3fv(shader("positionOffset"), 1, glm::value_ptr(positionOffset));
+
+    // one texture bind and one multi-draw per texture, the materials pass
+    // their model matrix and default colour flag as draw data
+    for (size_t group = 0; group < groupTextures.size(); group++) {
+      if (groupTextures[group] != 0)
+        glBindTexture(GL_TEXTURE_2D, groupTextures[group]);
+      for (size_t i : groupMaterials[group]) {
+        const Material *pMat = &materials[i];
+        const float useDefault = (pMat->map_Kd != "") ? 0.0f : 1.0f;
+        // if we have a single material, we render the whole mesh
+        if (materials.size() == 1)
+          indirectDraw.Add(static_cast<GLsizei>(indices.size()), 0, 0,
+                           glm::mat4(1), glm::vec4(useDefault));
+        else
+          indirectDraw.Add(pMat->count, static_cast<size_t>(pMat->offset), 0,
+                           glm::mat4(1), glm::vec4(useDefault));
+      }
+      indirectDraw.Draw(shader, GL_TRIANGLES, indexType, 1);
     }
     // unbind the shader
     shader.UnUse();
@@ -381,7 +429,7 @@ void OnRender() {
   glDisable(GL_DEPTH_TEST);
 
   // draw the light gizmo, set the light vertexx array object
-  glBindVertexArray(lightVAOID);
+  glBindVertexArray(lightVAO.Get());
   {
     // set the modelling transform for the light crosshair gizmo
     glm::mat4 Translation = glm::translate(glm::mat4(1), lightPosOS);
@@ -399,43 +447,32 @@ void OnRender() {
 
   // swap front and back buffers to show the rendered result
   glutSwapBuffers();
+
+  // fence the draw data of this frame
+  indirectDraw.EndFrame();
 }
 
 // release all allocated resources
 void OnShutdown() {
-  // delete all textures
-  size_t total_textures = textures.size();
-  for (size_t i = 0; i < total_textures; i++) {
-    glDeleteTextures(1, &textures[i]);
-  }
-  textures.clear();
+  indirectDraw.PrintStats(std::cout);
+  indirectDraw.Destroy();
 
-  // delete all meshes
-  size_t total_meshes = meshes.size();
-  for (size_t i = 0; i < total_meshes; i++) {
-    delete meshes[i];
-    meshes[i] = 0;
-  }
+  // delete all textures, meshes and materials
+  textures.clear();
   meshes.clear();
-
-  size_t total_materials = materials.size();
-  for (size_t i = 0; i < total_materials; i++) {
-    delete materials[i];
-    materials[i] = 0;
-  }
   materials.clear();
 
   // Destroy shader
   shader.DeleteShaderProgram();
   flatShader.DeleteShaderProgram();
 
-  // Destroy vao and vbo
-  glDeleteBuffers(1, &vboVerticesID);
-  glDeleteBuffers(1, &vboIndicesID);
-  glDeleteVertexArrays(1, &vaoID);
+  // Destroy vao and vbo while the context is current
+  vboVertices.Reset();
+  vboIndices.Reset();
+  vao.Reset();
 
-  glDeleteVertexArrays(1, &lightVAOID);
-  glDeleteBuffers(1, &lightVerticesVBO);
+  lightVAO.Reset();
+  lightVertices.Reset();
 
   std::cout << "Shutdown successfull\n";
 }
@@ -0,0 +1,26 @@
+// Per-draw data of CIndirectDraw, fetched by the index of the draw within
+// its multi-draw. Include right after #version, before any declaration.
+#ifdef MULTI_DRAW_INDIRECT
+#extension GL_ARB_shader_draw_parameters : require
+#define DRAW_ID gl_DrawIDARB
+#else
+uniform int drawID;	//index of the draw set for every draw call
+#define DRAW_ID drawID
+#endif
+
+uniform samplerBuffer drawData;	//five RGBA32F texels per draw
+uniform int drawDataBase;		//first texel of the batch
+
+mat4 DrawTransform()
+{
+	int base = drawDataBase + DRAW_ID*5;
+	return mat4(texelFetch(drawData, base),
+	            texelFetch(drawData, base+1),
+	            texelFetch(drawData, base+2),
+	            texelFetch(drawData, base+3));
+}
+
+vec4 DrawParams()
+{
+	return texelFetch(drawData, drawDataBase + DRAW_ID*5 + 4);
+}
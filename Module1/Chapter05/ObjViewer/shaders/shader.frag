@@ -5,13 +5,13 @@ layout(location=0) out vec4 vFragColor;	//fragment shader output
 //uniforms
 uniform mat4 MV;			   //modelview matrix
 uniform sampler2D textureMap;  //texture for the current mesh/submesh
-uniform float useDefault;	   //if we want to use default color
 uniform vec3 light_position;   //light position in object space
  
 //inputs from the vertex shader
 smooth in vec3 vEyeSpaceNormal;    //eye space normal from the vertex shader   
 smooth in vec3 vEyeSpacePosition;  //eye space position from the vertex shader
 smooth in vec2 vUVout;			   //texture coordinates from the vertex shader
+flat in float vUseDefault;		   //if we want to use default color
 
 //shader constants
 const float k0 = 1.0;	//constant attenuation
@@ -34,5 +34,5 @@ void main()
 	float attenuationAmount = 1.0/(k0 + (k1*d) + (k2*d*d));
 	diffuse *= attenuationAmount;
 	//return final output colour
-	vFragColor = diffuse*mix(texture(textureMap, vUVout), vec4(1), useDefault);
+	vFragColor = diffuse*mix(texture(textureMap, vUVout), vec4(1), vUseDefault);
 }
\ No newline at end of file
@@ -1,10 +1,28 @@
 #version 330 core
+#include "draw_data.glsl"
  
-layout(location = 0) in vec3 vVertex;	 //vertex position
-layout(location = 1) in vec3 vNormal;	 //vertex normal
-layout(location = 2) in vec2 vUV;		 //vertex uv coordinates
+layout(location = 0) in vec3 vVertex;	 //vertex position, unorm16
+layout(location = 1) in vec2 vNormal;	 //octahedral vertex normal, snorm16
+layout(location = 2) in vec2 vUV;		 //vertex uv coordinates, unorm16
 
-//uniforms for projection, modelview and normal matrices
+//scale (xy) and offset (zw) of the uv bounds of the mesh
+uniform vec4 uvTransform;
+
+//scale and offset of the position bounds of the mesh
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+//unfold the octahedral normal encoding
+vec3 OctDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(e.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(e, vec2(0.0)));
+	return normalize(n);
+}
+
+//uniforms for projection, modelview and normal matrices, the model
+//matrix of every draw comes from its draw data
 uniform mat4 P; 
 uniform mat4 MV;
 uniform mat3 N;
@@ -13,19 +31,25 @@ uniform mat3 N;
 smooth out vec2 vUVout;					//texture coordinates
 smooth out vec3 vEyeSpaceNormal;    	//eye space normals
 smooth out vec3 vEyeSpacePosition;		//eye space positions
+flat out float vUseDefault;				//if we want to use default color
 
 void main()
 {
     //output the texture coordinates
-	vUVout=vUV; 
-	
+	vUVout=vUV*uvTransform.xy + uvTransform.zw; 
+	vUseDefault = DrawParams().x;
+
+	//combine the modelview matrix with the model matrix of this draw
+	mat4 MVM = MV*DrawTransform();
+
 	//multiply the object space vertex position with the modelview matrix 
 	//to get the eye space position  
-	vEyeSpacePosition = (MV*vec4(vVertex,1)).xyz; 
+	vEyeSpacePosition = (MVM*vec4(vVertex*positionScale + positionOffset,1)).xyz; 
 
 	//multiply the object space normal with the normal matrix to get 
-	//the eye space normal
-	vEyeSpaceNormal   = N*vNormal;
+	//the eye space normal, the draw transforms are rigid so their upper
+	//3x3 is their own normal matrix
+	vEyeSpaceNormal   = N*mat3(DrawTransform())*OctDecode(vNormal);
 
 	//multiply the projection matrix with the eye space position to get
 	//the clipspace postion
@@ -14,6 +14,7 @@
 #include <SOIL.h>
 // Internal
 #include "GLSLShader.hpp"
+#include "MeshOptimizer.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
 
@@ -152,6 +153,13 @@ void OnInit() {
     }
   }
 
+  // the row by row order misses the cache on every new row, reorder it
+  const auto remap = CMeshOptimizer::Optimize(
+      g_pCommon->indices, {{0, g_pCommon->indices.size()}},
+      g_pCommon->vertices.data(), g_pCommon->vertices.size(), "Terrain",
+      std::cout);
+  CMeshOptimizer::Remap(g_pCommon->vertices, remap);
+
   GL_CHECK_ERRORS;
 
   // setup terrain vertex array and vertex buffer objects
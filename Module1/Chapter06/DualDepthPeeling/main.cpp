@@ -1,4 +1,5 @@
 // STL
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 // GLEW
@@ -10,7 +11,10 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 // Internal
+#include "GeometryPool.hpp"
 #include "Grid.hpp"
+#include "QueryPool.hpp"
+#include "UnitCube.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
 
@@ -26,6 +30,10 @@ float rX = 0, rY = 300, dist = -10;
 // grid object
 CGrid *grid;
 
+// unit cube drawn 27 times per pass with RenderInstanced
+CUnitCube *cube;
+const GLsizei TOTAL_CUBES = 27;
+
 // modelview projection and rotation matrices
 glm::mat4 MV, P, R;
 
@@ -49,19 +57,14 @@ GLuint colorBlenderFBOID;
 // colour blend FBO colour attachment texture ID
 GLuint colorBlenderTexID;
 
-// occlusion query ID
-GLuint queryId;
+// occlusion queries, one per peeling pass, read back a few frames late
+CQueryPool queries;
 
 // fullscreen quad vao and vbos
 GLuint quadVAOID;
 GLuint quadVBOID;
 GLuint quadIndicesID;
 
-// cube vertex array and vertex buffer object IDs
-GLuint cubeVBOID;
-GLuint cubeVAOID;
-GLuint cubeIndicesID;
-
 // shaders for cube, initialization, dual depth peeling, blending and final
 // rendering
 GLSLShader cubeShader, initShader, dualPeelShader, blendShader, finalShader;
@@ -72,6 +75,13 @@ const int NUM_PASSES = 4;
 // flag to use occlusion queries
 bool bUseOQ = true;
 
+// with occlusion queries, the last pass to peel as measured by the queries
+// of an earlier frame
+const int MAX_PEEL_PASSES = 32;
+int numPeelPasses = NUM_PASSES - 1;
+// first pass without samples in the frame whose results are arriving
+int firstEmptyPass = MAX_PEEL_PASSES + 1;
+
 // flag to use dual depth peeling
 bool bShowDepthPeeling = true;
 
@@ -260,14 +270,29 @@ void initFBO() {
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+// adapt the number of passes to the sample counts of an earlier frame
+void OnPassSamples(const int layer, const int lastLayer, const GLuint64 samples) {
+  if (samples == 0 && layer < firstEmptyPass) {
+    firstEmptyPass = layer;
+  }
+  if (layer == lastLayer) {
+    // keep peeling up to the first empty pass, like breaking out of the loop
+    // did, or try one more pass when even the last one drew samples
+    numPeelPasses = firstEmptyPass <= lastLayer
+                        ? firstEmptyPass
+                        : std::min(lastLayer + 1, MAX_PEEL_PASSES);
+    firstEmptyPass = MAX_PEEL_PASSES + 1;
+  }
+}
+
 void OnInit() {
   GL_CHECK_ERRORS;
 
   // initialize FBO
   initFBO();
 
-  // generate hardwre query
-  glGenQueries(1, &queryId);
+  // generate hardwre queries for a few frames of passes
+  queries.Init(GL_SAMPLES_PASSED, 4 * MAX_PEEL_PASSES);
 
   // create a uniform grid of size 20x20 in XZ plane
   grid = new CGrid(20, 20);
@@ -306,44 +331,19 @@ void OnInit() {
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndices), &quadIndices[0],
                GL_STATIC_DRAW);
 
-  // setup unit cube vertex array and vertex buffer objects
-  glGenVertexArrays(1, &cubeVAOID);
-  glGenBuffers(1,      &cubeVBOID);
-  glGenBuffers(1,      &cubeIndicesID);
-
-  // unit cube vertices
-  glm::vec3 vertices[8] = {
-      glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, -0.5f, -0.5f),
-      glm::vec3(0.5f, 0.5f, -0.5f),   glm::vec3(-0.5f, 0.5f, -0.5f),
-      glm::vec3(-0.5f, -0.5f, 0.5f),  glm::vec3(0.5f, -0.5f, 0.5f),
-      glm::vec3(0.5f, 0.5f, 0.5f),    glm::vec3(-0.5f, 0.5f, 0.5f)};
-
-  // unit cube indices
-  GLushort cubeIndices[36] = {0, 5, 4, 5, 0, 1, 3, 7, 6, 3, 6, 2,
-                              7, 4, 6, 6, 4, 5, 2, 1, 3, 3, 1, 0,
-                              3, 0, 7, 7, 0, 4, 6, 5, 2, 2, 5, 1};
-  glBindVertexArray(cubeVAOID);
-  glBindBuffer(GL_ARRAY_BUFFER, cubeVBOID);
-  // pass cube vertices to buffer object memory
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &(vertices[0].x),
-               GL_STATIC_DRAW);
-
-  GL_CHECK_ERRORS;
-
-  // enable vertex attributre array for position
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+  glBindVertexArray(0);
 
-  // pass cube indices to element array  buffer
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeIndicesID);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), &cubeIndices[0],
-               GL_STATIC_DRAW);
+  // the 3x3x3 cubes share the geometry of one instanced unit cube
+  cube = new CUnitCube();
 
-  glBindVertexArray(0);
+  // the cube drawing shaders read per-instance transforms and colours
+  const CShaderPreprocessor::Defines INSTANCED = {{"INSTANCED", "1"}};
 
   // Load the cube shader
-  cubeShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/cube_shader.vert");
-  cubeShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/cube_shader.frag");
+  cubeShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/cube_shader.vert",
+                          INSTANCED);
+  cubeShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/cube_shader.frag",
+                          INSTANCED);
   // compile and link the shader
   cubeShader.CreateAndLinkProgram();
   cubeShader.Use();
@@ -356,8 +356,10 @@ void OnInit() {
   GL_CHECK_ERRORS;
 
   // Load the initialization shader
-  initShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/cube_shader.vert");
-  initShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/dual_init.frag");
+  initShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/cube_shader.vert",
+                          INSTANCED);
+  initShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/dual_init.frag",
+                          INSTANCED);
   // compile and link the shader
   initShader.CreateAndLinkProgram();
   initShader.Use();
@@ -369,8 +371,10 @@ void OnInit() {
   GL_CHECK_ERRORS;
 
   // Load the dual depth peeling shader
-  dualPeelShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/dual_peel.vert");
-  dualPeelShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/dual_peel.frag");
+  dualPeelShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/dual_peel.vert",
+                              INSTANCED);
+  dualPeelShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/dual_peel.frag",
+                              INSTANCED);
   // compile and link the shader
   dualPeelShader.CreateAndLinkProgram();
   dualPeelShader.Use();
@@ -450,16 +454,16 @@ void OnShutdown() {
   finalShader.DeleteShaderProgram();
 
   shutdownFBO();
-  glDeleteQueries(1, &queryId);
+  queries.PrintStats(std::cout);
+  queries.Destroy();
 
   glDeleteVertexArrays(1, &quadVAOID);
   glDeleteBuffers(1, &quadVBOID);
   glDeleteBuffers(1, &quadIndicesID);
 
-  glDeleteVertexArrays(1, &cubeVAOID);
-  glDeleteBuffers(1, &cubeVBOID);
-  glDeleteBuffers(1, &cubeIndicesID);
-
+  CGeometryPool::Instance().PrintStats(std::cout);
+  RenderableObject::GetInstanceBuffer().GetStream().PrintStats(std::cout);
+  delete cube;
   delete grid;
   std::cout << "Shutdown successfull\n";
 }
@@ -477,39 +481,32 @@ void DrawScene(const glm::mat4 &MVP, GLSLShader &shader, bool useColor,
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  // bind the cube vertex array object
-  glBindVertexArray(cubeVAOID);
-
-  // bind the shader
-  shader.Use();
-
-  // for all cubes
+  // modelling transformation and colour of all cubes
+  glm::mat4 models[TOTAL_CUBES];
+  glm::vec4 colors[TOTAL_CUBES];
+  int index = 0;
   for (int k = -1; k <= 1; k++) {
     for (int j = -1; j <= 1; j++) {
-      int index = 0;
       for (int i = -1; i <= 1; i++) {
-        GL_CHECK_ERRORS;
-        // set the modelling transformation and shader uniforms
-        glm::mat4 T =
-            glm::translate(glm::mat4(1), glm::vec3(i * 2, j * 2, k * 2));
-        if (useColor)
-          glUniform4fv(shader("vColor"), 1, &(box_colors[index++].x));
-        if (useAlphaMultiplier)
-          glUniform1f(shader("alpha"), alpha);
-
-        glUniformMatrix4fv(shader("MVP"), 1, GL_FALSE,
-                           glm::value_ptr(MVP * R * T));
-
-        // draw the cube
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
-        GL_CHECK_ERRORS;
+        models[index] =
+            R * glm::translate(glm::mat4(1), glm::vec3(i * 2, j * 2, k * 2));
+        colors[index] = box_colors[i + 1];
+        ++index;
       }
     }
   }
-  // unbind shader
-  shader.UnUse();
-  // unbind vertex array object
-  glBindVertexArray(0);
+
+  if (useAlphaMultiplier) {
+    shader.Use();
+    glUniform1f(shader("alpha"), alpha);
+  }
+
+  // draw all cubes at once, MVP is the view projection for the instances
+  GL_CHECK_ERRORS;
+  cube->RenderInstanced(glm::value_ptr(MVP), models, TOTAL_CUBES,
+                        useColor ? colors : nullptr, &shader);
+  GL_CHECK_ERRORS;
+
   // diable alpha blending
   glDisable(GL_BLEND);
 }
@@ -525,6 +522,9 @@ void OnRender() {
   GL_CHECK_ERRORS;
 
   // camera transformation
+  // sample counts of the passes of earlier frames
+  queries.Poll();
+
   glm::mat4 Tr = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, dist));
   glm::mat4 Rx = glm::rotate(Tr, rX, glm::vec3(1.0f, 0.0f, 0.0f));
   glm::mat4 MV = glm::rotate(Rx, rY, glm::vec3(0.0f, 1.0f, 0.0f));
@@ -571,8 +571,9 @@ void OnRender() {
     glClear(GL_COLOR_BUFFER_BIT);
 
     int currId = 0;
+    const int lastPass = bUseOQ ? numPeelPasses : NUM_PASSES - 1;
     // for each pass
-    for (int layer = 1; bUseOQ || layer < NUM_PASSES; layer++) {
+    for (int layer = 1; layer <= lastPass; layer++) {
       currId = layer % 2;
       int prevId = 1 - currId;
       int bufId = currId * 3;
@@ -616,9 +617,10 @@ void OnRender() {
       glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
       // if we want to use occlusion query, we initiate it
-      if (bUseOQ) {
-        glBeginQuery(GL_SAMPLES_PASSED_ARB, queryId);
-      }
+      const bool queried =
+          bUseOQ && queries.Begin([layer, lastPass](const GLuint64 samples) {
+            OnPassSamples(layer, lastPass, samples);
+          });
 
       GL_CHECK_ERRORS;
 
@@ -631,16 +633,10 @@ void OnRender() {
       DrawFullScreenQuad();
       blendShader.UnUse();
 
-      // if we initiated the occlusion query, we end it and get
-      // the query result which is the total number of samples
-      // output from the blending result
-      if (bUseOQ) {
-        glEndQuery(GL_SAMPLES_PASSED);
-        GLuint sample_count;
-        glGetQueryObjectuiv(queryId, GL_QUERY_RESULT, &sample_count);
-        if (sample_count == 0) {
-          break;
-        }
+      // if we initiated the occlusion query, we end it, the total number
+      // of samples output from the blending result arrives in a later frame
+      if (queried) {
+        queries.End();
       }
       GL_CHECK_ERRORS;
     }
@@ -684,6 +680,9 @@ void OnRender() {
 
   // swap front and back buffers to show the rendered result
   glutSwapBuffers();
+
+  // fence this frame's instance uploads, the next frame writes elsewhere
+  RenderableObject::GetInstanceBuffer().EndFrame();
 }
 
 void OnKey(unsigned char key, int x, int y) {
@@ -2,7 +2,10 @@
 
 layout(location = 0) out vec4 vFragColor; //output fragment colour
 
+#include "instanced_fragment.glsl"
+#ifndef INSTANCED
 uniform vec4 vColor;	//colour uniform
+#endif
 
 void main()
 {
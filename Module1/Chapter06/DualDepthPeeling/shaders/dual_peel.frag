@@ -5,7 +5,10 @@ layout(location = 1) out vec4 vFragColor1;	//output to target 1
 layout(location = 2) out vec4 vFragColor2;	//output to target 2	
  
 //uniforms
+#include "instanced_fragment.glsl"
+#ifndef INSTANCED
 uniform vec4 vColor;		//solid colour of the cube
+#endif
 uniform sampler2DRect  depthBlenderTex;	//depth blending output
 uniform sampler2DRect  frontBlenderTex;	//front blending output
 uniform float alpha;	//fragment alpha
@@ -5,6 +5,7 @@
 // GLUT
 #include <GL/freeglut.h>
 // STL
+#include <algorithm>
 #include <iostream>
 // GLM
 #include <glm/glm.hpp>
@@ -12,7 +13,10 @@
 #include <glm/gtc/type_ptr.hpp>
 // internal
 #include "GLSLShader.hpp"
+#include "GeometryPool.hpp"
 #include "Grid.hpp"
+#include "QueryPool.hpp"
+#include "UnitCube.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
 
@@ -27,7 +31,19 @@ struct Common {
   // grid object
   CGrid *m_pGrid = nullptr;
 
-  GLuint mQueryId;
+  // unit cube drawn 27 times per pass with RenderInstanced
+  CUnitCube *m_pCube = nullptr;
+  static constexpr GLsizei TOTAL_CUBES = 27;
+
+  // occlusion queries, one per peeling layer, read back a few frames late
+  CQueryPool mQueries;
+  // with occlusion queries, the last layer to peel as measured by the
+  // queries of an earlier frame
+  static constexpr int MAX_PEEL_LAYERS = 32;
+  int mNumPeelLayers = (NUM_PASSES - 1) * 2 - 1;
+  // first layer without samples in the frame whose results are arriving
+  int mFirstEmptyLayer = MAX_PEEL_LAYERS + 1;
+
   GLuint mFBO[2];
   GLuint mTexID[2];
   GLuint mDepthTexID[2];
@@ -39,10 +55,6 @@ struct Common {
   GLuint mQuadVBOID;
   GLuint mQuadIndicesID;
 
-  GLuint mCubeVAOID;
-  GLuint mCubeVBOID;
-  GLuint mCubeIndicesID;
-
   GLSLShader mCubeShader;
   GLSLShader mFrontPeelShader;
   GLSLShader mBlendShader;
@@ -146,8 +158,8 @@ void OnInit() {
   // Initialize FBO
   initFBO();
 
-  // Generate hardwre query
-  glGenQueries(1, &g_pCommon->mQueryId);
+  // Generate hardwre queries for a few frames of layers
+  g_pCommon->mQueries.Init(GL_SAMPLES_PASSED, 4 * Common::MAX_PEEL_LAYERS);
 
   // Create a uniform grid of size 20x20 in XZ plane
   g_pCommon->m_pGrid = new CGrid(20, 20);
@@ -184,45 +196,19 @@ void OnInit() {
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndices), &quadIndices[0],
                GL_STATIC_DRAW);
 
-  // setup unit cube vertex array and vertex buffer objects
-  glGenVertexArrays(1, &g_pCommon->mCubeVAOID);
-  glGenBuffers(1, &g_pCommon->mCubeVBOID);
-  glGenBuffers(1, &g_pCommon->mCubeIndicesID);
-
-  // unit cube vertices
-  glm::vec3 vertices[8] = {
-      glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, -0.5f, -0.5f),
-      glm::vec3(0.5f, 0.5f, -0.5f),   glm::vec3(-0.5f, 0.5f, -0.5f),
-      glm::vec3(-0.5f, -0.5f, 0.5f),  glm::vec3(0.5f, -0.5f, 0.5f),
-      glm::vec3(0.5f, 0.5f, 0.5f),    glm::vec3(-0.5f, 0.5f, 0.5f)};
-
-  // unit cube indices
-  GLushort cubeIndices[36] = {0, 5, 4, 5, 0, 1, 3, 7, 6, 3, 6, 2,
-                              7, 4, 6, 6, 4, 5, 2, 1, 3, 3, 1, 0,
-                              3, 0, 7, 7, 0, 4, 6, 5, 2, 2, 5, 1};
-
-  glBindVertexArray(g_pCommon->mCubeVAOID);
-  glBindBuffer(GL_ARRAY_BUFFER, g_pCommon->mCubeVBOID);
-  // pass cube vertices to buffer object memory
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &(vertices[0].x),
-               GL_STATIC_DRAW);
-  GL_CHECK_ERRORS;
+  glBindVertexArray(0);
 
-  // enable vertex attributre array for position
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+  // the 3x3x3 cubes share the geometry of one instanced unit cube
+  g_pCommon->m_pCube = new CUnitCube();
 
-  // pass cube indices to element array  buffer
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_pCommon->mCubeIndicesID);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), &cubeIndices[0],
-               GL_STATIC_DRAW);
-  glBindVertexArray(0);
+  // the cube drawing shaders read per-instance transforms and colours
+  const CShaderPreprocessor::Defines INSTANCED = {{"INSTANCED", "1"}};
 
   // Load the cube shader
   g_pCommon->mCubeShader.LoadFromFile(GL_VERTEX_SHADER,
-                                      "shaders/cube_shader.vert");
+                                      "shaders/cube_shader.vert", INSTANCED);
   g_pCommon->mCubeShader.LoadFromFile(GL_FRAGMENT_SHADER,
-                                      "shaders/cube_shader.frag");
+                                      "shaders/cube_shader.frag", INSTANCED);
 
   // compile and link the shader
   g_pCommon->mCubeShader.CreateAndLinkProgram();
@@ -235,9 +221,11 @@ void OnInit() {
 
   // Load the front to back peeling shader
   g_pCommon->mFrontPeelShader.LoadFromFile(GL_VERTEX_SHADER,
-                                           "shaders/front_peel.vert");
+                                           "shaders/front_peel.vert",
+                                           INSTANCED);
   g_pCommon->mFrontPeelShader.LoadFromFile(GL_FRAGMENT_SHADER,
-                                           "shaders/front_peel.frag");
+                                           "shaders/front_peel.frag",
+                                           INSTANCED);
   // compile and link the shader
   g_pCommon->mFrontPeelShader.CreateAndLinkProgram();
   g_pCommon->mFrontPeelShader.Use();
@@ -298,16 +286,17 @@ void OnShutdown() {
   g_pCommon->mFinalShader.DeleteShaderProgram();
 
   shutdownFBO();
-  glDeleteQueries(1, &g_pCommon->mQueryId);
+  g_pCommon->mQueries.PrintStats(std::cout);
+  g_pCommon->mQueries.Destroy();
 
   glDeleteVertexArrays(1, &g_pCommon->mQuadVAOID);
   glDeleteBuffers(1, &g_pCommon->mQuadVBOID);
   glDeleteBuffers(1, &g_pCommon->mQuadIndicesID);
 
-  glDeleteVertexArrays(1, &g_pCommon->mCubeVAOID);
-  glDeleteBuffers(1, &g_pCommon->mCubeVBOID);
-  glDeleteBuffers(1, &g_pCommon->mCubeIndicesID);
-
+  CGeometryPool::Instance().PrintStats(std::cout);
+  RenderableObject::GetInstanceBuffer().GetStream().PrintStats(std::cout);
+  delete g_pCommon->m_pCube;
+  g_pCommon->m_pCube = nullptr;
   delete g_pCommon->m_pGrid;
   g_pCommon->m_pGrid = nullptr;
   std::cout << "Shutdown successfull" << std::endl;
@@ -329,38 +318,52 @@ void DrawScene(const glm::mat4 &MVP, GLSLShader &shader) {
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  // bind the cube vertex array object
-  glBindVertexArray(g_pCommon->mCubeVAOID);
-  // bind the shader
-  shader.Use();
-  // for all cubes
+  // modelling transformation and colour of all cubes
+  glm::mat4 models[Common::TOTAL_CUBES];
+  glm::vec4 colors[Common::TOTAL_CUBES];
+  int index = 0;
   for (int k = -1; k <= 1; k++) {
     for (int j = -1; j <= 1; j++) {
-      int index = 0;
       for (int i = -1; i <= 1; i++) {
-        GL_CHECK_ERRORS;
-        // set the modelling transformation and shader uniforms
-        glm::mat4 T =
+        models[index] =
+            g_pCommon->mR *
             glm::translate(glm::mat4(1), glm::vec3(i * 2, j * 2, k * 2));
-        glUniform4fv(shader("vColor"), 1, &(g_pCommon->mBox_colors[index++].x));
-        glUniformMatrix4fv(shader("MVP"), 1, GL_FALSE,
-                           glm::value_ptr(MVP * g_pCommon->mR * T));
-        // draw the cube
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, nullptr);
-        GL_CHECK_ERRORS;
+        colors[index] = g_pCommon->mBox_colors[i + 1];
+        ++index;
       }
     }
   }
-  // unbind shader
-  shader.UnUse();
-  // unbind vertex array object
-  glBindVertexArray(0);
+
+  // draw all cubes at once, MVP is the view projection for the instances
+  GL_CHECK_ERRORS;
+  g_pCommon->m_pCube->RenderInstanced(glm::value_ptr(MVP), models,
+                                      Common::TOTAL_CUBES, colors, &shader);
+  GL_CHECK_ERRORS;
+}
+
+// adapt the number of layers to the sample counts of an earlier frame
+void OnLayerSamples(const int layer, const int lastLayer, const GLuint64 samples) {
+  if (samples == 0 && layer < g_pCommon->mFirstEmptyLayer) {
+    g_pCommon->mFirstEmptyLayer = layer;
+  }
+  if (layer == lastLayer) {
+    // keep peeling up to the first empty layer, like breaking out of the
+    // loop did, or try one more when even the last layer drew samples
+    g_pCommon->mNumPeelLayers =
+        g_pCommon->mFirstEmptyLayer <= lastLayer
+            ? g_pCommon->mFirstEmptyLayer
+            : std::min(lastLayer + 1, Common::MAX_PEEL_LAYERS);
+    g_pCommon->mFirstEmptyLayer = Common::MAX_PEEL_LAYERS + 1;
+  }
 }
 
 // Display callback function
 void OnRender() {
   GL_CHECK_ERRORS;
 
+  // sample counts of the layers of earlier frames
+  g_pCommon->mQueries.Poll();
+
   // camera transformation
   auto Tr =
       glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, g_pCommon->mDist));
@@ -390,8 +393,11 @@ void OnRender() {
     // 2. Depth peeling + blending pass
     int numLayers = (Common::NUM_PASSES - 1) * 2;
 
+    const int lastLayer =
+        g_pCommon->m_bUseOQ ? g_pCommon->mNumPeelLayers : numLayers - 1;
+
     // for each pass
-    for (int layer = 1; g_pCommon->m_bUseOQ || layer < numLayers; layer++) {
+    for (int layer = 1; layer <= lastLayer; layer++) {
       int currId = layer % 2;
       int prevId = 1 - currId;
 
@@ -410,9 +416,11 @@ void OnRender() {
       glEnable(GL_DEPTH_TEST);
 
       // if we want to use occlusion query, we initiate it
-      if (g_pCommon->m_bUseOQ) {
-        glBeginQuery(GL_SAMPLES_PASSED_ARB, g_pCommon->mQueryId);
-      }
+      const bool queried =
+          g_pCommon->m_bUseOQ &&
+          g_pCommon->mQueries.Begin([layer, lastLayer](const GLuint64 samples) {
+            OnLayerSamples(layer, lastLayer, samples);
+          });
       GL_CHECK_ERRORS;
 
       // bind the depth texture from the previous step
@@ -421,9 +429,10 @@ void OnRender() {
       // render scene with the front to back peeling shader
       DrawScene(MVP, g_pCommon->mFrontPeelShader);
 
-      // if we initiated the occlusion query, we end it
-      if (g_pCommon->m_bUseOQ) {
-        glEndQuery(GL_SAMPLES_PASSED_ARB);
+      // if we initiated the occlusion query, we end it, the total number of
+      // samples arrives in a later frame
+      if (queried) {
+        g_pCommon->mQueries.End();
       }
       GL_CHECK_ERRORS;
 
@@ -452,17 +461,6 @@ void OnRender() {
       // disable blending
       glDisable(GL_BLEND);
       GL_CHECK_ERRORS;
-
-      // if we initiated the occlusion query, we get the query result
-      // that is the total number of samples
-      if (g_pCommon->m_bUseOQ) {
-        GLuint sample_count;
-        glGetQueryObjectuiv(g_pCommon->mQueryId, GL_QUERY_RESULT,
-                            &sample_count);
-        if (sample_count == 0) {
-          break;
-        }
-      }
     }
     GL_CHECK_ERRORS;
 
@@ -496,6 +494,9 @@ void OnRender() {
 
   // swap front and back buffers to show the rendered result
   glutSwapBuffers();
+
+  // fence this frame's instance uploads, the next frame writes elsewhere
+  RenderableObject::GetInstanceBuffer().EndFrame();
 }
 
 // Mouse down event handler
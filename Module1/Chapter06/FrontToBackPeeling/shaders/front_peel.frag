@@ -3,7 +3,10 @@
 layout(location = 0) out vec4 vFragColor;	//fragment shader output
 
 //uniforms
+#include "instanced_fragment.glsl"
+#ifndef INSTANCED
 uniform vec4 vColor;						//solid colour 
+#endif
 uniform sampler2DRect  depthTexture;		//depth texture 
 
 void main()
@@ -1,6 +1,8 @@
 // STL
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 // GLEW
 #include <GL/glew.h>
 // GLUT
@@ -13,6 +15,8 @@
 #include <SOIL/SOIL.h>
 // Internal
 #include "GLSLShader.hpp"
+#include "ProgramCache.hpp"
+#include "ShaderPermutations.hpp"
 #include "Obj.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
@@ -22,8 +26,20 @@ namespace {
 const int WIDTH = 1280;
 const int HEIGHT = 960;
 // shaders for use in the recipe
-// mesh rendering shader, pathtracing shader and flat shader
-GLSLShader shader, pathtraceShader, flatShader;
+// mesh rendering shader and flat shader
+GLSLShader shader, flatShader;
+// pathtracing shader, one program per MAX_BOUNCES value
+CShaderPermutations pathtracePermutations;
+// MAX_BOUNCES of the current pathtracing program, '1' to '4' switch it
+int maxBounces = 3;
+GLSLShader *pathtraceShader = nullptr;
+// per-frame pathtracing uniforms, resolved once in OnInit for every
+// permutation since a handle only indexes the program that returned it
+struct PathtraceUniforms {
+  UniformHandle eyePos, invMVP, lightPosition, time;
+};
+const int BOUNCE_PERMUTATIONS = 4;
+PathtraceUniforms pathtraceUniforms[BOUNCE_PERMUTATIONS];
 // IDs for vertex array and buffer object
 GLuint vaoID;
 GLuint vboVerticesID;
@@ -145,6 +161,15 @@ void OnKey(unsigned char k, int x, int y) {
   case ' ':
     bPathtrace = !bPathtrace;
     break;
+  case '1':
+  case '2':
+  case '3':
+  case '4':
+    maxBounces = k - '0';
+    pathtraceShader = &pathtracePermutations.Get(
+        {{"MAX_BOUNCES", std::to_string(maxBounces)}});
+    std::cout << "Pathtracing with " << maxBounces << " bounce(s)\n";
+    break;
   }
   glutPostRedisplay();
 }
@@ -334,36 +359,46 @@ void OnInit() {
   flatShader.AddUniform("MVP");
   flatShader.UnUse();
 
-  // load pathtracing shader
-  pathtraceShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/pathtracer.vert");
-  pathtraceShader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/pathtracer.frag");
-  // compile and link shader
-  pathtraceShader.CreateAndLinkProgram();
-  pathtraceShader.Use();
-  // add attribute and uniform
-  pathtraceShader.AddAttribute("vVertex");
-  pathtraceShader.AddUniform("eyePos");
-  pathtraceShader.AddUniform("invMVP");
-  pathtraceShader.AddUniform("light_position");
-  pathtraceShader.AddUniform("backgroundColor");
-  pathtraceShader.AddUniform("aabb.min");
-  pathtraceShader.AddUniform("aabb.max");
-  pathtraceShader.AddUniform("vertex_positions");
-  pathtraceShader.AddUniform("triangles_list");
-  pathtraceShader.AddUniform("time");
-  pathtraceShader.AddUniform("VERTEX_TEXTURE_SIZE");
-  pathtraceShader.AddUniform("TRIANGLE_TEXTURE_SIZE");
-
-  // set values of constant uniforms as initialization
-  glUniform1f(pathtraceShader("VERTEX_TEXTURE_SIZE"), (float)vertices2.size());
-  glUniform1f(pathtraceShader("TRIANGLE_TEXTURE_SIZE"),
-              (float)indices2.size() / 4);
-  glUniform3fv(pathtraceShader("aabb.min"), 1, glm::value_ptr(aabb.min));
-  glUniform3fv(pathtraceShader("aabb.max"), 1, glm::value_ptr(aabb.max));
-  glUniform4fv(pathtraceShader("backgroundColor"), 1, glm::value_ptr(bg));
-  glUniform1i(pathtraceShader("vertex_positions"), 1);
-  glUniform1i(pathtraceShader("triangles_list"), 2);
-  pathtraceShader.UnUse();
+  // load pathtracing shader permutations, all compiled up front so that
+  // switching the bounce count never stalls on a compile
+  pathtracePermutations.AddStage(GL_VERTEX_SHADER, "shaders/pathtracer.vert");
+  pathtracePermutations.AddStage(GL_FRAGMENT_SHADER,
+                                 "shaders/pathtracer.frag");
+  std::vector<CShaderPermutations::Defines> permutations;
+  for (int bounces = 1; bounces <= BOUNCE_PERMUTATIONS; ++bounces) {
+    permutations.push_back({{"MAX_BOUNCES", std::to_string(bounces)}});
+  }
+  pathtracePermutations.Compile(permutations);
+  for (size_t i = 0; i < permutations.size(); ++i) {
+    auto &program = pathtracePermutations.Get(permutations[i]);
+    auto &uniforms = pathtraceUniforms[i];
+    program.Use();
+    // add attribute and uniform
+    program.AddAttribute("vVertex");
+    uniforms.eyePos = program.AddUniform("eyePos");
+    uniforms.invMVP = program.AddUniform("invMVP");
+    uniforms.lightPosition = program.AddUniform("light_position");
+    program.AddUniform("backgroundColor");
+    program.AddUniform("aabb.min");
+    program.AddUniform("aabb.max");
+    program.AddUniform("vertex_positions");
+    program.AddUniform("triangles_list");
+    uniforms.time = program.AddUniform("time");
+    program.AddUniform("VERTEX_TEXTURE_SIZE");
+    program.AddUniform("TRIANGLE_TEXTURE_SIZE");
+
+    // set values of constant uniforms as initialization
+    glUniform1f(program("VERTEX_TEXTURE_SIZE"), (float)vertices2.size());
+    glUniform1f(program("TRIANGLE_TEXTURE_SIZE"), (float)indices2.size() / 4);
+    glUniform3fv(program("aabb.min"), 1, glm::value_ptr(aabb.min));
+    glUniform3fv(program("aabb.max"), 1, glm::value_ptr(aabb.max));
+    glUniform4fv(program("backgroundColor"), 1, glm::value_ptr(bg));
+    glUniform1i(program("vertex_positions"), 1);
+    glUniform1i(program("triangles_list"), 2);
+    program.UnUse();
+  }
+  pathtraceShader = &pathtracePermutations.Get(
+      {{"MAX_BOUNCES", std::to_string(maxBounces)}});
   GL_CHECK_ERRORS;
 
   // load mesh rendering shader
@@ -566,17 +601,19 @@ void OnRender() {
   // if pathtracing is enabled
   if (bPathtrace) {
     // set the pathtracing shader
-    pathtraceShader.Use();
+    pathtraceShader->Use();
     // pass shader uniforms
-    glUniform3fv(pathtraceShader("eyePos"), 1, glm::value_ptr(eyePos));
-    glUniform1f(pathtraceShader("time"), current);
-    glUniform3fv(pathtraceShader("light_position"), 1, &(lightPosOS.x));
-    glUniformMatrix4fv(pathtraceShader("invMVP"), 1, GL_FALSE,
+    auto &program = *pathtraceShader;
+    const auto &uniforms = pathtraceUniforms[maxBounces - 1];
+    glUniform3fv(program(uniforms.eyePos), 1, glm::value_ptr(eyePos));
+    glUniform1f(program(uniforms.time), current);
+    glUniform3fv(program(uniforms.lightPosition), 1, &(lightPosOS.x));
+    glUniformMatrix4fv(program(uniforms.invMVP), 1, GL_FALSE,
                        glm::value_ptr(invMVP));
     // draw a fullscreen quad
     DrawFullScreenQuad();
     // unbind pathtracing shader
-    pathtraceShader.UnUse();
+    pathtraceShader->UnUse();
   } else {
     // do rasterization
     // bind the mesh vertex array object
@@ -668,7 +705,7 @@ void OnShutdown() {
 
   // Destroy shader
   shader.DeleteShaderProgram();
-  pathtraceShader.DeleteShaderProgram();
+  pathtracePermutations.Destroy();
   flatShader.DeleteShaderProgram();
 
   // Destroy vao and vbo
@@ -681,5 +718,6 @@ void OnShutdown() {
 
   glDeleteTextures(1, &texVerticesID);
   glDeleteTextures(1, &texTrianglesID);
+  CProgramCache::Instance().PrintStats(std::cout);
   std::cout << "Shutdown successfull" << endl;
 }
@@ -14,6 +14,7 @@
 #include <SOIL/SOIL.h>
 // Internal
 #include "GLSLShader.hpp"
+#include "ProgramCache.hpp"
 #include "Obj.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
@@ -25,6 +26,8 @@ constexpr int HEIGHT = 960;
 // shaders for use in the recipe
 // mesh rendering shader, raytracing shader and flat shader
 GLSLShader shader, raytraceShader, flatShader;
+// per-frame raytraceShader uniforms, resolved once in OnInit
+UniformHandle eyePosUniform, invMVPUniform, lightPositionUniform;
 // IDs for vertex array and buffer object
 GLuint vaoID;
 GLuint vboVerticesID;
@@ -351,9 +354,9 @@ void OnInit() {
   raytraceShader.Use();
   // add attribute and uniform
   raytraceShader.AddAttribute("vVertex");
-  raytraceShader.AddUniform("eyePos");
-  raytraceShader.AddUniform("invMVP");
-  raytraceShader.AddUniform("light_position");
+  eyePosUniform = raytraceShader.AddUniform("eyePos");
+  invMVPUniform = raytraceShader.AddUniform("invMVP");
+  lightPositionUniform = raytraceShader.AddUniform("light_position");
   raytraceShader.AddUniform("backgroundColor");
   raytraceShader.AddUniform("aabb.min");
   raytraceShader.AddUniform("aabb.max");
@@ -579,6 +582,7 @@ void OnShutdown() {
 
   glDeleteTextures(1, &texVerticesID);
   glDeleteTextures(1, &texTrianglesID);
+  CProgramCache::Instance().PrintStats(cout);
   cout << "Shutdown successfull" << endl;
 }
 
@@ -619,10 +623,10 @@ void OnRender() {
     // set the raytracing shader
     raytraceShader.Use();
     // pass shader uniforms
-    glUniform3fv(raytraceShader("eyePos"), 1, glm::value_ptr(eyePos));
-    glUniformMatrix4fv(raytraceShader("invMVP"), 1, GL_FALSE,
+    glUniform3fv(raytraceShader(eyePosUniform), 1, glm::value_ptr(eyePos));
+    glUniformMatrix4fv(raytraceShader(invMVPUniform), 1, GL_FALSE,
                        glm::value_ptr(invMVP));
-    glUniform3fv(raytraceShader("light_position"), 1, &(lightPosOS.x));
+    glUniform3fv(raytraceShader(lightPositionUniform), 1, &(lightPosOS.x));
     // draw a fullscreen quad
     DrawFullScreenQuad();
     // unbind raytracing shader
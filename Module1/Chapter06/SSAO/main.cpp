@@ -16,6 +16,10 @@
 // Internal
 #include "Obj.hpp"
 #include "GLSLShader.hpp"
+#include "ProgramCache.hpp"
+#include "ShaderWatcher.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformBuffer.hpp"
 
 #define GL_CHECK_ERRORS assert(glGetError() == GL_NO_ERROR)
 
@@ -32,6 +36,10 @@ const int RTT_HEIGHT = HEIGHT / 4;
 GLSLShader shader, flatShader, finalShader, ssaoFirstShader, ssaoSecondShader,
     gaussianH_shader, gaussianV_shader;
 
+// per-frame camera and light data, and one per-draw slot per material
+CUniformBuffer perFrameUBO;
+CUniformBuffer perDrawUBO;
+
 // IDs for vertex array and buffer object
 GLuint vaoID;
 GLuint vboVerticesID;
@@ -85,6 +93,11 @@ GLuint noiseTexID;
 float sampling_radius = 0.25f;
 // flag to enable/disable SSAO
 bool bUseSSAO = true;
+
+// rebuilds the lighting and post-process shaders when their files change
+CShaderWatcher shaderWatcher;
+// how often shaderWatcher.Update runs, between two frames
+const unsigned int RELOAD_CHECK_MS = 100;
 }
 
 // OpenGL initialization function
@@ -98,6 +111,9 @@ void OnShutdown();
 
 void OnResize(int w, int h);
 
+// timer callback swapping in the reloaded shaders
+void OnReloadTimer(int value);
+
 namespace Keyboard {
 // keyboard event handler
 void OnKey(unsigned char k, int x, int y) {
@@ -216,6 +232,7 @@ auto main(int argc, char *argv[]) -> int {
   glutMotionFunc(Mouse::OnMouseMove);
   glutMouseWheelFunc(Mouse::OnMouseWheel);
   glutKeyboardFunc(Keyboard::OnKey);
+  glutTimerFunc(RELOAD_CHECK_MS, OnReloadTimer, 0);
 
   // main loop call
   glutMainLoop();
@@ -453,14 +470,10 @@ void OnInit() {
   shader.AddAttribute("vNormal");
   shader.AddAttribute("vUV");
 
-  shader.AddUniform("MV");
-  shader.AddUniform("N");
-  shader.AddUniform("P");
   shader.AddUniform("textureMap");
-  shader.AddUniform("useDefault");
-
-  shader.AddUniform("light_position");
-  shader.AddUniform("diffuse_color");
+  // the matrices, light and material colour live in the shared blocks
+  shader.BindUniformBlock("PerFrame", UniformBinding::PER_FRAME);
+  shader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
   // set values of constant uniforms as initialization
   glUniform1i(shader("textureMap"), 0);
   shader.UnUse();
@@ -503,10 +516,21 @@ void OnInit() {
   // add attribute and uniform
   ssaoFirstShader.AddAttribute("vVertex");
   ssaoFirstShader.AddAttribute("vNormal");
-  ssaoFirstShader.AddUniform("MVP");
-  ssaoFirstShader.AddUniform("N");
+  ssaoFirstShader.BindUniformBlock("PerFrame", UniformBinding::PER_FRAME);
+  ssaoFirstShader.BindUniformBlock("PerDraw", UniformBinding::PER_DRAW);
   ssaoFirstShader.UnUse();
 
+  // setup uniform buffers, the mesh never moves so every material's slot
+  // is uploaded once here; diffuse alpha 1 selects the default white colour
+  // for materials without a texture
+  perFrameUBO.Init(sizeof(PerFrameBlock));
+  perDrawUBO.Init(sizeof(PerDrawBlock), (GLsizei)materials.size());
+  for (size_t i = 0; i < materials.size(); i++) {
+    const float useDefault = materials[i]->map_Kd != "" ? 0.0f : 1.0f;
+    perDrawUBO.Update(PerDrawBlock{glm::mat4(1), glm::vec4(1, 1, 1, useDefault)},
+                      (GLsizei)i);
+  }
+
   // load the second step SSAO shader
   ssaoSecondShader.LoadFromFile(GL_VERTEX_SHADER, "shaders/Passthrough.vert");
   ssaoSecondShader.LoadFromFile(GL_FRAGMENT_SHADER,
@@ -664,9 +688,27 @@ void OnInit() {
 
   // initializa FBO
   InitFBO();
+
+  // edit the shaders while the sample runs, see OnReloadTimer
+  shaderWatcher.Watch(shader);
+  shaderWatcher.Watch(finalShader);
+  shaderWatcher.Watch(ssaoFirstShader);
+  shaderWatcher.Watch(ssaoSecondShader);
+  shaderWatcher.Watch(gaussianH_shader);
+  shaderWatcher.Watch(gaussianV_shader);
+  shaderWatcher.Start();
   std::cout << "Initialization successfull\n";
 }
 
+void OnReloadTimer(int value) {
+  const auto reloads = shaderWatcher.GetStats().reloads;
+  shaderWatcher.Update();
+  if (shaderWatcher.GetStats().reloads != reloads) {
+    glutPostRedisplay();
+  }
+  glutTimerFunc(RELOAD_CHECK_MS, OnReloadTimer, value);
+}
+
 void OnRender() {
   // clear the colour and depth buffer
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -676,24 +718,23 @@ void OnRender() {
   glm::mat4 Rx = glm::rotate(T, rX, glm::vec3(1.0f, 0.0f, 0.0f));
   glm::mat4 MV = glm::rotate(Rx, rY, glm::vec3(0.0f, 1.0f, 0.0f));
 
+  // upload the camera and the light once, both the lighting and the first
+  // SSAO step read them from the shared block
+  perFrameUBO.Update(PerFrameBlock{MV, P, glm::mat4(1), glm::vec4(lightPosOS, 1)});
+  perFrameUBO.Bind(UniformBinding::PER_FRAME);
+
   // bind the mesh vertex array object
   glBindVertexArray(vaoID);
   {
     // bind the mesh shader
     shader.Use();
-    // pass the shader uniforms
-    glUniformMatrix4fv(shader("MV"), 1, GL_FALSE, glm::value_ptr(MV));
-    glUniformMatrix3fv(shader("N"), 1, GL_FALSE,
-                       glm::value_ptr(glm::inverseTranspose(glm::mat3(MV))));
-    glUniformMatrix4fv(shader("P"), 1, GL_FALSE, glm::value_ptr(P));
-    glUniform3fv(shader("light_position"), 1, &(lightPosOS.x));
     // loop through all materials
     for (size_t i = 0; i < materials.size(); i++) {
       Material *pMat = materials[i];
+      // select the material's slot
+      perDrawUBO.Bind(UniformBinding::PER_DRAW, (GLsizei)i);
       // if material texture filename is not empty
       if (pMat->map_Kd != "") {
-        glUniform1f(shader("useDefault"), 0.0);
-
         // get the currently bound texture and check if the current texture ID
         // is not equal, if so bind the new texture
         GLint whichID[1];
@@ -702,9 +743,7 @@ void OnRender() {
           glActiveTexture(GL_TEXTURE0);
           glBindTexture(GL_TEXTURE_2D, textures[i]);
         }
-      } else
-        // otherwise we have no texture, we use a default colour
-        glUniform1f(shader("useDefault"), 1.0);
+      }
 
       // if we have a single material, we render the whole mesh in a single call
       if (materials.size() == 1)
@@ -734,14 +773,11 @@ void OnRender() {
     {
       // bind the shader
       ssaoFirstShader.Use();
-      // set the shader uniforms
-      glUniformMatrix4fv(ssaoFirstShader("MVP"), 1, GL_FALSE,
-                         glm::value_ptr(P * MV));
-      glUniformMatrix3fv(ssaoFirstShader("N"), 1, GL_FALSE,
-                         glm::value_ptr(glm::inverseTranspose(glm::mat3(MV))));
       // loop through all materials
       for (size_t i = 0; i < materials.size(); i++) {
         Material *pMat = materials[i];
+        // select the material's slot, only the model matrix is read here
+        perDrawUBO.Bind(UniformBinding::PER_DRAW, (GLsizei)i);
         // if we have a single material, we render the whole mesh in a single
         // call
         if (materials.size() == 1)
@@ -865,6 +901,10 @@ void OnShutdown() {
   finalShader.DeleteShaderProgram();
   flatShader.DeleteShaderProgram();
 
+  // Destroy uniform buffers
+  perFrameUBO.Destroy();
+  perDrawUBO.Destroy();
+
   // Destroy vao and vbo
   glDeleteBuffers(1, &vboVerticesID);
   glDeleteBuffers(1, &vboIndicesID);
@@ -876,6 +916,9 @@ void OnShutdown() {
 
   glDeleteVertexArrays(1, &lightVAOID);
   glDeleteBuffers(1, &lightVerticesVBO);
+  shaderWatcher.Stop();
+  shaderWatcher.PrintStats(cout);
+  CProgramCache::Instance().PrintStats(cout);
   cout << "Shutdown successfull" << endl;
 }
 
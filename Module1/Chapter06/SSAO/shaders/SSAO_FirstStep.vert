@@ -3,17 +3,32 @@
 layout(location = 0) in vec3 vVertex;	//object space vertex
 layout(location = 1) in vec3 vNormal;	//object space normal
  
-//uniforms 
-uniform mat4 MVP;	//combined modelview projection matrix
-uniform mat3 N;		//normal matrix
+//per-frame uniforms, uploaded once per frame (PerFrameBlock in Common)
+layout(std140) uniform PerFrame {
+	mat4 V;					//view matrix
+	mat4 P;					//projection matrix
+	mat4 S;					//shadow matrix, unused here
+	vec4 light_position;	//light position in world space
+	int  bIsLightPass;		//unused here
+};
+
+//per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//a is 1 to use a default colour instead of the texture
+	vec4 specular_color;	//unused here
+};
 
 smooth out vec3 vEyeSpaceNormal;   //output eye space normal  
 
 void main()
 {     
+	//the mesh only uses rigid transforms so the upper 3x3 of the
+	//modelview matrix doubles as the normal matrix
+	mat4 MV = V*M;
 	//get eye space normal by multiplying the object space normal
 	//with the normal matrix
-	vEyeSpaceNormal = N*vNormal;  
+	vEyeSpaceNormal = mat3(MV)*vNormal;  
 	//get the clipspace position
-	gl_Position = MVP*vec4(vVertex,1); 
+	gl_Position = P*MV*vec4(vVertex,1); 
 }
\ No newline at end of file
@@ -2,11 +2,23 @@
 
 layout(location=0) out vec4 vFragColor; //fragment shader output
 
-//uniforms 
-uniform mat4 MV;				//modelview matrix
+//per-frame uniforms, uploaded once per frame (PerFrameBlock in Common)
+layout(std140) uniform PerFrame {
+	mat4 V;					//view matrix
+	mat4 P;					//projection matrix
+	mat4 S;					//shadow matrix, unused here
+	vec4 light_position;	//light position in world space
+	int  bIsLightPass;		//unused here
+};
+
+//per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//a is 1 to use a default colour instead of the texture
+	vec4 specular_color;	//unused here
+};
+
 uniform sampler2D textureMap;	//mesh texture 
-uniform float useDefault;		//if we want to use a default colour
-uniform vec3 light_position;	//light position in object space
 
 //inputs from the vertex shader
 smooth in vec3 vEyeSpaceNormal;		//eye space normal from the vertex shader   
@@ -20,7 +32,7 @@ const float k2 = 0.0;	//quadratic attenuation
 void main()
 { 
 	//get the eye space light position
-	vec4 vEyeSpaceLightPos = MV*vec4(light_position,1);
+	vec4 vEyeSpaceLightPos = V*light_position;
 	//get the light vector
 	vec3 L = (vEyeSpaceLightPos.xyz-vEyeSpacePosition);
 	//get the distance of light
@@ -33,5 +45,5 @@ void main()
 	float attenuationAmount = 1.0/(k0 + (k1*d) + (k2*d*d));
 	diffuse *= attenuationAmount;
 	//return final output colour
-	vFragColor = diffuse*mix(texture(textureMap, vUVout), vec4(1), useDefault);
+	vFragColor = diffuse*mix(texture(textureMap, vUVout), vec4(1), diffuse_color.a);
 }
\ No newline at end of file
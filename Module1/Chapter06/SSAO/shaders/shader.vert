@@ -5,10 +5,21 @@ layout(location = 1) in vec3 vNormal;	//vertex normal
 layout(location = 2) in vec2 vUV;		//vertex uv coordinates
  
 
-//uniforms for projection, modelview and normal matrices
-uniform mat4 P; 
-uniform mat4 MV;
-uniform mat3 N;
+//per-frame uniforms, uploaded once per frame (PerFrameBlock in Common)
+layout(std140) uniform PerFrame {
+	mat4 V;					//view matrix
+	mat4 P;					//projection matrix
+	mat4 S;					//shadow matrix, unused here
+	vec4 light_position;	//light position in world space
+	int  bIsLightPass;		//unused here
+};
+
+//per-draw uniforms, selected with a buffer range (PerDrawBlock in Common)
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//a is 1 to use a default colour instead of the texture
+	vec4 specular_color;	//unused here
+};
 
 //shader outputs to the fragment shader
 smooth out vec2 vUVout;					//texture coordinates
@@ -20,13 +31,17 @@ void main()
 	//output the texture coordinates
 	vUVout=vUV; 
 
+	//the mesh only uses rigid transforms so the upper 3x3 of the
+	//modelview matrix doubles as the normal matrix
+	mat4 MV = V*M;
+
 	//multiply the object space vertex position with the modelview matrix 
 	//to get the eye space position  
 	vEyeSpacePosition = (MV*vec4(vVertex,1)).xyz; 
 
 	//multiply the object space normal with the normal matrix to get 
 	//the eye space normal
-    vEyeSpaceNormal   = N*vNormal;  
+    vEyeSpaceNormal   = mat3(MV)*vNormal;  
 
 	//multiply the projection matrix with the eye space position to get
 	//the clipspace postion
@@ -1,7 +1,9 @@
 // STL
 #include <fstream>
+#include <iostream>
 #include <sstream>
 // Internal
+#include "MeshOptimizer.hpp"
 #include "Obj.hpp"
 
 // removes leacing and trailing spaces
@@ -115,6 +117,34 @@ bool ReadMaterialLibrary(const std::string &filename,
   return true;
 }
 
+// every triangle corner is its own vertex after loading; weld the shared
+// ones, then reorder each material range for the post-transform cache
+static void OptimizeForCache(const string &filename, vector<Vertex> &verts,
+                             vector<unsigned short> &indices,
+                             const vector<Material *> &materials) {
+  const auto welded = CMeshOptimizer::Weld(verts);
+  std::vector<GLuint> optimized(indices.size());
+  for (size_t i = 0; i < indices.size(); i++) {
+    optimized[i] = welded[indices[i]];
+  }
+  std::vector<CMeshOptimizer::Range> ranges;
+  for (const auto *pMat : materials) {
+    ranges.push_back({static_cast<size_t>(pMat->offset),
+                      static_cast<size_t>(pMat->count)});
+  }
+  std::vector<glm::vec3> positions(verts.size());
+  for (size_t i = 0; i < verts.size(); i++) {
+    positions[i] = verts[i].pos;
+  }
+  const auto remap =
+      CMeshOptimizer::Optimize(optimized, ranges, positions.data(),
+                               positions.size(), filename.c_str(), std::cout);
+  CMeshOptimizer::Remap(verts, remap);
+  for (size_t i = 0; i < indices.size(); i++) {
+    indices[i] = static_cast<unsigned short>(optimized[i]);
+  }
+}
+
 bool ObjLoader::Load(const string &filename, vector<Mesh *> &meshes,
                      vector<Vertex> &verts, vector<unsigned short> &indices,
                      vector<Material *> &materials) {
@@ -383,6 +413,8 @@ bool ObjLoader::Load(const string &filename, vector<Mesh *> &meshes,
     sub_count = 0;
   }
 
+  OptimizeForCache(filename, verts, indices, materials);
+
   // copy the contents into a linear array without material sorting
   /*
   for(size_t i=0;i<inds.size();i+=9) {
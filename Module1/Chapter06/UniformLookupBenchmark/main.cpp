@@ -0,0 +1,124 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+// STL
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// GLUT
+#include <GL/freeglut.h>
+// Internal
+#include "GLSLShader.hpp"
+
+// Times the uniform lookups of the GPURaytracing shader. The baseline is the
+// std::map<std::string, GLuint> GLSLShader used before the flat handles,
+// called the way the samples did, with a string literal that is turned into
+// a std::string on every call.
+namespace {
+constexpr std::size_t ITERATIONS = 100000;
+
+using Clock = std::chrono::steady_clock;
+
+// the sum keeps the lookups from being optimized away
+GLint checksum = 0;
+
+template <typename Lookup>
+double NsPerLookup(const std::size_t count, Lookup &&lookup) {
+  const auto start = Clock::now();
+  for (std::size_t i = 0; i < ITERATIONS; ++i) {
+    for (std::size_t k = 0; k < count; ++k) {
+      checksum += static_cast<GLint>(lookup(k));
+    }
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - start)
+             .count() /
+         static_cast<double>(ITERATIONS * count);
+}
+
+// the old GLSLShader::operator()(const std::string &)
+class MapLookup {
+public:
+  void AddUniform(const std::string &uniform, const GLint location) {
+    _uniformLocationList[uniform] = static_cast<GLuint>(location);
+  }
+  GLuint operator()(const std::string &uniform) {
+    return _uniformLocationList[uniform];
+  }
+
+private:
+  std::map<std::string, GLuint> _uniformLocationList;
+};
+} // namespace
+
+auto main(int argc, char *argv[]) -> int {
+  // freeglut initialization, the window only provides the context
+  glutInit(&argc, argv);
+  glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
+  glutInitContextVersion(3, 3);
+  glutInitContextFlags(GLUT_CORE_PROFILE);
+  glutInitWindowSize(64, 64);
+  glutCreateWindow("Uniform lookup benchmark - OpenGL 3.3");
+
+  // initialize glew
+  glewExperimental = GL_TRUE;
+  const GLenum err = glewInit();
+  if (GLEW_OK != err) {
+    std::cerr << "Error: " << glewGetErrorString(err) << '\n';
+    return EXIT_FAILURE;
+  }
+  glGetError(); // this is to ignore INVALID ENUM error 1282
+
+  GLSLShader shader;
+  shader.LoadFromFile(GL_VERTEX_SHADER, "shaders/raytracer.vert");
+  shader.LoadFromFile(GL_FRAGMENT_SHADER, "shaders/raytracer.frag");
+  shader.CreateAndLinkProgram();
+
+  std::vector<std::string> names;
+  std::vector<ShaderName> hashed;
+  std::vector<UniformHandle> handles;
+  MapLookup map;
+  for (const auto &uniform : shader.GetActiveUniforms()) {
+    names.push_back(uniform.name);
+    hashed.emplace_back(uniform.name.c_str());
+    handles.push_back(shader.AddUniform(uniform.name));
+    map.AddUniform(uniform.name, uniform.location);
+  }
+  if (names.empty()) {
+    std::cerr << "The raytracing shader has no active uniforms\n";
+    return EXIT_FAILURE;
+  }
+
+  const GLuint program = shader._program.Get();
+  const double driverNs = NsPerLookup(names.size(), [&](const std::size_t k) {
+    return glGetUniformLocation(program, names[k].c_str());
+  });
+  const double mapNs = NsPerLookup(names.size(), [&](const std::size_t k) {
+    return map(names[k].c_str());
+  });
+  const double charNs = NsPerLookup(names.size(), [&](const std::size_t k) {
+    return shader(names[k].c_str());
+  });
+  const double hashedNs = NsPerLookup(names.size(), [&](const std::size_t k) {
+    return shader(hashed[k]);
+  });
+  const double handleNs = NsPerLookup(names.size(), [&](const std::size_t k) {
+    return shader(handles[k]);
+  });
+
+  std::cout << "Uniform lookup, " << names.size() << " uniforms x "
+            << ITERATIONS << " (checksum " << checksum << ")\n"
+            << "  glGetUniformLocation: " << driverNs << " ns\n"
+            << "  std::map<std::string, GLuint>: " << mapNs << " ns\n"
+            << "  const char *: " << charNs << " ns\n"
+            << "  ShaderName: " << hashedNs << " ns\n"
+            << "  UniformHandle: " << handleNs << " ns\n"
+            << "  handle speedup over std::map: " << mapNs / handleNs << "x\n";
+
+  shader.DeleteShaderProgram();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+//shared structs, uniforms and ray/scene intersection helpers of the
+//GPURaytracing and GPUPathtracing fragment shaders
+//expects to be included after the #version line
+
+//structs for Ray, Box and Camera objects
+struct Ray { vec3 origin, dir;} eyeRay; 
+struct Box { vec3 min, max; };
+struct Camera {
+   vec3 U,V,W; 
+   float d;
+}cam;
+
+
+//shader uniforms
+uniform mat4 invMVP;				//inverse of combined modelview projection matrix
+uniform vec4 backgroundColor;		//background colour
+uniform vec3 eyePos;				//eye position in object space
+uniform sampler2D vertex_positions;	//mesh vertices
+uniform isampler2D triangles_list;	//mesh triangles
+uniform sampler2DArray textureMaps;	//all mesh textures
+uniform vec3 light_position;		//light position is in object space
+uniform Box aabb;					//scene's bounding box 
+uniform float VERTEX_TEXTURE_SIZE;	//size of the vertex texture
+uniform float TRIANGLE_TEXTURE_SIZE;//size of the triangle texture 
+ 
+//function to return the intersection of a ray with a box
+//returns a vec2 in which the x value contains the t value at the near intersection
+						//the y value contains the t value at the far intersection
+vec2 intersectCube(vec3 origin, vec3 ray, Box cube) {		
+	vec3   tMin = (cube.min - origin) / ray;		
+	vec3   tMax = (cube.max - origin) / ray;		
+	vec3     t1 = min(tMin, tMax);		
+	vec3     t2 = max(tMin, tMax);
+	float tNear = max(max(t1.x, t1.y), t1.z);
+	float  tFar = min(min(t2.x, t2.y), t2.z);
+	return vec2(tNear, tFar);	
+}
+
+//gets the direction given a 2D position and a Camera
+vec3 get_direction(vec2 p, Camera c) {
+   return normalize(p.x * c.U + p.y * c.V + c.d * c.W);   
+}
+
+//Generates the eye ray for the given camera and a 2D position
+void setup_camera(vec2 uv) {
+ 
+  eyeRay.origin = eyePos; 
+    
+  cam.U = (invMVP*vec4(1,0,0,0)).xyz; 
+  cam.V = (invMVP*vec4(0,1,0,0)).xyz; 
+  cam.W = (invMVP*vec4(0,0,1,0)).xyz; 
+  cam.d = 1;    
+  
+  eyeRay.dir = get_direction(uv , cam); 
+  eyeRay.dir += cam.U*uv.x;
+  eyeRay.dir += cam.V*uv.y;  
+}
+
+//pseudorandom number generator
+float random(vec3 scale, float seed) {		
+	return fract(sin(dot(gl_FragCoord.xyz + seed, scale)) * 43758.5453 + seed);	
+}	
+
+//gives a uniform random direction vector
+vec3 uniformlyRandomDirection(float seed) {		
+	float u = random(vec3(12.9898, 78.233, 151.7182), seed);		
+	float v = random(vec3(63.7264, 10.873, 623.6736), seed);		
+	float z = 1.0 - 2.0 * u;		
+	float r = sqrt(1.0 - z * z);	
+	float angle = 6.283185307179586 * v;	
+	return vec3(r * cos(angle), r * sin(angle), z);	
+}	
+
+//ray triangle intesection routine. The normal is returned in the given 
+//normal reference argument.
+//
+//The return value is a vec4 with
+//x -> t value at intersection.
+//y -> u texture coordinate
+//z -> v texture coordinate
+//w -> texture map id
+vec4 intersectTriangle(vec3 origin, vec3 dir, int index,  out vec3 normal ) {
+	 
+	ivec4 list_pos = texture(triangles_list, vec2((index+0.5)/TRIANGLE_TEXTURE_SIZE, 0.5));
+	if((index+1) % 2 !=0 ) { 
+		list_pos.xyz = list_pos.zxy;
+	}  
+	vec3 v0 = texture(vertex_positions, vec2((list_pos.z + 0.5 )/VERTEX_TEXTURE_SIZE, 0.5)).xyz;
+	vec3 v1 = texture(vertex_positions, vec2((list_pos.y + 0.5 )/VERTEX_TEXTURE_SIZE, 0.5)).xyz;
+	vec3 v2 = texture(vertex_positions, vec2((list_pos.x + 0.5 )/VERTEX_TEXTURE_SIZE, 0.5)).xyz;
+	  
+	vec3 e1 = v1-v0;
+	vec3 e2 = v2-v0;
+	vec3 tvec = origin - v0;  
+	
+	vec3 pvec = cross(dir, e2);  
+	float  det  = dot(e1, pvec);   
+
+	float inv_det = 1.0/ det;  
+
+	float u = dot(tvec, pvec) * inv_det;  
+
+	if (u < 0.0 || u > 1.0)  
+		return vec4(-1,0,0,0);  
+
+	vec3 qvec = cross(tvec, e1);  
+
+	float v = dot(dir, qvec) * inv_det;  
+
+	if (v < 0.0 || (u + v) > 1.0)  
+		return vec4(-1,0,0,0);  
+
+	float t = dot(e2, qvec) * inv_det;
+	if((index+1) % 2 ==0 ) {
+		v = 1-v; 
+	} else {
+		u = 1-u;
+	} 
+
+	normal = normalize(cross(e2,e1));
+	return vec4(t,u,v,list_pos.w);
+}
+
+//function to test if the given ray intersect any object
+//if so it returns 0.5 otherwise 1. This darkens the shade
+//simulating shadow
+float shadow(vec3 origin, vec3 dir ) {
+	vec3 tmp;
+	for(int i=0;i<int(TRIANGLE_TEXTURE_SIZE);i++) 
+	{
+		vec4 res = intersectTriangle(origin, dir, i, tmp); 
+		if(res.x>0 ) { 
+		   return 0.5;   
+		}
+	}
+	return 1.0;
+}
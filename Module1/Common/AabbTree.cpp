@@ -0,0 +1,439 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "AabbTree.hpp"
+// STL
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <random>
+
+namespace {
+float SurfaceArea(const glm::vec3 &min, const glm::vec3 &max) {
+  const glm::vec3 e = max - min;
+  return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+bool Contains(const glm::vec3 &outerMin, const glm::vec3 &outerMax,
+              const glm::vec3 &min, const glm::vec3 &max) {
+  return outerMin.x <= min.x && outerMin.y <= min.y && outerMin.z <= min.z &&
+         max.x <= outerMax.x && max.y <= outerMax.y && max.z <= outerMax.z;
+}
+} // namespace
+
+CAabbTree::CAabbTree(const float margin_) : margin(margin_) {}
+
+int CAabbTree::AllocateNode() {
+  if (freeList == NULL_NODE) {
+    nodes.emplace_back();
+    return static_cast<int>(nodes.size() - 1);
+  }
+  const int node = freeList;
+  freeList = nodes[static_cast<std::size_t>(node)].parent;
+  nodes[static_cast<std::size_t>(node)] = Node();
+  return node;
+}
+
+void CAabbTree::FreeNode(const int node) {
+  Node &n = nodes[static_cast<std::size_t>(node)];
+  n.parent = freeList;
+  n.height = -1;
+  freeList = node;
+}
+
+int CAabbTree::Insert(const glm::vec3 &min, const glm::vec3 &max,
+                      const std::uint32_t userData) {
+  const int leaf = AllocateNode();
+  Node &n = nodes[static_cast<std::size_t>(leaf)];
+  n.min = min - glm::vec3(margin);
+  n.max = max + glm::vec3(margin);
+  n.userData = userData;
+  InsertLeaf(leaf);
+  ++objectCount;
+  return leaf;
+}
+
+void CAabbTree::Remove(const int proxy) {
+  assert(nodes[static_cast<std::size_t>(proxy)].IsLeaf());
+  RemoveLeaf(proxy);
+  FreeNode(proxy);
+  --objectCount;
+}
+
+bool CAabbTree::Update(const int proxy, const glm::vec3 &min,
+                       const glm::vec3 &max) {
+  Node &n = nodes[static_cast<std::size_t>(proxy)];
+  if (Contains(n.min, n.max, min, max)) {
+    return false;
+  }
+  RemoveLeaf(proxy);
+  n.min = min - glm::vec3(margin);
+  n.max = max + glm::vec3(margin);
+  InsertLeaf(proxy);
+  return true;
+}
+
+std::uint32_t CAabbTree::GetUserData(const int proxy) const {
+  return nodes[static_cast<std::size_t>(proxy)].userData;
+}
+
+std::size_t CAabbTree::GetObjectCount() const { return objectCount; }
+
+int CAabbTree::GetHeight() const {
+  return root == NULL_NODE ? 0 : nodes[static_cast<std::size_t>(root)].height;
+}
+
+void CAabbTree::InsertLeaf(const int leaf) {
+  if (root == NULL_NODE) {
+    root = leaf;
+    nodes[static_cast<std::size_t>(leaf)].parent = NULL_NODE;
+    return;
+  }
+
+  // walk down to the sibling with the lowest surface area cost
+  const glm::vec3 leafMin = nodes[static_cast<std::size_t>(leaf)].min;
+  const glm::vec3 leafMax = nodes[static_cast<std::size_t>(leaf)].max;
+  auto childCost = [&](const int child, const float inheritance) {
+    const Node &c = nodes[static_cast<std::size_t>(child)];
+    const float combined =
+        SurfaceArea(glm::min(c.min, leafMin), glm::max(c.max, leafMax));
+    return c.IsLeaf() ? combined + inheritance
+                      : combined - SurfaceArea(c.min, c.max) + inheritance;
+  };
+  int index = root;
+  while (!nodes[static_cast<std::size_t>(index)].IsLeaf()) {
+    const Node &n = nodes[static_cast<std::size_t>(index)];
+    const float area = SurfaceArea(n.min, n.max);
+    const float combined =
+        SurfaceArea(glm::min(n.min, leafMin), glm::max(n.max, leafMax));
+    // cost of a new parent for this node and the leaf
+    const float cost = 2.0f * combined;
+    // minimum cost of pushing the leaf further down
+    const float inheritance = 2.0f * (combined - area);
+    const float cost1 = childCost(n.child1, inheritance);
+    const float cost2 = childCost(n.child2, inheritance);
+    if (cost < cost1 && cost < cost2) {
+      break;
+    }
+    index = cost1 < cost2 ? n.child1 : n.child2;
+  }
+  const int sibling = index;
+
+  // new parent for the sibling and the leaf
+  const int oldParent = nodes[static_cast<std::size_t>(sibling)].parent;
+  const int newParent = AllocateNode();
+  {
+    Node &p = nodes[static_cast<std::size_t>(newParent)];
+    const Node &s = nodes[static_cast<std::size_t>(sibling)];
+    p.parent = oldParent;
+    p.min = glm::min(s.min, leafMin);
+    p.max = glm::max(s.max, leafMax);
+    p.height = s.height + 1;
+    p.child1 = sibling;
+    p.child2 = leaf;
+  }
+  if (oldParent != NULL_NODE) {
+    Node &op = nodes[static_cast<std::size_t>(oldParent)];
+    (op.child1 == sibling ? op.child1 : op.child2) = newParent;
+  } else {
+    root = newParent;
+  }
+  nodes[static_cast<std::size_t>(sibling)].parent = newParent;
+  nodes[static_cast<std::size_t>(leaf)].parent = newParent;
+
+  Refit(newParent);
+}
+
+void CAabbTree::RemoveLeaf(const int leaf) {
+  if (leaf == root) {
+    root = NULL_NODE;
+    return;
+  }
+
+  const int parent = nodes[static_cast<std::size_t>(leaf)].parent;
+  const Node &p = nodes[static_cast<std::size_t>(parent)];
+  const int grandParent = p.parent;
+  const int sibling = p.child1 == leaf ? p.child2 : p.child1;
+
+  // the sibling takes the parent's place
+  nodes[static_cast<std::size_t>(sibling)].parent = grandParent;
+  FreeNode(parent);
+  if (grandParent != NULL_NODE) {
+    Node &g = nodes[static_cast<std::size_t>(grandParent)];
+    (g.child1 == parent ? g.child1 : g.child2) = sibling;
+    Refit(grandParent);
+  } else {
+    root = sibling;
+  }
+}
+
+void CAabbTree::Refit(int node) {
+  // rebalance and refit every node up to the root
+  while (node != NULL_NODE) {
+    node = Balance(node);
+    Node &n = nodes[static_cast<std::size_t>(node)];
+    const Node &c1 = nodes[static_cast<std::size_t>(n.child1)];
+    const Node &c2 = nodes[static_cast<std::size_t>(n.child2)];
+    n.height = 1 + std::max(c1.height, c2.height);
+    n.min = glm::min(c1.min, c2.min);
+    n.max = glm::max(c1.max, c2.max);
+    node = n.parent;
+  }
+}
+
+int CAabbTree::Balance(const int iA) {
+  Node &A = nodes[static_cast<std::size_t>(iA)];
+  if (A.IsLeaf() || A.height < 2) {
+    return iA;
+  }
+
+  const int iB = A.child1;
+  const int iC = A.child2;
+  Node &B = nodes[static_cast<std::size_t>(iB)];
+  Node &C = nodes[static_cast<std::size_t>(iC)];
+  const int balance = C.height - B.height;
+
+  // rotate the taller child up, A takes the shorter grandchild
+  auto rotate = [&](const int iUp, Node &up, const Node &other, int &aSlot) {
+    const int iF = up.child1;
+    const int iG = up.child2;
+    Node &F = nodes[static_cast<std::size_t>(iF)];
+    Node &G = nodes[static_cast<std::size_t>(iG)];
+
+    up.child1 = iA;
+    up.parent = A.parent;
+    A.parent = iUp;
+    if (up.parent != NULL_NODE) {
+      Node &p = nodes[static_cast<std::size_t>(up.parent)];
+      (p.child1 == iA ? p.child1 : p.child2) = iUp;
+    } else {
+      root = iUp;
+    }
+
+    const bool keepF = F.height > G.height;
+    const int iKeep = keepF ? iF : iG;
+    const int iMove = keepF ? iG : iF;
+    Node &keep = keepF ? F : G;
+    Node &move = keepF ? G : F;
+    up.child2 = iKeep;
+    aSlot = iMove;
+    move.parent = iA;
+    A.min = glm::min(other.min, move.min);
+    A.max = glm::max(other.max, move.max);
+    A.height = 1 + std::max(other.height, move.height);
+    up.min = glm::min(A.min, keep.min);
+    up.max = glm::max(A.max, keep.max);
+    up.height = 1 + std::max(A.height, keep.height);
+    return iUp;
+  };
+
+  if (balance > 1) {
+    return rotate(iC, C, B, A.child2);
+  }
+  if (balance < -1) {
+    return rotate(iB, B, C, A.child1);
+  }
+  return iA;
+}
+
+void CAabbTree::Rebuild() {
+  if (root == NULL_NODE) {
+    return;
+  }
+  std::vector<int> leaves;
+  leaves.reserve(objectCount);
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    Node &n = nodes[i];
+    if (n.height < 0) {
+      continue;
+    }
+    if (n.IsLeaf()) {
+      leaves.push_back(static_cast<int>(i));
+    } else {
+      FreeNode(static_cast<int>(i));
+    }
+  }
+  root = Build(leaves.data(), leaves.size());
+  nodes[static_cast<std::size_t>(root)].parent = NULL_NODE;
+}
+
+int CAabbTree::Build(int *leaves, const std::size_t count) {
+  if (count == 1) {
+    return leaves[0];
+  }
+
+  // split at the median centre along the longest axis of the centres
+  glm::vec3 lo(nodes[static_cast<std::size_t>(leaves[0])].min);
+  glm::vec3 hi(lo);
+  for (std::size_t i = 0; i < count; ++i) {
+    const Node &n = nodes[static_cast<std::size_t>(leaves[i])];
+    const glm::vec3 centre = (n.min + n.max) * 0.5f;
+    lo = glm::min(lo, centre);
+    hi = glm::max(hi, centre);
+  }
+  const glm::vec3 extent = hi - lo;
+  const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                       : (extent.y > extent.z ? 1 : 2);
+  const std::size_t half = count / 2;
+  std::nth_element(leaves, leaves + half, leaves + count, [&](const int a, const int b) {
+    const Node &na = nodes[static_cast<std::size_t>(a)];
+    const Node &nb = nodes[static_cast<std::size_t>(b)];
+    return na.min[axis] + na.max[axis] < nb.min[axis] + nb.max[axis];
+  });
+
+  const int child1 = Build(leaves, half);
+  const int child2 = Build(leaves + half, count - half);
+  const int node = AllocateNode();
+  Node &n = nodes[static_cast<std::size_t>(node)];
+  Node &c1 = nodes[static_cast<std::size_t>(child1)];
+  Node &c2 = nodes[static_cast<std::size_t>(child2)];
+  n.child1 = child1;
+  n.child2 = child2;
+  n.min = glm::min(c1.min, c2.min);
+  n.max = glm::max(c1.max, c2.max);
+  n.height = 1 + std::max(c1.height, c2.height);
+  c1.parent = node;
+  c2.parent = node;
+  return node;
+}
+
+void CAabbTree::Cull(CAbstractCamera &camera,
+                     std::vector<std::uint32_t> &visible) {
+  const auto start = std::chrono::steady_clock::now();
+  visible.clear();
+  if (root != NULL_NODE) {
+    stack.clear();
+    stack.emplace_back(root, CAbstractCamera::ALL_PLANES);
+    while (!stack.empty()) {
+      const int index = stack.back().first;
+      std::uint8_t planeMask = stack.back().second;
+      stack.pop_back();
+
+      Node &n = nodes[static_cast<std::size_t>(index)];
+      ++stats.nodesVisited;
+      const auto visibility = camera.ClassifyBox(n.min, n.max, n.lastPlane, planeMask);
+      // a hidden node hides its whole subtree
+      if (visibility != CAbstractCamera::Visibility::OUTSIDE &&
+          camera.IsBoxOccluded(n.min, n.max)) {
+        ++stats.nodesOccluded;
+        continue;
+      }
+      switch (visibility) {
+      case CAbstractCamera::Visibility::OUTSIDE:
+        break;
+      case CAbstractCamera::Visibility::INSIDE:
+        GatherLeaves(index, visible);
+        break;
+      case CAbstractCamera::Visibility::INTERSECT:
+        if (n.IsLeaf()) {
+          visible.push_back(n.userData);
+        } else {
+          stack.emplace_back(n.child2, planeMask);
+          stack.emplace_back(n.child1, planeMask);
+        }
+        break;
+      }
+    }
+  }
+
+  ++stats.frames;
+  stats.visible += visible.size();
+  stats.ms += std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+}
+
+void CAabbTree::GatherLeaves(const int node, std::vector<std::uint32_t> &visible) {
+  // runs on top of the cull stack, below its current size
+  const std::size_t base = stack.size();
+  stack.emplace_back(node, 0);
+  while (stack.size() > base) {
+    const Node &n = nodes[static_cast<std::size_t>(stack.back().first)];
+    stack.pop_back();
+    if (n.IsLeaf()) {
+      visible.push_back(n.userData);
+    } else {
+      ++stats.nodesSkipped;
+      stack.emplace_back(n.child2, 0);
+      stack.emplace_back(n.child1, 0);
+    }
+  }
+}
+
+const CAabbTree::Stats &CAabbTree::GetStats() const { return stats; }
+
+void CAabbTree::ResetStats() { stats = Stats(); }
+
+void CAabbTree::PrintStats(std::ostream &out) const {
+  const double frames = static_cast<double>(std::max<std::size_t>(stats.frames, 1));
+  out << "AABB tree: " << objectCount << " objects, height " << GetHeight()
+      << ", per frame " << static_cast<double>(stats.nodesVisited) / frames
+      << " nodes visited, " << static_cast<double>(stats.nodesSkipped) / frames
+      << " inside nodes skipped, " << static_cast<double>(stats.nodesOccluded) / frames
+      << " occluded, " << static_cast<double>(stats.visible) / frames
+      << " visible, " << stats.ms / frames << " ms\n";
+}
+
+void CAabbTree::Benchmark(CAbstractCamera &camera, const std::size_t maxCount,
+                          const float extent, std::ostream &out) {
+  using Clock = std::chrono::steady_clock;
+  auto elapsed = [](const Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  };
+
+  out << "AABB tree benchmark\n";
+  for (std::size_t count = 10000; count <= maxCount; count *= 10) {
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> offset(-extent, extent);
+    std::uniform_real_distribution<float> size(0.01f, 0.1f);
+    const glm::vec3 origin = camera.GetPosition();
+    std::vector<glm::vec3> mins(count), maxs(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      const glm::vec3 centre =
+          origin + glm::vec3(offset(random), offset(random), offset(random));
+      const glm::vec3 half(size(random));
+      mins[i] = centre - half;
+      maxs[i] = centre + half;
+    }
+
+    // every box against the camera
+    auto start = Clock::now();
+    std::size_t bruteVisible = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+      bruteVisible += camera.IsBoxInFrustum(mins[i], maxs[i]) ? 1U : 0U;
+    }
+    const double bruteMs = elapsed(start);
+
+    CAabbTree tree(0.05f);
+    std::vector<int> proxies(count);
+    start = Clock::now();
+    for (std::size_t i = 0; i < count; ++i) {
+      proxies[i] = tree.Insert(mins[i], maxs[i], static_cast<std::uint32_t>(i));
+    }
+    const double insertMs = elapsed(start);
+    const int insertHeight = tree.GetHeight();
+
+    start = Clock::now();
+    tree.Rebuild();
+    const double rebuildMs = elapsed(start);
+
+    // move 1% of the objects past their margin
+    start = Clock::now();
+    for (std::size_t i = 0; i < count; i += 100) {
+      const glm::vec3 move(0.1f, 0, 0);
+      tree.Update(proxies[i], mins[i] + move, maxs[i] + move);
+    }
+    const double updateMs = elapsed(start);
+
+    std::vector<std::uint32_t> visible;
+    tree.Cull(camera, visible);
+    const Stats &treeStats = tree.GetStats();
+    out << "  " << count << " objects: insert " << insertMs << " ms (height "
+        << insertHeight << "), rebuild " << rebuildMs << " ms (height "
+        << tree.GetHeight() << "), " << count / 100 << " updates "
+        << updateMs << " ms\n    cull " << treeStats.ms << " ms, "
+        << treeStats.nodesVisited << " nodes visited, " << visible.size()
+        << " visible; testing every box " << bruteMs << " ms, "
+        << bruteVisible << " visible\n";
+  }
+}
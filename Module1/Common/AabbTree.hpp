@@ -0,0 +1,112 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <utility>
+#include <vector>
+// GLM
+#include <glm/glm.hpp>
+// Internal
+#include "AbstractCamera.hpp"
+
+/**
+ * @brief Dynamic AABB tree for hierarchical view frustum culling.
+ *
+ * Every object is a leaf holding its box grown by a margin, so objects that
+ * move a little only refit nothing; an object leaving its fat box is removed
+ * and reinserted. Inserts pick the sibling with the lowest surface area cost
+ * and the path back to the root is rebalanced with rotations. Rebuild()
+ * replaces all internal nodes with a median split tree, which is much faster
+ * than inserting one object at a time for large static sets.
+ *
+ * Culling walks the tree with CAbstractCamera::ClassifyBox, passes the
+ * planes a node intersects on to its children, skips outside subtrees and
+ * gathers inside subtrees without further tests. Leaves are tested with
+ * their fat boxes, so the visible list is conservative by the margin.
+ * Nodes in the frustum are also checked with CAbstractCamera::IsBoxOccluded,
+ * occluded subtrees are dropped.
+ */
+class CAabbTree {
+public:
+  static constexpr int NULL_NODE = -1;
+
+  struct Stats {
+    std::size_t frames       = 0;
+    std::size_t nodesVisited = 0; // frustum tests
+    std::size_t nodesSkipped = 0; // inside subtrees gathered without tests
+    std::size_t nodesOccluded = 0; // subtrees hidden by the occlusion culler
+    std::size_t visible      = 0;
+    double ms = 0;
+  };
+
+  explicit CAabbTree(float margin = 0.1f);
+
+  /**
+   * @brief Add an object, returns its proxy.
+   */
+  int Insert(const glm::vec3 &min, const glm::vec3 &max, std::uint32_t userData);
+  void Remove(int proxy);
+
+  /**
+   * @brief Move an object, returns true when it left its fat box and was
+   * reinserted.
+   */
+  bool Update(int proxy, const glm::vec3 &min, const glm::vec3 &max);
+
+  std::uint32_t GetUserData(int proxy) const;
+  std::size_t GetObjectCount() const;
+  int GetHeight() const;
+
+  /**
+   * @brief Rebuild the internal nodes top-down, proxies stay valid.
+   */
+  void Rebuild();
+
+  /**
+   * @brief User data of every object in the camera frustum.
+   */
+  void Cull(CAbstractCamera &camera, std::vector<std::uint32_t> &visible);
+
+  const Stats &GetStats() const;
+  void ResetStats();
+  void PrintStats(std::ostream &out) const;
+
+  /**
+   * @brief Insert, rebuild, update and cull 10k up to `maxCount` random
+   * boxes around the camera and compare the cull with testing every box.
+   */
+  static void Benchmark(CAbstractCamera &camera, std::size_t maxCount,
+                        float extent, std::ostream &out);
+
+private:
+  struct Node {
+    glm::vec3 min, max;
+    int parent = NULL_NODE; // next free node while on the free list
+    int child1 = NULL_NODE;
+    int child2 = NULL_NODE;
+    int height = 0; // -1 when free
+    std::uint32_t userData = 0;
+    std::uint8_t lastPlane = 0; // plane that rejected the node last frame
+
+    bool IsLeaf() const { return child1 == NULL_NODE; }
+  };
+
+  int AllocateNode();
+  void FreeNode(int node);
+  void InsertLeaf(int leaf);
+  void RemoveLeaf(int leaf);
+  int Balance(int node);
+  void Refit(int node);
+  int Build(int *leaves, std::size_t count);
+  void GatherLeaves(int node, std::vector<std::uint32_t> &visible);
+
+  std::vector<Node> nodes;
+  int root     = NULL_NODE;
+  int freeList = NULL_NODE;
+  std::size_t objectCount = 0;
+  float margin;
+
+  std::vector<std::pair<int, std::uint8_t>> stack;
+  Stats stats;
+};
@@ -1,6 +1,8 @@
 // This is an open source non-commercial project. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
 #include "AbstractCamera.hpp"
+// Internal
+#include "OcclusionCuller.hpp"
 
 CAbstractCamera::~CAbstractCamera() = default;
 
@@ -66,6 +68,13 @@ void CAbstractCamera::CalcFrustumPlanes() {
   planes[3] = CPlane::FromPoints(nearPts[2], nearPts[3], farPts[2]);
   planes[4] = CPlane::FromPoints(nearPts[0], nearPts[3], nearPts[2]);
   planes[5] = CPlane::FromPoints(farPts[3], farPts[0], farPts[1]);
+
+  for (int i = 0; i < 6; ++i) {
+    const glm::vec3 &N = planes[i].N;
+    octants[i] = static_cast<std::uint8_t>((N.x >= 0 ? 1U : 0U) |
+                                           (N.y >= 0 ? 2U : 0U) |
+                                           (N.z >= 0 ? 4U : 0U));
+  }
 }
 
 bool CAbstractCamera::IsPointInFrustum(const glm::vec3 &point) {
@@ -88,26 +97,125 @@ bool CAbstractCamera::IsSphereInFrustum(const glm::vec3 &center,
   return true;
 }
 
+namespace {
+// the box corner furthest along a normal in the given octant
+glm::vec3 PositiveVertex(const glm::vec3 corners[2], const std::uint8_t octant) {
+  return glm::vec3(corners[octant & 1U].x, corners[(octant >> 1U) & 1U].y,
+                   corners[(octant >> 2U) & 1U].z);
+}
+
+// the corner furthest against it
+glm::vec3 NegativeVertex(const glm::vec3 corners[2], const std::uint8_t octant) {
+  return PositiveVertex(corners, static_cast<std::uint8_t>(~octant));
+}
+
+// i-th plane to test, the cached one first and then the rest in order
+int PlaneOrder(const int i, const int lastPlane) {
+  if (i == 0) {
+    return lastPlane;
+  }
+  return i <= lastPlane ? i - 1 : i;
+}
+} // namespace
+
 bool CAbstractCamera::IsBoxInFrustum(const glm::vec3 &min,
                                      const glm::vec3 &max) {
-  for (auto& plane : planes) {
-    glm::vec3 p = min;
-    glm::vec3 N = plane.N;
-    if (N.x >= 0) {
-      p.x = max.x;
+  const glm::vec3 corners[2] = {min, max};
+  for (int i = 0; i < 6; ++i) {
+    if (planes[i].GetDistance(PositiveVertex(corners, octants[i])) < 0) {
+      return false;
     }
-    if (N.y >= 0) {
-      p.y = max.y;
+  }
+  return true;
+}
+
+CAbstractCamera::Visibility
+CAbstractCamera::ClassifySphere(const glm::vec3 &center, const float radius) {
+  std::uint8_t lastPlane = 0;
+  return ClassifySphere(center, radius, lastPlane);
+}
+
+CAbstractCamera::Visibility
+CAbstractCamera::ClassifySphere(const glm::vec3 &center, const float radius,
+                                std::uint8_t &lastPlane) {
+  ++cullStats.objects;
+  Visibility result = Visibility::INSIDE;
+  for (int i = 0; i < 6; ++i) {
+    const int plane = PlaneOrder(i, lastPlane);
+    ++cullStats.planeTests;
+    const float d = planes[plane].GetDistance(center);
+    if (d < -radius) {
+      lastPlane = static_cast<std::uint8_t>(plane);
+      return Visibility::OUTSIDE;
     }
-    if (N.z >= 0) {
-      p.z = max.z;
+    if (d < radius) {
+      result = Visibility::INTERSECT;
     }
+  }
+  return result;
+}
 
-    if (plane.GetDistance(p) < 0) {
-      return false;
+CAbstractCamera::Visibility
+CAbstractCamera::ClassifyBox(const glm::vec3 &min, const glm::vec3 &max) {
+  std::uint8_t lastPlane = 0;
+  return ClassifyBox(min, max, lastPlane);
+}
+
+CAbstractCamera::Visibility
+CAbstractCamera::ClassifyBox(const glm::vec3 &min, const glm::vec3 &max,
+                             std::uint8_t &lastPlane) {
+  ++cullStats.objects;
+  std::uint8_t planeMask = ALL_PLANES;
+  return ClassifyBox(min, max, lastPlane, planeMask, cullStats.planeTests);
+}
+
+CAbstractCamera::Visibility
+CAbstractCamera::ClassifyBox(const glm::vec3 &min, const glm::vec3 &max,
+                             std::uint8_t &lastPlane, std::uint8_t &planeMask) {
+  ++cullStats.nodes;
+  return ClassifyBox(min, max, lastPlane, planeMask, cullStats.nodePlaneTests);
+}
+
+CAbstractCamera::Visibility
+CAbstractCamera::ClassifyBox(const glm::vec3 &min, const glm::vec3 &max,
+                             std::uint8_t &lastPlane, std::uint8_t &planeMask,
+                             std::size_t &planeTests) {
+  const glm::vec3 corners[2] = {min, max};
+  for (int i = 0; i < 6; ++i) {
+    const int plane = PlaneOrder(i, lastPlane);
+    const auto bit = static_cast<std::uint8_t>(1U << plane);
+    if ((planeMask & bit) == 0) {
+      continue;
+    }
+    ++planeTests;
+    if (planes[plane].GetDistance(PositiveVertex(corners, octants[plane])) < 0) {
+      lastPlane = static_cast<std::uint8_t>(plane);
+      return Visibility::OUTSIDE;
+    }
+    // fully in front of this plane, children need not test it
+    if (planes[plane].GetDistance(NegativeVertex(corners, octants[plane])) >= 0) {
+      planeMask = static_cast<std::uint8_t>(planeMask & ~bit);
     }
   }
-  return true;
+  return planeMask == 0 ? Visibility::INSIDE : Visibility::INTERSECT;
+}
+
+const CAbstractCamera::CullStats &CAbstractCamera::GetCullStats() const {
+  return cullStats;
+}
+
+void CAbstractCamera::ResetCullStats() { cullStats = CullStats(); }
+
+void CAbstractCamera::SetOcclusionCuller(COcclusionCuller *culler) {
+  occlusionCuller = culler;
+}
+
+bool CAbstractCamera::IsBoxOccluded(const glm::vec3 &min, const glm::vec3 &max) {
+  return occlusionCuller != nullptr && occlusionCuller->IsOccluded(min, max);
+}
+
+bool CAbstractCamera::IsBoxVisible(const glm::vec3 &min, const glm::vec3 &max) {
+  return IsBoxInFrustum(min, max) && !IsBoxOccluded(min, max);
 }
 
 void CAbstractCamera::GetFrustumPlanes(glm::vec4 fp[6]) {
@@ -1,11 +1,29 @@
 #pragma once
+// STL
+#include <cstddef>
+#include <cstdint>
 // GLM
 #include <glm/gtc/matrix_transform.hpp>
 // Internal
 #include "Plane.hpp"
 
+class COcclusionCuller;
+
 class CAbstractCamera {
 public:
+  enum class Visibility : std::uint8_t { OUTSIDE, INTERSECT, INSIDE };
+
+  // all six frustum planes, bit i is planes[i]
+  static constexpr std::uint8_t ALL_PLANES = 0x3F;
+
+  struct CullStats {
+    std::size_t objects    = 0;
+    std::size_t planeTests = 0;
+    // hierarchy nodes classified with a plane mask, e.g. by CAabbTree
+    std::size_t nodes          = 0;
+    std::size_t nodePlaneTests = 0;
+  };
+
   /**
    * @brief Default destructor
    */
@@ -55,8 +73,57 @@ public:
 
   bool IsBoxInFrustum(const glm::vec3 &min, const glm::vec3 &max);
 
+  /**
+   * @brief Classify a sphere against the frustum.
+   *
+   * @param lastPlane Per object cache, the plane that rejected the object
+   * last time is tested first and is updated when another plane rejects it.
+   */
+  Visibility ClassifySphere(const glm::vec3 &center, const float radius);
+  Visibility ClassifySphere(const glm::vec3 &center, const float radius,
+                            std::uint8_t &lastPlane);
+
+  /**
+   * @brief Classify a box against the frustum with the p/n-vertices picked
+   * from the octant of each plane normal.
+   *
+   * @param lastPlane Same cache as ClassifySphere.
+   * @param planeMask Planes to test, on return the planes the box
+   * intersects. Pass a parent's result to its children: planes the parent
+   * is fully inside are skipped and an INSIDE parent leaves 0. These calls
+   * count as hierarchy nodes in CullStats, the others as objects.
+   */
+  Visibility ClassifyBox(const glm::vec3 &min, const glm::vec3 &max);
+  Visibility ClassifyBox(const glm::vec3 &min, const glm::vec3 &max,
+                         std::uint8_t &lastPlane);
+  Visibility ClassifyBox(const glm::vec3 &min, const glm::vec3 &max,
+                         std::uint8_t &lastPlane, std::uint8_t &planeMask);
+
+  /**
+   * @brief Objects and nodes classified and the plane tests done for each
+   * by the Classify calls.
+   */
+  const CullStats &GetCullStats() const;
+  void ResetCullStats();
+
   void GetFrustumPlanes(glm::vec4 planes[6]);
 
+  /**
+   * @brief Occlusion culler consulted by IsBoxOccluded, nullptr disables
+   * it. The caller rasterizes the occluders for this camera every frame.
+   */
+  void SetOcclusionCuller(COcclusionCuller *culler);
+
+  /**
+   * @brief True when the occlusion culler hides the box, false without one.
+   */
+  bool IsBoxOccluded(const glm::vec3 &min, const glm::vec3 &max);
+
+  /**
+   * @brief IsBoxInFrustum and not IsBoxOccluded.
+   */
+  bool IsBoxVisible(const glm::vec3 &min, const glm::vec3 &max);
+
   // frustum points
   glm::vec3 farPts[4];
 
@@ -77,4 +144,14 @@ protected:
 
   // Frsutum planes
   CPlane planes[6];
+  // per plane octant of the normal, bit 0/1/2 set when N.x/y/z >= 0
+  std::uint8_t octants[6] = {7, 7, 7, 7, 7, 7};
+
+  CullStats cullStats;
+
+  Visibility ClassifyBox(const glm::vec3 &min, const glm::vec3 &max,
+                         std::uint8_t &lastPlane, std::uint8_t &planeMask,
+                         std::size_t &planeTests);
+
+  COcclusionCuller *occlusionCuller = nullptr;
 };
@@ -0,0 +1,239 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "CascadedShadowMap.hpp"
+// STL
+#include <algorithm>
+#include <bitset>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+// GLM
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+void CCascadedShadowMap::Init(const GLsizei size_, const int cascades,
+                              const GLenum momentFormat) {
+  assert(cascades > 0 && cascades <= MAX_CASCADES);
+  size         = size_;
+  cascadeCount = cascades;
+  block.count  = cascades;
+
+  texture = GLTexture::Create();
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture.Get());
+  // linear filtering with compare mode gives 2x2 hardware PCF
+  const GLfloat border[4] = {1, 0, 0, 0};
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+                  GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size,
+               cascades, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, nullptr);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  // the moments are filtered like the single variance shadow map, with
+  // trilinear lookups into the mipmaps the caller generates
+  if (momentFormat != GL_NONE) {
+    moments = GLTexture::Create();
+    SetMoments(momentFormat, farMoments);
+  }
+  const GLenum drawBuffer = moments ? GL_COLOR_ATTACHMENT0 : GL_NONE;
+
+  // attaching the whole array makes the framebuffer layered
+  fbo = GLFramebuffer::Create();
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo.Get());
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture.Get(), 0);
+  if (moments) {
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, moments.Get(), 0);
+  }
+  glDrawBuffer(drawBuffer);
+  glReadBuffer(GL_NONE);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "Cascaded shadow map FBO is incomplete." << std::endl;
+  }
+  layerFbo = GLFramebuffer::Create();
+  glBindFramebuffer(GL_FRAMEBUFFER, layerFbo.Get());
+  glDrawBuffer(drawBuffer);
+  glReadBuffer(GL_NONE);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  cascadeUBO.Init(sizeof(CascadeBlock));
+}
+
+void CCascadedShadowMap::Destroy() {
+  cascadeUBO.Destroy();
+  // the handles delete the framebuffers and textures
+  layerFbo.Reset();
+  fbo.Reset();
+  texture.Reset();
+  moments.Reset();
+}
+
+void CCascadedShadowMap::SetMoments(const GLenum momentFormat,
+                                    const glm::vec4 &farMoments_) {
+  assert(moments);
+  farMoments = farMoments_;
+  glBindTexture(GL_TEXTURE_2D_ARRAY, moments.Get());
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 4);
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR,
+                   glm::value_ptr(farMoments));
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, static_cast<GLint>(momentFormat), size,
+               size, cascadeCount, 0, GL_RGBA, GL_FLOAT, nullptr);
+  glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void CCascadedShadowMap::SetLambda(const float lambda_) {
+  lambda = std::min(std::max(lambda_, 0.0f), 1.0f);
+}
+
+void CCascadedShadowMap::SetMaxDistance(const float distance) {
+  maxDistance = distance;
+}
+
+void CCascadedShadowMap::SetCasterDistance(const float distance) {
+  casterDistance = distance;
+}
+
+void CCascadedShadowMap::Update(const CAbstractCamera &camera,
+                                const glm::vec3 &lightDirection) {
+  // view space depths of the frustum, the corners of each slice lie on the
+  // lines from the near to the far corners
+  const glm::mat4 V = camera.GetViewMatrix();
+  const float zNear = -(V * glm::vec4(camera.nearPts[0], 1)).z;
+  const float zFar  = -(V * glm::vec4(camera.farPts[0], 1)).z;
+  const float zEnd  = std::min(zFar, maxDistance);
+
+  // light view with the world origin on the texel grid
+  const glm::vec3 dir = glm::normalize(lightDirection);
+  const glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+  const glm::mat4 lightView = glm::lookAt(glm::vec3(0), dir, up);
+  const glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1), glm::vec3(0.5f)),
+                                    glm::vec3(0.5f));
+
+  culler.ClearViews();
+  float splitNear = zNear;
+  for (int c = 0; c < cascadeCount; ++c) {
+    // practical split scheme
+    const float i = static_cast<float>(c + 1) / static_cast<float>(cascadeCount);
+    const float logSplit = zNear * std::pow(zEnd / zNear, i);
+    const float uniformSplit = zNear + (zEnd - zNear) * i;
+    const float splitFar = lambda * logSplit + (1 - lambda) * uniformSplit;
+
+    glm::vec3 corners[8];
+    const float t0 = (splitNear - zNear) / (zFar - zNear);
+    const float t1 = (splitFar - zNear) / (zFar - zNear);
+    glm::vec3 center(0);
+    for (int k = 0; k < 4; ++k) {
+      const glm::vec3 ray = camera.farPts[k] - camera.nearPts[k];
+      corners[k]     = camera.nearPts[k] + ray * t0;
+      corners[k + 4] = camera.nearPts[k] + ray * t1;
+      center += corners[k] + corners[k + 4];
+    }
+    center /= 8.0f;
+    float radius = 0;
+    for (const auto &corner : corners) {
+      radius = std::max(radius, glm::length(corner - center));
+    }
+    // round up so the texel size only changes with the split distances
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    // snap the centre to whole texels
+    const float texel = 2 * radius / static_cast<float>(size);
+    glm::vec4 centerLS = lightView * glm::vec4(center, 1);
+    centerLS.x = std::floor(centerLS.x / texel) * texel;
+    centerLS.y = std::floor(centerLS.y / texel) * texel;
+
+    // the light looks down -z, casters up to casterDistance in front of
+    // the slice are kept
+    const glm::mat4 lightProjection =
+        glm::ortho(centerLS.x - radius, centerLS.x + radius, centerLS.y - radius,
+                   centerLS.y + radius, -(centerLS.z + radius + casterDistance),
+                   -(centerLS.z - radius));
+    block.viewProjection[c] = lightProjection * lightView;
+    block.shadow[c] = bias * block.viewProjection[c];
+    block.splits[c] = splitFar;
+    culler.AddView(block.viewProjection[c]);
+    splitNear = splitFar;
+  }
+  cascadeUBO.Update(block);
+  ++stats.frames;
+}
+
+void CCascadedShadowMap::CullCasters(const CFrustumCuller::Spheres &casters,
+                                     std::vector<CMultiViewCuller::ViewMask> &masks) {
+  culler.CullSpheres(casters, masks);
+  stats.casterTests += casters.count;
+  for (const auto mask : masks) {
+    if (mask == 0) {
+      ++stats.casterSkips;
+    } else {
+      stats.casterDraws += std::bitset<32>(mask).count();
+    }
+  }
+}
+
+void CCascadedShadowMap::BeginLayered(const CMultiViewCuller::ViewMask layers) {
+  glViewport(0, 0, size, size);
+  const CMultiViewCuller::ViewMask all = (1U << cascadeCount) - 1;
+  if ((layers & all) != all) {
+    // a clear of the layered framebuffer clears every layer
+    glBindFramebuffer(GL_FRAMEBUFFER, layerFbo.Get());
+    for (int c = 0; c < cascadeCount; ++c) {
+      if ((layers >> c) & 1U) {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture.Get(), 0, c);
+        if (moments) {
+          glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, moments.Get(), 0, c);
+          glClearBufferfv(GL_COLOR, 0, glm::value_ptr(farMoments));
+        }
+        glClear(GL_DEPTH_BUFFER_BIT);
+      }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo.Get());
+  } else {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo.Get());
+    if (moments) {
+      glClearBufferfv(GL_COLOR, 0, glm::value_ptr(farMoments));
+    }
+    glClear(GL_DEPTH_BUFFER_BIT);
+  }
+  cascadeUBO.Bind(UniformBinding::CASCADES);
+}
+
+void CCascadedShadowMap::End() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+
+GLuint CCascadedShadowMap::GetTexture() const { return texture.Get(); }
+
+GLuint CCascadedShadowMap::GetMomentTexture() const { return moments.Get(); }
+
+GLsizei CCascadedShadowMap::GetSize() const { return size; }
+
+int CCascadedShadowMap::GetCascadeCount() const { return cascadeCount; }
+
+const CascadeBlock &CCascadedShadowMap::GetBlock() const { return block; }
+
+const CCascadedShadowMap::Stats &CCascadedShadowMap::GetStats() const {
+  return stats;
+}
+
+void CCascadedShadowMap::ResetStats() { stats = Stats(); }
+
+void CCascadedShadowMap::PrintStats(std::ostream &out) const {
+  out << "Cascaded shadow map: " << cascadeCount << " cascades of " << size
+      << "x" << size << ", splits";
+  for (int c = 0; c < cascadeCount; ++c) {
+    out << " " << block.splits[c];
+  }
+  out << ", " << stats.casterTests << " casters tested, " << stats.casterDraws
+      << " cascade draws, " << stats.casterSkips << " skipped in "
+      << stats.frames << " frames\n";
+}
@@ -0,0 +1,135 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <ostream>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// GLM
+#include <glm/glm.hpp>
+// Internal
+#include "AbstractCamera.hpp"
+#include "FrustumCuller.hpp"
+#include "GLHandle.hpp"
+#include "MultiViewCuller.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformBuffer.hpp"
+
+/**
+ * @brief Cascaded shadow maps of a directional light.
+ *
+ * Update splits the camera frustum, the nearPts/farPts of
+ * CAbstractCamera::CalcFrustumPlanes, at the practical split scheme
+ * distances: a blend of logarithmic and uniform splits weighted by lambda.
+ * Every slice gets an orthographic projection around its bounding sphere,
+ * so its size does not change when the camera turns, with the centre
+ * snapped to whole shadow map texels in light space so the shadows do not
+ * shimmer when the camera moves.
+ *
+ * CullCasters tests caster bounding spheres against all cascades in one
+ * pass and returns a mask of the cascades each caster is drawn into.
+ *
+ * All cascades are layers of one GL_TEXTURE_2D_ARRAY depth texture. With
+ * BeginLayered bound, one pass over the casters fills every layer: a
+ * geometry shader copies each triangle to the layers of its cascade mask
+ * with gl_Layer. The cascade data is a CascadeBlock in the
+ * UniformBinding::CASCADES uniform buffer, for the depth pass and for the
+ * lookup in the lighting shader.
+ *
+ * With a moment format the layered framebuffer also gets a colour array of
+ * the same layers, so variance shadow maps can store filterable moments per
+ * cascade; the depth array then only serves the depth test.
+ */
+class CCascadedShadowMap {
+public:
+  static constexpr int MAX_CASCADES = 4;
+
+  struct Stats {
+    std::size_t frames = 0;
+    std::size_t casterTests = 0;
+    std::size_t casterDraws = 0; // caster and cascade pairs to draw
+    std::size_t casterSkips = 0; // casters outside every cascade
+  };
+
+  /**
+   * @brief Depth texture array of `cascades` layers of size x size texels,
+   * and a moment array in `momentFormat` unless it is GL_NONE.
+   */
+  void Init(GLsizei size = 1024, int cascades = MAX_CASCADES,
+            GLenum momentFormat = GL_NONE);
+
+  void Destroy();
+
+  /**
+   * @brief Reallocate the moment array of Init in `momentFormat`, its
+   * content is lost. `farMoments` are the moments of the far plane, the
+   * border colour and the value BeginLayered clears the moment layers to.
+   */
+  void SetMoments(GLenum momentFormat, const glm::vec4 &farMoments);
+
+  /**
+   * @brief Blend of the split scheme, 0 is uniform and 1 logarithmic.
+   */
+  void SetLambda(float lambda);
+
+  /**
+   * @brief Shadows end at this view distance or the camera far plane.
+   */
+  void SetMaxDistance(float distance);
+
+  /**
+   * @brief How far towards the light casters outside a slice are kept.
+   */
+  void SetCasterDistance(float distance);
+
+  /**
+   * @brief Fit the cascades to the camera frustum, CalcFrustumPlanes must
+   * be up to date. `lightDirection` points from the light into the scene.
+   */
+  void Update(const CAbstractCamera &camera, const glm::vec3 &lightDirection);
+
+  /**
+   * @brief Bit c of masks[i] is set when caster i reaches cascade c.
+   */
+  void CullCasters(const CFrustumCuller::Spheres &casters,
+                   std::vector<CMultiViewCuller::ViewMask> &masks);
+
+  /**
+   * @brief Bind the layered framebuffer and clear the cascades in `layers`,
+   * the others keep their depth; mask the casters with the same layers.
+   */
+  void BeginLayered(CMultiViewCuller::ViewMask layers = ~CMultiViewCuller::ViewMask{0});
+
+  /**
+   * @brief Unbind the framebuffer, the viewport is left to the caller.
+   */
+  void End();
+
+  GLuint GetTexture() const;
+  GLuint GetMomentTexture() const; // 0 without a moment format
+  GLsizei GetSize() const;
+  int GetCascadeCount() const;
+  const CascadeBlock &GetBlock() const;
+
+  const Stats &GetStats() const;
+  void ResetStats();
+  void PrintStats(std::ostream &out) const;
+
+private:
+  GLsizei size = 0;
+  int cascadeCount = 0;
+  float lambda = 0.75f;
+  float maxDistance = 50.0f;
+  float casterDistance = 20.0f;
+
+  GLTexture texture;
+  GLFramebuffer fbo;
+  GLFramebuffer layerFbo; // one layer at a time, to clear single cascades
+  GLTexture moments;
+  glm::vec4 farMoments = glm::vec4(1, 0, 0, 0);
+  CUniformBuffer cascadeUBO;
+  CascadeBlock block;
+
+  CMultiViewCuller culler;
+  Stats stats;
+};
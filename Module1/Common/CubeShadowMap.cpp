@@ -0,0 +1,146 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "CubeShadowMap.hpp"
+// STL
+#include <bitset>
+#include <iostream>
+// GLM
+#include <glm/gtc/matrix_transform.hpp>
+
+void CCubeShadowMap::Init(const GLsizei size_) {
+  size = size_;
+
+  texture = GLTexture::Create();
+  glBindTexture(GL_TEXTURE_CUBE_MAP, texture.Get());
+  // linear filtering with compare mode gives 2x2 hardware PCF
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE,
+                  GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  for (int face = 0; face < FACES; ++face) {
+    glTexImage2D(static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face), 0,
+                 GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT,
+                 GL_UNSIGNED_BYTE, nullptr);
+  }
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+  // attaching the whole cube map makes the framebuffer layered, gl_Layer
+  // selects the face
+  layeredFbo = GLFramebuffer::Create();
+  glBindFramebuffer(GL_FRAMEBUFFER, layeredFbo.Get());
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture.Get(), 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "Layered cube shadow map FBO is incomplete." << std::endl;
+  }
+
+  for (int face = 0; face < FACES; ++face) {
+    faceFbos[face] = GLFramebuffer::Create();
+    glBindFramebuffer(GL_FRAMEBUFFER, faceFbos[face].Get());
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                           static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face),
+                           texture.Get(), 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  cubeUBO.Init(sizeof(CubeShadowBlock));
+}
+
+void CCubeShadowMap::Destroy() {
+  cubeUBO.Destroy();
+  // the handles delete the framebuffers and the texture
+  for (auto &fbo : faceFbos) {
+    fbo.Reset();
+  }
+  layeredFbo.Reset();
+  texture.Reset();
+}
+
+void CCubeShadowMap::Update(const glm::vec3 &lightPosition, const float nearPlane,
+                            const float farPlane) {
+  // the cube map face order and orientations, +x -x +y -y +z -z
+  static const glm::vec3 directions[FACES] = {
+      glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+      glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)};
+  static const glm::vec3 ups[FACES] = {
+      glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1),
+      glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0)};
+
+  const glm::mat4 P =
+      glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
+  culler.ClearViews();
+  for (int face = 0; face < FACES; ++face) {
+    block.viewProjection[face] =
+        P * glm::lookAt(lightPosition, lightPosition + directions[face], ups[face]);
+    culler.AddView(block.viewProjection[face]);
+  }
+  block.light = glm::vec4(lightPosition, farPlane);
+  cubeUBO.Update(block);
+  ++stats.frames;
+}
+
+void CCubeShadowMap::CullCasters(const CFrustumCuller::Spheres &casters,
+                                 std::vector<CMultiViewCuller::ViewMask> &masks) {
+  culler.CullSpheres(casters, masks);
+  stats.casterTests += casters.count;
+  for (const auto mask : masks) {
+    if (mask == 0) {
+      ++stats.casterSkips;
+    } else {
+      ++stats.casterDraws;
+      stats.faceDraws += std::bitset<32>(mask).count();
+    }
+  }
+}
+
+void CCubeShadowMap::BeginLayered(const CMultiViewCuller::ViewMask faces) {
+  glViewport(0, 0, size, size);
+  const CMultiViewCuller::ViewMask all = (1U << FACES) - 1;
+  if ((faces & all) != all) {
+    // a clear of the layered framebuffer clears every face
+    for (int face = 0; face < FACES; ++face) {
+      if ((faces >> face) & 1U) {
+        glBindFramebuffer(GL_FRAMEBUFFER, faceFbos[face].Get());
+        glClear(GL_DEPTH_BUFFER_BIT);
+      }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, layeredFbo.Get());
+  } else {
+    glBindFramebuffer(GL_FRAMEBUFFER, layeredFbo.Get());
+    glClear(GL_DEPTH_BUFFER_BIT);
+  }
+  cubeUBO.Bind(UniformBinding::CUBE_SHADOW);
+}
+
+void CCubeShadowMap::BeginFace(const int face) {
+  glBindFramebuffer(GL_FRAMEBUFFER, faceFbos[face].Get());
+  glViewport(0, 0, size, size);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  cubeUBO.Bind(UniformBinding::CUBE_SHADOW);
+}
+
+void CCubeShadowMap::End() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+
+GLuint CCubeShadowMap::GetTexture() const { return texture.Get(); }
+
+GLsizei CCubeShadowMap::GetSize() const { return size; }
+
+const CubeShadowBlock &CCubeShadowMap::GetBlock() const { return block; }
+
+const CCubeShadowMap::Stats &CCubeShadowMap::GetStats() const { return stats; }
+
+void CCubeShadowMap::ResetStats() { stats = Stats(); }
+
+void CCubeShadowMap::PrintStats(std::ostream &out) const {
+  out << "Cube shadow map: " << FACES << " faces of " << size << "x" << size
+      << ", " << stats.casterTests << " casters tested, " << stats.casterDraws
+      << " layered draws against " << stats.faceDraws << " per face draws, "
+      << stats.casterSkips << " skipped in " << stats.frames << " frames\n";
+}
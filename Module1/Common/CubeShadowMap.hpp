@@ -0,0 +1,99 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <ostream>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// GLM
+#include <glm/glm.hpp>
+// Internal
+#include "FrustumCuller.hpp"
+#include "GLHandle.hpp"
+#include "MultiViewCuller.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformBuffer.hpp"
+
+/**
+ * @brief Omnidirectional shadow map of a point light in a depth cube map.
+ *
+ * Update places the six 90 degree face frusta at the light. CullCasters
+ * tests the caster bounding spheres against all faces in one pass and
+ * returns a mask of the faces each caster is drawn into.
+ *
+ * With BeginLayered bound the cube map is one layered framebuffer: each
+ * caster is drawn once and a geometry shader copies every triangle to the
+ * faces of its mask with gl_Layer, dropping the faces whose frustum the
+ * triangle lies outside of. BeginFace binds a single face instead, for the
+ * six pass reference path. The faces store the distance to the light over
+ * the far plane, so the lookup compares against the length of the light to
+ * fragment vector, the direction of the cube map lookup. The face matrices
+ * are a CubeShadowBlock in the UniformBinding::CUBE_SHADOW uniform buffer.
+ */
+class CCubeShadowMap {
+public:
+  static constexpr int FACES = 6;
+
+  struct Stats {
+    std::size_t frames = 0;
+    std::size_t casterTests = 0;
+    std::size_t casterDraws = 0; // draws with one layered pass
+    std::size_t faceDraws = 0;   // draws with one pass per face
+    std::size_t casterSkips = 0; // casters outside every face
+  };
+
+  /**
+   * @brief Depth cube map with faces of size x size texels.
+   */
+  void Init(GLsizei size = 512);
+
+  void Destroy();
+
+  /**
+   * @brief Place the faces at the light.
+   */
+  void Update(const glm::vec3 &lightPosition, float nearPlane = 0.1f,
+              float farPlane = 25.0f);
+
+  /**
+   * @brief Bit f of masks[i] is set when caster i reaches face f.
+   */
+  void CullCasters(const CFrustumCuller::Spheres &casters,
+                   std::vector<CMultiViewCuller::ViewMask> &masks);
+
+  /**
+   * @brief Bind the layered framebuffer and clear the faces in `faces`, the
+   * others keep their depth; mask the casters with the same faces.
+   */
+  void BeginLayered(CMultiViewCuller::ViewMask faces = ~CMultiViewCuller::ViewMask{0});
+
+  /**
+   * @brief Bind and clear the framebuffer of one face.
+   */
+  void BeginFace(int face);
+
+  /**
+   * @brief Unbind the framebuffer, the viewport is left to the caller.
+   */
+  void End();
+
+  GLuint GetTexture() const;
+  GLsizei GetSize() const;
+  const CubeShadowBlock &GetBlock() const;
+
+  const Stats &GetStats() const;
+  void ResetStats();
+  void PrintStats(std::ostream &out) const;
+
+private:
+  GLsizei size = 0;
+
+  GLTexture texture;
+  GLFramebuffer layeredFbo;
+  GLFramebuffer faceFbos[FACES];
+  CUniformBuffer cubeUBO;
+  CubeShadowBlock block;
+
+  CMultiViewCuller culler;
+  Stats stats;
+};
@@ -0,0 +1,425 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "FrustumCuller.hpp"
+// STL
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <random>
+#include <thread>
+// Internal
+#include "WorkerPool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_SSE 1
+#include <emmintrin.h>
+#endif
+
+#if defined(FRUSTUM_CULLER_SSE) && \
+    (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define FRUSTUM_CULLER_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+using Batch = CFrustumCuller::Batch;
+using Planes = float[6][4];
+
+// writes the mask words of objects [begin, end), begin is a multiple of 32
+using Kernel = void (*)(const Planes &planes, const Batch &batch,
+                        std::size_t begin, std::size_t end,
+                        std::uint32_t *mask);
+
+bool IsVisibleScalar(const Planes &planes, const Batch &batch,
+                     const std::size_t i) {
+  const float threshold = batch.radius ? -batch.radius[i] : 0.0f;
+  for (int p = 0; p < 6; ++p) {
+    const float d = planes[p][0] * batch.x[p][i] + planes[p][1] * batch.y[p][i] +
+                    planes[p][2] * batch.z[p][i] + planes[p][3];
+    if (d < threshold) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void CullScalar(const Planes &planes, const Batch &batch,
+                const std::size_t begin, const std::size_t end,
+                std::uint32_t *mask) {
+  for (std::size_t word = begin; word < end; word += 32) {
+    std::uint32_t bits = 0;
+    const std::size_t last = std::min(end, word + 32);
+    for (std::size_t i = word; i < last; ++i) {
+      bits |= static_cast<std::uint32_t>(IsVisibleScalar(planes, batch, i))
+              << (i - word);
+    }
+    mask[word / 32] = bits;
+  }
+}
+
+#ifdef FRUSTUM_CULLER_SSE
+void CullSSE(const Planes &planes, const Batch &batch, const std::size_t begin,
+             const std::size_t end, std::uint32_t *mask) {
+  __m128 n[6][4];
+  for (int p = 0; p < 6; ++p) {
+    for (int k = 0; k < 4; ++k) {
+      n[p][k] = _mm_set1_ps(planes[p][k]);
+    }
+  }
+  const std::size_t simdEnd = begin + ((end - begin) & ~std::size_t{3});
+  for (std::size_t word = begin; word < end; word += 32) {
+    std::uint32_t bits = 0;
+    const std::size_t last = std::min(simdEnd, word + 32);
+    std::size_t i = word;
+    for (; i < last; i += 4) {
+      const __m128 threshold =
+          batch.radius ? _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(batch.radius + i))
+                       : _mm_setzero_ps();
+      __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      for (int p = 0; p < 6; ++p) {
+        const __m128 d = _mm_add_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[p][0], _mm_loadu_ps(batch.x[p] + i)),
+                                  _mm_mul_ps(n[p][1], _mm_loadu_ps(batch.y[p] + i))),
+                       _mm_mul_ps(n[p][2], _mm_loadu_ps(batch.z[p] + i))),
+            n[p][3]);
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(d, threshold));
+      }
+      bits |= static_cast<std::uint32_t>(_mm_movemask_ps(inside)) << (i - word);
+    }
+    // the last few objects of the batch
+    for (; i < std::min(end, word + 32); ++i) {
+      bits |= static_cast<std::uint32_t>(IsVisibleScalar(planes, batch, i))
+              << (i - word);
+    }
+    mask[word / 32] = bits;
+  }
+}
+#endif
+
+#ifdef FRUSTUM_CULLER_AVX2
+AVX2_TARGET void CullAVX2(const Planes &planes, const Batch &batch,
+                          const std::size_t begin, const std::size_t end,
+                          std::uint32_t *mask) {
+  __m256 n[6][4];
+  for (int p = 0; p < 6; ++p) {
+    for (int k = 0; k < 4; ++k) {
+      n[p][k] = _mm256_set1_ps(planes[p][k]);
+    }
+  }
+  const std::size_t simdEnd = begin + ((end - begin) & ~std::size_t{7});
+  for (std::size_t word = begin; word < end; word += 32) {
+    std::uint32_t bits = 0;
+    const std::size_t last = std::min(simdEnd, word + 32);
+    std::size_t i = word;
+    for (; i < last; i += 8) {
+      const __m256 threshold =
+          batch.radius
+              ? _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(batch.radius + i))
+              : _mm256_setzero_ps();
+      __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+      // no FMA, so the results match the scalar tests bit for bit
+      for (int p = 0; p < 6; ++p) {
+        const __m256 d = _mm256_add_ps(
+            _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(n[p][0], _mm256_loadu_ps(batch.x[p] + i)),
+                              _mm256_mul_ps(n[p][1], _mm256_loadu_ps(batch.y[p] + i))),
+                _mm256_mul_ps(n[p][2], _mm256_loadu_ps(batch.z[p] + i))),
+            n[p][3]);
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, threshold, _CMP_GE_OQ));
+      }
+      bits |= static_cast<std::uint32_t>(_mm256_movemask_ps(inside)) << (i - word);
+    }
+    for (; i < std::min(end, word + 32); ++i) {
+      bits |= static_cast<std::uint32_t>(IsVisibleScalar(planes, batch, i))
+              << (i - word);
+    }
+    mask[word / 32] = bits;
+  }
+}
+
+bool CpuHasAVX2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx     = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+Kernel GetKernel(const CFrustumCuller::Path path) {
+  switch (path) {
+#ifdef FRUSTUM_CULLER_AVX2
+  case CFrustumCuller::Path::AVX2:
+    return CullAVX2;
+#endif
+#ifdef FRUSTUM_CULLER_SSE
+  case CFrustumCuller::Path::SSE:
+    return CullSSE;
+#endif
+  default:
+    return CullScalar;
+  }
+}
+
+Batch SphereBatch(const CFrustumCuller::Spheres &spheres) {
+  Batch batch{};
+  for (int p = 0; p < 6; ++p) {
+    batch.x[p] = spheres.x;
+    batch.y[p] = spheres.y;
+    batch.z[p] = spheres.z;
+  }
+  batch.radius = spheres.radius;
+  batch.count  = spheres.count;
+  return batch;
+}
+
+Batch BoxBatch(const Planes &planes, const CFrustumCuller::Boxes &boxes) {
+  Batch batch{};
+  for (int p = 0; p < 6; ++p) {
+    batch.x[p] = planes[p][0] >= 0 ? boxes.maxX : boxes.minX;
+    batch.y[p] = planes[p][1] >= 0 ? boxes.maxY : boxes.minY;
+    batch.z[p] = planes[p][2] >= 0 ? boxes.maxZ : boxes.minZ;
+  }
+  batch.radius = nullptr;
+  batch.count  = boxes.count;
+  return batch;
+}
+} // namespace
+
+CFrustumCuller::CFrustumCuller()
+    : planes{}, path(BestPath()),
+      threads(std::max(1U, std::thread::hardware_concurrency())) {}
+
+CFrustumCuller::Path CFrustumCuller::BestPath() {
+#ifdef FRUSTUM_CULLER_AVX2
+  static const bool avx2 = CpuHasAVX2();
+  if (avx2) {
+    return Path::AVX2;
+  }
+#endif
+#ifdef FRUSTUM_CULLER_SSE
+  return Path::SSE;
+#else
+  return Path::SCALAR;
+#endif
+}
+
+const char *CFrustumCuller::PathName(const Path path_) {
+  switch (path_) {
+  case Path::AVX2:
+    return "AVX2";
+  case Path::SSE:
+    return "SSE";
+  default:
+    return "scalar";
+  }
+}
+
+void CFrustumCuller::SetPath(const Path path_) {
+  path = std::min(path_, BestPath());
+}
+
+CFrustumCuller::Path CFrustumCuller::GetPath() const { return path; }
+
+void CFrustumCuller::SetThreads(const unsigned threads_) {
+  threads = std::max(1U, threads_);
+}
+
+void CFrustumCuller::SetPlanes(const glm::vec4 planes_[6]) {
+  for (int p = 0; p < 6; ++p) {
+    for (int k = 0; k < 4; ++k) {
+      planes[p][k] = planes_[p][k];
+    }
+  }
+}
+
+void CFrustumCuller::Cull(const Batch &batch, Mask &visible) {
+  const auto start = std::chrono::steady_clock::now();
+  visible.assign((batch.count + 31) / 32, 0);
+  const Kernel kernel = GetKernel(path);
+
+  if (threads == 1 || batch.count < PARALLEL_MIN_OBJECTS) {
+    kernel(planes, batch, 0, batch.count, visible.data());
+  } else {
+    // whole mask words per chunk
+    const std::size_t words = visible.size();
+    const std::size_t perChunk = (words + threads - 1) / threads;
+    const std::size_t chunks = (words + perChunk - 1) / perChunk;
+    CWorkerPool::Instance().ParallelFor(chunks, [&](const std::size_t chunk) {
+      const std::size_t begin = chunk * perChunk * 32;
+      const std::size_t end = std::min(batch.count, (chunk + 1) * perChunk * 32);
+      kernel(planes, batch, begin, end, visible.data());
+    });
+  }
+
+  ++stats.batches;
+  stats.objects += batch.count;
+  stats.visible += CountVisible(visible);
+  stats.ms += std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+}
+
+void CFrustumCuller::CullSpheres(const Spheres &spheres, Mask &visible) {
+  Cull(SphereBatch(spheres), visible);
+}
+
+void CFrustumCuller::CullBoxes(const Boxes &boxes, Mask &visible) {
+  Cull(BoxBatch(planes, boxes), visible);
+}
+
+void CFrustumCuller::CullSpheresToIndices(const Spheres &spheres,
+                                          std::vector<GLuint> &visible) {
+  CullSpheres(spheres, scratch);
+  MaskToIndices(scratch, spheres.count, visible);
+}
+
+void CFrustumCuller::CullBoxesToIndices(const Boxes &boxes,
+                                        std::vector<GLuint> &visible) {
+  CullBoxes(boxes, scratch);
+  MaskToIndices(scratch, boxes.count, visible);
+}
+
+void CFrustumCuller::MaskToIndices(const Mask &mask, const std::size_t count,
+                                   std::vector<GLuint> &indices) {
+  indices.clear();
+  for (std::size_t word = 0; word < mask.size(); ++word) {
+    std::uint32_t bits = mask[word];
+    while (bits != 0) {
+      // lowest set bit first keeps the indices in order
+      const std::uint32_t lowest = bits & (~bits + 1U);
+      const auto bit = std::bitset<32>(lowest - 1U).count();
+      const std::size_t index = word * 32 + bit;
+      if (index < count) {
+        indices.push_back(static_cast<GLuint>(index));
+      }
+      bits ^= lowest;
+    }
+  }
+}
+
+std::size_t CFrustumCuller::CountVisible(const Mask &mask) {
+  std::size_t visible = 0;
+  for (const auto word : mask) {
+    visible += std::bitset<32>(word).count();
+  }
+  return visible;
+}
+
+const CFrustumCuller::Stats &CFrustumCuller::GetStats() const { return stats; }
+
+void CFrustumCuller::ResetStats() { stats = Stats(); }
+
+void CFrustumCuller::PrintStats(std::ostream &out) const {
+  out << "Frustum culling (" << PathName(path) << "): " << stats.visible
+      << " of " << stats.objects << " objects visible in " << stats.batches
+      << " batches, " << stats.ms << " ms\n";
+}
+
+void CFrustumCuller::Benchmark(CAbstractCamera &camera, const std::size_t count,
+                               const float extent, std::ostream &out) {
+  // random objects in a cube around the camera
+  std::mt19937 random(7);
+  std::uniform_real_distribution<float> offset(-extent, extent);
+  std::uniform_real_distribution<float> size(0.05f, 0.5f);
+  const glm::vec3 origin = camera.GetPosition();
+
+  std::vector<glm::vec3> centers(count), mins(count), maxs(count);
+  std::vector<float> radii(count);
+  std::vector<float> soa[9];
+  for (auto &array : soa) {
+    array.resize(count);
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    centers[i] = origin + glm::vec3(offset(random), offset(random), offset(random));
+    radii[i]   = size(random);
+    mins[i]    = centers[i] - glm::vec3(radii[i]);
+    maxs[i]    = centers[i] + glm::vec3(radii[i]);
+    for (int k = 0; k < 3; ++k) {
+      soa[k][i]     = centers[i][k];
+      soa[3 + k][i] = mins[i][k];
+      soa[6 + k][i] = maxs[i][k];
+    }
+  }
+  const Spheres spheres{soa[0].data(), soa[1].data(), soa[2].data(),
+                        radii.data(), count};
+  const Boxes boxes{soa[3].data(), soa[4].data(), soa[5].data(),
+                    soa[6].data(), soa[7].data(), soa[8].data(), count};
+
+  using Clock = std::chrono::steady_clock;
+  auto elapsed = [](const Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  };
+
+  // reference: one object at a time through the camera
+  std::vector<bool> sphereReference(count), boxReference(count);
+  auto start = Clock::now();
+  for (std::size_t i = 0; i < count; ++i) {
+    sphereReference[i] = camera.IsSphereInFrustum(centers[i], radii[i]);
+  }
+  const double sphereScalarMs = elapsed(start);
+  start = Clock::now();
+  for (std::size_t i = 0; i < count; ++i) {
+    boxReference[i] = camera.IsBoxInFrustum(mins[i], maxs[i]);
+  }
+  const double boxScalarMs = elapsed(start);
+  out << "Frustum culling benchmark, " << count << " objects\n"
+      << "  CAbstractCamera: spheres " << sphereScalarMs << " ms, boxes "
+      << boxScalarMs << " ms\n";
+
+  glm::vec4 planes_[6];
+  camera.GetFrustumPlanes(planes_);
+  CFrustumCuller culler;
+  culler.SetPlanes(planes_);
+  Mask mask;
+  auto matches = [&](const std::vector<bool> &reference) {
+    for (std::size_t i = 0; i < count; ++i) {
+      if (IsVisible(mask, i) != reference[i]) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  const unsigned hardwareThreads = std::max(1U, std::thread::hardware_concurrency());
+  for (int p = 0; p <= static_cast<int>(BestPath()); ++p) {
+    for (const unsigned threadCount : {1U, hardwareThreads}) {
+      if (threadCount == hardwareThreads && (p != static_cast<int>(BestPath()) ||
+                                             hardwareThreads == 1)) {
+        continue;
+      }
+      culler.SetPath(static_cast<Path>(p));
+      culler.SetThreads(threadCount);
+      start = Clock::now();
+      culler.CullSpheres(spheres, mask);
+      const double sphereMs = elapsed(start);
+      const bool sphereMatch = matches(sphereReference);
+      start = Clock::now();
+      culler.CullBoxes(boxes, mask);
+      const double boxMs = elapsed(start);
+      const bool boxMatch = matches(boxReference);
+      out << "  " << PathName(culler.GetPath()) << ", " << threadCount
+          << " thread(s): spheres " << sphereMs << " ms ("
+          << sphereScalarMs / sphereMs << "x), boxes " << boxMs << " ms ("
+          << boxScalarMs / boxMs << "x)"
+          << (sphereMatch && boxMatch ? "" : " MISMATCH") << '\n';
+    }
+  }
+}
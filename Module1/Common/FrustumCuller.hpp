@@ -0,0 +1,125 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// GLM
+#include <glm/glm.hpp>
+// Internal
+#include "AbstractCamera.hpp"
+
+/**
+ * @brief Batch frustum test of spheres and boxes stored as structure of
+ * arrays.
+ *
+ * Works plane-major on 4 (SSE) or 8 (AVX2) objects at a time, the path is
+ * picked from the CPU at runtime and falls back to scalar code elsewhere.
+ * Large batches are split into ranges of 32 objects run on the shared
+ * CWorkerPool, so every chunk writes its own mask words.
+ *
+ * The planes are the ones CAbstractCamera::GetFrustumPlanes returns and
+ * the results match IsSphereInFrustum and IsBoxInFrustum: a sphere is
+ * rejected when it lies behind any plane by more than its radius, a box
+ * when its corner furthest along the plane normal is behind it.
+ */
+class CFrustumCuller {
+public:
+  enum class Path : std::uint8_t { SCALAR, SSE, AVX2 };
+
+  // below this many objects a batch stays on the calling thread
+  static constexpr std::size_t PARALLEL_MIN_OBJECTS = 1U << 16U;
+
+  struct Spheres {
+    const float *x, *y, *z;
+    const float *radius;
+    std::size_t count;
+  };
+
+  struct Boxes {
+    const float *minX, *minY, *minZ;
+    const float *maxX, *maxY, *maxZ;
+    std::size_t count;
+  };
+
+  // bit (i % 32) of word i / 32 is set when object i is visible
+  using Mask = std::vector<std::uint32_t>;
+
+  struct Stats {
+    std::size_t batches = 0;
+    std::size_t objects = 0;
+    std::size_t visible = 0;
+    double ms = 0;
+  };
+
+  CFrustumCuller();
+
+  /**
+   * @brief Fastest path the CPU supports.
+   */
+  static Path BestPath();
+  static const char *PathName(Path path);
+
+  /**
+   * @brief Force a slower path, paths the CPU lacks fall back to BestPath.
+   */
+  void SetPath(Path path);
+  Path GetPath() const;
+
+  /**
+   * @brief Chunks for batches of PARALLEL_MIN_OBJECTS or more, run on the
+   * shared CWorkerPool; 1 disables the parallel path. Defaults to the
+   * hardware concurrency.
+   */
+  void SetThreads(unsigned threads);
+
+  void SetPlanes(const glm::vec4 planes[6]);
+
+  void CullSpheres(const Spheres &spheres, Mask &visible);
+  void CullBoxes(const Boxes &boxes, Mask &visible);
+
+  /**
+   * @brief Compacted form, the indices of the visible objects in order.
+   */
+  void CullSpheresToIndices(const Spheres &spheres,
+                            std::vector<GLuint> &visible);
+  void CullBoxesToIndices(const Boxes &boxes, std::vector<GLuint> &visible);
+
+  static bool IsVisible(const Mask &mask, const std::size_t index) {
+    return (mask[index / 32] >> (index % 32)) & 1U;
+  }
+  static void MaskToIndices(const Mask &mask, std::size_t count,
+                            std::vector<GLuint> &indices);
+  static std::size_t CountVisible(const Mask &mask);
+
+  const Stats &GetStats() const;
+  void ResetStats();
+  void PrintStats(std::ostream &out) const;
+
+  /**
+   * @brief Cull `count` random spheres and boxes around the camera with
+   * CAbstractCamera's scalar tests and with every path, print the times
+   * and check all paths agree with the scalar tests.
+   */
+  static void Benchmark(CAbstractCamera &camera, std::size_t count,
+                        float extent, std::ostream &out);
+
+  // per plane position arrays, the box corner furthest along the normal;
+  // threshold is -radius for spheres and 0 for boxes
+  struct Batch {
+    const float *x[6], *y[6], *z[6];
+    const float *radius; // null for boxes
+    std::size_t count;
+  };
+
+private:
+  void Cull(const Batch &batch, Mask &visible);
+
+  float planes[6][4];
+  Path path;
+  unsigned threads;
+  Mask scratch;
+  Stats stats;
+};
@@ -0,0 +1,128 @@
+#pragma once
+// STL
+#include <utility>
+// GLEW
+#include <GL/glew.h>
+
+/**
+ * @brief Owner of one GL object name, deleted when the owner goes away.
+ *
+ * Move-only, a moved-from handle is empty (name 0) and deletes nothing, so
+ * objects holding handles can live in a std::vector by value. Reset(0) is
+ * the explicit Destroy; call it while the context is still current when
+ * the owner outlives the GL context (globals, function statics).
+ *
+ * `Traits` provides `static GLuint Create()` and `static void Delete(GLuint)`.
+ */
+template <typename Traits> class GLHandle {
+public:
+  GLHandle() = default;
+  explicit GLHandle(const GLuint id_) : id(id_) {}
+  ~GLHandle() { Reset(); }
+
+  GLHandle(const GLHandle &)            = delete;
+  GLHandle &operator=(const GLHandle &) = delete;
+
+  GLHandle(GLHandle &&other) noexcept : id(other.Release()) {}
+  GLHandle &operator=(GLHandle &&other) noexcept {
+    if (this != &other) {
+      Reset(other.Release());
+    }
+    return *this;
+  }
+
+  /**
+   * @brief A new name from glGen* / glCreate*.
+   */
+  static GLHandle Create() { return GLHandle(Traits::Create()); }
+
+  GLuint Get() const { return id; }
+  explicit operator bool() const { return id != 0; }
+
+  /**
+   * @brief Give up ownership without deleting.
+   */
+  GLuint Release() { return std::exchange(id, 0U); }
+
+  /**
+   * @brief Delete the owned name, if any, and own `id_` instead.
+   */
+  void Reset(const GLuint id_ = 0) {
+    if (id != 0 && id != id_) {
+      Traits::Delete(id);
+    }
+    id = id_;
+  }
+
+private:
+  GLuint id = 0;
+};
+
+namespace GLHandleTraits {
+struct Buffer {
+  static GLuint Create() {
+    GLuint id = 0;
+    glGenBuffers(1, &id);
+    return id;
+  }
+  static void Delete(const GLuint id) { glDeleteBuffers(1, &id); }
+};
+
+struct VertexArray {
+  static GLuint Create() {
+    GLuint id = 0;
+    glGenVertexArrays(1, &id);
+    return id;
+  }
+  static void Delete(const GLuint id) { glDeleteVertexArrays(1, &id); }
+};
+
+struct Program {
+  static GLuint Create() { return glCreateProgram(); }
+  static void Delete(const GLuint id) { glDeleteProgram(id); }
+};
+
+struct Texture {
+  static GLuint Create() {
+    GLuint id = 0;
+    glGenTextures(1, &id);
+    return id;
+  }
+  static void Delete(const GLuint id) { glDeleteTextures(1, &id); }
+};
+
+struct Framebuffer {
+  static GLuint Create() {
+    GLuint id = 0;
+    glGenFramebuffers(1, &id);
+    return id;
+  }
+  static void Delete(const GLuint id) { glDeleteFramebuffers(1, &id); }
+};
+
+struct TransformFeedback {
+  static GLuint Create() {
+    GLuint id = 0;
+    glGenTransformFeedbacks(1, &id);
+    return id;
+  }
+  static void Delete(const GLuint id) { glDeleteTransformFeedbacks(1, &id); }
+};
+
+struct Query {
+  static GLuint Create() {
+    GLuint id = 0;
+    glGenQueries(1, &id);
+    return id;
+  }
+  static void Delete(const GLuint id) { glDeleteQueries(1, &id); }
+};
+} // namespace GLHandleTraits
+
+using GLBuffer            = GLHandle<GLHandleTraits::Buffer>;
+using GLVertexArray       = GLHandle<GLHandleTraits::VertexArray>;
+using GLProgram           = GLHandle<GLHandleTraits::Program>;
+using GLTexture           = GLHandle<GLHandleTraits::Texture>;
+using GLFramebuffer       = GLHandle<GLHandleTraits::Framebuffer>;
+using GLTransformFeedback = GLHandle<GLHandleTraits::TransformFeedback>;
+using GLQuery             = GLHandle<GLHandleTraits::Query>;
@@ -1,12 +1,14 @@
 // This is an open source non-commercial project. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
 #include "GLSLShader.hpp"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <string>
+
+#include "ProgramCache.hpp"
 
 GLSLShader::GLSLShader() {
-  _shaders[VERTEX_SHADER]   = 0;
-  _shaders[FRAGMENT_SHADER] = 0;
-  _shaders[GEOMETRY_SHADER] = 0;
   _attributeList.clear();
   _uniformLocationList.clear();
 }
@@ -16,96 +18,463 @@ GLSLShader::~GLSLShader() {
   _uniformLocationList.clear();
 }
 
-void GLSLShader::DeleteShaderProgram() { glDeleteProgram(_program); }
+void GLSLShader::DeleteShaderProgram() { _program.Reset(); }
 
 void GLSLShader::LoadFromString(GLenum type, const std::string &source) {
+  _sources.emplace_back(type, source);
+  _stringSources.emplace_back(type, source);
+}
+
+GLuint GLSLShader::CompileShader(GLenum type, const std::string &source) {
   GLuint shader = glCreateShader(type);
 
   const char *ptmp = source.c_str();
   glShaderSource(shader, 1, &ptmp, nullptr);
-
-  // check whether the shader loads fine
-  GLint status;
+  // the status is only queried in FinishCreateAndLinkProgram so the driver
+  // can keep compiling in the background
   glCompileShader(shader);
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-  if (status == GL_FALSE) {
-    GLint infoLogLength;
-    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLength);
-    GLchar *infoLog = new GLchar[static_cast<std::size_t>(infoLogLength)];
-    glGetShaderInfoLog(shader, infoLogLength, nullptr, infoLog);
-    std::cerr << "Compile log: " << infoLog << std::endl;
-    delete[] infoLog;
-  }
-  _shaders[_totalShaders++] = shader;
+  return shader;
+}
+
+void GLSLShader::SetTransformFeedbackVaryings(
+    const std::vector<std::string> &varyings, const GLenum bufferMode) {
+  _feedbackVaryings = varyings;
+  _feedbackMode     = bufferMode;
 }
 
 void GLSLShader::CreateAndLinkProgram() {
-  _program = glCreateProgram();
-  if (_shaders[VERTEX_SHADER] != 0) {
-    glAttachShader(_program, _shaders[VERTEX_SHADER]);
+  BeginCreateAndLinkProgram();
+  FinishCreateAndLinkProgram();
+}
+
+void GLSLShader::BeginCreateAndLinkProgram() {
+  auto &cache = CProgramCache::Instance();
+  _useCache = cache.IsActive();
+  if (_useCache) {
+    // the captured varyings are part of the linked program
+    auto sources = _sources;
+    for (const auto &varying : _feedbackVaryings) {
+      sources.emplace_back(GL_TRANSFORM_FEEDBACK_VARYINGS, varying);
+    }
+    _cacheKey = cache.MakeKey(sources);
+  } else {
+    _cacheKey = 0;
   }
-  if (_shaders[FRAGMENT_SHADER] != 0) {
-    glAttachShader(_program, _shaders[FRAGMENT_SHADER]);
+
+  _program = GLProgram::Create();
+  if (_useCache) {
+    if (cache.Load(_program.Get(), _cacheKey)) {
+      _sources.clear();
+      _restored = true;
+      return;
+    }
+    // a rejected blob leaves the program in a failed link state
+    _program = GLProgram::Create();
   }
-  if (_shaders[GEOMETRY_SHADER] != 0) {
-    glAttachShader(_program, _shaders[GEOMETRY_SHADER]);
+  _restored = false;
+
+  _linkStart = std::chrono::steady_clock::now();
+  for (const auto &source : _sources) {
+    _pendingShaders.push_back(CompileShader(source.first, source.second));
+    glAttachShader(_program.Get(), _pendingShaders.back());
   }
+  _sources.clear();
 
-  // link and check whether the program links fine
+  if (_useCache) {
+    glProgramParameteri(_program.Get(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  if (!_feedbackVaryings.empty()) {
+    std::vector<const GLchar *> names;
+    for (const auto &varying : _feedbackVaryings) {
+      names.push_back(varying.c_str());
+    }
+    glTransformFeedbackVaryings(_program.Get(), static_cast<GLsizei>(names.size()),
+                                names.data(), _feedbackMode);
+  }
+  glLinkProgram(_program.Get());
+}
+
+bool GLSLShader::IsLinkComplete() const {
+  if (_restored || _pendingShaders.empty()) {
+    return true;
+  }
+  if (GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile) {
+    GLint done = GL_TRUE;
+    glGetProgramiv(_program.Get(), GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+  }
+  // without the extension the next status query simply blocks
+  return true;
+}
+
+bool GLSLShader::FinishCreateAndLinkProgram() {
+  if (_restored) {
+    Reflect();
+    return true;
+  }
+
+  // check whether the shaders compiled fine
+  for (auto shader : _pendingShaders) {
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status == GL_FALSE) {
+      GLint infoLogLength;
+      glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+      GLchar *infoLog = new GLchar[static_cast<std::size_t>(infoLogLength)];
+      glGetShaderInfoLog(shader, infoLogLength, nullptr, infoLog);
+      std::cerr << "Compile log: " << infoLog << std::endl;
+      delete[] infoLog;
+    }
+  }
+
+  // check whether the program links fine
   GLint status;
-  glLinkProgram(_program);
-  glGetProgramiv(_program, GL_LINK_STATUS, &status);
+  glGetProgramiv(_program.Get(), GL_LINK_STATUS, &status);
   if (status == GL_FALSE) {
     GLint infoLogLength;
 
-    glGetProgramiv(_program, GL_INFO_LOG_LENGTH, &infoLogLength);
+    glGetProgramiv(_program.Get(), GL_INFO_LOG_LENGTH, &infoLogLength);
     GLchar *infoLog = new GLchar[static_cast<std::size_t>(infoLogLength)];
-    glGetProgramInfoLog(_program, infoLogLength, nullptr, infoLog);
+    glGetProgramInfoLog(_program.Get(), infoLogLength, nullptr, infoLog);
     std::cerr << "Link log: " << infoLog << std::endl;
     delete[] infoLog;
   }
 
-  glDeleteShader(_shaders[VERTEX_SHADER]);
-  glDeleteShader(_shaders[FRAGMENT_SHADER]);
-  glDeleteShader(_shaders[GEOMETRY_SHADER]);
+  for (auto shader : _pendingShaders) {
+    glDetachShader(_program.Get(), shader);
+    glDeleteShader(shader);
+  }
+  _pendingShaders.clear();
+
+  auto &cache = CProgramCache::Instance();
+  cache.AddCompileTime(std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - _linkStart)
+                           .count());
+
+  const bool linked = status == GL_TRUE;
+  if (_useCache && linked) {
+    cache.Store(_program.Get(), _cacheKey);
+  }
+  if (linked) {
+    Reflect();
+  }
+  return linked;
+}
+
+void GLSLShader::Reflect() {
+  _activeAttributes.clear();
+  _activeUniforms.clear();
+  _uniformBlocks.clear();
+
+  GLint maxLength = 0;
+  glGetProgramiv(_program.Get(), GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+  GLint uniformMaxLength = 0;
+  glGetProgramiv(_program.Get(), GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniformMaxLength);
+  GLint blockMaxLength = 0;
+  glGetProgramiv(_program.Get(), GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                 &blockMaxLength);
+  std::vector<GLchar> name(static_cast<std::size_t>(
+      std::max({maxLength, uniformMaxLength, blockMaxLength, 1})));
+  const auto nameSize = static_cast<GLsizei>(name.size());
+
+  // attributes
+  GLint count = 0;
+  glGetProgramiv(_program.Get(), GL_ACTIVE_ATTRIBUTES, &count);
+  for (GLuint i = 0; i < static_cast<GLuint>(count); ++i) {
+    ActiveVariable attribute{};
+    GLsizei length = 0;
+    glGetActiveAttrib(_program.Get(), i, nameSize, &length, &attribute.size,
+                      &attribute.type, name.data());
+    attribute.name.assign(name.data(), static_cast<std::size_t>(length));
+    attribute.location = glGetAttribLocation(_program.Get(), name.data());
+    AddBinding(_attributeList, Hash::Fnv1a32(name.data()), attribute.location);
+    _activeAttributes.push_back(std::move(attribute));
+  }
+
+  // default block uniforms, members of uniform blocks have no location
+  glGetProgramiv(_program.Get(), GL_ACTIVE_UNIFORMS, &count);
+  for (GLuint i = 0; i < static_cast<GLuint>(count); ++i) {
+    GLint blockIndex = -1;
+    glGetActiveUniformsiv(_program.Get(), 1, &i, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+    if (blockIndex != -1) {
+      continue;
+    }
+    ActiveVariable uniform{};
+    GLsizei length = 0;
+    glGetActiveUniform(_program.Get(), i, nameSize, &length, &uniform.size,
+                       &uniform.type, name.data());
+    uniform.name.assign(name.data(), static_cast<std::size_t>(length));
+    uniform.location = glGetUniformLocation(_program.Get(), name.data());
+    AddBinding(_uniformLocationList, Hash::Fnv1a32(name.data()),
+               uniform.location);
+    // arrays are reported as "name[0]", make "name" resolve as well
+    const auto bracket = uniform.name.find('[');
+    if (bracket != std::string::npos) {
+      AddBinding(_uniformLocationList,
+                 Hash::Fnv1a32(uniform.name.substr(0, bracket).c_str()),
+                 uniform.location);
+    }
+    _activeUniforms.push_back(std::move(uniform));
+  }
+
+  // uniform blocks
+  glGetProgramiv(_program.Get(), GL_ACTIVE_UNIFORM_BLOCKS, &count);
+  for (GLuint i = 0; i < static_cast<GLuint>(count); ++i) {
+    ActiveBlock block{};
+    GLsizei length = 0;
+    glGetActiveUniformBlockName(_program.Get(), i, nameSize, &length, name.data());
+    block.name.assign(name.data(), static_cast<std::size_t>(length));
+    block.index = i;
+    glGetActiveUniformBlockiv(_program.Get(), i, GL_UNIFORM_BLOCK_DATA_SIZE,
+                              &block.dataSize);
+    _uniformBlocks.push_back(std::move(block));
+  }
+}
+
+const std::vector<GLSLShader::ActiveVariable> &
+GLSLShader::GetActiveAttributes() const {
+  return _activeAttributes;
 }
 
-void GLSLShader::Use() { glUseProgram(_program); }
+const std::vector<GLSLShader::ActiveVariable> &
+GLSLShader::GetActiveUniforms() const {
+  return _activeUniforms;
+}
+
+const std::vector<GLSLShader::ActiveBlock> &
+GLSLShader::GetUniformBlocks() const {
+  return _uniformBlocks;
+}
+
+bool GLSLShader::BindUniformBlock(const char *block, const GLuint binding) {
+  for (const auto &uniformBlock : _uniformBlocks) {
+    if (uniformBlock.name == block) {
+      glUniformBlockBinding(_program.Get(), uniformBlock.index, binding);
+      // remembered so a reloaded program gets the same routing
+      auto found = std::find_if(
+          _blockBindings.begin(), _blockBindings.end(),
+          [block](const std::pair<std::string, GLuint> &blockBinding) {
+            return blockBinding.first == block;
+          });
+      if (found == _blockBindings.end()) {
+        _blockBindings.emplace_back(block, binding);
+      } else {
+        found->second = binding;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+const std::vector<GLSLShader::FileSource> &GLSLShader::GetFiles() const {
+  return _files;
+}
+
+void GLSLShader::CopyBuildState(const GLSLShader &source) {
+  for (const auto &stage : source._stringSources) {
+    LoadFromString(stage.first, stage.second);
+  }
+  _feedbackVaryings = source._feedbackVaryings;
+  _feedbackMode     = source._feedbackMode;
+}
+
+void GLSLShader::SwapProgram(GLSLShader &linked) {
+  // `previous` is deleted on return
+  const GLProgram previous = std::move(_program);
+  _program = std::move(linked._program);
+
+  for (auto &binding : _attributeList) {
+    binding.location = -1;
+  }
+  for (auto &binding : _uniformLocationList) {
+    binding.location = -1;
+  }
+  // copy before Reflect so _activeUniforms still describes `previous`
+  CopyUniformValues(previous.Get(), _activeUniforms);
+  Reflect();
+
+  for (const auto &blockBinding : _blockBindings) {
+    for (const auto &uniformBlock : _uniformBlocks) {
+      if (uniformBlock.name == blockBinding.first) {
+        glUniformBlockBinding(_program.Get(), uniformBlock.index,
+                              blockBinding.second);
+      }
+    }
+  }
+}
+
+namespace {
+// number of float components of a float, vector or matrix uniform type,
+// 0 for everything else
+GLsizei FloatComponents(const GLenum type) {
+  switch (type) {
+  case GL_FLOAT:      return 1;
+  case GL_FLOAT_VEC2: return 2;
+  case GL_FLOAT_VEC3: return 3;
+  case GL_FLOAT_VEC4: return 4;
+  case GL_FLOAT_MAT2: return 4;
+  case GL_FLOAT_MAT3: return 9;
+  case GL_FLOAT_MAT4: return 16;
+  default:            return 0;
+  }
+}
+
+// same for int, bool and unsigned vectors; samplers count as one int
+GLsizei IntComponents(const GLenum type) {
+  switch (type) {
+  case GL_INT_VEC2:
+  case GL_BOOL_VEC2:
+  case GL_UNSIGNED_INT_VEC2: return 2;
+  case GL_INT_VEC3:
+  case GL_BOOL_VEC3:
+  case GL_UNSIGNED_INT_VEC3: return 3;
+  case GL_INT_VEC4:
+  case GL_BOOL_VEC4:
+  case GL_UNSIGNED_INT_VEC4: return 4;
+  default:                   return 1;
+  }
+}
+
+bool IsUnsigned(const GLenum type) {
+  return type == GL_UNSIGNED_INT || type == GL_UNSIGNED_INT_VEC2 ||
+         type == GL_UNSIGNED_INT_VEC3 || type == GL_UNSIGNED_INT_VEC4;
+}
+} // namespace
+
+void GLSLShader::CopyUniformValues(const GLSLShader &source) const {
+  CopyUniformValues(source._program.Get(), source._activeUniforms);
+}
+
+void GLSLShader::CopyUniformValues(
+    const GLuint from, const std::vector<ActiveVariable> &uniforms) const {
+  GLint current = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+  glUseProgram(_program.Get());
+
+  for (const auto &uniform : uniforms) {
+    // element i of an array lives at its own location
+    const auto bracket = uniform.name.find('[');
+    const auto base = uniform.name.substr(0, bracket);
+    for (GLint i = 0; i < uniform.size; ++i) {
+      const auto name = uniform.size > 1
+                            ? base + "[" + std::to_string(i) + "]"
+                            : uniform.name;
+      const GLint source = glGetUniformLocation(from, name.c_str());
+      const GLint target = glGetUniformLocation(_program.Get(), name.c_str());
+      if (source == -1 || target == -1) {
+        continue;
+      }
+      const GLsizei floats = FloatComponents(uniform.type);
+      if (floats > 0) {
+        GLfloat value[16];
+        glGetUniformfv(from, source, value);
+        switch (uniform.type) {
+        case GL_FLOAT_MAT2: glUniformMatrix2fv(target, 1, GL_FALSE, value); break;
+        case GL_FLOAT_MAT3: glUniformMatrix3fv(target, 1, GL_FALSE, value); break;
+        case GL_FLOAT_MAT4: glUniformMatrix4fv(target, 1, GL_FALSE, value); break;
+        case GL_FLOAT:      glUniform1fv(target, 1, value); break;
+        case GL_FLOAT_VEC2: glUniform2fv(target, 1, value); break;
+        case GL_FLOAT_VEC3: glUniform3fv(target, 1, value); break;
+        default:            glUniform4fv(target, 1, value); break;
+        }
+        continue;
+      }
+      if (IsUnsigned(uniform.type)) {
+        GLuint value[4];
+        glGetUniformuiv(from, source, value);
+        switch (IntComponents(uniform.type)) {
+        case 2:  glUniform2uiv(target, 1, value); break;
+        case 3:  glUniform3uiv(target, 1, value); break;
+        case 4:  glUniform4uiv(target, 1, value); break;
+        default: glUniform1uiv(target, 1, value); break;
+        }
+        continue;
+      }
+      GLint value[4];
+      glGetUniformiv(from, source, value);
+      switch (IntComponents(uniform.type)) {
+      case 2:  glUniform2iv(target, 1, value); break;
+      case 3:  glUniform3iv(target, 1, value); break;
+      case 4:  glUniform4iv(target, 1, value); break;
+      default: glUniform1iv(target, 1, value); break;
+      }
+    }
+  }
+  glUseProgram(static_cast<GLuint>(current));
+}
+
+void GLSLShader::Use() { glUseProgram(_program.Get()); }
 
 void GLSLShader::UnUse() { glUseProgram(0); }
 
-void GLSLShader::AddAttribute(const std::string &attribute) {
-  _attributeList[attribute] =
-      static_cast<GLuint>(glGetAttribLocation(_program, attribute.c_str()));
+std::uint16_t GLSLShader::AddBinding(std::vector<Binding> &list,
+                                     const std::uint32_t hash,
+                                     const GLint location) {
+  for (std::size_t i = 0; i < list.size(); ++i) {
+    if (list[i].hash == hash) {
+      list[i].location = location;
+      return static_cast<std::uint16_t>(i);
+    }
+  }
+  list.push_back({hash, location});
+  return static_cast<std::uint16_t>(list.size() - 1);
+}
+
+// Bindings are few and contiguous, a linear scan over the hashes beats a
+// tree walk and never allocates. Unknown names map to 0 as before.
+GLuint GLSLShader::Find(const std::vector<Binding> &list,
+                        const std::uint32_t hash) {
+  for (const auto &binding : list) {
+    if (binding.hash == hash) {
+      return static_cast<GLuint>(binding.location);
+    }
+  }
+  return 0;
+}
+
+AttributeHandle GLSLShader::AddAttribute(const std::string &attribute) {
+  return {AddBinding(_attributeList, Hash::Fnv1a32(attribute.c_str()),
+                     glGetAttribLocation(_program.Get(), attribute.c_str()))};
 }
 
 // An indexer that returns the location of the attribute
-GLuint GLSLShader::operator[](const std::string &attribute) {
-  return _attributeList[attribute];
+GLuint GLSLShader::operator[](const char *attribute) const {
+  return Find(_attributeList, Hash::Fnv1a32(attribute));
 }
 
-void GLSLShader::AddUniform(const std::string &uniform) {
-  _uniformLocationList[uniform] =
-      static_cast<GLuint>(glGetUniformLocation(_program, uniform.c_str()));
+GLuint GLSLShader::operator[](const std::string &attribute) const {
+  return Find(_attributeList, Hash::Fnv1a32(attribute.c_str()));
 }
 
-GLuint GLSLShader::operator()(const std::string &uniform) {
-  return _uniformLocationList[uniform];
+GLuint GLSLShader::operator[](const ShaderName attribute) const {
+  return Find(_attributeList, attribute.hash);
 }
 
-#include <fstream>
-void GLSLShader::LoadFromFile(GLenum whichShader, const std::string &filename) {
-  std::ifstream fp;
-  fp.open(filename.c_str(), std::ios_base::in);
-  if (fp) {
-    std::string line, buffer;
-    while (getline(fp, line)) {
-      buffer.append(line);
-      buffer.append("\r\n");
-    }
-    // copy to source
-    LoadFromString(whichShader, buffer);
-  } else {
-    std::cerr << "Error loading shader: " << filename << std::endl;
+UniformHandle GLSLShader::AddUniform(const std::string &uniform) {
+  return {AddBinding(_uniformLocationList, Hash::Fnv1a32(uniform.c_str()),
+                     glGetUniformLocation(_program.Get(), uniform.c_str()))};
+}
+
+GLuint GLSLShader::operator()(const char *uniform) const {
+  return Find(_uniformLocationList, Hash::Fnv1a32(uniform));
+}
+
+GLuint GLSLShader::operator()(const std::string &uniform) const {
+  return Find(_uniformLocationList, Hash::Fnv1a32(uniform.c_str()));
+}
+
+GLuint GLSLShader::operator()(const ShaderName uniform) const {
+  return Find(_uniformLocationList, uniform.hash);
+}
+
+void GLSLShader::LoadFromFile(GLenum whichShader, const std::string &filename,
+                              const CShaderPreprocessor::Defines &defines) {
+  std::string buffer;
+  std::set<std::string> includes;
+  if (CShaderPreprocessor().LoadFile(filename, defines, buffer, &includes)) {
+    // copy to source, _files keeps what a rebuild needs
+    _sources.emplace_back(whichShader, std::move(buffer));
   }
+  _files.push_back({whichShader, filename, defines, std::move(includes)});
 }
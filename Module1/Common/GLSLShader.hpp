@@ -1,30 +1,155 @@
 #pragma once
-#include <map>
+#include <chrono>
+#include <cstdint>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <GL/glew.h>
 
+#include "GLHandle.hpp"
+#include "Hash.hpp"
+#include "ShaderPreprocessor.hpp"
+
+// Index into GLSLShader's flat uniform/attribute arrays, resolved once
+struct UniformHandle {
+  std::uint16_t index = 0;
+};
+
+struct AttributeHandle {
+  std::uint16_t index = 0;
+};
+
+// Uniform/attribute name hashed at compile time when used in a constexpr
+struct ShaderName {
+  constexpr explicit ShaderName(const char *name) : hash(Hash::Fnv1a32(name)) {}
+  std::uint32_t hash;
+};
+
 class GLSLShader {
 public:
   GLSLShader();
   ~GLSLShader();
+  // Owns its program: move-only, the program is deleted with the shader
+  GLSLShader(GLSLShader &&)            = default;
+  GLSLShader &operator=(GLSLShader &&) = default;
+  // Sources are only compiled in CreateAndLinkProgram, which first tries
+  // to restore the program from the CProgramCache.
   void LoadFromString(GLenum whichShader, const std::string &source);
-  void LoadFromFile(GLenum whichShader, const std::string &filename);
+  // Runs the file through CShaderPreprocessor (#include, injected defines)
+  void LoadFromFile(GLenum whichShader, const std::string &filename,
+                    const CShaderPreprocessor::Defines &defines = {});
+  // Outputs captured by transform feedback, set before linking
+  void SetTransformFeedbackVaryings(const std::vector<std::string> &varyings,
+                                    GLenum bufferMode = GL_INTERLEAVED_ATTRIBS);
   void CreateAndLinkProgram();
+  // Split form of CreateAndLinkProgram: Begin issues the compile and link
+  // without any status query so several programs can compile at once,
+  // Finish checks the logs, fills the cache and reflects the program.
+  void BeginCreateAndLinkProgram();
+  bool IsLinkComplete() const;
+  bool FinishCreateAndLinkProgram();
   void Use();
   void UnUse();
-  void AddAttribute(const std::string &attribute);
-  void AddUniform(const std::string &uniform);
+  // Resolve the location once; adding the same name twice returns the
+  // same handle
+  AttributeHandle AddAttribute(const std::string &attribute);
+  UniformHandle AddUniform(const std::string &uniform);
 
   // An indexer that returns the location of the attribute/uniform
-  GLuint operator[](const std::string &attribute);
-  GLuint operator()(const std::string &uniform);
+  GLuint operator[](const char *attribute) const;
+  GLuint operator[](const std::string &attribute) const;
+  GLuint operator[](const ShaderName attribute) const;
+  GLuint operator()(const char *uniform) const;
+  GLuint operator()(const std::string &uniform) const;
+  GLuint operator()(const ShaderName uniform) const;
+
+  // Per-frame path: a plain array index
+  GLint operator[](const AttributeHandle handle) const {
+    return _attributeList[handle.index].location;
+  }
+  GLint operator()(const UniformHandle handle) const {
+    return _uniformLocationList[handle.index].location;
+  }
   void DeleteShaderProgram();
 
-  enum ShaderType { VERTEX_SHADER, FRAGMENT_SHADER, GEOMETRY_SHADER };
-  GLuint _program = 0;
-  int _totalShaders = 0;
-  GLuint _shaders[3]; // 0->vertexshader, 1->fragmentshader, 2->geometryshader
-  std::map<std::string, GLuint> _attributeList;
-  std::map<std::string, GLuint> _uniformLocationList;
+  // Reflection, filled after every successful link so AddUniform and
+  // AddAttribute are only needed to obtain handles
+  struct ActiveVariable {
+    std::string name;
+    GLenum type;
+    GLint size;
+    GLint location;
+  };
+  struct ActiveBlock {
+    std::string name;
+    GLuint index;
+    GLint dataSize;
+  };
+  const std::vector<ActiveVariable> &GetActiveAttributes() const;
+  const std::vector<ActiveVariable> &GetActiveUniforms() const;
+  const std::vector<ActiveBlock> &GetUniformBlocks() const;
+  // Route a uniform block to the binding point its CUniformBuffer uses,
+  // returns false when the program has no such active block
+  bool BindUniformBlock(const char *block, const GLuint binding);
+
+  // Files given to LoadFromFile, kept so CShaderWatcher can rebuild the
+  // program when one of them or one of their includes changes
+  struct FileSource {
+    GLenum type;
+    std::string filename;
+    CShaderPreprocessor::Defines defines;
+    std::set<std::string> includes;
+  };
+  const std::vector<FileSource> &GetFiles() const;
+
+  // Take the LoadFromString stages and the transform feedback varyings of
+  // `source`, which CShaderWatcher cannot rebuild from files
+  void CopyBuildState(const GLSLShader &source);
+
+  // Replace the program by the one `linked` holds (which loses it). Handles
+  // stay valid: every location is re-resolved against the new program,
+  // default block uniform values and uniform block bindings are carried
+  // over, names the new program no longer has resolve to -1.
+  void SwapProgram(GLSLShader &linked);
+
+  // Copy the default block uniform values `source` has set into the
+  // uniforms of the same name in this program
+  void CopyUniformValues(const GLSLShader &source) const;
+
+  struct Binding {
+    std::uint32_t hash;
+    GLint location;
+  };
+
+  GLProgram _program;
+  std::vector<std::pair<GLenum, std::string>> _sources;
+  std::vector<Binding> _attributeList;
+  std::vector<Binding> _uniformLocationList;
+
+private:
+  static GLuint CompileShader(GLenum whichShader, const std::string &source);
+  static std::uint16_t AddBinding(std::vector<Binding> &list,
+                                  const std::uint32_t hash, const GLint location);
+  static GLuint Find(const std::vector<Binding> &list, const std::uint32_t hash);
+  void Reflect();
+  void CopyUniformValues(GLuint from,
+                         const std::vector<ActiveVariable> &uniforms) const;
+
+  // in-flight state between Begin/FinishCreateAndLinkProgram
+  std::vector<GLuint> _pendingShaders;
+  std::chrono::steady_clock::time_point _linkStart;
+  std::uint64_t _cacheKey = 0;
+  bool _useCache = false;
+  bool _restored = false;
+
+  std::vector<ActiveVariable> _activeAttributes;
+  std::vector<ActiveVariable> _activeUniforms;
+  std::vector<ActiveBlock> _uniformBlocks;
+  std::vector<std::pair<std::string, GLuint>> _blockBindings;
+  std::vector<FileSource> _files;
+  std::vector<std::pair<GLenum, std::string>> _stringSources;
+  std::vector<std::string> _feedbackVaryings;
+  GLenum _feedbackMode = GL_INTERLEAVED_ATTRIBS;
 };
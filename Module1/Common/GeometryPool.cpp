@@ -0,0 +1,422 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "GeometryPool.hpp"
+// STL
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+
+namespace {
+constexpr std::size_t UNPACKED_VERTEX_SIZE = 3 * sizeof(GLfloat);
+constexpr std::size_t UNPACKED_INDEX_SIZE  = sizeof(GLuint);
+} // namespace
+
+GLintptr CGeometryPool::VertexBytes(const Page &page, const GLsizei count) {
+  return static_cast<GLintptr>(count) *
+         CVertexFormat::PositionSize(page.position);
+}
+
+GLintptr CGeometryPool::IndexBytes(const Page &page, const GLsizei count) {
+  return static_cast<GLintptr>(count) *
+         CVertexFormat::IndexSize(page.indexType);
+}
+
+CGeometryPool &CGeometryPool::Instance() {
+  static CGeometryPool pool;
+  return pool;
+}
+
+bool CGeometryPool::Take(std::vector<Range> &freeList, const GLsizei count,
+                         GLsizei &offset) {
+  // first fit, the lists are short
+  for (auto range = freeList.begin(); range != freeList.end(); ++range) {
+    if (range->count < count) {
+      continue;
+    }
+    offset = range->offset;
+    range->offset += count;
+    range->count -= count;
+    if (range->count == 0) {
+      freeList.erase(range);
+    }
+    return true;
+  }
+  return false;
+}
+
+void CGeometryPool::Release(std::vector<Range> &freeList, const Range range) {
+  if (range.count == 0) {
+    return;
+  }
+  auto next = std::lower_bound(
+      freeList.begin(), freeList.end(), range,
+      [](const Range &a, const Range &b) { return a.offset < b.offset; });
+  next = freeList.insert(next, range);
+
+  // merge with the following and the preceding free range
+  const auto following = next + 1;
+  if (following != freeList.end() &&
+      next->offset + next->count == following->offset) {
+    next->count += following->count;
+    freeList.erase(following);
+  }
+  if (next != freeList.begin()) {
+    const auto preceding = next - 1;
+    if (preceding->offset + preceding->count == next->offset) {
+      preceding->count += next->count;
+      freeList.erase(next);
+    }
+  }
+}
+
+GLsizei CGeometryPool::FreeSpace(const std::vector<Range> &freeList) {
+  GLsizei total = 0;
+  for (const auto &range : freeList) {
+    total += range.count;
+  }
+  return total;
+}
+
+void CGeometryPool::CreateBuffers(Page &page) const {
+  page.vboVertices = GLBuffer::Create();
+  page.vboIndices  = GLBuffer::Create();
+
+  glBindVertexArray(page.vao.Get());
+  glBindBuffer(GL_ARRAY_BUFFER, page.vboVertices.Get());
+  glBufferData(GL_ARRAY_BUFFER, VertexBytes(page, page.vertexCapacity),
+               nullptr, GL_STATIC_DRAW);
+  // RenderableObject shaders read vVertex from location 0
+  CVertexFormat format;
+  format.position = page.position;
+  format.SetAttributes({page.vboVertices.Get()});
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.vboIndices.Get());
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, IndexBytes(page, page.indexCapacity),
+               nullptr, GL_STATIC_DRAW);
+  glBindVertexArray(0);
+}
+
+std::size_t CGeometryPool::CreatePage(const GLsizei vertexCapacity,
+                                      const GLsizei indexCapacity,
+                                      const CVertexFormat::Position position) {
+  // reuse the slot of a deleted page so page indices stay small
+  auto slot = std::find_if(pages.begin(), pages.end(), [](const Page &page) {
+    return !page.vao;
+  });
+  if (slot == pages.end()) {
+    slot = pages.insert(pages.end(), Page());
+  }
+
+  Page &page = *slot;
+  page.vertexCapacity = vertexCapacity;
+  page.indexCapacity  = indexCapacity;
+  page.position       = position;
+  page.indexType      = CVertexFormat::IndexType(
+      static_cast<std::size_t>(vertexCapacity));
+  page.freeVertices   = {{0, vertexCapacity}};
+  page.freeIndices    = {{0, indexCapacity}};
+  page.liveAllocations = 0;
+  page.vao = GLVertexArray::Create();
+  CreateBuffers(page);
+  // CreateBuffers left VAO 0 bound
+  boundVAO = 0;
+  return static_cast<std::size_t>(slot - pages.begin());
+}
+
+void CGeometryPool::DestroyPage(Page &page) const {
+  // the handles delete the buffers and the VAO
+  page = Page();
+}
+
+CGeometryPool::Handle CGeometryPool::Allocate(const GLsizei vertexCount,
+                                              const GLsizei indexCount,
+                                              const GLfloat *vertices,
+                                              const GLuint *indices,
+                                              const CVertexFormat::Position position) {
+  Allocation allocation{};
+  allocation.vertexCount = vertexCount;
+  allocation.indexCount  = indexCount;
+
+  auto fits = [&](Page &page) {
+    if (!page.vao || page.position != position) {
+      return false;
+    }
+    if (!Take(page.freeVertices, vertexCount, allocation.baseVertex)) {
+      return false;
+    }
+    if (!Take(page.freeIndices, indexCount, allocation.firstIndex)) {
+      Release(page.freeVertices, {allocation.baseVertex, vertexCount});
+      return false;
+    }
+    return true;
+  };
+
+  bool found = false;
+  for (std::size_t i = 0; i < pages.size() && !found; ++i) {
+    if (fits(pages[i])) {
+      allocation.page = i;
+      found = true;
+    }
+  }
+  // enough room but no single range: pack the page and retry
+  for (std::size_t i = 0; i < pages.size() && !found; ++i) {
+    if (pages[i].vao && pages[i].position == position &&
+        FreeSpace(pages[i].freeVertices) >= vertexCount &&
+        FreeSpace(pages[i].freeIndices) >= indexCount) {
+      CompactPage(i);
+      if (fits(pages[i])) {
+        allocation.page = i;
+        found = true;
+      }
+    }
+  }
+  if (!found) {
+    allocation.page = CreatePage(std::max(vertexCount, PAGE_VERTICES),
+                                 std::max(indexCount, PAGE_INDICES), position);
+    fits(pages[allocation.page]);
+  }
+
+  Page &page = pages[allocation.page];
+  ++page.liveAllocations;
+  allocation.indexType = page.indexType;
+
+  // encode into the page formats
+  CVertexFormat format;
+  format.position = page.position;
+  const auto packed = format.Pack(
+      reinterpret_cast<const glm::vec3 *>(vertices), nullptr, nullptr,
+      static_cast<std::size_t>(vertexCount), indices,
+      static_cast<std::size_t>(indexCount));
+  allocation.positionScale  = packed.positionScale;
+  allocation.positionOffset = packed.positionOffset;
+  assert(packed.indexType == page.indexType ||
+         page.indexType == GL_UNSIGNED_INT);
+  std::vector<GLuint> wideIndices;
+  const GLvoid *indexData = packed.indices.data();
+  if (packed.indexType != page.indexType) {
+    // a small allocation in an oversized 32-bit page
+    wideIndices.assign(indices, indices + indexCount);
+    indexData = wideIndices.data();
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, page.vboVertices.Get());
+  glBufferSubData(GL_ARRAY_BUFFER, VertexBytes(page, allocation.baseVertex),
+                  VertexBytes(page, vertexCount), packed.streams[0].data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  // the element binding is VAO state, upload through the copy target
+  glBindBuffer(GL_COPY_WRITE_BUFFER, page.vboIndices.Get());
+  glBufferSubData(GL_COPY_WRITE_BUFFER, IndexBytes(page, allocation.firstIndex),
+                  IndexBytes(page, indexCount), indexData);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  Handle handle;
+  if (freeHandles.empty()) {
+    handle = static_cast<Handle>(allocations.size());
+    allocations.push_back(allocation);
+    liveHandles.push_back(true);
+  } else {
+    handle = freeHandles.back();
+    freeHandles.pop_back();
+    allocations[handle] = allocation;
+    liveHandles[handle] = true;
+  }
+  return handle;
+}
+
+void CGeometryPool::Free(const Handle handle) {
+  if (handle == INVALID_HANDLE || !liveHandles[handle]) {
+    return;
+  }
+  const Allocation &allocation = allocations[handle];
+  Page &page = pages[allocation.page];
+  Release(page.freeVertices, {allocation.baseVertex, allocation.vertexCount});
+  Release(page.freeIndices, {allocation.firstIndex, allocation.indexCount});
+  if (--page.liveAllocations == 0) {
+    DestroyPage(page);
+    // the name of the deleted VAO may be handed out again
+    boundVAO = 0;
+  }
+  liveHandles[handle] = false;
+  freeHandles.push_back(handle);
+}
+
+const CGeometryPool::Allocation &CGeometryPool::Get(const Handle handle) const {
+  assert(handle != INVALID_HANDLE && liveHandles[handle]);
+  return allocations[handle];
+}
+
+GLuint CGeometryPool::GetVAO(const Handle handle) const {
+  return pages[Get(handle).page].vao.Get();
+}
+
+void CGeometryPool::Bind(const Handle handle) {
+  const GLuint vao = pages[Get(handle).page].vao.Get();
+  if (batching && vao == boundVAO) {
+    return;
+  }
+  glBindVertexArray(vao);
+  boundVAO = vao;
+  ++vaoBinds;
+}
+
+void CGeometryPool::BeginBatch() {
+  batching = true;
+  boundVAO = 0;
+}
+
+void CGeometryPool::EndBatch() {
+  batching = false;
+  boundVAO = 0;
+  glBindVertexArray(0);
+}
+
+bool CGeometryPool::IsBatching() const { return batching; }
+
+void CGeometryPool::Draw(const Handle handle, const GLenum primitive) {
+  const Allocation &allocation = Get(handle);
+  const Page &page = pages[allocation.page];
+  glDrawElementsBaseVertex(
+      primitive, allocation.indexCount, allocation.indexType,
+      reinterpret_cast<const GLvoid *>(IndexBytes(page, allocation.firstIndex)),
+      allocation.baseVertex);
+  ++draws;
+}
+
+void CGeometryPool::DrawInstanced(const Handle handle, const GLenum primitive,
+                                  const GLsizei instanceCount) {
+  const Allocation &allocation = Get(handle);
+  const Page &page = pages[allocation.page];
+  glDrawElementsInstancedBaseVertex(
+      primitive, allocation.indexCount, allocation.indexType,
+      reinterpret_cast<const GLvoid *>(IndexBytes(page, allocation.firstIndex)),
+      instanceCount, allocation.baseVertex);
+  ++draws;
+  instances += static_cast<std::size_t>(instanceCount);
+}
+
+void CGeometryPool::Compact() {
+  for (std::size_t i = 0; i < pages.size(); ++i) {
+    if (pages[i].vao &&
+        (pages[i].freeVertices.size() > 1 || pages[i].freeIndices.size() > 1)) {
+      CompactPage(i);
+    }
+  }
+}
+
+void CGeometryPool::CompactPage(const std::size_t index) {
+  Page &page = pages[index];
+  // deleted on return, once their contents are copied
+  const GLBuffer oldVertices = std::move(page.vboVertices);
+  const GLBuffer oldIndices  = std::move(page.vboIndices);
+  CreateBuffers(page);
+  boundVAO = 0;
+
+  // live ranges of the page in buffer order
+  std::vector<Handle> live;
+  for (Handle handle = 0; handle < allocations.size(); ++handle) {
+    if (liveHandles[handle] && allocations[handle].page == index) {
+      live.push_back(handle);
+    }
+  }
+
+  GLsizei vertexEnd = 0;
+  std::sort(live.begin(), live.end(), [this](Handle a, Handle b) {
+    return allocations[a].baseVertex < allocations[b].baseVertex;
+  });
+  glBindBuffer(GL_COPY_READ_BUFFER, oldVertices.Get());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, page.vboVertices.Get());
+  for (const auto handle : live) {
+    Allocation &allocation = allocations[handle];
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                        VertexBytes(page, allocation.baseVertex),
+                        VertexBytes(page, vertexEnd),
+                        VertexBytes(page, allocation.vertexCount));
+    allocation.baseVertex = vertexEnd;
+    vertexEnd += allocation.vertexCount;
+  }
+
+  // indices are relative to baseVertex, moving them needs no rewrite
+  GLsizei indexEnd = 0;
+  std::sort(live.begin(), live.end(), [this](Handle a, Handle b) {
+    return allocations[a].firstIndex < allocations[b].firstIndex;
+  });
+  glBindBuffer(GL_COPY_READ_BUFFER, oldIndices.Get());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, page.vboIndices.Get());
+  for (const auto handle : live) {
+    Allocation &allocation = allocations[handle];
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                        IndexBytes(page, allocation.firstIndex),
+                        IndexBytes(page, indexEnd),
+                        IndexBytes(page, allocation.indexCount));
+    allocation.firstIndex = indexEnd;
+    indexEnd += allocation.indexCount;
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  page.freeVertices.clear();
+  page.freeIndices.clear();
+  Release(page.freeVertices, {vertexEnd, page.vertexCapacity - vertexEnd});
+  Release(page.freeIndices, {indexEnd, page.indexCapacity - indexEnd});
+  ++compactions;
+}
+
+CGeometryPool::Stats CGeometryPool::GetStats() const {
+  Stats stats;
+  std::size_t freeBytes    = 0;
+  std::size_t largestBytes = 0;
+  for (const auto &page : pages) {
+    if (!page.vao) {
+      continue;
+    }
+    ++stats.pages;
+    stats.bytesReserved += static_cast<std::size_t>(
+        VertexBytes(page, page.vertexCapacity) +
+        IndexBytes(page, page.indexCapacity));
+    GLsizei largestVertices = 0;
+    for (const auto &range : page.freeVertices) {
+      largestVertices = std::max(largestVertices, range.count);
+    }
+    GLsizei largestIndices = 0;
+    for (const auto &range : page.freeIndices) {
+      largestIndices = std::max(largestIndices, range.count);
+    }
+    freeBytes += static_cast<std::size_t>(
+        VertexBytes(page, FreeSpace(page.freeVertices)) +
+        IndexBytes(page, FreeSpace(page.freeIndices)));
+    largestBytes += static_cast<std::size_t>(
+        VertexBytes(page, largestVertices) + IndexBytes(page, largestIndices));
+  }
+  for (Handle handle = 0; handle < allocations.size(); ++handle) {
+    if (liveHandles[handle]) {
+      const Allocation &allocation = allocations[handle];
+      ++stats.allocations;
+      stats.vertices += static_cast<std::size_t>(allocation.vertexCount);
+      stats.bytesUsedUnpacked +=
+          static_cast<std::size_t>(allocation.vertexCount) *
+              UNPACKED_VERTEX_SIZE +
+          static_cast<std::size_t>(allocation.indexCount) * UNPACKED_INDEX_SIZE;
+    }
+  }
+  stats.bytesUsed = stats.bytesReserved - freeBytes;
+  stats.fragmentation =
+      freeBytes == 0 ? 0.0
+                     : 1.0 - static_cast<double>(largestBytes) /
+                                 static_cast<double>(freeBytes);
+  stats.compactions = compactions;
+  stats.vaoBinds    = vaoBinds;
+  stats.draws       = draws;
+  stats.instances   = instances;
+  return stats;
+}
+
+void CGeometryPool::PrintStats(std::ostream &out) const {
+  const Stats stats = GetStats();
+  out << "Geometry pool: " << stats.allocations << " allocations in "
+      << stats.pages << " page(s), " << stats.bytesUsed << " of "
+      << stats.bytesReserved << " bytes used (" << stats.bytesUsedUnpacked
+      << " unpacked) for " << stats.vertices << " vertices, fragmentation "
+      << stats.fragmentation * 100.0 << "%, " << stats.compactions
+      << " compactions, " << stats.vaoBinds << " VAO binds for "
+      << stats.draws << " draws (" << stats.instances << " instances)\n";
+}
@@ -0,0 +1,182 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// Internal
+#include "GLHandle.hpp"
+#include "VertexFormat.hpp"
+
+/**
+ * @brief Sub-allocates RenderableObject geometry from a few large buffers.
+ *
+ * Vertices (vec3 positions at attribute location 0) and GLuint indices live
+ * in pages of one VBO, one IBO and one VAO each. An allocation is a vertex
+ * range and an index range inside one page; indices stay relative to the
+ * range so objects draw with glDrawElementsBaseVertex and every object of a
+ * page shares the same VAO. Free ranges are kept sorted and merged with
+ * their neighbours; when no single range fits but the page has room the
+ * live ranges are packed with glCopyBufferSubData (see Compact). Handles
+ * stay valid across compaction.
+ *
+ * Pages store positions in one CVertexFormat::Position encoding, chosen per
+ * allocation, and use 16-bit indices whenever the page has few enough
+ * vertices for them, which every regular page has.
+ */
+class CGeometryPool {
+public:
+  using Handle = std::uint32_t;
+  static constexpr Handle INVALID_HANDLE = 0xFFFFFFFFu;
+
+  // vertices per page, larger requests get a page of their own
+  static constexpr GLsizei PAGE_VERTICES = 64 * 1024;
+  static constexpr GLsizei PAGE_INDICES  = 3 * PAGE_VERTICES;
+
+  struct Allocation {
+    std::size_t page;
+    GLint baseVertex;  // first vertex of the range
+    GLsizei firstIndex; // first index of the range
+    GLsizei vertexCount;
+    GLsizei indexCount;
+    GLenum indexType; // of the page
+    // UNORM16 positions decode as position * scale + offset
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+  };
+
+  struct Stats {
+    std::size_t pages = 0;
+    std::size_t allocations = 0;
+    std::size_t bytesReserved = 0; // buffer storage of all pages
+    std::size_t bytesUsed = 0;     // live vertex and index ranges
+    // the live ranges as float positions and 32-bit indices
+    std::size_t bytesUsedUnpacked = 0;
+    std::size_t vertices = 0; // live vertices, for the bytes per vertex
+    // 1 - (largest free range of each stream of each page) / (all free
+    // space), in bytes; 0 when every free list is a single block
+    double fragmentation = 0.0;
+    std::size_t compactions = 0;
+    std::size_t vaoBinds = 0; // glBindVertexArray issued by Bind
+    std::size_t draws = 0;    // Draw and DrawInstanced calls
+    std::size_t instances = 0; // instances drawn by DrawInstanced
+  };
+
+  static CGeometryPool &Instance();
+
+  /**
+   * @brief Reserve a vertex and an index range and upload their contents.
+   *
+   * @param vertices vertexCount vec3 positions
+   * @param indices indexCount indices relative to the first vertex
+   * @param position encoding of the positions in the page buffers
+   */
+  Handle Allocate(GLsizei vertexCount, GLsizei indexCount,
+                  const GLfloat *vertices, const GLuint *indices,
+                  CVertexFormat::Position position =
+                      CVertexFormat::Position::FLOAT3);
+
+  /**
+   * @brief Return the ranges to their page, a page left empty is deleted.
+   */
+  void Free(Handle handle);
+
+  const Allocation &Get(Handle handle) const;
+
+  /**
+   * @brief VAO of the page holding `handle`, for callers that bind it.
+   */
+  GLuint GetVAO(Handle handle) const;
+
+  /**
+   * @brief Bind the VAO of the page holding `handle`.
+   *
+   * Inside a batch the VAO is only bound when the page changes.
+   */
+  void Bind(Handle handle);
+
+  /**
+   * @brief Keep the page VAO bound between draws until EndBatch.
+   *
+   * RenderableObject::Render leaves the VAO bound while a batch is open,
+   * so consecutive pooled draws share one bind. Nothing else may bind a
+   * VAO between BeginBatch and EndBatch.
+   */
+  void BeginBatch();
+
+  /**
+   * @brief Close the batch and unbind the VAO.
+   */
+  void EndBatch();
+
+  bool IsBatching() const;
+
+  /**
+   * @brief glDrawElementsBaseVertex of the whole allocation.
+   */
+  void Draw(Handle handle, GLenum primitive);
+
+  /**
+   * @brief glDrawElementsInstancedBaseVertex of the whole allocation.
+   */
+  void DrawInstanced(Handle handle, GLenum primitive, GLsizei instances);
+
+  /**
+   * @brief Pack the live ranges of every page to the front.
+   */
+  void Compact();
+
+  Stats GetStats() const;
+
+  void PrintStats(std::ostream &out) const;
+
+private:
+  struct Range {
+    GLsizei offset;
+    GLsizei count;
+  };
+
+  struct Page {
+    GLVertexArray vao; // empty while the slot is unused
+    GLBuffer vboVertices;
+    GLBuffer vboIndices;
+    GLsizei vertexCapacity = 0;
+    GLsizei indexCapacity = 0;
+    CVertexFormat::Position position = CVertexFormat::Position::FLOAT3;
+    GLenum indexType = GL_UNSIGNED_INT;
+    std::vector<Range> freeVertices; // sorted by offset, never adjacent
+    std::vector<Range> freeIndices;
+    std::size_t liveAllocations = 0;
+  };
+
+  CGeometryPool() = default;
+
+  static bool Take(std::vector<Range> &freeList, GLsizei count,
+                   GLsizei &offset);
+  static void Release(std::vector<Range> &freeList, Range range);
+  static GLsizei FreeSpace(const std::vector<Range> &freeList);
+
+  static GLintptr VertexBytes(const Page &page, GLsizei count);
+  static GLintptr IndexBytes(const Page &page, GLsizei count);
+
+  std::size_t CreatePage(GLsizei vertexCapacity, GLsizei indexCapacity,
+                         CVertexFormat::Position position);
+  void CreateBuffers(Page &page) const;
+  void DestroyPage(Page &page) const;
+  void CompactPage(std::size_t index);
+
+  std::vector<Page> pages;
+  std::vector<Allocation> allocations;
+  std::vector<Handle> freeHandles;
+  std::vector<bool> liveHandles;
+
+  bool batching = false;
+  GLuint boundVAO = 0; // only tracked while batching
+
+  std::size_t compactions = 0;
+  std::size_t vaoBinds = 0;
+  std::size_t draws = 0;
+  std::size_t instances = 0;
+};
@@ -0,0 +1,212 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "GpuCuller.hpp"
+// STL
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+// GLM
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+constexpr GLuint SPHERE_ATTRIBUTE = 0;
+constexpr GLuint WORKGROUP_SIZE = 64;
+} // namespace
+
+bool CGpuCuller::IsSupported() {
+  return GLEW_VERSION_4_0 ||
+         (GLEW_ARB_draw_indirect && GLEW_ARB_transform_feedback2);
+}
+
+void CGpuCuller::Init(const GLsizei maxInstances_,
+                      const bool forceTransformFeedback) {
+  maxInstances = maxInstances_;
+  sphereCount  = 0;
+  // gpu_cull.comp is #version 430 for its storage buffers, which a 3.3
+  // context with ARB_compute_shader does not compile
+  path = !forceTransformFeedback && GLEW_VERSION_4_3 ? Path::COMPUTE
+                                                     : Path::TRANSFORM_FEEDBACK;
+  queryBuffer = GLEW_VERSION_4_4 || GLEW_ARB_query_buffer_object;
+
+  const auto count = static_cast<std::size_t>(maxInstances);
+  sphereBuffer = GLBuffer::Create();
+  glBindBuffer(GL_ARRAY_BUFFER, sphereBuffer.Get());
+  glBufferData(GL_ARRAY_BUFFER,
+               static_cast<GLsizeiptr>(count * sizeof(glm::vec4)), nullptr,
+               GL_DYNAMIC_DRAW);
+  instanceBuffer = GLBuffer::Create();
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.Get());
+  glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(count * sizeof(GLuint)),
+               nullptr, GL_DYNAMIC_COPY);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  commandBuffer = GLBuffer::Create();
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.Get());
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(Command), &command,
+               GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  if (path == Path::COMPUTE) {
+    program.LoadFromFile(GL_COMPUTE_SHADER, "shaders/gpu_cull.comp");
+    program.CreateAndLinkProgram();
+    program.AddUniform("sphereCount");
+  } else {
+    program.LoadFromFile(GL_VERTEX_SHADER, "shaders/gpu_cull.vert");
+    program.LoadFromFile(GL_GEOMETRY_SHADER, "shaders/gpu_cull.geom");
+    program.SetTransformFeedbackVaryings({"instanceID"});
+    program.CreateAndLinkProgram();
+
+    // the spheres are the points drawn into transform feedback
+    sphereVAO = GLVertexArray::Create();
+    glBindVertexArray(sphereVAO.Get());
+    glBindBuffer(GL_ARRAY_BUFFER, sphereBuffer.Get());
+    glEnableVertexAttribArray(SPHERE_ATTRIBUTE);
+    glVertexAttribPointer(SPHERE_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    feedback = GLTransformFeedback::Create();
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, feedback.Get());
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, instanceBuffer.Get());
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    writtenQuery = GLQuery::Create();
+  }
+  program.AddUniform("FrustumPlanes");
+}
+
+void CGpuCuller::Destroy() {
+  program.DeleteShaderProgram();
+  writtenQuery.Reset();
+  feedback.Reset();
+  sphereVAO.Reset();
+  commandBuffer.Reset();
+  instanceBuffer.Reset();
+  sphereBuffer.Reset();
+}
+
+CGpuCuller::Path CGpuCuller::GetPath() const { return path; }
+
+void CGpuCuller::SetSpheres(const glm::vec4 *spheres, const GLsizei count) {
+  assert(count <= maxInstances);
+  sphereCount = count;
+  glBindBuffer(GL_ARRAY_BUFFER, sphereBuffer.Get());
+  glBufferSubData(GL_ARRAY_BUFFER, 0,
+                  static_cast<GLsizeiptr>(static_cast<std::size_t>(count) *
+                                          sizeof(glm::vec4)),
+                  spheres);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CGpuCuller::SetMesh(const GLsizei count, const GLuint firstIndex,
+                         const GLint baseVertex) {
+  command.count      = static_cast<GLuint>(count);
+  command.firstIndex = firstIndex;
+  command.baseVertex = baseVertex;
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.Get());
+  glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(Command), &command);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void CGpuCuller::Cull(const glm::vec4 planes[6]) {
+  program.Use();
+  glUniform4fv(program("FrustumPlanes"), 6, glm::value_ptr(planes[0]));
+
+  if (path == Path::COMPUTE) {
+    // instanceCount is the append counter of the shader
+    const GLuint zero = 0;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.Get());
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER,
+                    static_cast<GLintptr>(offsetof(Command, instanceCount)),
+                    sizeof(GLuint), &zero);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glUniform1ui(program("sphereCount"), static_cast<GLuint>(sphereCount));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sphereBuffer.Get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instanceBuffer.Get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer.Get());
+    glDispatchCompute(
+        (static_cast<GLuint>(sphereCount) + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+        1, 1);
+    // the draw reads the command and the indices the shader wrote
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                    GL_BUFFER_UPDATE_BARRIER_BIT);
+  } else {
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(sphereVAO.Get());
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, feedback.Get());
+    glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN,
+                 writtenQuery.Get());
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, sphereCount);
+    glEndTransformFeedback();
+    glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    // the number of points written is the instance count
+    if (queryBuffer) {
+      glBindBuffer(GL_QUERY_BUFFER, commandBuffer.Get());
+      glGetQueryObjectuiv(writtenQuery.Get(), GL_QUERY_RESULT,
+                          reinterpret_cast<GLuint *>(offsetof(Command, instanceCount)));
+      glBindBuffer(GL_QUERY_BUFFER, 0);
+    } else {
+      GLuint written = 0;
+      glGetQueryObjectuiv(writtenQuery.Get(), GL_QUERY_RESULT, &written);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.Get());
+      glBufferSubData(GL_DRAW_INDIRECT_BUFFER,
+                      static_cast<GLintptr>(offsetof(Command, instanceCount)),
+                      sizeof(GLuint), &written);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+      ++stats.countReadbacks;
+    }
+  }
+  program.UnUse();
+
+  ++stats.frames;
+  stats.instances += static_cast<std::size_t>(sphereCount);
+}
+
+void CGpuCuller::EnableInstanceAttribute(const GLuint location) const {
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.Get());
+  glEnableVertexAttribArray(location);
+  glVertexAttribIPointer(location, 1, GL_UNSIGNED_INT, 0, nullptr);
+  glVertexAttribDivisor(location, 1);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CGpuCuller::Draw(const GLenum primitive, const GLenum indexType) const {
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.Get());
+  glDrawElementsIndirect(primitive, indexType, nullptr);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void CGpuCuller::ReadVisible(std::vector<GLuint> &visible) const {
+  Command written;
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.Get());
+  glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(Command), &written);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  visible.resize(std::min(written.instanceCount, static_cast<GLuint>(maxInstances)));
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.Get());
+  glGetBufferSubData(GL_ARRAY_BUFFER, 0,
+                     static_cast<GLsizeiptr>(visible.size() * sizeof(GLuint)),
+                     visible.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  // the compute path appends in any order
+  std::sort(visible.begin(), visible.end());
+}
+
+GLuint CGpuCuller::GetSphereBuffer() const { return sphereBuffer.Get(); }
+
+GLuint CGpuCuller::GetInstanceBuffer() const { return instanceBuffer.Get(); }
+
+GLuint CGpuCuller::GetCommandBuffer() const { return commandBuffer.Get(); }
+
+const CGpuCuller::Stats &CGpuCuller::GetStats() const { return stats; }
+
+void CGpuCuller::PrintStats(std::ostream &out) const {
+  out << "GPU culling ("
+      << (path == Path::COMPUTE ? "compute shader" : "transform feedback")
+      << "): " << stats.instances << " instances in " << stats.frames
+      << " frames, " << stats.countReadbacks << " count readbacks\n";
+}
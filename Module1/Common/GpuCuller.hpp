@@ -0,0 +1,124 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <ostream>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// GLM
+#include <glm/glm.hpp>
+// Internal
+#include "GLHandle.hpp"
+#include "GLSLShader.hpp"
+
+/**
+ * @brief Frustum culling on the GPU that feeds an indirect draw.
+ *
+ * Every instance has a bounding sphere (xyz centre, w radius) in a buffer.
+ * Cull tests them against the CAbstractCamera::GetFrustumPlanes planes and
+ * packs the indices of the visible ones into the instance buffer, the
+ * instanceCount of the DrawElementsIndirect command in the command buffer
+ * is the number written. The CPU never sees which instances survived.
+ *
+ * With a GL 4.3 context a compute shader appends the indices with an
+ * atomic counter in the command buffer. On GL 3.3 a vertex and
+ * geometry shader emit one point per visible sphere into transform
+ * feedback; ARB_query_buffer_object writes the primitive count into the
+ * command on the GPU, without it the count is read back with a wait.
+ * Both paths need ARB_draw_indirect and ARB_transform_feedback2 (GL 4.0),
+ * the draw and the transform feedback object.
+ *
+ * The programs are loaded from the sample's shaders folder:
+ * shaders/gpu_cull.comp, or shaders/gpu_cull.vert and shaders/gpu_cull.geom.
+ *
+ * The vertex shader of the culled draw reads its instance index from an
+ * unsigned integer attribute set up by EnableInstanceAttribute.
+ */
+class CGpuCuller {
+public:
+  enum class Path { COMPUTE, TRANSFORM_FEEDBACK };
+
+  // layout fixed by the GL
+  struct Command {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+  struct Stats {
+    std::size_t frames = 0;
+    std::size_t instances = 0; // spheres tested
+    std::size_t countReadbacks = 0; // waits for the count, GL 3.3 only
+  };
+
+  static bool IsSupported();
+
+  /**
+   * @brief Buffers for `maxInstances` spheres, `forceTransformFeedback`
+   * picks the GL 3.3 path even when compute shaders are available.
+   */
+  void Init(GLsizei maxInstances, bool forceTransformFeedback = false);
+
+  void Destroy();
+
+  Path GetPath() const;
+
+  /**
+   * @brief Upload `count` bounding spheres, replaces the previous ones.
+   */
+  void SetSpheres(const glm::vec4 *spheres, GLsizei count);
+
+  /**
+   * @brief The indexed mesh every visible instance draws.
+   */
+  void SetMesh(GLsizei count, GLuint firstIndex = 0, GLint baseVertex = 0);
+
+  /**
+   * @brief Test the spheres against the planes and write the command.
+   */
+  void Cull(const glm::vec4 planes[6]);
+
+  /**
+   * @brief Feed the visible indices to `location` of the bound VAO, one
+   * per instance.
+   */
+  void EnableInstanceAttribute(GLuint location) const;
+
+  /**
+   * @brief Draw the culled instances, the VAO and program must be bound.
+   */
+  void Draw(GLenum primitive, GLenum indexType) const;
+
+  /**
+   * @brief Read the visible indices back, sorted; waits for the GPU, for
+   * verification only.
+   */
+  void ReadVisible(std::vector<GLuint> &visible) const;
+
+  GLuint GetSphereBuffer() const;
+  GLuint GetInstanceBuffer() const;
+  GLuint GetCommandBuffer() const;
+
+  const Stats &GetStats() const;
+  void PrintStats(std::ostream &out) const;
+
+private:
+  Path path = Path::COMPUTE;
+  bool queryBuffer = false;
+  GLsizei maxInstances = 0;
+  GLsizei sphereCount = 0;
+
+  GLBuffer sphereBuffer;
+  GLBuffer instanceBuffer;
+  GLBuffer commandBuffer;
+  GLVertexArray sphereVAO;    // transform feedback input
+  GLTransformFeedback feedback;
+  GLQuery writtenQuery;       // primitives written by transform feedback
+
+  GLSLShader program;
+  Command command = {0, 0, 0, 0, 0};
+
+  Stats stats;
+};
@@ -23,7 +23,9 @@ CGrid::~CGrid() {}
 
 int CGrid::GetTotalVertices() { return ((width + 1) + (depth + 1)) * 2; }
 
-int CGrid::GetTotalIndices() { return (width * depth); }
+// one index per line end point; the pooled vertex ranges are packed, so
+// indices past the object's own vertices would read its neighbours
+int CGrid::GetTotalIndices() { return GetTotalVertices(); }
 
 GLenum CGrid::GetPrimitiveType() { return GL_LINES; }
 
@@ -47,7 +49,7 @@ void CGrid::FillIndexBuffer(GLuint *pBuffer) {
   int i = 0;
   // fill indices array
   GLuint *id = pBuffer;
-  for (i = 0; i < width * depth; i += 4) {
+  for (i = 0; i < GetTotalIndices(); i += 4) {
     *id++ = static_cast<GLuint>(i);
     *id++ = static_cast<GLuint>(i + 1);
     *id++ = static_cast<GLuint>(i + 2);
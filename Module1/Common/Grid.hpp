@@ -5,6 +5,8 @@ class CGrid : public RenderableObject {
 public:
   CGrid(int width = 10, int depth = 10);
   virtual ~CGrid();
+  CGrid(CGrid &&) = default;
+  CGrid &operator=(CGrid &&) = default;
 
   int GetTotalVertices();
   int GetTotalIndices();
@@ -0,0 +1,42 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Hash {
+constexpr std::uint32_t FNV32_OFFSET = 0x811c9dc5U;
+constexpr std::uint32_t FNV32_PRIME  = 0x01000193U;
+constexpr std::uint64_t FNV64_OFFSET = 0xcbf29ce484222325ULL;
+constexpr std::uint64_t FNV64_PRIME  = 0x100000001b3ULL;
+
+/**
+ * @brief 64-bit FNV-1a over a byte range, can be chained through `seed`.
+ */
+constexpr std::uint64_t Fnv1a64(const char *data, std::size_t length,
+                                std::uint64_t seed = FNV64_OFFSET) {
+  std::uint64_t hash = seed;
+  for (std::size_t i = 0; i < length; ++i) {
+    hash ^= static_cast<std::uint8_t>(data[i]);
+    hash *= FNV64_PRIME;
+  }
+  return hash;
+}
+
+inline std::uint64_t Fnv1a64(const std::string &str,
+                             std::uint64_t seed = FNV64_OFFSET) {
+  return Fnv1a64(str.data(), str.size(), seed);
+}
+
+/**
+ * @brief 32-bit FNV-1a over a null terminated string, usable at compile time.
+ */
+constexpr std::uint32_t Fnv1a32(const char *str) {
+  std::uint32_t hash = FNV32_OFFSET;
+  for (; *str != '\0'; ++str) {
+    hash ^= static_cast<std::uint8_t>(*str);
+    hash *= FNV32_PRIME;
+  }
+  return hash;
+}
+} // namespace Hash
@@ -0,0 +1,173 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "IndirectDraw.hpp"
+// STL
+#include <cassert>
+#include <cstring>
+
+namespace {
+constexpr GLsizeiptr TEXEL_SIZE = 4 * sizeof(GLfloat);
+
+std::size_t IndexSize(const GLenum indexType) {
+  switch (indexType) {
+  case GL_UNSIGNED_BYTE:
+    return sizeof(GLubyte);
+  case GL_UNSIGNED_SHORT:
+    return sizeof(GLushort);
+  default:
+    return sizeof(GLuint);
+  }
+}
+} // namespace
+
+bool CIndirectDraw::IsSupported() {
+  return (GLEW_ARB_multi_draw_indirect || GLEW_VERSION_4_3) &&
+         (GLEW_ARB_shader_draw_parameters || GLEW_VERSION_4_6);
+}
+
+CShaderPreprocessor::Defines CIndirectDraw::GetDefines() {
+  if (IsSupported()) {
+    return {{"MULTI_DRAW_INDIRECT", "1"}};
+  }
+  return {};
+}
+
+void CIndirectDraw::Init(const GLsizei maxDraws_) {
+  supported = IsSupported();
+  maxDraws  = maxDraws_;
+
+  const auto drawDataSize =
+      static_cast<GLsizeiptr>(static_cast<std::size_t>(maxDraws) *
+                              sizeof(DrawData));
+  // every region of the buffer texture must stay addressable
+  GLint maxTexels = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+  assert(drawDataSize * CStreamingBuffer::REGIONS / TEXEL_SIZE <= maxTexels);
+
+  if (supported) {
+    commandStream.Init(GL_DRAW_INDIRECT_BUFFER,
+                       static_cast<GLsizeiptr>(
+                           static_cast<std::size_t>(maxDraws) * sizeof(Command)));
+  }
+  drawDataStream.Init(GL_TEXTURE_BUFFER, drawDataSize);
+
+  glGenTextures(1, &drawDataTexture);
+  glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataStream.GetBuffer());
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+  commands.reserve(static_cast<std::size_t>(maxDraws));
+  drawData.reserve(static_cast<std::size_t>(maxDraws));
+}
+
+void CIndirectDraw::Destroy() {
+  glDeleteTextures(1, &drawDataTexture);
+  drawDataTexture = 0;
+  if (supported) {
+    commandStream.Destroy();
+  }
+  drawDataStream.Destroy();
+  resolvedFor = nullptr;
+  Clear();
+}
+
+void CIndirectDraw::Add(const GLsizei count, const std::size_t firstIndex,
+                        const GLint baseVertex, const glm::mat4 &transform,
+                        const glm::vec4 &params) {
+  assert(static_cast<GLsizei>(commands.size()) < maxDraws);
+  Command command;
+  command.count         = static_cast<GLuint>(count);
+  command.instanceCount = 1;
+  command.firstIndex    = static_cast<GLuint>(firstIndex);
+  command.baseVertex    = baseVertex;
+  command.baseInstance  = 0;
+  commands.push_back(command);
+  drawData.push_back({transform, params});
+  ++stats.draws;
+}
+
+GLsizei CIndirectDraw::GetDrawCount() const {
+  return static_cast<GLsizei>(commands.size());
+}
+
+void CIndirectDraw::ResolveUniforms(GLSLShader &program) {
+  drawDataUniform     = program.AddUniform("drawData");
+  drawDataBaseUniform = program.AddUniform("drawDataBase");
+  drawIDUniform       = program.AddUniform("drawID");
+  resolvedFor         = &program;
+}
+
+void CIndirectDraw::Draw(GLSLShader &program, const GLenum primitive,
+                         const GLenum indexType, const GLint unit) {
+  if (commands.empty()) {
+    return;
+  }
+  if (resolvedFor != &program) {
+    ResolveUniforms(program);
+  }
+
+  // the per-draw data of this batch, addressed in texels from its start
+  const auto data = drawDataStream.Alloc(
+      static_cast<GLsizeiptr>(drawData.size() * sizeof(DrawData)), TEXEL_SIZE);
+  std::memcpy(data.data, drawData.data(), drawData.size() * sizeof(DrawData));
+  drawDataStream.Commit();
+
+  glActiveTexture(static_cast<GLenum>(GL_TEXTURE0 + unit));
+  glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+  glUniform1i(program(drawDataUniform), unit);
+  glUniform1i(program(drawDataBaseUniform),
+              static_cast<GLint>(data.offset / TEXEL_SIZE));
+
+  if (supported) {
+    const auto indirect = commandStream.Alloc(
+        static_cast<GLsizeiptr>(commands.size() * sizeof(Command)),
+        static_cast<GLsizeiptr>(sizeof(GLuint)));
+    std::memcpy(indirect.data, commands.data(),
+                commands.size() * sizeof(Command));
+    commandStream.Commit();
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandStream.GetBuffer());
+    glMultiDrawElementsIndirect(
+        primitive, indexType,
+        reinterpret_cast<const GLvoid *>(static_cast<std::size_t>(indirect.offset)),
+        static_cast<GLsizei>(commands.size()), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    ++stats.apiCalls;
+  } else {
+    const auto indexSize = IndexSize(indexType);
+    for (std::size_t i = 0; i < commands.size(); ++i) {
+      const Command &command = commands[i];
+      glUniform1i(program(drawIDUniform), static_cast<GLint>(i));
+      glDrawElementsBaseVertex(
+          primitive, static_cast<GLsizei>(command.count), indexType,
+          reinterpret_cast<const GLvoid *>(command.firstIndex * indexSize),
+          command.baseVertex);
+      ++stats.apiCalls;
+    }
+  }
+
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glActiveTexture(GL_TEXTURE0);
+  ++stats.batches;
+  Clear();
+}
+
+void CIndirectDraw::Clear() {
+  commands.clear();
+  drawData.clear();
+}
+
+void CIndirectDraw::EndFrame() {
+  if (supported) {
+    commandStream.EndFrame();
+  }
+  drawDataStream.EndFrame();
+}
+
+const CIndirectDraw::Stats &CIndirectDraw::GetStats() const { return stats; }
+
+void CIndirectDraw::PrintStats(std::ostream &out) const {
+  out << "Indirect draws (" << (supported ? "multi-draw indirect" : "fallback")
+      << "): " << stats.draws << " draws in " << stats.batches
+      << " batches, " << stats.apiCalls << " draw calls\n";
+}
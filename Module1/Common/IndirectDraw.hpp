@@ -0,0 +1,111 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <ostream>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// GLM
+#include <glm/glm.hpp>
+// Internal
+#include "GLSLShader.hpp"
+#include "ShaderPreprocessor.hpp"
+#include "StreamingBuffer.hpp"
+
+/**
+ * @brief Batch of indexed draws issued with one glMultiDrawElementsIndirect.
+ *
+ * Add records a DrawElementsIndirectCommand plus a model matrix and a vec4
+ * of per-draw parameters. Draw streams both into GPU buffers and issues
+ * every command of the batch with a single call; the vertex shader fetches
+ * its per-draw data with gl_DrawID from a samplerBuffer:
+ *
+ *   #include "draw_data.glsl"        // right after #version
+ *   mat4 M = DrawTransform();
+ *   vec4 params = DrawParams();
+ *
+ * Programs are built with GetDefines(). Without ARB_multi_draw_indirect
+ * and ARB_shader_draw_parameters the batch falls back to one
+ * glDrawElementsBaseVertex per command and the draw index is a uniform.
+ */
+class CIndirectDraw {
+public:
+  // layout fixed by the GL
+  struct Command {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+  // five RGBA32F texels per draw
+  struct DrawData {
+    glm::mat4 transform;
+    glm::vec4 params;
+  };
+
+  struct Stats {
+    std::size_t draws = 0;     // commands added
+    std::size_t batches = 0;   // Draw calls with at least one command
+    std::size_t apiCalls = 0;  // glMultiDraw* or glDraw* issued
+  };
+
+  static bool IsSupported();
+
+  /**
+   * @brief Defines the programs drawn with this batch must be built with.
+   */
+  static CShaderPreprocessor::Defines GetDefines();
+
+  /**
+   * @brief Reserve streaming space for `maxDraws` draws per frame.
+   */
+  void Init(GLsizei maxDraws);
+
+  void Destroy();
+
+  void Add(GLsizei count, std::size_t firstIndex, GLint baseVertex,
+           const glm::mat4 &transform, const glm::vec4 &params = glm::vec4(0));
+
+  GLsizei GetDrawCount() const;
+
+  /**
+   * @brief Issue and clear the added draws.
+   *
+   * The VAO must be bound and `program` in use; the draw data is bound as
+   * a buffer texture on texture unit `unit`.
+   */
+  void Draw(GLSLShader &program, GLenum primitive, GLenum indexType,
+            GLint unit);
+
+  void Clear();
+
+  /**
+   * @brief Fence this frame's commands and draw data, call after the swap.
+   */
+  void EndFrame();
+
+  const Stats &GetStats() const;
+
+  void PrintStats(std::ostream &out) const;
+
+private:
+  void ResolveUniforms(GLSLShader &program);
+
+  bool supported = false;
+  GLsizei maxDraws = 0;
+
+  CStreamingBuffer commandStream;  // GL_DRAW_INDIRECT_BUFFER
+  CStreamingBuffer drawDataStream; // GL_TEXTURE_BUFFER
+  GLuint drawDataTexture = 0;
+
+  std::vector<Command> commands;
+  std::vector<DrawData> drawData;
+
+  // uniforms of the last program drawn with
+  const GLSLShader *resolvedFor = nullptr;
+  UniformHandle drawDataUniform, drawDataBaseUniform, drawIDUniform;
+
+  Stats stats;
+};
@@ -0,0 +1,81 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "InstanceBuffer.hpp"
+// STL
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace {
+GLsizeiptr RegionSize(const GLsizei instances) {
+  return static_cast<GLsizeiptr>(static_cast<std::size_t>(instances) *
+                                 sizeof(CInstanceBuffer::Instance));
+}
+} // namespace
+
+void CInstanceBuffer::Init() {
+  capacity = REGION_INSTANCES;
+  stream.Init(GL_ARRAY_BUFFER, RegionSize(capacity));
+}
+
+void CInstanceBuffer::Destroy() {
+  stream.Destroy();
+  capacity = 0;
+}
+
+void CInstanceBuffer::Upload(const glm::mat4 *models, const glm::vec4 *colors,
+                             const GLsizei count) {
+  // grow by doubling, the old buffer is released once the GPU is done
+  if (count > capacity) {
+    const auto grown = std::max(count, 2 * capacity);
+    stream.Destroy();
+    capacity = grown;
+    stream.Init(GL_ARRAY_BUFFER, RegionSize(capacity));
+  }
+
+  const auto allocation =
+      stream.Alloc(RegionSize(count), static_cast<GLsizeiptr>(sizeof(Instance)));
+  auto *instances = static_cast<Instance *>(allocation.data);
+  for (GLsizei i = 0; i < count; ++i) {
+    instances[i].model = models[i];
+    instances[i].color = colors ? colors[i] : glm::vec4(1);
+  }
+  stream.Commit();
+  offset = allocation.offset;
+}
+
+void CInstanceBuffer::Enable() const {
+  const auto stride = static_cast<GLsizei>(sizeof(Instance));
+  const auto base   = static_cast<std::size_t>(offset);
+  glBindBuffer(GL_ARRAY_BUFFER, stream.GetBuffer());
+
+  glEnableVertexAttribArray(INSTANCE_COLOR);
+  glVertexAttribPointer(
+      INSTANCE_COLOR, 4, GL_FLOAT, GL_FALSE, stride,
+      reinterpret_cast<const GLvoid *>(base + offsetof(Instance, color)));
+  glVertexAttribDivisor(INSTANCE_COLOR, 1);
+
+  // a mat4 attribute takes one location per column
+  for (GLuint column = 0; column < 4; ++column) {
+    const auto columnOffset =
+        base + offsetof(Instance, model) + column * sizeof(glm::vec4);
+    glEnableVertexAttribArray(INSTANCE_MODEL + column);
+    glVertexAttribPointer(INSTANCE_MODEL + column, 4, GL_FLOAT, GL_FALSE,
+                          stride, reinterpret_cast<const GLvoid *>(columnOffset));
+    glVertexAttribDivisor(INSTANCE_MODEL + column, 1);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CInstanceBuffer::Disable() const {
+  glDisableVertexAttribArray(INSTANCE_COLOR);
+  glVertexAttribDivisor(INSTANCE_COLOR, 0);
+  for (GLuint column = 0; column < 4; ++column) {
+    glDisableVertexAttribArray(INSTANCE_MODEL + column);
+    glVertexAttribDivisor(INSTANCE_MODEL + column, 0);
+  }
+}
+
+void CInstanceBuffer::EndFrame() { stream.EndFrame(); }
+
+const CStreamingBuffer &CInstanceBuffer::GetStream() const { return stream; }
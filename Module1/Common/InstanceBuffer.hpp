@@ -0,0 +1,66 @@
+#pragma once
+// GLEW
+#include <GL/glew.h>
+// GLM
+#include <glm/glm.hpp>
+// Internal
+#include "StreamingBuffer.hpp"
+
+/**
+ * @brief Per-instance attributes of RenderableObject::RenderInstanced.
+ *
+ * Instances are interleaved {mat4 model; vec4 color} and feed the vertex
+ * shader convention of the Common primitives:
+ *
+ *   layout(location = 1) in vec4 vInstanceColor; // INSTANCE_COLOR
+ *   layout(location = 2) in mat4 mInstance;      // INSTANCE_MODEL, 2 to 5
+ *
+ * declared once in Common/shaders/instanced_vertex.glsl, which the
+ * shaders pull in with #include.
+ *
+ * Uploads are written straight into a CStreamingBuffer, every upload gets
+ * a fresh range so the driver never has to wait for the draws still
+ * reading the previous instances.
+ */
+class CInstanceBuffer {
+public:
+  static constexpr GLuint INSTANCE_COLOR = 1;
+  static constexpr GLuint INSTANCE_MODEL = 2;
+
+  struct Instance {
+    glm::mat4 model;
+    glm::vec4 color;
+  };
+
+  static constexpr GLsizei REGION_INSTANCES = 1024;
+
+  void Init();
+  void Destroy();
+
+  /**
+   * @brief Stream `count` instances, a null `colors` means white.
+   */
+  void Upload(const glm::mat4 *models, const glm::vec4 *colors, GLsizei count);
+
+  /**
+   * @brief Point the instance attributes of the bound VAO at the last upload.
+   */
+  void Enable() const;
+
+  /**
+   * @brief Disable the instance attributes of the bound VAO again.
+   */
+  void Disable() const;
+
+  /**
+   * @brief Fence the uploads of this frame, call once after the swap.
+   */
+  void EndFrame();
+
+  const CStreamingBuffer &GetStream() const;
+
+private:
+  CStreamingBuffer stream;
+  GLsizei capacity = 0; // instances per region
+  GLintptr offset  = 0; // of the last upload
+};
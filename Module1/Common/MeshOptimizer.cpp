@@ -0,0 +1,363 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "MeshOptimizer.hpp"
+// STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// Forsyth, "Linear-Speed Vertex Cache Optimisation"
+constexpr int FORSYTH_CACHE_SIZE   = 32;
+constexpr float CACHE_DECAY_POWER  = 1.5f;
+constexpr float LAST_TRI_SCORE     = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+constexpr GLuint UNASSIGNED = std::numeric_limits<GLuint>::max();
+
+float VertexScore(const int cachePosition, const unsigned remainingTriangles) {
+  if (remainingTriangles == 0) {
+    return -1.0f;
+  }
+  float score = 0.0f;
+  if (cachePosition >= 0) {
+    if (cachePosition < 3) {
+      // the last triangle's vertices score the same whatever their order,
+      // so the next triangle does not just reuse one edge
+      score = LAST_TRI_SCORE;
+    } else {
+      const float scale = 1.0f / static_cast<float>(FORSYTH_CACHE_SIZE - 3);
+      score = std::pow(
+          1.0f - static_cast<float>(cachePosition - 3) * scale,
+          CACHE_DECAY_POWER);
+    }
+  }
+  // favour vertices with few triangles left so they get finished
+  score += VALENCE_BOOST_SCALE *
+           std::pow(static_cast<float>(remainingTriangles),
+                    -VALENCE_BOOST_POWER);
+  return score;
+}
+
+/**
+ * @brief FIFO post-transform cache, a vertex is cached while fewer than
+ * `size` misses happened since it was loaded.
+ */
+class FifoCache {
+public:
+  FifoCache(const std::size_t vertexCount, const unsigned size_)
+      : loaded(vertexCount, 0), size(size_), time(size_ + 1) {}
+
+  bool Access(const GLuint vertex) {
+    if (time - loaded[vertex] <= size) {
+      return false;
+    }
+    loaded[vertex] = time++;
+    return true;
+  }
+
+  void Flush() { time += size + 1; }
+
+private:
+  std::vector<unsigned> loaded;
+  unsigned size;
+  unsigned time;
+};
+
+unsigned TriangleMisses(FifoCache &cache, const GLuint *triangle) {
+  unsigned misses = 0;
+  for (int k = 0; k < 3; ++k) {
+    misses += cache.Access(triangle[k]) ? 1U : 0U;
+  }
+  return misses;
+}
+} // namespace
+
+CMeshOptimizer::CacheStats CMeshOptimizer::Analyze(const GLuint *indices,
+                                                   const std::size_t indexCount,
+                                                   const std::size_t vertexCount,
+                                                   const unsigned cacheSize) {
+  CacheStats stats;
+  if (indexCount < 3) {
+    return stats;
+  }
+  FifoCache cache(vertexCount, cacheSize);
+  std::vector<bool> referenced(vertexCount, false);
+  std::size_t misses = 0, unique = 0;
+  for (std::size_t i = 0; i < indexCount; ++i) {
+    misses += cache.Access(indices[i]) ? 1 : 0;
+    if (!referenced[indices[i]]) {
+      referenced[indices[i]] = true;
+      ++unique;
+    }
+  }
+  stats.acmr = static_cast<double>(misses) /
+               static_cast<double>(indexCount / 3);
+  stats.atvr = static_cast<double>(misses) / static_cast<double>(unique);
+  return stats;
+}
+
+void CMeshOptimizer::OptimizeVertexCache(GLuint *indices,
+                                         const std::size_t indexCount,
+                                         const std::size_t vertexCount) {
+  const std::size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // triangles of every vertex, the live ones are the first `remaining`
+  std::vector<unsigned> remaining(vertexCount, 0);
+  for (std::size_t i = 0; i < indexCount; ++i) {
+    ++remaining[indices[i]];
+  }
+  std::vector<std::size_t> offsets(vertexCount + 1, 0);
+  for (std::size_t v = 0; v < vertexCount; ++v) {
+    offsets[v + 1] = offsets[v] + remaining[v];
+  }
+  std::vector<GLuint> adjacency(indexCount);
+  {
+    std::vector<std::size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (std::size_t t = 0; t < triangleCount; ++t) {
+      for (int k = 0; k < 3; ++k) {
+        adjacency[fill[indices[3 * t + static_cast<std::size_t>(k)]]++] =
+            static_cast<GLuint>(t);
+      }
+    }
+  }
+
+  std::vector<int> cachePosition(vertexCount, -1);
+  std::vector<float> vertexScore(vertexCount);
+  for (std::size_t v = 0; v < vertexCount; ++v) {
+    vertexScore[v] = VertexScore(-1, remaining[v]);
+  }
+  std::vector<float> triangleScore(triangleCount);
+  for (std::size_t t = 0; t < triangleCount; ++t) {
+    triangleScore[t] = vertexScore[indices[3 * t]] +
+                       vertexScore[indices[3 * t + 1]] +
+                       vertexScore[indices[3 * t + 2]];
+  }
+
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<GLuint> output;
+  output.reserve(indexCount);
+  std::vector<GLuint> cache, newCache;
+  cache.reserve(FORSYTH_CACHE_SIZE + 3);
+  newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+  std::size_t cursor = 0; // input order fallback when the cache is empty
+  std::size_t best   = static_cast<std::size_t>(
+      std::max_element(triangleScore.begin(), triangleScore.end()) -
+      triangleScore.begin());
+
+  for (std::size_t done = 0; done < triangleCount; ++done) {
+    if (best == triangleCount) {
+      while (emitted[cursor]) {
+        ++cursor;
+      }
+      best = cursor;
+    }
+    emitted[best] = true;
+    const GLuint *triangle = indices + 3 * best;
+
+    newCache.clear();
+    for (int k = 0; k < 3; ++k) {
+      const GLuint v = triangle[k];
+      output.push_back(v);
+      newCache.push_back(v);
+
+      // drop the triangle from the live list of its vertex
+      auto *first = &adjacency[offsets[v]];
+      auto *last  = first + remaining[v];
+      std::iter_swap(std::find(first, last, static_cast<GLuint>(best)),
+                     last - 1);
+      --remaining[v];
+    }
+    for (const auto v : cache) {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        newCache.push_back(v);
+      }
+    }
+
+    // rescore the cached and just evicted vertices and their triangles
+    for (std::size_t i = 0; i < newCache.size(); ++i) {
+      const GLuint v = newCache[i];
+      cachePosition[v] =
+          i < static_cast<std::size_t>(FORSYTH_CACHE_SIZE) ? static_cast<int>(i) : -1;
+      vertexScore[v] = VertexScore(cachePosition[v], remaining[v]);
+    }
+    best = triangleCount;
+    float bestScore = -1.0f;
+    for (const auto v : newCache) {
+      for (unsigned j = 0; j < remaining[v]; ++j) {
+        const GLuint t = adjacency[offsets[v] + j];
+        const GLuint *candidate = indices + 3 * static_cast<std::size_t>(t);
+        triangleScore[t] = vertexScore[candidate[0]] +
+                           vertexScore[candidate[1]] +
+                           vertexScore[candidate[2]];
+        if (triangleScore[t] > bestScore) {
+          bestScore = triangleScore[t];
+          best      = t;
+        }
+      }
+    }
+    if (newCache.size() > static_cast<std::size_t>(FORSYTH_CACHE_SIZE)) {
+      newCache.resize(FORSYTH_CACHE_SIZE);
+    }
+    cache.swap(newCache);
+  }
+
+  std::copy(output.begin(), output.end(), indices);
+}
+
+void CMeshOptimizer::OptimizeOverdraw(GLuint *indices,
+                                      const std::size_t indexCount,
+                                      const glm::vec3 *positions,
+                                      const std::size_t vertexCount,
+                                      const float threshold) {
+  const std::size_t triangleCount = indexCount / 3;
+  if (triangleCount < 2) {
+    return;
+  }
+
+  // hard boundaries: triangles that miss with all their vertices, the
+  // cache is cold there so splitting costs nothing
+  std::vector<std::size_t> hard;
+  {
+    FifoCache cache(vertexCount, ANALYZE_CACHE_SIZE);
+    for (std::size_t t = 0; t < triangleCount; ++t) {
+      if (TriangleMisses(cache, indices + 3 * t) == 3 || t == 0) {
+        hard.push_back(t);
+      }
+    }
+    hard.push_back(triangleCount);
+  }
+
+  // soft boundaries: split a cluster further while the part so far is
+  // within `threshold` of the whole cluster's miss ratio
+  std::vector<std::size_t> clusters;
+  FifoCache cache(vertexCount, ANALYZE_CACHE_SIZE);
+  for (std::size_t c = 0; c + 1 < hard.size(); ++c) {
+    const std::size_t begin = hard[c], end = hard[c + 1];
+    cache.Flush();
+    unsigned misses = 0;
+    for (std::size_t t = begin; t < end; ++t) {
+      misses += TriangleMisses(cache, indices + 3 * t);
+    }
+    const float clusterAcmr =
+        static_cast<float>(misses) / static_cast<float>(end - begin);
+
+    clusters.push_back(begin);
+    cache.Flush();
+    misses = 0;
+    std::size_t start = begin;
+    for (std::size_t t = begin; t < end; ++t) {
+      misses += TriangleMisses(cache, indices + 3 * t);
+      const float partAcmr =
+          static_cast<float>(misses) / static_cast<float>(t + 1 - start);
+      if (t + 1 < end && partAcmr <= clusterAcmr * threshold) {
+        clusters.push_back(t + 1);
+        cache.Flush();
+        misses = 0;
+        start  = t + 1;
+      }
+    }
+  }
+  clusters.push_back(triangleCount);
+
+  // sort clusters by how much they face away from the mesh centre
+  glm::vec3 meshCentroid(0);
+  float meshArea = 0;
+  struct Cluster {
+    std::size_t begin, end;
+    glm::vec3 centroid, normal;
+    float sortKey;
+  };
+  std::vector<Cluster> sorted;
+  for (std::size_t c = 0; c + 1 < clusters.size(); ++c) {
+    Cluster cluster{clusters[c], clusters[c + 1], glm::vec3(0), glm::vec3(0), 0};
+    float area = 0;
+    for (std::size_t t = cluster.begin; t < cluster.end; ++t) {
+      const glm::vec3 &p0 = positions[indices[3 * t]];
+      const glm::vec3 &p1 = positions[indices[3 * t + 1]];
+      const glm::vec3 &p2 = positions[indices[3 * t + 2]];
+      const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+      const float triangleArea = glm::length(normal);
+      cluster.centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+      cluster.normal += normal;
+      area += triangleArea;
+    }
+    meshCentroid += cluster.centroid;
+    meshArea += area;
+    if (area > 0.0f) {
+      cluster.centroid /= area;
+    }
+    const float length = glm::length(cluster.normal);
+    if (length > 0.0f) {
+      cluster.normal /= length;
+    }
+    sorted.push_back(cluster);
+  }
+  if (meshArea > 0.0f) {
+    meshCentroid /= meshArea;
+  }
+  for (auto &cluster : sorted) {
+    cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, cluster.normal);
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const Cluster &a, const Cluster &b) {
+                     return a.sortKey > b.sortKey;
+                   });
+
+  std::vector<GLuint> output;
+  output.reserve(triangleCount * 3);
+  for (const auto &cluster : sorted) {
+    output.insert(output.end(), indices + 3 * cluster.begin,
+                  indices + 3 * cluster.end);
+  }
+  std::copy(output.begin(), output.end(), indices);
+}
+
+std::vector<GLuint> CMeshOptimizer::OptimizeVertexFetch(
+    std::vector<GLuint> &indices, const std::size_t vertexCount) {
+  std::vector<GLuint> remap(vertexCount, UNASSIGNED);
+  GLuint next = 0;
+  for (auto &index : indices) {
+    if (remap[index] == UNASSIGNED) {
+      remap[index] = next++;
+    }
+    index = remap[index];
+  }
+  for (auto &target : remap) {
+    if (target == UNASSIGNED) {
+      target = next++;
+    }
+  }
+  return remap;
+}
+
+std::vector<GLuint> CMeshOptimizer::Optimize(std::vector<GLuint> &indices,
+                                             const std::vector<Range> &ranges,
+                                             const glm::vec3 *positions,
+                                             const std::size_t vertexCount,
+                                             const char *name,
+                                             std::ostream &report) {
+  const auto before = Analyze(indices.data(), indices.size(), vertexCount);
+  for (const auto &range : ranges) {
+    OptimizeVertexCache(indices.data() + range.first, range.count, vertexCount);
+    OptimizeOverdraw(indices.data() + range.first, range.count, positions,
+                     vertexCount);
+  }
+  auto remap = OptimizeVertexFetch(indices, vertexCount);
+  const auto after = Analyze(indices.data(), indices.size(), vertexCount);
+  PrintReport(report, name, before, after);
+  return remap;
+}
+
+void CMeshOptimizer::PrintReport(std::ostream &out, const char *name,
+                                 const CacheStats &before,
+                                 const CacheStats &after) {
+  out << name << ": ACMR " << before.acmr << " -> " << after.acmr
+      << ", ATVR " << before.atvr << " -> " << after.atvr << " (FIFO "
+      << ANALYZE_CACHE_SIZE << ")\n";
+}
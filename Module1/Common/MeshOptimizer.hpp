@@ -0,0 +1,129 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// GLM
+#include <glm/glm.hpp>
+// Internal
+#include "Hash.hpp"
+
+/**
+ * @brief Triangle and vertex reordering for indexed triangle lists.
+ *
+ * Run by the mesh loaders once the geometry is indexed:
+ *
+ *   1. OptimizeVertexCache, Forsyth's greedy post-transform cache order
+ *   2. OptimizeOverdraw, splits the cache order into clusters where the
+ *      cache is cold anyway and sorts them so outward facing clusters
+ *      come first
+ *   3. OptimizeVertexFetch, numbers the vertices in first use order and
+ *      returns the remap for every vertex attribute (see Remap)
+ *
+ * Steps 1 and 2 work on ranges of an index list, so submeshes keep their
+ * offsets. Analyze reports the average cache miss ratio per triangle
+ * (ACMR, 0.5 to 3) and per vertex (ATVR, 1 is optimal) of a FIFO cache.
+ */
+class CMeshOptimizer {
+public:
+  static constexpr unsigned ANALYZE_CACHE_SIZE = 16;
+
+  struct Range {
+    std::size_t first; // in indices
+    std::size_t count;
+  };
+
+  struct CacheStats {
+    double acmr = 0;
+    double atvr = 0;
+  };
+
+  static CacheStats Analyze(const GLuint *indices, std::size_t indexCount,
+                            std::size_t vertexCount,
+                            unsigned cacheSize = ANALYZE_CACHE_SIZE);
+
+  static void OptimizeVertexCache(GLuint *indices, std::size_t indexCount,
+                                  std::size_t vertexCount);
+
+  /**
+   * @brief Reorder clusters of the cache order front to back on average.
+   *
+   * @param threshold ACMR a cluster may lose by being split further
+   */
+  static void OptimizeOverdraw(GLuint *indices, std::size_t indexCount,
+                               const glm::vec3 *positions,
+                               std::size_t vertexCount,
+                               float threshold = 1.05f);
+
+  /**
+   * @brief Rewrite `indices` to first use order.
+   *
+   * @return old to new vertex numbers, unreferenced vertices move to the end
+   */
+  static std::vector<GLuint> OptimizeVertexFetch(std::vector<GLuint> &indices,
+                                                 std::size_t vertexCount);
+
+  /**
+   * @brief Cache and overdraw order per range, then the fetch order of the
+   * whole list; prints the ACMR/ATVR before and after to `report`.
+   *
+   * @return the vertex remap of OptimizeVertexFetch
+   */
+  static std::vector<GLuint> Optimize(std::vector<GLuint> &indices,
+                                      const std::vector<Range> &ranges,
+                                      const glm::vec3 *positions,
+                                      std::size_t vertexCount,
+                                      const char *name, std::ostream &report);
+
+  /**
+   * @brief Move every element to its new position, `remap[old] = new`.
+   */
+  template <typename T>
+  static void Remap(std::vector<T> &attribute,
+                    const std::vector<GLuint> &remap) {
+    std::vector<T> remapped(attribute.size());
+    for (std::size_t i = 0; i < attribute.size(); ++i) {
+      remapped[remap[i]] = attribute[i];
+    }
+    attribute.swap(remapped);
+  }
+
+  /**
+   * @brief Merge bitwise identical vertices, keeping first occurrences.
+   *
+   * @return old to new vertex numbers, to be applied to the indices
+   */
+  template <typename T> static std::vector<GLuint> Weld(std::vector<T> &vertices) {
+    std::vector<GLuint> remap(vertices.size());
+    std::unordered_map<std::uint64_t, std::vector<GLuint>> buckets;
+    std::vector<T> unique;
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+      const auto hash = Hash::Fnv1a64(reinterpret_cast<const char *>(&vertices[i]),
+                                      sizeof(T));
+      auto &bucket = buckets[hash];
+      bool found   = false;
+      for (const auto candidate : bucket) {
+        if (std::memcmp(&unique[candidate], &vertices[i], sizeof(T)) == 0) {
+          remap[i] = candidate;
+          found    = true;
+          break;
+        }
+      }
+      if (!found) {
+        remap[i] = static_cast<GLuint>(unique.size());
+        bucket.push_back(remap[i]);
+        unique.push_back(vertices[i]);
+      }
+    }
+    vertices.swap(unique);
+    return remap;
+  }
+
+  static void PrintReport(std::ostream &out, const char *name,
+                          const CacheStats &before, const CacheStats &after);
+};
@@ -0,0 +1,208 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "MultiViewCuller.hpp"
+// STL
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <thread>
+// Internal
+#include "WorkerPool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MULTI_VIEW_CULLER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+using ViewMask = CMultiViewCuller::ViewMask;
+
+// arrays are x, y, z, radius for spheres and minX, minY, minZ, maxX, maxY,
+// maxZ for boxes; a box is tested with its corner furthest along the normal
+ViewMask MaskScalar(const float *planes, const int viewCount,
+                    const float *const *arrays, const bool boxes,
+                    const std::size_t i) {
+  const float threshold = boxes ? 0.0f : -arrays[3][i];
+  ViewMask mask = 0;
+  for (int v = 0; v < viewCount; ++v) {
+    bool inside = true;
+    for (int p = 0; p < 6 && inside; ++p) {
+      const float *n = planes + (v * 6 + p) * 4;
+      const float x = boxes && n[0] >= 0 ? arrays[3][i] : arrays[0][i];
+      const float y = boxes && n[1] >= 0 ? arrays[4][i] : arrays[1][i];
+      const float z = boxes && n[2] >= 0 ? arrays[5][i] : arrays[2][i];
+      inside = n[0] * x + n[1] * y + n[2] * z + n[3] >= threshold;
+    }
+    mask |= static_cast<ViewMask>(inside) << v;
+  }
+  return mask;
+}
+
+void CullRange(const float *planes, const int viewCount,
+               const float *const *arrays, const bool boxes,
+               const std::size_t begin, const std::size_t end,
+               ViewMask *masks) {
+  std::size_t i = begin;
+#ifdef MULTI_VIEW_CULLER_SSE
+  for (; i + 4 <= end; i += 4) {
+    // the objects are loaded once for all views
+    const __m128 x = _mm_loadu_ps(arrays[0] + i);
+    const __m128 y = _mm_loadu_ps(arrays[1] + i);
+    const __m128 z = _mm_loadu_ps(arrays[2] + i);
+    const __m128 other[3] = {
+        boxes ? _mm_loadu_ps(arrays[3] + i) : x,
+        boxes ? _mm_loadu_ps(arrays[4] + i) : y,
+        boxes ? _mm_loadu_ps(arrays[5] + i) : z};
+    const __m128 threshold =
+        boxes ? _mm_setzero_ps()
+              : _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(arrays[3] + i));
+
+    __m128i mask = _mm_setzero_si128();
+    for (int v = 0; v < viewCount; ++v) {
+      __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      for (int p = 0; p < 6; ++p) {
+        const float *n = planes + (v * 6 + p) * 4;
+        const __m128 d = _mm_add_ps(
+            _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(n[0]), boxes && n[0] >= 0 ? other[0] : x),
+                           _mm_mul_ps(_mm_set1_ps(n[1]), boxes && n[1] >= 0 ? other[1] : y)),
+                _mm_mul_ps(_mm_set1_ps(n[2]), boxes && n[2] >= 0 ? other[2] : z)),
+            _mm_set1_ps(n[3]));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(d, threshold));
+        if (_mm_movemask_ps(inside) == 0) {
+          break;
+        }
+      }
+      mask = _mm_or_si128(mask, _mm_and_si128(_mm_castps_si128(inside),
+                                              _mm_set1_epi32(static_cast<int>(1U << v))));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(masks + i), mask);
+  }
+#endif
+  for (; i < end; ++i) {
+    masks[i] = MaskScalar(planes, viewCount, arrays, boxes, i);
+  }
+}
+} // namespace
+
+CMultiViewCuller::CMultiViewCuller()
+    : threads(std::max(1U, std::thread::hardware_concurrency())) {}
+
+void CMultiViewCuller::SetThreads(const unsigned threads_) {
+  threads = std::max(1U, threads_);
+}
+
+void CMultiViewCuller::ClearViews() { planes.clear(); }
+
+int CMultiViewCuller::AddView(const glm::vec4 planes_[6]) {
+  const int view = GetViewCount();
+  if (view == MAX_VIEWS) {
+    return -1;
+  }
+  for (int p = 0; p < 6; ++p) {
+    for (int k = 0; k < 4; ++k) {
+      planes.push_back(planes_[p][k]);
+    }
+  }
+  return view;
+}
+
+int CMultiViewCuller::AddView(CAbstractCamera &camera) {
+  glm::vec4 planes_[6];
+  camera.GetFrustumPlanes(planes_);
+  return AddView(planes_);
+}
+
+int CMultiViewCuller::AddView(const glm::mat4 &viewProjection) {
+  // left, right, bottom, top, near and far from the rows of the matrix
+  glm::vec4 planes_[6];
+  for (int p = 0; p < 6; ++p) {
+    const int row = p / 2;
+    const float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+    glm::vec4 plane;
+    for (int k = 0; k < 4; ++k) {
+      plane[k] = viewProjection[k][3] + sign * viewProjection[k][row];
+    }
+    planes_[p] = plane / glm::length(glm::vec3(plane));
+  }
+  return AddView(planes_);
+}
+
+int CMultiViewCuller::GetViewCount() const {
+  return static_cast<int>(planes.size() / 24);
+}
+
+void CMultiViewCuller::Cull(const float *const *arrays, const bool boxes,
+                            const std::size_t count,
+                            std::vector<ViewMask> &masks) {
+  const auto start = std::chrono::steady_clock::now();
+  masks.resize(count);
+  const int viewCount = GetViewCount();
+
+  if (threads == 1 || count < CFrustumCuller::PARALLEL_MIN_OBJECTS) {
+    CullRange(planes.data(), viewCount, arrays, boxes, 0, count, masks.data());
+  } else {
+    // multiples of 4 objects per chunk
+    const std::size_t perChunk = ((count + threads - 1) / threads + 3) & ~std::size_t{3};
+    const std::size_t chunks = (count + perChunk - 1) / perChunk;
+    CWorkerPool::Instance().ParallelFor(chunks, [&](const std::size_t chunk) {
+      const std::size_t begin = chunk * perChunk;
+      CullRange(planes.data(), viewCount, arrays, boxes, begin,
+                std::min(count, begin + perChunk), masks.data());
+    });
+  }
+
+  ++stats.batches;
+  stats.objects += count;
+  stats.viewTests += count * static_cast<std::size_t>(viewCount);
+  for (const ViewMask mask : masks) {
+    stats.visible += std::bitset<32>(mask).count();
+  }
+  stats.ms += std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+}
+
+void CMultiViewCuller::CullSpheres(const CFrustumCuller::Spheres &spheres,
+                                   std::vector<ViewMask> &masks) {
+  const float *arrays[4] = {spheres.x, spheres.y, spheres.z, spheres.radius};
+  Cull(arrays, false, spheres.count, masks);
+}
+
+void CMultiViewCuller::CullBoxes(const CFrustumCuller::Boxes &boxes,
+                                 std::vector<ViewMask> &masks) {
+  const float *arrays[6] = {boxes.minX, boxes.minY, boxes.minZ,
+                            boxes.maxX, boxes.maxY, boxes.maxZ};
+  Cull(arrays, true, boxes.count, masks);
+}
+
+void CMultiViewCuller::BuildLists(const std::vector<ViewMask> &masks,
+                                  std::vector<std::vector<GLuint>> &lists) const {
+  lists.resize(static_cast<std::size_t>(GetViewCount()));
+  for (auto &list : lists) {
+    list.clear();
+  }
+  for (std::size_t i = 0; i < masks.size(); ++i) {
+    // visit only the set bits
+    for (ViewMask mask = masks[i]; mask != 0; mask &= mask - 1) {
+      int view = 0;
+      while (((mask >> view) & 1U) == 0) {
+        ++view;
+      }
+      lists[static_cast<std::size_t>(view)].push_back(static_cast<GLuint>(i));
+    }
+  }
+}
+
+const CMultiViewCuller::Stats &CMultiViewCuller::GetStats() const { return stats; }
+
+void CMultiViewCuller::ResetStats() { stats = Stats(); }
+
+void CMultiViewCuller::PrintStats(std::ostream &out) const {
+  const double batches = static_cast<double>(std::max<std::size_t>(stats.batches, 1));
+  out << "Multi-view culling: " << stats.objects << " objects, "
+      << stats.viewTests << " object and view tests in " << stats.batches
+      << " batches, " << stats.visible << " visible, " << stats.ms / batches
+      << " ms per batch\n";
+}
@@ -0,0 +1,91 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// GLM
+#include <glm/glm.hpp>
+// Internal
+#include "AbstractCamera.hpp"
+#include "FrustumCuller.hpp"
+
+/**
+ * @brief Frustum test of spheres and boxes against up to 32 views at once.
+ *
+ * Every object is loaded once and tested against all views, the result is
+ * one mask per object with bit v set when view v sees it. The per-view draw
+ * lists are then built from the masks, instead of walking the objects once
+ * per cube face, camera or light.
+ *
+ * Objects use the structure of arrays layout of CFrustumCuller and give the
+ * same answer as CFrustumCuller for every view. 4 objects are tested at a
+ * time with SSE, large batches are split across the shared CWorkerPool.
+ */
+class CMultiViewCuller {
+public:
+  static constexpr int MAX_VIEWS = 32;
+
+  // bit v is set when view v sees the object
+  using ViewMask = std::uint32_t;
+
+  struct Stats {
+    std::size_t batches = 0;
+    std::size_t objects = 0;
+    std::size_t viewTests = 0; // objects times views
+    std::size_t visible = 0;   // object and view pairs that passed
+    double ms = 0;
+  };
+
+  CMultiViewCuller();
+
+  /**
+   * @brief Chunks for batches of CFrustumCuller::PARALLEL_MIN_OBJECTS or
+   * more, run on the shared CWorkerPool; defaults to the hardware
+   * concurrency.
+   */
+  void SetThreads(unsigned threads);
+
+  void ClearViews();
+
+  /**
+   * @brief Add a view with the CAbstractCamera::GetFrustumPlanes planes,
+   * returns its bit or -1 when MAX_VIEWS are already set.
+   */
+  int AddView(const glm::vec4 planes[6]);
+  int AddView(CAbstractCamera &camera);
+
+  /**
+   * @brief Add a view with the planes of a projection times view matrix,
+   * for views without a camera such as cube map faces.
+   */
+  int AddView(const glm::mat4 &viewProjection);
+
+  int GetViewCount() const;
+
+  void CullSpheres(const CFrustumCuller::Spheres &spheres,
+                   std::vector<ViewMask> &masks);
+  void CullBoxes(const CFrustumCuller::Boxes &boxes,
+                 std::vector<ViewMask> &masks);
+
+  /**
+   * @brief Indices of the objects each view sees, `lists` is resized to
+   * the view count.
+   */
+  void BuildLists(const std::vector<ViewMask> &masks,
+                  std::vector<std::vector<GLuint>> &lists) const;
+
+  const Stats &GetStats() const;
+  void ResetStats();
+  void PrintStats(std::ostream &out) const;
+
+private:
+  void Cull(const float *const *arrays, bool boxes, std::size_t count,
+            std::vector<ViewMask> &masks);
+
+  std::vector<float> planes; // 6 planes of 4 floats per view
+  unsigned threads;
+  Stats stats;
+};
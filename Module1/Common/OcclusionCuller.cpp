@@ -0,0 +1,316 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "OcclusionCuller.hpp"
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+// Internal
+#include "WorkerPool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_CULLER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+// below this many triangles Rasterize stays on the calling thread
+constexpr std::size_t PARALLEL_MIN_TRIANGLES = 64;
+
+struct Edge {
+  float a, b, c; // a * x + b * y + c, positive inside
+
+  // moved inwards by half a pixel along each axis, so the value at a pixel
+  // centre is the smallest one over the whole pixel
+  Edge(const float x0, const float y0, const float x1, const float y1)
+      : a(y0 - y1), b(x1 - x0),
+        c(-(a * x0 + b * y0) - 0.5f * (std::abs(a) + std::abs(b))) {}
+};
+} // namespace
+
+void COcclusionCuller::Init(const int width_, const int height_) {
+  tilesX = (width_ + TILE_SIZE - 1) / TILE_SIZE;
+  tilesY = (height_ + TILE_SIZE - 1) / TILE_SIZE;
+  width  = tilesX * TILE_SIZE;
+  height = tilesY * TILE_SIZE;
+  depth.assign(static_cast<std::size_t>(width * height), 1.0f);
+  tileMax.assign(static_cast<std::size_t>(tilesX * tilesY), 1.0f);
+  threads = std::max(1U, std::thread::hardware_concurrency());
+}
+
+void COcclusionCuller::SetThreads(const unsigned threads_) {
+  threads = std::max(1U, threads_);
+}
+
+void COcclusionCuller::Begin(const glm::mat4 &viewProjection_) {
+  viewProjection = viewProjection_;
+  std::fill(depth.begin(), depth.end(), 1.0f);
+  std::fill(tileMax.begin(), tileMax.end(), 1.0f);
+  triangles.clear();
+  ++stats.frames;
+}
+
+void COcclusionCuller::AddOccluder(const glm::vec3 *positions,
+                                   const std::uint32_t *indices,
+                                   const std::size_t indexCount,
+                                   const glm::mat4 &model) {
+  Add(positions, indices, indexCount, model);
+}
+
+void COcclusionCuller::AddOccluder(const glm::vec3 *positions,
+                                   const std::uint16_t *indices,
+                                   const std::size_t indexCount,
+                                   const glm::mat4 &model) {
+  Add(positions, indices, indexCount, model);
+}
+
+template <typename Index>
+void COcclusionCuller::Add(const glm::vec3 *positions, const Index *indices,
+                           const std::size_t indexCount,
+                           const glm::mat4 &model) {
+  if (indexCount == 0) {
+    return;
+  }
+  // transform every referenced vertex once
+  const std::size_t vertexCount =
+      static_cast<std::size_t>(*std::max_element(indices, indices + indexCount)) + 1;
+  const glm::mat4 MVP = viewProjection * model;
+  std::vector<glm::vec4> clip(vertexCount);
+  for (std::size_t i = 0; i < vertexCount; ++i) {
+    clip[i] = MVP * glm::vec4(positions[i], 1);
+  }
+
+  for (std::size_t i = 0; i + 2 < indexCount; i += 3) {
+    const glm::vec4 triangle[3] = {clip[indices[i]], clip[indices[i + 1]],
+                                   clip[indices[i + 2]]};
+    AddClipped(triangle);
+  }
+}
+
+void COcclusionCuller::AddClipped(const glm::vec4 clip[3]) {
+  // all three vertices outside one side of the frustum
+  for (int axis = 0; axis < 3; ++axis) {
+    if ((clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w &&
+         clip[2][axis] > clip[2].w) ||
+        (axis < 2 && clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w &&
+         clip[2][axis] < -clip[2].w)) {
+      return;
+    }
+  }
+
+  // clip against the near plane, z >= -w
+  glm::vec4 polygon[4];
+  int count = 0;
+  for (int i = 0; i < 3; ++i) {
+    const glm::vec4 &a = clip[i];
+    const glm::vec4 &b = clip[(i + 1) % 3];
+    const float da = a.z + a.w;
+    const float db = b.z + b.w;
+    if (da >= 0) {
+      polygon[count++] = a;
+    }
+    if ((da >= 0) != (db >= 0)) {
+      polygon[count++] = a + (b - a) * (da / (da - db));
+    }
+  }
+
+  for (int i = 1; i + 1 < count; ++i) {
+    triangles.push_back(ToScreen(polygon[0]));
+    triangles.push_back(ToScreen(polygon[i]));
+    triangles.push_back(ToScreen(polygon[i + 1]));
+    ++stats.triangles;
+  }
+}
+
+COcclusionCuller::Vertex COcclusionCuller::ToScreen(const glm::vec4 &clip) const {
+  // a vertex exactly on the near plane at the eye has w 0; depth past the
+  // far plane is kept, the cleared buffer and IsOccluded stop at 1
+  const float w = std::max(clip.w, 1e-6f);
+  return {(clip.x / w * 0.5f + 0.5f) * static_cast<float>(width),
+          (clip.y / w * 0.5f + 0.5f) * static_cast<float>(height),
+          std::max(clip.z / w * 0.5f + 0.5f, 0.0f)};
+}
+
+void COcclusionCuller::Rasterize() {
+  const auto start = std::chrono::steady_clock::now();
+
+  const std::size_t triangleCount = triangles.size() / 3;
+  const int bands = triangleCount < PARALLEL_MIN_TRIANGLES
+                        ? 1
+                        : std::min(static_cast<int>(threads), tilesY);
+  // whole tile rows per band
+  const int tileRowsPerBand = (tilesY + bands - 1) / bands;
+  CWorkerPool::Instance().ParallelFor(
+      static_cast<std::size_t>(bands), [&](const std::size_t band) {
+        const int first = static_cast<int>(band) * tileRowsPerBand * TILE_SIZE;
+        const int last  = std::min(height, first + tileRowsPerBand * TILE_SIZE);
+        if (first < last) {
+          RasterizeBand(first, last);
+        }
+      });
+
+  stats.rasterMs += std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+}
+
+void COcclusionCuller::RasterizeBand(const int firstRow, const int lastRow) {
+  for (std::size_t t = 0; t + 2 < triangles.size(); t += 3) {
+    Vertex v0 = triangles[t];
+    Vertex v1 = triangles[t + 1];
+    Vertex v2 = triangles[t + 2];
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    if (std::abs(area) < 1e-8f) {
+      continue;
+    }
+    // occluders are two sided, make the winding counter-clockwise
+    if (area < 0) {
+      std::swap(v1, v2);
+      area = -area;
+    }
+
+    const int minX = std::max(0, static_cast<int>(std::floor(std::min({v0.x, v1.x, v2.x}))));
+    const int maxX = std::min(width - 1, static_cast<int>(std::floor(std::max({v0.x, v1.x, v2.x}))));
+    const int minY = std::max(firstRow, static_cast<int>(std::floor(std::min({v0.y, v1.y, v2.y}))));
+    const int maxY = std::min(lastRow - 1, static_cast<int>(std::floor(std::max({v0.y, v1.y, v2.y}))));
+    if (minX > maxX || minY > maxY) {
+      continue;
+    }
+
+    const Edge e0(v1.x, v1.y, v2.x, v2.y);
+    const Edge e1(v2.x, v2.y, v0.x, v0.y);
+    const Edge e2(v0.x, v0.y, v1.x, v1.y);
+    // depth plane through the three vertices, offset to its farthest value
+    // over the pixel around the centre it is evaluated at
+    const float dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    const float dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+    const float z0 = v0.z - dzdx * v0.x - dzdy * v0.y +
+                     0.5f * (std::abs(dzdx) + std::abs(dzdy));
+
+    for (int y = minY; y <= maxY; ++y) {
+      const float py = static_cast<float>(y) + 0.5f;
+      float *row = depth.data() + static_cast<std::size_t>(y * width);
+#ifdef OCCLUSION_CULLER_SSE
+      // 4 pixels at a time, the width is a multiple of the tile size
+      const __m128 step = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+      const __m128 zero = _mm_setzero_ps();
+      for (int x = minX & ~3; x <= maxX; x += 4) {
+        const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), step);
+        auto edge = [&](const Edge &e) {
+          return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e.a), px),
+                            _mm_set1_ps(e.b * py + e.c));
+        };
+        const __m128 inside =
+            _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge(e0), zero), _mm_cmpge_ps(edge(e1), zero)),
+                       _mm_cmpge_ps(edge(e2), zero));
+        if (_mm_movemask_ps(inside) == 0) {
+          continue;
+        }
+        const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px),
+                                    _mm_set1_ps(dzdy * py + z0));
+        // the nearest of the occluders that cover the whole pixel
+        const __m128 old = _mm_loadu_ps(row + x);
+        const __m128 nearest = _mm_min_ps(old, z);
+        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest),
+                                         _mm_andnot_ps(inside, old)));
+      }
+#else
+      for (int x = minX; x <= maxX; ++x) {
+        const float px = static_cast<float>(x) + 0.5f;
+        if (e0.a * px + e0.b * py + e0.c >= 0 && e1.a * px + e1.b * py + e1.c >= 0 &&
+            e2.a * px + e2.b * py + e2.c >= 0) {
+          row[x] = std::min(row[x], dzdx * px + dzdy * py + z0);
+        }
+      }
+#endif
+    }
+  }
+
+  // farthest depth of every tile of the band
+  for (int ty = firstRow / TILE_SIZE; ty < lastRow / TILE_SIZE; ++ty) {
+    for (int tx = 0; tx < tilesX; ++tx) {
+      float farthest = 0;
+      for (int y = ty * TILE_SIZE; y < (ty + 1) * TILE_SIZE; ++y) {
+        const float *row = depth.data() + static_cast<std::size_t>(y * width + tx * TILE_SIZE);
+        farthest = std::max(farthest, *std::max_element(row, row + TILE_SIZE));
+      }
+      tileMax[static_cast<std::size_t>(ty * tilesX + tx)] = farthest;
+    }
+  }
+}
+
+bool COcclusionCuller::IsOccluded(const glm::vec3 &min, const glm::vec3 &max) {
+  ++stats.tests;
+
+  // screen rectangle and nearest depth of the box
+  float minX = static_cast<float>(width), maxX = 0;
+  float minY = static_cast<float>(height), maxY = 0;
+  float nearest = 1.0f;
+  for (int i = 0; i < 8; ++i) {
+    const glm::vec3 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y,
+                           (i & 4) ? max.z : min.z);
+    const glm::vec4 clip = viewProjection * glm::vec4(corner, 1);
+    if (clip.w <= 0 || clip.z < -clip.w) {
+      return false;
+    }
+    const Vertex v = ToScreen(clip);
+    minX = std::min(minX, v.x);
+    maxX = std::max(maxX, v.x);
+    minY = std::min(minY, v.y);
+    maxY = std::max(maxY, v.y);
+    nearest = std::min(nearest, v.z);
+  }
+  if (minX < 0 || minY < 0 || maxX >= static_cast<float>(width) ||
+      maxY >= static_cast<float>(height)) {
+    return false;
+  }
+
+  const int x0 = static_cast<int>(minX), x1 = static_cast<int>(maxX);
+  const int y0 = static_cast<int>(minY), y1 = static_cast<int>(maxY);
+  bool pixelTest = false;
+  for (int ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ++ty) {
+    for (int tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; ++tx) {
+      // every occluder pixel of the tile is nearer than the box
+      if (tileMax[static_cast<std::size_t>(ty * tilesX + tx)] < nearest) {
+        continue;
+      }
+      if (!pixelTest) {
+        pixelTest = true;
+        ++stats.pixelTests;
+      }
+      const int top = std::min(y1, (ty + 1) * TILE_SIZE - 1);
+      const int right = std::min(x1, (tx + 1) * TILE_SIZE - 1);
+      for (int y = std::max(y0, ty * TILE_SIZE); y <= top; ++y) {
+        const float *row = depth.data() + static_cast<std::size_t>(y * width);
+        for (int x = std::max(x0, tx * TILE_SIZE); x <= right; ++x) {
+          if (row[x] >= nearest) {
+            return false;
+          }
+        }
+      }
+    }
+  }
+  ++stats.occluded;
+  return true;
+}
+
+int COcclusionCuller::GetWidth() const { return width; }
+
+int COcclusionCuller::GetHeight() const { return height; }
+
+const float *COcclusionCuller::GetDepth() const { return depth.data(); }
+
+const COcclusionCuller::Stats &COcclusionCuller::GetStats() const { return stats; }
+
+void COcclusionCuller::ResetStats() { stats = Stats(); }
+
+void COcclusionCuller::PrintStats(std::ostream &out) const {
+  const double frames = static_cast<double>(std::max<std::size_t>(stats.frames, 1));
+  out << "Occlusion culling: " << width << "x" << height << ", per frame "
+      << static_cast<double>(stats.triangles) / frames << " occluder triangles in "
+      << stats.rasterMs / frames << " ms, " << stats.occluded << " of "
+      << stats.tests << " boxes occluded, " << stats.pixelTests
+      << " needed pixel tests\n";
+}
@@ -0,0 +1,108 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+// GLM
+#include <glm/glm.hpp>
+
+/**
+ * @brief Software occlusion culling against a low resolution depth buffer.
+ *
+ * Every frame, Begin clears the buffer for a view projection matrix,
+ * AddOccluder transforms, near-clips and projects the triangles of the
+ * occluder meshes and Rasterize draws them. The screen is split into bands
+ * of tile rows rasterized on the shared CWorkerPool, 4 pixels at a time with
+ * SSE. Rasterization is conservative: an occluder only writes the pixels it
+ * covers entirely, with its farthest depth over the pixel, and a pixel
+ * keeps the nearest of those. Each 8x8 tile then stores the farthest depth
+ * in it, a one-level hierarchical depth buffer.
+ * Pixels crossed by an edge that two occluder triangles share are covered
+ * by neither, so boxes behind such an edge stay visible.
+ *
+ * IsOccluded projects a box and compares its nearest depth with every pixel
+ * its screen rectangle touches, the tiles first and only the tiles that
+ * cannot decide per pixel, so a box is never culled while some part of it
+ * may be visible.
+ * A box crossing the near plane or leaving the screen is never occluded.
+ *
+ * Everything runs on the CPU, so it works without a GL context. Depth is
+ * the GL window depth, 0 at the near plane and 1 at the far plane.
+ */
+class COcclusionCuller {
+public:
+  static constexpr int TILE_SIZE = 8;
+
+  struct Stats {
+    std::size_t frames = 0;
+    std::size_t triangles = 0; // occluder triangles after clipping
+    std::size_t tests = 0;
+    std::size_t occluded = 0;
+    std::size_t pixelTests = 0; // tests the tiles could not decide
+    double rasterMs = 0;
+  };
+
+  /**
+   * @brief Size of the depth buffer, rounded up to whole tiles.
+   */
+  void Init(int width = 256, int height = 128);
+
+  /**
+   * @brief Bands for Rasterize, run on the shared CWorkerPool; defaults to
+   * the hardware concurrency.
+   */
+  void SetThreads(unsigned threads);
+
+  /**
+   * @brief Clear the depth buffer and the occluders for a new frame.
+   */
+  void Begin(const glm::mat4 &viewProjection);
+
+  void AddOccluder(const glm::vec3 *positions, const std::uint32_t *indices,
+                   std::size_t indexCount, const glm::mat4 &model = glm::mat4(1));
+  void AddOccluder(const glm::vec3 *positions, const std::uint16_t *indices,
+                   std::size_t indexCount, const glm::mat4 &model = glm::mat4(1));
+
+  /**
+   * @brief Draw the added occluders and build the tile depths.
+   */
+  void Rasterize();
+
+  /**
+   * @brief True when the box is hidden behind the rasterized occluders.
+   */
+  bool IsOccluded(const glm::vec3 &min, const glm::vec3 &max);
+
+  int GetWidth() const;
+  int GetHeight() const;
+  const float *GetDepth() const;
+
+  const Stats &GetStats() const;
+  void ResetStats();
+  void PrintStats(std::ostream &out) const;
+
+private:
+  // screen space vertex, x and y in pixels
+  struct Vertex {
+    float x, y, z;
+  };
+
+  template <typename Index>
+  void Add(const glm::vec3 *positions, const Index *indices,
+           std::size_t indexCount, const glm::mat4 &model);
+  void AddClipped(const glm::vec4 clip[3]);
+  void RasterizeBand(int firstRow, int lastRow);
+  Vertex ToScreen(const glm::vec4 &clip) const;
+
+  int width = 0, height = 0;
+  int tilesX = 0, tilesY = 0;
+  unsigned threads = 1;
+  glm::mat4 viewProjection = glm::mat4(1);
+
+  std::vector<float> depth;   // occluder depth the whole pixel is behind
+  std::vector<float> tileMax; // farthest depth of each tile
+  std::vector<Vertex> triangles;
+
+  Stats stats;
+};
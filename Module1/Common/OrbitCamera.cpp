@@ -0,0 +1,16 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "OrbitCamera.hpp"
+
+void COrbitCamera::SetViewMatrix(const glm::mat4 &MV) {
+  V = MV;
+  Update();
+}
+
+void COrbitCamera::Update() {
+  const glm::mat4 inverseV = glm::inverse(V);
+  right    = glm::vec3(inverseV[0]);
+  up       = glm::vec3(inverseV[1]);
+  look     = -glm::vec3(inverseV[2]);
+  position = glm::vec3(inverseV[3]);
+}
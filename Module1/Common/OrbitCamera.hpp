@@ -0,0 +1,19 @@
+#pragma once
+// GLM
+#include <glm/glm.hpp>
+// Internal
+#include "AbstractCamera.hpp"
+
+/**
+ * @brief The mouse orbit of the samples as a CAbstractCamera.
+ *
+ * The samples build their view matrix from a distance and two rotations;
+ * SetViewMatrix takes it as is and derives the camera frame from it, so
+ * CalcFrustumPlanes and the cascaded shadow maps can split its frustum.
+ */
+class COrbitCamera : public CAbstractCamera {
+public:
+  void SetViewMatrix(const glm::mat4 &MV);
+
+  void Update() override;
+};
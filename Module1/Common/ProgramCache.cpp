@@ -0,0 +1,155 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "ProgramCache.hpp"
+// STL
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+// Internal
+#include "Hash.hpp"
+
+namespace {
+constexpr std::uint32_t BLOB_MAGIC = 0x42504c47; // "GLPB"
+
+struct BlobHeader {
+  std::uint32_t magic;
+  std::uint32_t format;
+  std::uint32_t length;
+};
+
+std::string GetString(GLenum name) {
+  const auto *str = reinterpret_cast<const char *>(glGetString(name));
+  return str != nullptr ? std::string(str) : std::string();
+}
+} // namespace
+
+CProgramCache &CProgramCache::Instance() {
+  static CProgramCache cache;
+  return cache;
+}
+
+void CProgramCache::SetDirectory(const std::string &dir) { directory = dir; }
+
+const std::string &CProgramCache::GetDirectory() const { return directory; }
+
+void CProgramCache::SetEnabled(const bool e) { enabled = e; }
+
+bool CProgramCache::IsActive() {
+  if (!enabled) {
+    return false;
+  }
+  if (supported < 0) {
+    GLint formats = 0;
+    if (GLEW_ARB_get_program_binary) {
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    supported = formats > 0 ? 1 : 0;
+  }
+  return supported == 1;
+}
+
+std::uint64_t CProgramCache::MakeKey(const Sources &sources) const {
+  std::uint64_t key = Hash::FNV64_OFFSET;
+  key = Hash::Fnv1a64(GetString(GL_VENDOR), key);
+  key = Hash::Fnv1a64(GetString(GL_RENDERER), key);
+  key = Hash::Fnv1a64(GetString(GL_VERSION), key);
+  for (const auto &source : sources) {
+    const auto type = static_cast<std::uint32_t>(source.first);
+    key = Hash::Fnv1a64(reinterpret_cast<const char *>(&type), sizeof(type), key);
+    key = Hash::Fnv1a64(source.second, key);
+  }
+  return key;
+}
+
+std::string CProgramCache::PathFor(const std::uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.bin",
+                static_cast<unsigned long long>(key));
+  return (std::filesystem::path(directory) / name).string();
+}
+
+bool CProgramCache::Load(GLuint program, const std::uint64_t key) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto path  = PathFor(key);
+
+  std::error_code error;
+  const auto fileSize = std::filesystem::file_size(path, error);
+  std::ifstream file(path, std::ios::binary);
+  if (error || !file) {
+    return false;
+  }
+
+  // check the header before trusting its length: a truncated or corrupt
+  // file must not size the allocation
+  BlobHeader header{};
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+  const bool valid = file && header.magic == BLOB_MAGIC && header.length > 0 &&
+                     header.length <= fileSize - sizeof(header);
+  std::vector<char> blob(valid ? header.length : 0);
+  if (valid) {
+    file.read(blob.data(), static_cast<std::streamsize>(blob.size()));
+  }
+  if (!valid || !file) {
+    file.close();
+    std::filesystem::remove(path, error);
+    ++stats.rejected;
+    return false;
+  }
+
+  glProgramBinary(program, header.format, blob.data(),
+                  static_cast<GLsizei>(blob.size()));
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status == GL_FALSE) {
+    // driver refused the blob (e.g. driver update), recompile from source
+    file.close();
+    std::filesystem::remove(path);
+    ++stats.rejected;
+    return false;
+  }
+
+  ++stats.hits;
+  stats.loadMs += std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  return true;
+}
+
+void CProgramCache::Store(GLuint program, const std::uint64_t key) {
+  ++stats.misses;
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  std::vector<char> blob(static_cast<std::size_t>(length));
+  GLenum format = 0;
+  glGetProgramBinary(program, length, nullptr, &format, blob.data());
+
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  if (error) {
+    std::cerr << "Program cache: cannot create " << directory << ": "
+              << error.message() << std::endl;
+    return;
+  }
+
+  const BlobHeader header{BLOB_MAGIC, format, static_cast<std::uint32_t>(length)};
+  std::ofstream file(PathFor(key), std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+}
+
+void CProgramCache::AddCompileTime(const double ms) { stats.compileMs += ms; }
+
+const CProgramCache::Stats &CProgramCache::GetStats() const { return stats; }
+
+void CProgramCache::PrintStats(std::ostream &out) const {
+  out << "Program cache: " << stats.hits << " hits, " << stats.misses
+      << " misses, " << stats.rejected << " rejected, compile "
+      << stats.compileMs << " ms, load " << stats.loadMs << " ms" << std::endl;
+}
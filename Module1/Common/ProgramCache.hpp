@@ -0,0 +1,70 @@
+#pragma once
+// STL
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+
+/**
+ * @brief On-disk cache of linked program binaries.
+ *
+ * Programs are keyed on the full source of every stage plus the driver
+ * vendor, renderer and version strings, so a driver update or a source
+ * edit never picks up a stale blob. Blobs the driver rejects are deleted
+ * and the caller falls back to a normal compile.
+ */
+class CProgramCache {
+public:
+  struct Stats {
+    unsigned hits     = 0; // programs restored from a blob
+    unsigned misses   = 0; // programs compiled from source
+    unsigned rejected = 0; // blobs found on disk but refused by the driver
+    double compileMs  = 0; // time spent compiling and linking from source
+    double loadMs     = 0; // time spent restoring blobs
+  };
+
+  using Sources = std::vector<std::pair<GLenum, std::string>>;
+
+  static CProgramCache &Instance();
+
+  void SetDirectory(const std::string &directory);
+
+  const std::string &GetDirectory() const;
+
+  void SetEnabled(const bool enabled);
+
+  /**
+   * @brief True when enabled and the context exposes a binary format.
+   */
+  bool IsActive();
+
+  std::uint64_t MakeKey(const Sources &sources) const;
+
+  /**
+   * @brief Try to restore `program` from the blob stored under `key`.
+   *
+   * @return true when the driver accepted the blob and the program is linked.
+   */
+  bool Load(GLuint program, const std::uint64_t key);
+
+  void Store(GLuint program, const std::uint64_t key);
+
+  void AddCompileTime(const double ms);
+
+  const Stats &GetStats() const;
+
+  void PrintStats(std::ostream &out) const;
+
+private:
+  CProgramCache() = default;
+
+  std::string PathFor(const std::uint64_t key) const;
+
+  std::string directory = "shader_cache";
+  bool enabled          = true;
+  int supported         = -1; // -1 -> not queried yet
+  Stats stats;
+};
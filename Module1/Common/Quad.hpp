@@ -9,6 +9,8 @@ public:
         const char* vert = "shaders/quad_shader.vert",
         const char* frag = "shaders/quad_shader.frag");
   virtual ~CQuad();
+  CQuad(CQuad &&) = default;
+  CQuad &operator=(CQuad &&) = default;
 
   int GetTotalVertices();
   int GetTotalIndices();
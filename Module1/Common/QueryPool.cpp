@@ -0,0 +1,91 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "QueryPool.hpp"
+// STL
+#include <cassert>
+#include <utility>
+
+void CQueryPool::Init(const GLenum target_, const std::size_t size) {
+  assert(size > 0);
+  target = target_;
+  queries.resize(size);
+  for (auto &query : queries) {
+    glGenQueries(1, &query.id);
+  }
+  head    = 0;
+  pending = 0;
+  frame   = 0;
+  active  = false;
+}
+
+void CQueryPool::Destroy() {
+  // results still in flight are dropped with their queries
+  for (auto &query : queries) {
+    glDeleteQueries(1, &query.id);
+  }
+  queries.clear();
+  pending = 0;
+}
+
+bool CQueryPool::Begin(Callback callback) {
+  assert(!active);
+  if (pending == queries.size()) {
+    ++stats.dropped;
+    return false;
+  }
+  Query &query = queries[head];
+  query.callback = std::move(callback);
+  query.frame = frame;
+  glBeginQuery(target, query.id);
+  active = true;
+  return true;
+}
+
+void CQueryPool::End() {
+  assert(active);
+  glEndQuery(target);
+  head = (head + 1) % queries.size();
+  ++pending;
+  ++stats.issued;
+  active = false;
+}
+
+void CQueryPool::Poll() {
+  while (pending > 0) {
+    Query &query = queries[(head + queries.size() - pending) % queries.size()];
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+    // later queries finish after this one
+    if (available == GL_FALSE) {
+      break;
+    }
+    GLuint64 result = 0;
+    glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &result);
+    --pending;
+    ++stats.delivered;
+    stats.latencyFrames += frame - query.frame;
+    // the callback may issue new queries
+    Callback callback = std::move(query.callback);
+    query.callback = nullptr;
+    if (callback) {
+      callback(result);
+    }
+  }
+  ++frame;
+}
+
+std::size_t CQueryPool::GetPending() const { return pending; }
+
+const CQueryPool::Stats &CQueryPool::GetStats() const { return stats; }
+
+void CQueryPool::PrintStats(std::ostream &out) const {
+  out << "Query pool: " << stats.issued << " issued, " << stats.delivered
+      << " delivered";
+  if (stats.delivered > 0) {
+    out << " after "
+        << static_cast<double>(stats.latencyFrames) /
+               static_cast<double>(stats.delivered)
+        << " frames on average";
+  }
+  out << ", " << stats.dropped << " dropped\n";
+}
@@ -0,0 +1,77 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+
+/**
+ * @brief Ring of query objects read back without stalling the pipeline.
+ *
+ * Begin/End wrap the commands to measure with the next query of the ring.
+ * Poll, called once a frame, checks the oldest pending queries with
+ * GL_QUERY_RESULT_AVAILABLE and hands every finished result to the
+ * callback given to Begin, usually a few frames after it was issued. The
+ * results arrive in the order the queries were issued.
+ *
+ * When every query is still in flight Begin returns false and the commands
+ * run unmeasured rather than waiting for the GPU, make the ring larger if
+ * the stats show dropped queries.
+ */
+class CQueryPool {
+public:
+  using Callback = std::function<void(GLuint64 result)>;
+
+  struct Stats {
+    std::size_t issued = 0;
+    std::size_t delivered = 0;
+    std::size_t dropped = 0;       // Begin with every query in flight
+    std::size_t latencyFrames = 0; // summed over the delivered results
+  };
+
+  /**
+   * @brief Create `size` queries for `target`, e.g. GL_SAMPLES_PASSED.
+   */
+  void Init(GLenum target, std::size_t size = 16);
+
+  void Destroy();
+
+  /**
+   * @brief Start a query, false and no query when all are in flight.
+   */
+  bool Begin(Callback callback);
+
+  /**
+   * @brief End the query started by a successful Begin.
+   */
+  void End();
+
+  /**
+   * @brief Deliver the results that are available, never waits.
+   */
+  void Poll();
+
+  std::size_t GetPending() const;
+
+  const Stats &GetStats() const;
+
+  void PrintStats(std::ostream &out) const;
+
+private:
+  struct Query {
+    GLuint id = 0;
+    Callback callback;
+    std::size_t frame = 0; // Poll count when issued
+  };
+
+  std::vector<Query> queries;
+  GLenum target = GL_SAMPLES_PASSED;
+  std::size_t head = 0;    // next query to issue
+  std::size_t pending = 0; // in flight, oldest at head - pending
+  std::size_t frame = 0;
+  bool active = false;
+
+  Stats stats;
+};
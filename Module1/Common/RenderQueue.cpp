@@ -0,0 +1,336 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "RenderQueue.hpp"
+// STL
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+
+namespace {
+constexpr int DEPTH_BITS = 32;
+constexpr int PASS_SHIFT = 60;
+
+std::size_t IndexSize(const GLenum indexType) {
+  switch (indexType) {
+  case GL_UNSIGNED_BYTE:
+    return sizeof(GLubyte);
+  case GL_UNSIGNED_SHORT:
+    return sizeof(GLushort);
+  default:
+    return sizeof(GLuint);
+  }
+}
+
+bool SameState(const CRenderQueue::DrawCall &a,
+               const CRenderQueue::DrawCall &b) {
+  return a.program == b.program && a.vao == b.vao && a.texture == b.texture &&
+         a.primitive == b.primitive && a.indexType == b.indexType &&
+         a.setUniforms == b.setUniforms;
+}
+} // namespace
+
+std::uint32_t CRenderQueue::DepthBits(const float depth) {
+  // IEEE floats order like sign-magnitude integers, flip them into
+  // unsigned order so negative depths sort before positive ones
+  std::uint32_t bits = 0;
+  std::memcpy(&bits, &depth, sizeof(bits));
+  return (bits & 0x80000000U) ? ~bits : (bits | 0x80000000U);
+}
+
+std::uint64_t CRenderQueue::MakeKey(const Pass pass, const GLuint program,
+                                    const GLuint material, const float depth) {
+  // ids are handed out in order of first use since the last Clear
+  const auto programID =
+      programIDs.emplace(program, static_cast<std::uint32_t>(programIDs.size()))
+          .first->second;
+  const auto materialID =
+      materialIDs
+          .emplace(material, static_cast<std::uint32_t>(materialIDs.size()))
+          .first->second;
+  assert(programID < (1U << PROGRAM_BITS));
+  assert(materialID < (1U << MATERIAL_BITS));
+
+  const std::uint64_t state =
+      (static_cast<std::uint64_t>(programID) << MATERIAL_BITS) | materialID;
+  const std::uint64_t key = static_cast<std::uint64_t>(pass) << PASS_SHIFT;
+  if (pass == PASS_TRANSPARENT) {
+    // back to front first, far depths have the larger bit patterns
+    const std::uint64_t farFirst = ~DepthBits(depth);
+    return key | (farFirst << (PROGRAM_BITS + MATERIAL_BITS)) | state;
+  }
+  return key | (state << DEPTH_BITS) | DepthBits(depth);
+}
+
+void CRenderQueue::Submit(const Pass pass, const DrawCall &draw,
+                          const float depth, const void *uniforms,
+                          const std::size_t size) {
+  assert(draw.program != nullptr);
+  Packet packet;
+  packet.key  = MakeKey(pass, draw.program->_program.Get(), draw.texture, depth);
+  packet.draw = draw;
+  packet.instances = nullptr;
+  packet.instance  = 0;
+  packet.uniformOffset = uniformData.size();
+  packet.uniformSize   = uniforms ? size : 0;
+  if (packet.uniformSize > 0) {
+    const auto blocks = (size + sizeof(Block) - 1) / sizeof(Block);
+    uniformData.resize(uniformData.size() + blocks);
+    std::memcpy(&uniformData[packet.uniformOffset], uniforms, size);
+  }
+  packets.push_back(packet);
+}
+
+bool CRenderQueue::SupportsInstances() {
+  // the base instance of indirect commands is honoured since GL 4.2
+  return GLEW_VERSION_4_3 ||
+         (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+}
+
+void CRenderQueue::SubmitInstance(const Pass pass, const DrawCall &draw,
+                                  const float depth, CInstanceBuffer &instances,
+                                  const CInstanceBuffer::Instance &instance,
+                                  const void *uniforms, const std::size_t size) {
+  assert(SupportsInstances());
+  Submit(pass, draw, depth, uniforms, size);
+  packets.back().instances = &instances;
+  packets.back().instance  = instanceData.size();
+  instanceData.push_back(instance);
+}
+
+void CRenderQueue::RadixSort() {
+  const auto count = packets.size();
+  order.resize(count);
+  scratch.resize(count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    order[i] = i;
+  }
+
+  // LSD radix sort of the packet indices, one byte of the key per pass,
+  // bytes that are equal in every key are skipped
+  for (int shift = 0; shift < 64; shift += 8) {
+    std::array<std::size_t, 257> histogram{};
+    for (const auto &packet : packets) {
+      ++histogram[((packet.key >> shift) & 0xFF) + 1];
+    }
+    const auto digit = (packets[0].key >> shift) & 0xFF;
+    if (histogram[digit + 1] == count) {
+      continue;
+    }
+    for (std::size_t i = 1; i < histogram.size(); ++i) {
+      histogram[i] += histogram[i - 1];
+    }
+    for (const auto index : order) {
+      scratch[histogram[(packets[index].key >> shift) & 0xFF]++] = index;
+    }
+    order.swap(scratch);
+  }
+}
+
+const void *CRenderQueue::Uniforms(const Packet &packet) const {
+  return packet.uniformSize > 0 ? &uniformData[packet.uniformOffset] : nullptr;
+}
+
+bool CRenderQueue::SameUniforms(const Packet &a, const Packet &b) const {
+  return a.uniformSize == b.uniformSize &&
+         (a.uniformSize == 0 ||
+          std::memcmp(Uniforms(a), Uniforms(b), a.uniformSize) == 0);
+}
+
+void CRenderQueue::Execute() {
+  if (packets.empty()) {
+    return;
+  }
+  RadixSort();
+  stats.packets += packets.size();
+
+  GLSLShader *program = nullptr;
+  GLuint vao = 0, texture = 0;
+  const Packet *uniformsOf = nullptr; // packet whose uniforms are set
+  bool blending = false;
+
+  for (std::size_t first = 0; first < order.size();) {
+    const Packet &packet = packets[order[first]];
+    const DrawCall &draw = packet.draw;
+
+    // gather the following packets that only differ in their ranges,
+    // never across passes since the blend state changes between them
+    const auto pass = packet.key >> PASS_SHIFT;
+    std::size_t last = first + 1;
+    while (last < order.size()) {
+      const Packet &next = packets[order[last]];
+      if ((next.key >> PASS_SHIFT) != pass || !SameState(draw, next.draw) ||
+          next.instances != packet.instances || !SameUniforms(packet, next)) {
+        break;
+      }
+      ++last;
+    }
+
+    const bool transparent = pass == PASS_TRANSPARENT;
+    if (transparent != blending) {
+      blending = transparent;
+      if (blending) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE);
+      } else {
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+      }
+    }
+
+    if (draw.program != program) {
+      program = draw.program;
+      program->Use();
+      ++stats.programBinds;
+      uniformsOf = nullptr; // uniforms are per program
+    } else {
+      ++stats.skippedBinds;
+    }
+    if (draw.vao != vao) {
+      vao = draw.vao;
+      glBindVertexArray(vao);
+      ++stats.vaoBinds;
+    } else {
+      ++stats.skippedBinds;
+    }
+    if (draw.texture != texture) {
+      texture = draw.texture;
+      glBindTexture(GL_TEXTURE_2D, texture);
+      ++stats.textureBinds;
+    } else {
+      ++stats.skippedBinds;
+    }
+    if (draw.setUniforms &&
+        (!uniformsOf || uniformsOf->draw.setUniforms != draw.setUniforms ||
+         !SameUniforms(*uniformsOf, packet))) {
+      draw.setUniforms(*program, Uniforms(packet));
+      uniformsOf = &packet;
+      ++stats.uniformUpdates;
+    }
+
+    const auto indexSize = IndexSize(draw.indexType);
+    if (packet.instances) {
+      DrawInstanced(first, last);
+    } else if (last - first == 1) {
+      glDrawElementsBaseVertex(
+          draw.primitive, draw.count, draw.indexType,
+          reinterpret_cast<const GLvoid *>(draw.firstIndex * indexSize),
+          draw.baseVertex);
+      ++stats.drawCalls;
+    } else {
+      counts.clear();
+      offsets.clear();
+      baseVertices.clear();
+      for (auto i = first; i < last; ++i) {
+        const DrawCall &merged = packets[order[i]].draw;
+        counts.push_back(merged.count);
+        offsets.push_back(
+            reinterpret_cast<const GLvoid *>(merged.firstIndex * indexSize));
+        baseVertices.push_back(merged.baseVertex);
+      }
+      glMultiDrawElementsBaseVertex(draw.primitive, counts.data(),
+                                    draw.indexType, offsets.data(),
+                                    static_cast<GLsizei>(counts.size()),
+                                    baseVertices.data());
+      stats.mergedDraws += last - first;
+      ++stats.drawCalls;
+    }
+    first = last;
+  }
+
+  if (blending) {
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindVertexArray(0);
+  program->UnUse();
+  Clear();
+}
+
+void CRenderQueue::DrawInstanced(const std::size_t first,
+                                 const std::size_t last) {
+  const Packet &packet = packets[order[first]];
+  const DrawCall &draw = packet.draw;
+  if (!commandStream.GetBuffer()) {
+    commandStream.Init(GL_DRAW_INDIRECT_BUFFER,
+                       static_cast<GLsizeiptr>(MAX_INSTANCED_RUN * sizeof(Command)));
+  }
+
+  // the VAO is bound, every chunk points its instance attributes at its
+  // own upload and draw i of the chunk reads instance i
+  for (auto begin = first; begin < last; begin += MAX_INSTANCED_RUN) {
+    const auto end = std::min(last, begin + MAX_INSTANCED_RUN);
+    models.clear();
+    colors.clear();
+    commands.clear();
+    for (auto i = begin; i < end; ++i) {
+      const Packet &merged = packets[order[i]];
+      const auto &instance = instanceData[merged.instance];
+      models.push_back(instance.model);
+      colors.push_back(instance.color);
+      commands.push_back({static_cast<GLuint>(merged.draw.count), 1,
+                          static_cast<GLuint>(merged.draw.firstIndex),
+                          merged.draw.baseVertex,
+                          static_cast<GLuint>(i - begin)});
+    }
+    packet.instances->Upload(models.data(), colors.data(),
+                             static_cast<GLsizei>(models.size()));
+    packet.instances->Enable();
+
+    const auto indirect = commandStream.Alloc(
+        static_cast<GLsizeiptr>(commands.size() * sizeof(Command)),
+        static_cast<GLsizeiptr>(sizeof(GLuint)));
+    std::memcpy(indirect.data, commands.data(),
+                commands.size() * sizeof(Command));
+    commandStream.Commit();
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandStream.GetBuffer());
+    glMultiDrawElementsIndirect(
+        draw.primitive, draw.indexType,
+        reinterpret_cast<const GLvoid *>(static_cast<std::size_t>(indirect.offset)),
+        static_cast<GLsizei>(commands.size()), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    // the VAO may be shared with draws that have no instance attributes
+    packet.instances->Disable();
+    ++stats.drawCalls;
+  }
+  stats.instancedDraws += last - first;
+  if (last - first > 1) {
+    stats.mergedDraws += last - first;
+  }
+}
+
+void CRenderQueue::Clear() {
+  packets.clear();
+  uniformData.clear();
+  instanceData.clear();
+  programIDs.clear();
+  materialIDs.clear();
+}
+
+void CRenderQueue::EndFrame() {
+  if (commandStream.GetBuffer()) {
+    commandStream.EndFrame();
+  }
+}
+
+void CRenderQueue::Destroy() {
+  Clear();
+  commandStream.Destroy();
+}
+
+const CRenderQueue::Stats &CRenderQueue::GetStats() const { return stats; }
+
+void CRenderQueue::ResetStats() { stats = Stats(); }
+
+void CRenderQueue::PrintStats(std::ostream &out) const {
+  out << "Render queue: " << stats.packets << " packets in "
+      << stats.drawCalls << " draw calls (" << stats.mergedDraws
+      << " merged into multi-draws, " << stats.instancedDraws
+      << " from the instance stream), " << stats.programBinds
+      << " program, " << stats.vaoBinds << " VAO and " << stats.textureBinds
+      << " texture binds, " << stats.uniformUpdates << " uniform updates, "
+      << stats.skippedBinds << " redundant binds skipped\n";
+}
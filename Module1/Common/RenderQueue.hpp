@@ -0,0 +1,191 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// Internal
+#include "GLSLShader.hpp"
+#include "InstanceBuffer.hpp"
+#include "StreamingBuffer.hpp"
+
+/**
+ * @brief Per-frame list of draw packets executed in sort key order.
+ *
+ * Every packet carries a 64-bit key, most significant bits first:
+ *
+ *   opaque:       pass(4) | program(12) | material(16) | depth(32)
+ *   transparent:  pass(4) | ~depth(32)  | program(12) | material(16)
+ *
+ * so opaque draws are grouped by state and then go front to back, while
+ * transparent draws go back to front regardless of state. Keys are radix
+ * sorted, program, VAO and texture binds that match the previous packet
+ * are skipped, and consecutive packets that share their program, VAO,
+ * material and uniforms are merged into one multi-draw.
+ *
+ * Uniforms are copied into the queue at Submit and handed back to
+ * `setUniforms` at Execute, after the program is bound. They are part of
+ * the merge test, so they should only carry material state. Data that
+ * changes with every draw, like a model matrix, goes through SubmitInstance
+ * instead: it is streamed as the single instance of its draw and read by
+ * an INSTANCED program, so draws that only differ in it still merge.
+ */
+class CRenderQueue {
+public:
+  enum Pass : std::uint8_t {
+    PASS_OPAQUE      = 0,
+    PASS_TRANSPARENT = 1, // blended over, no depth writes
+  };
+
+  using UniformSetter = void (*)(GLSLShader &program, const void *uniforms);
+
+  struct DrawCall {
+    GLSLShader *program = nullptr;
+    GLuint vao          = 0;
+    GLuint texture      = 0; // GL_TEXTURE_2D on the active unit, 0 for none
+    GLenum primitive    = GL_TRIANGLES;
+    GLenum indexType    = GL_UNSIGNED_INT;
+    GLsizei count       = 0;
+    std::size_t firstIndex = 0; // in indices, into the VAO's element buffer
+    GLint baseVertex    = 0;
+    UniformSetter setUniforms = nullptr;
+  };
+
+  struct Stats {
+    std::size_t packets = 0;
+    std::size_t drawCalls = 0;   // glDrawElements* and glMultiDraw* issued
+    std::size_t mergedDraws = 0; // packets folded into a multi-draw
+    std::size_t instancedDraws = 0; // packets drawn from the instance stream
+    std::size_t programBinds = 0;
+    std::size_t vaoBinds = 0;
+    std::size_t textureBinds = 0;
+    std::size_t uniformUpdates = 0;
+    std::size_t skippedBinds = 0; // binds equal to the current state
+  };
+
+  static constexpr int PROGRAM_BITS  = 12;
+  static constexpr int MATERIAL_BITS = 16;
+
+  /**
+   * @brief Queue a draw, `uniforms` is `size` bytes passed to setUniforms.
+   *
+   * @param depth view space distance, only its order matters
+   */
+  void Submit(Pass pass, const DrawCall &draw, float depth,
+              const void *uniforms = nullptr, std::size_t size = 0);
+
+  template <typename T>
+  void Submit(const Pass pass, const DrawCall &draw, const float depth,
+              const T &uniforms) {
+    Submit(pass, draw, depth, &uniforms, sizeof(T));
+  }
+
+  /**
+   * @brief Multi-draw indirect with a base instance per draw, which
+   * SubmitInstance needs.
+   */
+  static bool SupportsInstances();
+
+  /**
+   * @brief Queue a draw whose per-draw data is streamed into `instances`.
+   *
+   * `draw.program` must read the instance as described in CInstanceBuffer.
+   * Each merged run uploads its instances once and issues one
+   * glMultiDrawElementsIndirect where draw i reads instance i through its
+   * base instance. Needs SupportsInstances().
+   */
+  void SubmitInstance(Pass pass, const DrawCall &draw, float depth,
+                      CInstanceBuffer &instances,
+                      const CInstanceBuffer::Instance &instance,
+                      const void *uniforms = nullptr, std::size_t size = 0);
+
+  /**
+   * @brief Sort and issue every packet, then empty the queue.
+   *
+   * Packets are only merged within a pass.
+   *
+   * Leaves no program, VAO or texture bound.
+   */
+  void Execute();
+
+  void Clear();
+
+  /**
+   * @brief Fence this frame's indirect commands, call after the swap.
+   */
+  void EndFrame();
+
+  void Destroy();
+
+  std::uint64_t MakeKey(Pass pass, GLuint program, GLuint material,
+                        float depth);
+
+  const Stats &GetStats() const;
+
+  void ResetStats();
+
+  void PrintStats(std::ostream &out) const;
+
+private:
+  struct Packet {
+    std::uint64_t key;
+    DrawCall draw;
+    std::size_t uniformOffset; // into uniformData, in blocks
+    std::size_t uniformSize;   // in bytes
+    CInstanceBuffer *instances; // null for draws without an instance
+    std::size_t instance;       // into instanceData
+  };
+
+  // layout fixed by the GL
+  struct Command {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+  // commands per glMultiDrawElementsIndirect, and per streamed region
+  static constexpr std::size_t MAX_INSTANCED_RUN = 1024;
+
+  // uniform copies are kept block aligned for the setters
+  struct alignas(16) Block {
+    unsigned char bytes[16];
+  };
+
+  static std::uint32_t DepthBits(float depth);
+
+  void RadixSort();
+
+  bool SameUniforms(const Packet &a, const Packet &b) const;
+
+  void DrawInstanced(std::size_t first, std::size_t last);
+
+  const void *Uniforms(const Packet &packet) const;
+
+  std::vector<Packet> packets;
+  std::vector<Block> uniformData;
+  std::vector<CInstanceBuffer::Instance> instanceData;
+
+  // sort scratch, reused between frames
+  std::vector<std::uint32_t> order, scratch;
+
+  // compact ids of the GL names, they must fit their key fields. Keys
+  // only live until the queue is cleared, so are the ids: names of
+  // programs deleted since, e.g. by a shader reload, are recycled then
+  std::unordered_map<GLuint, std::uint32_t> programIDs, materialIDs;
+
+  // multi-draw argument arrays, reused between batches
+  std::vector<GLsizei> counts;
+  std::vector<const GLvoid *> offsets;
+  std::vector<GLint> baseVertices;
+  std::vector<glm::mat4> models;
+  std::vector<glm::vec4> colors;
+  std::vector<Command> commands;
+  CStreamingBuffer commandStream; // created by the first instanced run
+
+  Stats stats;
+};
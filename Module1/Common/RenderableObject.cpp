@@ -1,70 +1,220 @@
 // This is an open source non-commercial project. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
 #include "RenderableObject.hpp"
+#include <utility>
+#include <vector>
+
 #include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 RenderableObject::RenderableObject() {}
 
+CInstanceBuffer &RenderableObject::GetInstanceBuffer() {
+  // streamed by every RenderInstanced call
+  static CInstanceBuffer instances;
+  static bool initialized = false;
+  if (!initialized) {
+    instances.Init();
+    initialized = true;
+  }
+  return instances;
+}
+
 RenderableObject::~RenderableObject() { Destroy(); }
 
-void RenderableObject::Init() {
-  // setup vao and vbo stuff
-  glGenVertexArrays(1, &vaoID);
-  glGenBuffers(1,      &vboVerticesID);
-  glGenBuffers(1,      &vboIndicesID);
+RenderableObject::RenderableObject(RenderableObject &&other) noexcept
+    : geometry(std::exchange(other.geometry, CGeometryPool::INVALID_HANDLE)),
+      shader(std::move(other.shader)), mvpUniform(other.mvpUniform),
+      instancedShader(std::move(other.instancedShader)),
+      instancedMvpUniform(other.instancedMvpUniform), primType(other.primType),
+      totalVertices(other.totalVertices), totalIndices(other.totalIndices) {}
 
+RenderableObject &RenderableObject::operator=(RenderableObject &&other) noexcept {
+  if (this != &other) {
+    Destroy();
+    geometry = std::exchange(other.geometry, CGeometryPool::INVALID_HANDLE);
+    shader              = std::move(other.shader);
+    mvpUniform          = other.mvpUniform;
+    instancedShader     = std::move(other.instancedShader);
+    instancedMvpUniform = other.instancedMvpUniform;
+    primType            = other.primType;
+    totalVertices       = other.totalVertices;
+    totalIndices        = other.totalIndices;
+  }
+  return *this;
+}
+
+void RenderableObject::Init() {
   // get total vertices and indices
   totalVertices = GetTotalVertices();
   totalIndices  = GetTotalIndices();
   primType      = GetPrimitiveType();
 
-  // now allocate buffers
-  glBindVertexArray(vaoID);
+  // resolve the per-draw uniform once
+  mvpUniform = shader.AddUniform("MVP");
 
-  glBindBuffer(GL_ARRAY_BUFFER, vboVerticesID);
-  glBufferData(GL_ARRAY_BUFFER, static_cast<std::size_t>(totalVertices) * sizeof(glm::vec3), nullptr,
-               GL_STATIC_DRAW);
+  // fill on the CPU, the pool uploads into its shared buffers
+  std::vector<glm::vec3> vertices(static_cast<std::size_t>(totalVertices));
+  std::vector<GLuint> indices(static_cast<std::size_t>(totalIndices));
+  FillVertexBuffer(glm::value_ptr(vertices[0]));
+  FillIndexBuffer(indices.data());
 
-  GLfloat *pBuffer =
-      static_cast<GLfloat *>(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
-  FillVertexBuffer(pBuffer);
-  glUnmapBuffer(GL_ARRAY_BUFFER);
+  // positions are quantized over the mesh bounds when the shader decodes
+  // them, the pool picks 16-bit indices on its own
+  const bool decodes =
+      glGetUniformLocation(shader._program.Get(), "positionScale") != -1;
+  geometry = CGeometryPool::Instance().Allocate(
+      totalVertices, totalIndices, glm::value_ptr(vertices[0]), indices.data(),
+      decodes ? CVertexFormat::Position::UNORM16
+              : CVertexFormat::Position::FLOAT3);
 
-  glEnableVertexAttribArray(shader["vVertex"]);
-  glVertexAttribPointer(shader["vVertex"], 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIndicesID);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<std::size_t>(totalIndices) * sizeof(GLuint), nullptr,
-               GL_STATIC_DRAW);
+  // the decode is constant, the instanced program copies it from here
+  shader.Use();
+  SetPositionDecode(shader);
+  shader.UnUse();
+}
 
-  GLuint *pIBuffer = static_cast<GLuint *>(
-      glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY));
-  FillIndexBuffer(pIBuffer);
-  glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+void RenderableObject::SetPositionDecode(GLSLShader &program) const {
+  const auto &allocation = CGeometryPool::Instance().Get(geometry);
+  SetPositionDecode(program, allocation.positionScale,
+                    allocation.positionOffset);
+}
 
-  glBindVertexArray(0);
+void RenderableObject::SetPositionDecode(GLSLShader &program,
+                                         const glm::vec3 &scale,
+                                         const glm::vec3 &offset) {
+  // looked up directly, an unknown name would map to location 0
+  const GLuint id = program._program.Get();
+  const GLint scaleLocation  = glGetUniformLocation(id, "positionScale");
+  const GLint offsetLocation = glGetUniformLocation(id, "positionOffset");
+  if (scaleLocation != -1) {
+    glUniform3fv(scaleLocation, 1, glm::value_ptr(scale));
+  }
+  if (offsetLocation != -1) {
+    glUniform3fv(offsetLocation, 1, glm::value_ptr(offset));
+  }
 }
 
 void RenderableObject::Destroy() {
-  // Destroy shader
+  // Destroy shaders
   shader.DeleteShaderProgram();
+  instancedShader.DeleteShaderProgram();
 
-  // Destroy vao and vbo
-  glDeleteBuffers(1, &vboVerticesID);
-  glDeleteBuffers(1, &vboIndicesID);
-  glDeleteVertexArrays(1, &vaoID);
+  // return the geometry ranges to the pool
+  CGeometryPool::Instance().Free(geometry);
+  geometry = CGeometryPool::INVALID_HANDLE;
 }
 
 void RenderableObject::Render(const GLfloat *MVP) {
+  auto &pool = CGeometryPool::Instance();
   shader.Use();
-  glUniformMatrix4fv(shader("MVP"), 1, GL_FALSE, MVP);
+  glUniformMatrix4fv(shader(mvpUniform), 1, GL_FALSE, MVP);
   SetCustomUniforms();
-  glBindVertexArray(vaoID);
-  glDrawElements(primType, totalIndices, GL_UNSIGNED_INT, nullptr);
-  glBindVertexArray(0);
+  pool.Bind(geometry);
+  pool.Draw(geometry, primType);
+  // inside a batch the next pooled draw keeps the VAO, EndBatch unbinds it
+  if (!pool.IsBatching()) {
+    glBindVertexArray(0);
+  }
   shader.UnUse();
 }
 
+void RenderableObject::Submit(CRenderQueue &queue, const GLfloat *MVP,
+                              const float depth,
+                              const CRenderQueue::Pass pass) {
+  const auto &allocation = CGeometryPool::Instance().Get(geometry);
+
+  CRenderQueue::DrawCall draw;
+  draw.vao         = CGeometryPool::Instance().GetVAO(geometry);
+  draw.primitive   = primType;
+  draw.indexType   = allocation.indexType;
+  draw.count       = allocation.indexCount;
+  draw.firstIndex  = static_cast<std::size_t>(allocation.firstIndex);
+  draw.baseVertex  = allocation.baseVertex;
+
+  if (CRenderQueue::SupportsInstances()) {
+    // the whole MVP is the instance's model matrix, so the uniforms are
+    // the same for every object drawn with the program
+    draw.program     = &GetInstancedShader();
+    draw.setUniforms = &RenderableObject::SetInstancedUniforms;
+    queue.SubmitInstance(pass, draw, depth, GetInstanceBuffer(),
+                         {glm::make_mat4(MVP), GetInstanceColor()});
+    return;
+  }
+
+  draw.program     = &shader;
+  draw.setUniforms = &RenderableObject::SetQueuedUniforms;
+  QueuedUniforms uniforms;
+  uniforms.object = this;
+  uniforms.MVP    = glm::make_mat4(MVP);
+  queue.Submit(pass, draw, depth, uniforms);
+}
+
+void RenderableObject::SetQueuedUniforms(GLSLShader &program,
+                                         const void *uniforms) {
+  const auto *queued = static_cast<const QueuedUniforms *>(uniforms);
+  glUniformMatrix4fv(program(queued->object->mvpUniform), 1, GL_FALSE,
+                     glm::value_ptr(queued->MVP));
+  queued->object->SetCustomUniforms();
+}
+
+void RenderableObject::SetInstancedUniforms(GLSLShader &program,
+                                            const void * /*uniforms*/) {
+  glUniformMatrix4fv(program("MVP"), 1, GL_FALSE,
+                     glm::value_ptr(glm::mat4(1)));
+}
+
+GLSLShader &RenderableObject::GetInstancedShader() {
+  if (!instancedShader._program) {
+    for (const auto &file : shader.GetFiles()) {
+      auto defines = file.defines;
+      defines.emplace_back("INSTANCED", "1");
+      instancedShader.LoadFromFile(file.type, file.filename, defines);
+    }
+    instancedShader.CreateAndLinkProgram();
+    instancedMvpUniform = instancedShader.AddUniform("MVP");
+    // samplers and other constants set on the regular program
+    instancedShader.CopyUniformValues(shader);
+  }
+  return instancedShader;
+}
+
+void RenderableObject::RenderInstanced(const GLfloat *VP,
+                                       const glm::mat4 *models,
+                                       const GLsizei count,
+                                       const glm::vec4 *colors,
+                                       GLSLShader *program) {
+  if (count <= 0) {
+    return;
+  }
+  if (!program) {
+    program = &GetInstancedShader();
+  }
+
+  auto &pool      = CGeometryPool::Instance();
+  auto &instances = GetInstanceBuffer();
+  instances.Upload(models, colors, count);
+
+  program->Use();
+  // a caller supplied program has no handle resolved, look its MVP up
+  const GLint mvp = program == &instancedShader
+                        ? instancedShader(instancedMvpUniform)
+                        : (*program)("MVP");
+  glUniformMatrix4fv(mvp, 1, GL_FALSE, VP);
+  if (program != &instancedShader) {
+    SetPositionDecode(*program);
+  }
+  pool.Bind(geometry);
+  instances.Enable();
+  pool.DrawInstanced(geometry, primType, count);
+  // the page VAO is shared with non-instanced draws
+  instances.Disable();
+  if (!pool.IsBatching()) {
+    glBindVertexArray(0);
+  }
+  program->UnUse();
+}
+
 GLSLShader* RenderableObject::GetShader() {
 	return &shader;
 }
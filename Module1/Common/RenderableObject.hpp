@@ -1,5 +1,9 @@
 #pragma once
 #include "GLSLShader.hpp"
+#include "GeometryPool.hpp"
+#include "InstanceBuffer.hpp"
+#include "RenderQueue.hpp"
+#include <glm/glm.hpp>
 
 class RenderableObject {
 public:
@@ -7,8 +11,38 @@ public:
 
 	virtual ~RenderableObject();
 
+	// Move-only, the programs and the pool geometry have a single owner.
+	// A moved-from object draws nothing; queued draws keep pointing at
+	// the object they were submitted from.
+	RenderableObject(RenderableObject&& other) noexcept;
+	RenderableObject& operator=(RenderableObject&& other) noexcept;
+	RenderableObject(const RenderableObject&) = delete;
+	RenderableObject& operator=(const RenderableObject&) = delete;
+
 	void Render(const float* MVP);
 
+	// Draw `count` copies with a single instanced draw call. The object's
+	// shader files are built a second time with INSTANCED defined, they
+	// then read the per-instance model matrix and colour as described in
+	// CInstanceBuffer and MVP holds the view projection matrix only.
+	// Constant uniforms are copied from the regular program once,
+	// SetCustomUniforms is not called. `program` replaces the instanced
+	// program, e.g. for a depth-only pass, and follows the same convention.
+	void RenderInstanced(const float* VP, const glm::mat4* models,
+	                     GLsizei count, const glm::vec4* colors = nullptr,
+	                     GLSLShader* program = nullptr);
+
+	// Per-instance data shared by the RenderInstanced calls of all objects.
+	static CInstanceBuffer& GetInstanceBuffer();
+
+	// Queue a draw instead of issuing it. When the queue supports instances
+	// the instanced program is used, MVP and GetInstanceColor() become the
+	// draw's instance and the draws of this object merge whatever their
+	// MVP. Otherwise MVP is copied, SetCustomUniforms runs when the queue executes and sees
+	// the object's state at that time.
+	void Submit(CRenderQueue& queue, const float* MVP, float depth,
+	            CRenderQueue::Pass pass = CRenderQueue::PASS_OPAQUE);
+
 	virtual int GetTotalVertices()=0;
 	virtual int GetTotalIndices()=0;
 	virtual GLenum GetPrimitiveType() =0;
@@ -17,17 +51,40 @@ public:
 	virtual void FillIndexBuffer(GLuint* pBuffer)=0;
 
 	virtual void SetCustomUniforms(){}
+	// Colour an instanced program reads instead of its custom uniforms
+	virtual glm::vec4 GetInstanceColor() const { return glm::vec4(1); }
 	GLSLShader* GetShader();
 
+	// Map the object's UNORM16 pool positions back to object space in
+	// `program`, which must be in use. Programs that do not call
+	// DecodePosition (see instanced_vertex.glsl) are left alone.
+	void SetPositionDecode(GLSLShader& program) const;
+	static void SetPositionDecode(GLSLShader& program, const glm::vec3& scale,
+	                              const glm::vec3& offset);
+
 	void Init();
 	void Destroy();
 
 protected:
-	GLuint vaoID = 0;
-	GLuint vboVerticesID = 0;
-	GLuint vboIndicesID = 0;
+	struct QueuedUniforms {
+		RenderableObject* object;
+		glm::mat4 MVP;
+	};
+
+	static void SetQueuedUniforms(GLSLShader& program, const void* uniforms);
+	static void SetInstancedUniforms(GLSLShader& program, const void* uniforms);
+
+	GLSLShader& GetInstancedShader();
+
+	// vertex and index ranges in the shared CGeometryPool buffers
+	CGeometryPool::Handle geometry = CGeometryPool::INVALID_HANDLE;
 
 	GLSLShader shader;
+	UniformHandle mvpUniform;
+
+	// built from shader's files on the first RenderInstanced
+	GLSLShader instancedShader;
+	UniformHandle instancedMvpUniform;
 
 	GLenum primType = 0;
 	int totalVertices = 0, totalIndices = 0;
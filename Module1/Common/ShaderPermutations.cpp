@@ -0,0 +1,85 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "ShaderPermutations.hpp"
+// STL
+#include <algorithm>
+#include <thread>
+// Internal
+#include "Hash.hpp"
+
+void CShaderPermutations::AddStage(GLenum type, const std::string &filename) {
+  stages.emplace_back(type, filename);
+}
+
+void CShaderPermutations::AddIncludePath(const std::string &path) {
+  preprocessor.AddIncludePath(path);
+}
+
+std::uint64_t CShaderPermutations::MakeKey(Defines defines) {
+  std::sort(defines.begin(), defines.end());
+  std::uint64_t key = Hash::FNV64_OFFSET;
+  for (const auto &define : defines) {
+    key = Hash::Fnv1a64(define.first, key);
+    key = Hash::Fnv1a64("=", 1, key);
+    key = Hash::Fnv1a64(define.second, key);
+    key = Hash::Fnv1a64(";", 1, key);
+  }
+  return key;
+}
+
+void CShaderPermutations::Compile(const std::vector<Defines> &permutations) {
+  if (GLEW_KHR_parallel_shader_compile) {
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+  } else if (GLEW_ARB_parallel_shader_compile) {
+    glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+  }
+
+  // issue every compile and link before the first status query
+  std::vector<GLSLShader *> pending;
+  for (const auto &defines : permutations) {
+    const auto key = MakeKey(defines);
+    if (programs.find(key) != programs.end()) {
+      continue;
+    }
+    auto &program = programs[key];
+    for (const auto &stage : stages) {
+      std::string source;
+      if (preprocessor.LoadFile(stage.second, defines, source)) {
+        program.LoadFromString(stage.first, source);
+      }
+    }
+    program.BeginCreateAndLinkProgram();
+    pending.push_back(&program);
+  }
+
+  // finish programs in completion order
+  while (!pending.empty()) {
+    const auto done = std::find_if(pending.begin(), pending.end(),
+                                   [](const GLSLShader *program) {
+                                     return program->IsLinkComplete();
+                                   });
+    if (done == pending.end()) {
+      std::this_thread::yield();
+      continue;
+    }
+    (*done)->FinishCreateAndLinkProgram();
+    pending.erase(done);
+  }
+}
+
+GLSLShader &CShaderPermutations::Get(const Defines &defines) {
+  const auto key = MakeKey(defines);
+  auto found = programs.find(key);
+  if (found == programs.end()) {
+    Compile({defines});
+    found = programs.find(key);
+  }
+  return found->second;
+}
+
+void CShaderPermutations::Destroy() {
+  for (auto &program : programs) {
+    program.second.DeleteShaderProgram();
+  }
+  programs.clear();
+}
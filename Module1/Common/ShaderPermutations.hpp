@@ -0,0 +1,51 @@
+#pragma once
+// STL
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+// Internal
+#include "GLSLShader.hpp"
+#include "ShaderPreprocessor.hpp"
+
+/**
+ * @brief Set of programs built from the same stage files with different
+ * injected #defines, e.g. one program per MAX_BOUNCES value.
+ *
+ * Each permutation is a separate linked program so switching variants
+ * costs a glUseProgram and nothing per fragment. Requested permutations
+ * are compiled together: all compiles and links are issued first and the
+ * status queries deferred, with GL_KHR_parallel_shader_compile polled when
+ * the driver exposes it.
+ */
+class CShaderPermutations {
+public:
+  using Defines = CShaderPreprocessor::Defines;
+
+  void AddStage(GLenum whichShader, const std::string &filename);
+
+  void AddIncludePath(const std::string &path);
+
+  /**
+   * @brief Compile every permutation that is not built yet.
+   */
+  void Compile(const std::vector<Defines> &permutations);
+
+  /**
+   * @brief Return the program for `defines`, compiling it on first use.
+   */
+  GLSLShader &Get(const Defines &defines);
+
+  /**
+   * @brief Permutation key, independent of the order of the defines.
+   */
+  static std::uint64_t MakeKey(Defines defines);
+
+  void Destroy();
+
+private:
+  std::vector<std::pair<GLenum, std::string>> stages;
+  std::map<std::uint64_t, GLSLShader> programs;
+  CShaderPreprocessor preprocessor;
+};
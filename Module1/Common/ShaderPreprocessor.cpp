@@ -0,0 +1,172 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "ShaderPreprocessor.hpp"
+// STL
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+bool ReadFile(const std::string &filename, std::string &out) {
+  std::ifstream fp(filename, std::ios_base::in);
+  if (!fp) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << fp.rdbuf();
+  out = buffer.str();
+  return true;
+}
+
+// returns the quoted file name when `line` is an #include directive
+bool ParseInclude(const std::string &line, std::string &name) {
+  const auto hash = line.find_first_not_of(" \t");
+  if (hash == std::string::npos || line[hash] != '#') {
+    return false;
+  }
+  const auto directive = line.find_first_not_of(" \t", hash + 1);
+  if (directive == std::string::npos ||
+      line.compare(directive, 7, "include") != 0) {
+    return false;
+  }
+  const auto open  = line.find_first_of("\"<", directive + 7);
+  const auto close = open == std::string::npos
+                         ? std::string::npos
+                         : line.find_first_of("\">", open + 1);
+  if (close == std::string::npos) {
+    return false;
+  }
+  name = line.substr(open + 1, close - open - 1);
+  return true;
+}
+
+bool IsVersion(const std::string &line) {
+  const auto hash = line.find_first_not_of(" \t");
+  return hash != std::string::npos && line.compare(hash, 8, "#version") == 0;
+}
+} // namespace
+
+void CShaderPreprocessor::AddIncludePath(const std::string &path) {
+  includePaths.push_back(path);
+}
+
+bool CShaderPreprocessor::LoadFile(const std::string &filename,
+                                   const Defines &defines,
+                                   std::string &out,
+                                   std::set<std::string> *includes) const {
+  std::string source;
+  if (!ReadFile(filename, source)) {
+    std::cerr << "Error loading shader: " << filename << std::endl;
+    return false;
+  }
+  const auto directory = std::filesystem::path(filename).parent_path().string();
+  return Process(source, directory, defines, out, includes);
+}
+
+bool CShaderPreprocessor::Process(const std::string &source,
+                                  const std::string &directory,
+                                  const Defines &defines,
+                                  std::string &out,
+                                  std::set<std::string> *includes) const {
+  std::string expanded;
+  std::set<std::string> included;
+  int totalSources = 1;
+  if (!Expand(source, directory, 0, expanded, included, totalSources)) {
+    return false;
+  }
+  if (includes) {
+    includes->insert(included.begin(), included.end());
+  }
+
+  // nothing to inject, keep the source as is
+  if (defines.empty()) {
+    out = std::move(expanded);
+    return true;
+  }
+
+  std::string injected;
+  for (const auto &define : defines) {
+    injected += "#define " + define.first + " " + define.second + "\n";
+  }
+
+  // defines go right after #version, which must stay the first statement
+  std::istringstream stream(expanded);
+  std::string line;
+  int lineNumber = 0;
+  bool done = false;
+  out.clear();
+  while (std::getline(stream, line)) {
+    ++lineNumber;
+    out += line;
+    out += '\n';
+    if (!done && IsVersion(line)) {
+      out += injected;
+      out += "#line " + std::to_string(lineNumber + 1) + " 0\n";
+      done = true;
+    }
+  }
+  if (!done) {
+    out = injected + "#line 1 0\n" + out;
+  }
+  return true;
+}
+
+std::string CShaderPreprocessor::Resolve(const std::string &name,
+                                         const std::string &directory) const {
+  namespace fs = std::filesystem;
+  const auto local = fs::path(directory) / name;
+  if (fs::exists(local)) {
+    return local.lexically_normal().string();
+  }
+  for (const auto &path : includePaths) {
+    const auto candidate = fs::path(path) / name;
+    if (fs::exists(candidate)) {
+      return candidate.lexically_normal().string();
+    }
+  }
+  return std::string();
+}
+
+bool CShaderPreprocessor::Expand(const std::string &source,
+                                 const std::string &directory,
+                                 const int sourceNumber, std::string &out,
+                                 std::set<std::string> &included,
+                                 int &totalSources) const {
+  std::istringstream stream(source);
+  std::string line;
+  std::string name;
+  int lineNumber = 0;
+  while (std::getline(stream, line)) {
+    ++lineNumber;
+    if (!ParseInclude(line, name)) {
+      out += line;
+      out += '\n';
+      continue;
+    }
+
+    const auto path = Resolve(name, directory);
+    std::string content;
+    if (path.empty() || !ReadFile(path, content)) {
+      std::cerr << "Error loading shader include: " << name << std::endl;
+      return false;
+    }
+    // every file is included once, like #pragma once
+    if (!included.insert(path).second) {
+      out += '\n';
+      continue;
+    }
+
+    const int includeNumber = totalSources++;
+    out += "#line 1 " + std::to_string(includeNumber) + "\n";
+    const auto includeDirectory =
+        std::filesystem::path(path).parent_path().string();
+    if (!Expand(content, includeDirectory, includeNumber, out, included,
+                totalSources)) {
+      return false;
+    }
+    out += "#line " + std::to_string(lineNumber + 1) + " " +
+           std::to_string(sourceNumber) + "\n";
+  }
+  return true;
+}
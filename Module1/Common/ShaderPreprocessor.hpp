@@ -0,0 +1,49 @@
+#pragma once
+// STL
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Minimal GLSL preprocessor run before GLSLShader::LoadFromString.
+ *
+ * Expands `#include "file"` (each file at most once, looked up next to the
+ * including file and then in the include paths) and injects `#define`s
+ * right after the `#version` line. `#line` directives keep compiler
+ * messages pointing at the original file and line, the source string
+ * number being the include order (0 -> top level file).
+ */
+class CShaderPreprocessor {
+public:
+  using Defines = std::vector<std::pair<std::string, std::string>>;
+
+  void AddIncludePath(const std::string &path);
+
+  /**
+   * @brief Read and preprocess `filename` into `out`.
+   *
+   * @param includes when set, receives the paths of every included file
+   * @return false when the file or one of its includes cannot be read.
+   */
+  bool LoadFile(const std::string &filename, const Defines &defines,
+                std::string &out,
+                std::set<std::string> *includes = nullptr) const;
+
+  /**
+   * @brief Preprocess an in-memory source, includes resolve from `directory`.
+   */
+  bool Process(const std::string &source, const std::string &directory,
+               const Defines &defines, std::string &out,
+               std::set<std::string> *includes = nullptr) const;
+
+private:
+  bool Expand(const std::string &source, const std::string &directory,
+              int sourceNumber, std::string &out,
+              std::set<std::string> &included, int &totalSources) const;
+
+  std::string Resolve(const std::string &name,
+                      const std::string &directory) const;
+
+  std::vector<std::string> includePaths;
+};
@@ -0,0 +1,269 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "ShaderWatcher.hpp"
+// STL
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+// POSIX
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+// Internal
+#include "ShaderPreprocessor.hpp"
+
+namespace {
+// editors save by rewriting or by renaming a temporary over the file
+#ifdef __linux__
+constexpr std::uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+#endif
+// events closer than this are handled as one change
+constexpr int SETTLE_MS = 50;
+// how often the thread checks whether it has to stop
+constexpr int POLL_MS = 200;
+
+std::string Normalize(const std::string &path) {
+  return std::filesystem::absolute(path).lexically_normal().string();
+}
+
+std::string Directory(const std::string &path) {
+  return std::filesystem::path(Normalize(path)).parent_path().string();
+}
+} // namespace
+
+CShaderWatcher::~CShaderWatcher() { Stop(); }
+
+void CShaderWatcher::Watch(GLSLShader &shader, Callback onReload) {
+  entries.push_back({&shader, shader.GetFiles(), std::move(onReload)});
+}
+
+bool CShaderWatcher::Start() {
+#ifdef __linux__
+  if (running) {
+    return true;
+  }
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd == -1) {
+    std::cerr << "Shader hot reload disabled: inotify unavailable\n";
+    return false;
+  }
+  for (const auto &entry : entries) {
+    AddWatches(entry);
+  }
+  running = true;
+  thread = std::thread(&CShaderWatcher::Run, this);
+  return true;
+#else
+  std::cerr << "Shader hot reload is only supported on Linux\n";
+  return false;
+#endif
+}
+
+void CShaderWatcher::Stop() {
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+#ifdef __linux__
+  if (fd != -1) {
+    close(fd);
+    fd = -1;
+  }
+#endif
+  watchedDirectories.clear();
+  // programs still linking are simply dropped
+  for (auto &pending : linking) {
+    pending.program->FinishCreateAndLinkProgram();
+    pending.program->DeleteShaderProgram();
+  }
+  linking.clear();
+}
+
+void CShaderWatcher::AddWatches(const Entry &entry) {
+#ifdef __linux__
+  std::set<std::string> directories;
+  for (const auto &file : entry.files) {
+    directories.insert(Directory(file.filename));
+    for (const auto &include : file.includes) {
+      directories.insert(Directory(include));
+    }
+  }
+  for (const auto &directory : directories) {
+    const auto known = std::find_if(
+        watchedDirectories.begin(), watchedDirectories.end(),
+        [&directory](const std::pair<int, std::string> &watched) {
+          return watched.second == directory;
+        });
+    if (known != watchedDirectories.end()) {
+      continue;
+    }
+    const int wd = inotify_add_watch(fd, directory.c_str(), WATCH_MASK);
+    if (wd == -1) {
+      std::cerr << "Cannot watch shader directory: " << directory << '\n';
+      continue;
+    }
+    watchedDirectories.emplace_back(wd, directory);
+  }
+#else
+  static_cast<void>(entry);
+#endif
+}
+
+bool CShaderWatcher::Uses(const Entry &entry, const std::string &path) const {
+  for (const auto &file : entry.files) {
+    if (Normalize(file.filename) == path) {
+      return true;
+    }
+    for (const auto &include : file.includes) {
+      if (Normalize(include) == path) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool CShaderWatcher::Rebuild(const std::size_t index, Rebuilt &rebuilt) {
+  auto &entry = entries[index];
+  CShaderPreprocessor preprocessor;
+  rebuilt.entry = index;
+  rebuilt.sources.clear();
+  std::vector<std::set<std::string>> includes;
+  for (const auto &file : entry.files) {
+    std::string source;
+    std::set<std::string> fileIncludes;
+    if (!preprocessor.LoadFile(file.filename, file.defines, source,
+                               &fileIncludes)) {
+      // typically a save still in progress, the next event retries
+      return false;
+    }
+    rebuilt.sources.emplace_back(file.type, std::move(source));
+    includes.push_back(std::move(fileIncludes));
+  }
+  // an edit may have added includes, watch their directories too
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::size_t i = 0; i < entry.files.size(); ++i) {
+      entry.files[i].includes = std::move(includes[i]);
+    }
+  }
+  AddWatches(entry);
+  return true;
+}
+
+void CShaderWatcher::Run() {
+#ifdef __linux__
+  alignas(inotify_event) char buffer[4096];
+  std::set<std::string> changed;
+  while (running) {
+    pollfd descriptor{fd, POLLIN, 0};
+    const int timeout = changed.empty() ? POLL_MS : SETTLE_MS;
+    if (poll(&descriptor, 1, timeout) > 0) {
+      ssize_t length;
+      while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t offset = 0; offset < length;) {
+          const auto *event = reinterpret_cast<const inotify_event *>(
+              buffer + offset);
+          offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+          if (event->len == 0) {
+            continue;
+          }
+          for (const auto &watched : watchedDirectories) {
+            if (watched.first == event->wd) {
+              changed.insert(Normalize(watched.second + "/" + event->name));
+            }
+          }
+        }
+      }
+      continue;
+    }
+    if (changed.empty()) {
+      continue;
+    }
+
+    // quiet for SETTLE_MS: rebuild every program using a changed file
+    std::vector<Rebuilt> rebuilt;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+      const bool affected =
+          std::any_of(changed.begin(), changed.end(),
+                      [&](const std::string &path) {
+                        return Uses(entries[i], path);
+                      });
+      Rebuilt sources;
+      if (affected && Rebuild(i, sources)) {
+        rebuilt.push_back(std::move(sources));
+      }
+    }
+    changed.clear();
+    if (!rebuilt.empty()) {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto &sources : rebuilt) {
+        // a newer rebuild of the same program replaces an unclaimed one
+        ready.erase(std::remove_if(ready.begin(), ready.end(),
+                                   [&sources](const Rebuilt &older) {
+                                     return older.entry == sources.entry;
+                                   }),
+                    ready.end());
+        ready.push_back(std::move(sources));
+      }
+    }
+  }
+#endif
+}
+
+void CShaderWatcher::Update() {
+  std::vector<Rebuilt> claimed;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    claimed.swap(ready);
+  }
+
+  // issue compiles and links, the status is checked on later frames
+  for (auto &sources : claimed) {
+    auto program = std::make_unique<GLSLShader>();
+    for (auto &source : sources.sources) {
+      program->LoadFromString(source.first, source.second);
+    }
+    program->CopyBuildState(*entries[sources.entry].shader);
+    program->BeginCreateAndLinkProgram();
+    linking.push_back({sources.entry, std::move(program)});
+  }
+
+  for (auto pending = linking.begin(); pending != linking.end();) {
+    if (!pending->program->IsLinkComplete()) {
+      ++pending;
+      continue;
+    }
+    auto &entry = entries[pending->entry];
+    std::string name = "<string>";
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!entry.files.empty()) {
+        name = entry.files.back().filename;
+      }
+    }
+    if (pending->program->FinishCreateAndLinkProgram()) {
+      entry.shader->SwapProgram(*pending->program);
+      if (entry.onReload) {
+        entry.onReload(*entry.shader);
+      }
+      ++stats.reloads;
+      std::cout << "Reloaded shader: " << name << '\n';
+    } else {
+      pending->program->DeleteShaderProgram();
+      ++stats.failures;
+      std::cerr << "Reload failed, keeping previous program: " << name
+                << '\n';
+    }
+    pending = linking.erase(pending);
+  }
+}
+
+const CShaderWatcher::Stats &CShaderWatcher::GetStats() const { return stats; }
+
+void CShaderWatcher::PrintStats(std::ostream &out) const {
+  out << "Shader reloads: " << stats.reloads
+      << " failed: " << stats.failures << '\n';
+}
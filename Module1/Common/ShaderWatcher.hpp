@@ -0,0 +1,101 @@
+#pragma once
+// STL
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+// Internal
+#include "GLSLShader.hpp"
+
+/**
+ * @brief Rebuilds GLSLShader programs when their source files change.
+ *
+ * A background thread waits on inotify (Linux only) for writes to the
+ * directories of the watched files and of their includes, then reads and
+ * preprocesses the sources of the affected programs. The GL thread calls
+ * Update once per frame: it issues the compile and link of the new sources
+ * and only swaps a program in once its link has completed, so a frame never
+ * waits on the compiler when GL_KHR_parallel_shader_compile is available.
+ * A program that fails to compile or link is dropped and the previous one
+ * kept.
+ */
+class CShaderWatcher {
+public:
+  using Callback = std::function<void(GLSLShader &)>;
+
+  struct Stats {
+    std::size_t reloads = 0;  // programs swapped in
+    std::size_t failures = 0; // rebuilds rejected, old program kept
+  };
+
+  ~CShaderWatcher();
+
+  /**
+   * @brief Watch the files `shader` was loaded from with LoadFromFile.
+   *
+   * Must be called before Start. `onReload` runs on the GL thread after
+   * the swap, for state SwapProgram does not carry over.
+   */
+  void Watch(GLSLShader &shader, Callback onReload = {});
+
+  /**
+   * @brief Start the watcher thread, false when inotify is unavailable.
+   */
+  bool Start();
+
+  void Stop();
+
+  /**
+   * @brief Swap in the programs rebuilt since the last call, GL thread only.
+   */
+  void Update();
+
+  const Stats &GetStats() const;
+
+  void PrintStats(std::ostream &out) const;
+
+private:
+  struct Entry {
+    GLSLShader *shader;
+    std::vector<GLSLShader::FileSource> files;
+    Callback onReload;
+  };
+  // sources read by the watcher thread, waiting for the GL thread
+  struct Rebuilt {
+    std::size_t entry;
+    std::vector<std::pair<GLenum, std::string>> sources;
+  };
+  // program being linked by the GL thread
+  struct Linking {
+    std::size_t entry;
+    std::unique_ptr<GLSLShader> program;
+  };
+
+  void Run();
+  void AddWatches(const Entry &entry);
+  bool Rebuild(std::size_t index, Rebuilt &rebuilt);
+  bool Uses(const Entry &entry, const std::string &path) const;
+
+  // written by Watch before Start. Afterwards the watcher thread rewrites
+  // the include sets of `files` under mutex, Update reads `files` under
+  // mutex too and uses `shader` and `onReload` freely, they never change
+  std::vector<Entry> entries;
+  std::vector<std::pair<int, std::string>> watchedDirectories;
+
+  std::mutex mutex;
+  std::vector<Rebuilt> ready; // guarded by mutex
+
+  std::vector<Linking> linking;
+  Stats stats;
+
+  std::thread thread;
+  std::atomic<bool> running{false};
+  int fd = -1;
+};
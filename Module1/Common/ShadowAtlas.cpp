@@ -0,0 +1,334 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "ShadowAtlas.hpp"
+// STL
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+// GLM
+#include <glm/gtc/matrix_transform.hpp>
+
+void CShadowAtlas::Init(const GLsizei size_, const GLsizei minTile_,
+                        const GLsizei maxTile_) {
+  assert(minTile_ > 0 && minTile_ <= maxTile_ && maxTile_ <= size_);
+  size    = size_;
+  minTile = minTile_;
+  maxTile = maxTile_;
+
+  int levels = 1;
+  for (GLsizei tile = maxTile; tile > minTile; tile /= 2) {
+    ++levels;
+  }
+  freeTiles.assign(static_cast<std::size_t>(levels), std::vector<Tile>());
+  // reversed so the lower left tiles are handed out first
+  for (GLint y = size - maxTile; y >= 0; y -= maxTile) {
+    for (GLint x = size - maxTile; x >= 0; x -= maxTile) {
+      freeTiles[0].push_back({x, y, maxTile});
+    }
+  }
+  for (auto &slot : slots) {
+    slot = Slot();
+  }
+  frame   = 0;
+  changed = 0;
+
+  texture = GLTexture::Create();
+  glBindTexture(GL_TEXTURE_2D, texture.Get());
+  // linear filtering with compare mode gives 2x2 hardware PCF, the lookup
+  // is clamped to the tile in the shader
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE,
+                  GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0,
+               GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, nullptr);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  fbo = GLFramebuffer::Create();
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo.Get());
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                         texture.Get(), 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "Shadow atlas FBO is incomplete." << std::endl;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  atlasUBO.Init(sizeof(AtlasBlock));
+}
+
+void CShadowAtlas::Destroy() {
+  atlasUBO.Destroy();
+  // the handles delete the framebuffer and the texture
+  fbo.Reset();
+  texture.Reset();
+  freeTiles.clear();
+}
+
+float CShadowAtlas::ScreenImportance(const glm::mat4 &V, const glm::mat4 &P,
+                                     const glm::vec3 &center, const float radius) {
+  const float depth = -(V * glm::vec4(center, 1)).z;
+  if (depth < -radius) {
+    return 0;
+  }
+  // projected radius over the half screen height, 1 inside the sphere
+  return std::min(1.0f, radius * P[1][1] / std::max(depth, radius));
+}
+
+void CShadowAtlas::BeginFrame() {
+  ++frame;
+  for (auto &slot : slots) {
+    slot.requested = false;
+  }
+}
+
+void CShadowAtlas::Request(const int light, const float importance) {
+  assert(light >= 0 && light < MAX_LIGHTS);
+  if (importance <= 0) {
+    return;
+  }
+  Slot &slot = slots[light];
+  slot.requested  = true;
+  slot.importance = importance;
+  ++stats.requests;
+}
+
+int CShadowAtlas::LevelOf(const float importance) const {
+  // the smallest tile with at least importance * maxTile texels
+  const float texels = importance * static_cast<float>(maxTile);
+  const int levels = static_cast<int>(freeTiles.size());
+  int level = 0;
+  for (GLsizei tile = maxTile / 2; level + 1 < levels && static_cast<float>(tile) >= texels;
+       tile /= 2) {
+    ++level;
+  }
+  return level;
+}
+
+bool CShadowAtlas::Allocate(const int level, Tile &tile) {
+  auto &free = freeTiles[static_cast<std::size_t>(level)];
+  if (!free.empty()) {
+    tile = free.back();
+    free.pop_back();
+    return true;
+  }
+  // split a tile of the level above into four
+  Tile parent;
+  if (level == 0 || !Allocate(level - 1, parent)) {
+    return false;
+  }
+  const GLsizei half = parent.size / 2;
+  free.push_back({parent.x + half, parent.y + half, half});
+  free.push_back({parent.x, parent.y + half, half});
+  free.push_back({parent.x + half, parent.y, half});
+  tile = {parent.x, parent.y, half};
+  return true;
+}
+
+void CShadowAtlas::Free(const int level, const Tile &tile) {
+  auto &free = freeTiles[static_cast<std::size_t>(level)];
+  if (level > 0) {
+    // merge with the three buddies when they are all free
+    const GLsizei parentSize = tile.size * 2;
+    const Tile parent{tile.x - tile.x % parentSize, tile.y - tile.y % parentSize,
+                      parentSize};
+    auto inParent = [&parent](const Tile &t) {
+      return t.x >= parent.x && t.x < parent.x + parent.size && t.y >= parent.y &&
+             t.y < parent.y + parent.size;
+    };
+    if (std::count_if(free.begin(), free.end(), inParent) == 3) {
+      free.erase(std::remove_if(free.begin(), free.end(), inParent), free.end());
+      Free(level - 1, parent);
+      return;
+    }
+  }
+  free.push_back(tile);
+}
+
+bool CShadowAtlas::EvictLeastRecentlyUsed() {
+  Slot *oldest = nullptr;
+  for (auto &slot : slots) {
+    if (slot.level >= 0 && !slot.requested &&
+        (oldest == nullptr || slot.lastUsed < oldest->lastUsed)) {
+      oldest = &slot;
+    }
+  }
+  if (oldest == nullptr) {
+    return false;
+  }
+  Free(oldest->level, oldest->tile);
+  oldest->tile  = Tile();
+  oldest->level = -1;
+  ++stats.evicted;
+  return true;
+}
+
+void CShadowAtlas::Assign() {
+  changed = 0;
+
+  // the wanted tile sizes, halved from the largest and least important
+  // down until they fit the atlas together
+  const int levels = static_cast<int>(freeTiles.size());
+  auto area = [this](const int level) {
+    const GLsizeiptr tile = maxTile >> level;
+    return tile * tile;
+  };
+  GLsizeiptr total = 0;
+  for (auto &slot : slots) {
+    if (slot.requested) {
+      slot.wanted = LevelOf(slot.importance);
+      total += area(slot.wanted);
+    }
+  }
+  const GLsizeiptr capacity = GLsizeiptr{size} * size;
+  while (total > capacity) {
+    Slot *largest = nullptr;
+    for (auto &slot : slots) {
+      if (slot.requested && slot.wanted + 1 < levels &&
+          (largest == nullptr || slot.wanted < largest->wanted ||
+           (slot.wanted == largest->wanted && slot.importance < largest->importance))) {
+        largest = &slot;
+      }
+    }
+    if (largest == nullptr) {
+      break;
+    }
+    total -= area(largest->wanted) - area(largest->wanted + 1);
+    ++largest->wanted;
+    ++stats.downsized;
+  }
+
+  // keep the tiles of the wanted size, the others are given back first so
+  // their space can be reused this frame
+  int pending[MAX_LIGHTS];
+  int pendingCount = 0;
+  for (int light = 0; light < MAX_LIGHTS; ++light) {
+    Slot &slot = slots[light];
+    if (!slot.requested) {
+      continue;
+    }
+    if (slot.level >= 0 && slot.level == slot.wanted) {
+      slot.lastUsed = frame;
+      ++stats.kept;
+      continue;
+    }
+    if (slot.level >= 0) {
+      Free(slot.level, slot.tile);
+      slot.tile  = Tile();
+      slot.level = -1;
+    }
+    pending[pendingCount++] = light;
+  }
+
+  // largest tiles first so the buddies pack without holes, then the most
+  // important lights
+  std::sort(pending, pending + pendingCount, [this](const int a, const int b) {
+    return slots[a].wanted != slots[b].wanted
+               ? slots[a].wanted < slots[b].wanted
+               : slots[a].importance > slots[b].importance;
+  });
+  for (int i = 0; i < pendingCount; ++i) {
+    Slot &slot = slots[pending[i]];
+    int level = slot.wanted;
+    Tile tile;
+    bool allocated = Allocate(level, tile);
+    while (!allocated) {
+      // evict unused tiles before settling for a smaller one
+      if (!EvictLeastRecentlyUsed()) {
+        if (level + 1 >= levels) {
+          break;
+        }
+        ++level;
+        ++stats.downsized;
+      }
+      allocated = Allocate(level, tile);
+    }
+    if (!allocated) {
+      ++stats.denied;
+      continue;
+    }
+    slot.tile     = tile;
+    slot.level    = level;
+    slot.lastUsed = frame;
+    changed |= LightMask{1} << pending[i];
+    ++stats.allocated;
+  }
+
+  // tile transform table, lights without a tile this frame are unshadowed
+  const float texel = 1.0f / static_cast<float>(size);
+  block.count = 0;
+  for (int light = 0; light < MAX_LIGHTS; ++light) {
+    const Slot &slot = slots[light];
+    if (slot.requested && slot.level >= 0) {
+      block.tile[light] = glm::vec4(static_cast<float>(slot.tile.x),
+                                    static_cast<float>(slot.tile.y),
+                                    static_cast<float>(slot.tile.size),
+                                    static_cast<float>(slot.tile.size)) *
+                          texel;
+      block.count = light + 1;
+    } else {
+      block.tile[light] = glm::vec4(0);
+    }
+  }
+  atlasUBO.Update(block);
+  ++stats.frames;
+}
+
+CShadowAtlas::LightMask CShadowAtlas::GetChanged() const { return changed; }
+
+bool CShadowAtlas::HasTile(const int light) const {
+  return slots[light].requested && slots[light].level >= 0;
+}
+
+const CShadowAtlas::Tile &CShadowAtlas::GetTile(const int light) const {
+  return slots[light].tile;
+}
+
+void CShadowAtlas::SetViewProjection(const int light,
+                                     const glm::mat4 &viewProjection) {
+  assert(light >= 0 && light < MAX_LIGHTS);
+  const glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1), glm::vec3(0.5f)),
+                                    glm::vec3(0.5f));
+  block.shadow[light] = bias * viewProjection;
+}
+
+void CShadowAtlas::Begin() {
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo.Get());
+  glEnable(GL_SCISSOR_TEST);
+  atlasUBO.Bind(UniformBinding::ATLAS);
+}
+
+void CShadowAtlas::BeginTile(const int light) {
+  const Tile &tile = slots[light].tile;
+  glViewport(tile.x, tile.y, tile.size, tile.size);
+  // the clear only touches the scissor rectangle
+  glScissor(tile.x, tile.y, tile.size, tile.size);
+  glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void CShadowAtlas::End() {
+  glDisable(GL_SCISSOR_TEST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GLuint CShadowAtlas::GetTexture() const { return texture.Get(); }
+
+GLsizei CShadowAtlas::GetSize() const { return size; }
+
+const AtlasBlock &CShadowAtlas::GetBlock() const { return block; }
+
+const CShadowAtlas::Stats &CShadowAtlas::GetStats() const { return stats; }
+
+void CShadowAtlas::ResetStats() { stats = Stats(); }
+
+void CShadowAtlas::PrintStats(std::ostream &out) const {
+  out << "Shadow atlas: " << size << "x" << size << ", tiles " << minTile
+      << " to " << maxTile << ", " << stats.requests << " requests, "
+      << stats.kept << " tiles kept, " << stats.allocated << " allocated, "
+      << stats.evicted << " evicted, " << stats.downsized << " downsized, "
+      << stats.denied << " denied in " << stats.frames << " frames\n";
+}
@@ -0,0 +1,154 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// GLM
+#include <glm/glm.hpp>
+// Internal
+#include "GLHandle.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformBuffer.hpp"
+
+/**
+ * @brief Shadow maps of many lights as tiles of one depth texture.
+ *
+ * The atlas is cut into power-of-two tiles by a buddy allocator: a tile is
+ * split into four when no tile of the wanted size is free, and four free
+ * buddies merge back into their parent. Every frame each shadowed light
+ * requests a tile sized by its importance, the share of the screen it
+ * covers (see ScreenImportance). When the requests add up to more than the
+ * atlas, the largest tiles of the least important lights are halved until
+ * they fit. A light keeps its tile while the size stays the same, so its
+ * depth is reused; new tiles are handed out largest first. When no tile is
+ * free the least recently used tiles of lights not requested this frame are
+ * evicted, then the request is halved down to the smallest tile before the
+ * light goes without shadows.
+ *
+ * GetChanged returns the lights that got a new tile, their shadow maps
+ * must be rendered again (CShadowCache::Invalidate with light = slot). The
+ * tile transform table is an AtlasBlock in the UniformBinding::ATLAS
+ * uniform buffer: the lighting shader maps the [0,1] shadow coordinates of
+ * light i to atlas_tile[i].xy + coords.xy * atlas_tile[i].zw.
+ */
+class CShadowAtlas {
+public:
+  static constexpr int MAX_LIGHTS = 32;
+
+  // bit l is light l, as CShadowCache::SlotMask
+  using LightMask = std::uint32_t;
+
+  struct Tile {
+    GLint x = 0, y = 0;  // lower left texel
+    GLsizei size = 0;    // 0 without a tile
+  };
+
+  struct Stats {
+    std::size_t frames = 0;
+    std::size_t requests = 0;
+    std::size_t kept = 0;      // tiles reused from the previous frame
+    std::size_t allocated = 0; // new tiles
+    std::size_t evicted = 0;   // tiles taken from unused lights
+    std::size_t downsized = 0; // requests served with a smaller tile
+    std::size_t denied = 0;    // requests without a tile
+  };
+
+  /**
+   * @brief Depth texture of size x size texels, tiles from maxTile down to
+   * minTile; all three are powers of two.
+   */
+  void Init(GLsizei size = 4096, GLsizei minTile = 128, GLsizei maxTile = 1024);
+
+  void Destroy();
+
+  /**
+   * @brief Share of the screen height, 0 to 1, covered by a light's sphere
+   * of influence; 0 when it is behind the camera.
+   */
+  static float ScreenImportance(const glm::mat4 &V, const glm::mat4 &P,
+                                const glm::vec3 &center, float radius);
+
+  /**
+   * @brief Forget the requests of the previous frame.
+   */
+  void BeginFrame();
+
+  /**
+   * @brief Ask for a tile of about importance * maxTile texels, nothing is
+   * requested for importance <= 0.
+   */
+  void Request(int light, float importance);
+
+  /**
+   * @brief Hand out the tiles of this frame's requests and upload the
+   * tile transform table.
+   */
+  void Assign();
+
+  LightMask GetChanged() const;
+  bool HasTile(int light) const;
+  const Tile &GetTile(int light) const;
+
+  /**
+   * @brief Light projection * view matrix, stored as bias * viewProjection
+   * in the AtlasBlock; call before Assign.
+   */
+  void SetViewProjection(int light, const glm::mat4 &viewProjection);
+
+  /**
+   * @brief Bind the atlas framebuffer and the tile table.
+   */
+  void Begin();
+
+  /**
+   * @brief Restrict drawing to the tile of `light` and clear it.
+   */
+  void BeginTile(int light);
+
+  /**
+   * @brief Unbind the framebuffer, the viewport is left to the caller.
+   */
+  void End();
+
+  GLuint GetTexture() const;
+  GLsizei GetSize() const;
+  const AtlasBlock &GetBlock() const;
+
+  const Stats &GetStats() const;
+  void ResetStats();
+  void PrintStats(std::ostream &out) const;
+
+private:
+  struct Slot {
+    Tile tile;
+    int level = -1; // index into freeTiles, -1 without a tile
+    int wanted = -1; // level asked for this frame
+    float importance = 0;
+    bool requested = false;
+    std::uint64_t lastUsed = 0;
+  };
+
+  int LevelOf(float importance) const;
+  bool Allocate(int level, Tile &tile);
+  void Free(int level, const Tile &tile);
+  bool EvictLeastRecentlyUsed();
+
+  GLsizei size = 0;
+  GLsizei minTile = 0;
+  GLsizei maxTile = 0;
+  // free tiles per level, level l holds tiles of maxTile >> l texels
+  std::vector<std::vector<Tile>> freeTiles;
+  Slot slots[MAX_LIGHTS];
+  std::uint64_t frame = 0;
+  LightMask changed = 0;
+
+  GLTexture texture;
+  GLFramebuffer fbo;
+  CUniformBuffer atlasUBO;
+  AtlasBlock block;
+
+  Stats stats;
+};
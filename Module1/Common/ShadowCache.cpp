@@ -0,0 +1,82 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "ShadowCache.hpp"
+// STL
+#include <bitset>
+#include <cassert>
+
+void CShadowCache::Init(const int slots) {
+  assert(slots > 0 && slots <= MAX_SLOTS);
+  slotCount = slots;
+  allSlots  = slots == MAX_SLOTS ? ~SlotMask{0} : (SlotMask{1} << slots) - 1;
+  dirty     = allSlots;
+  lights.assign(static_cast<std::size_t>(slots), glm::mat4(0));
+  casters.clear();
+  windowStart   = std::chrono::steady_clock::now();
+  windowSkipped = 0;
+}
+
+void CShadowCache::Invalidate() { dirty = allSlots; }
+
+void CShadowCache::Invalidate(const SlotMask slots) { dirty |= slots & allSlots; }
+
+void CShadowCache::SetLight(const int slot, const glm::mat4 &viewProjection) {
+  assert(slot >= 0 && slot < slotCount);
+  glm::mat4 &light = lights[static_cast<std::size_t>(slot)];
+  if (light != viewProjection) {
+    light = viewProjection;
+    dirty |= SlotMask{1} << slot;
+  }
+}
+
+void CShadowCache::SetCaster(const std::size_t caster, const std::uint64_t version,
+                             const SlotMask slots) {
+  if (caster >= casters.size()) {
+    casters.resize(caster + 1);
+  }
+  Caster &c = casters[caster];
+  // where it was drawn and where it is drawn now
+  if (!c.known || c.version != version) {
+    dirty |= (c.slots | slots) & allSlots;
+  }
+  c.version = version;
+  c.slots   = slots;
+  c.known   = true;
+}
+
+CShadowCache::SlotMask CShadowCache::GetDirty() const { return dirty; }
+
+bool CShadowCache::IsDirty(const int slot) const {
+  return ((dirty >> slot) & 1U) != 0;
+}
+
+void CShadowCache::EndFrame(SlotMask drawn, SlotMask active) {
+  drawn &= allSlots;
+  active &= allSlots;
+  assert((drawn & ~active) == 0);
+  const std::size_t rendered = std::bitset<32>(drawn).count();
+  const std::size_t skipped = std::bitset<32>(active & ~(drawn | dirty)).count();
+  ++stats.frames;
+  stats.rendered += rendered;
+  stats.skipped += skipped;
+  dirty &= ~drawn;
+
+  windowSkipped += skipped;
+  const auto now = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(now - windowStart).count();
+  if (seconds >= 1.0) {
+    stats.skippedPerSecond = static_cast<double>(windowSkipped) / seconds;
+    windowStart   = now;
+    windowSkipped = 0;
+  }
+}
+
+const CShadowCache::Stats &CShadowCache::GetStats() const { return stats; }
+
+void CShadowCache::ResetStats() { stats = Stats(); }
+
+void CShadowCache::PrintStats(std::ostream &out) const {
+  out << "Shadow cache: " << slotCount << " slots, " << stats.rendered
+      << " passes rendered, " << stats.skipped << " skipped in "
+      << stats.frames << " frames\n";
+}
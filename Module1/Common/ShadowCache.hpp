@@ -0,0 +1,90 @@
+#pragma once
+// STL
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+// GLM
+#include <glm/glm.hpp>
+
+/**
+ * @brief Tracks which shadow maps are out of date.
+ *
+ * A slot is one shadow map, cascade or atlas tile. It is dirty when the
+ * light matrix it was rendered with changes, or when a caster it holds
+ * moves: casters report a version number that changes with their
+ * transform, and the slots they were drawn into before and after the
+ * change are dirtied. Depth passes of clean slots are skipped, so a static
+ * scene under a static light renders its shadows once.
+ *
+ * Every frame: SetLight for each slot, SetCaster for each caster, render
+ * the dirty slots that are in use, then EndFrame with the slots drawn and
+ * the slots in use. A slot that is dirty but not drawn, like a light
+ * without an atlas tile, stays dirty.
+ */
+class CShadowCache {
+public:
+  static constexpr int MAX_SLOTS = 32;
+
+  // bit s is slot s
+  using SlotMask = std::uint32_t;
+
+  struct Stats {
+    std::size_t frames = 0;
+    std::size_t rendered = 0; // slot passes drawn
+    std::size_t skipped = 0;  // clean slots in use that were not drawn
+    double skippedPerSecond = 0; // over the last full second
+  };
+
+  /**
+   * @brief `slots` slots, all dirty.
+   */
+  void Init(int slots);
+
+  /**
+   * @brief Dirty every slot, for example after the shadow map is resized.
+   */
+  void Invalidate();
+  void Invalidate(SlotMask slots);
+
+  void SetLight(int slot, const glm::mat4 &viewProjection);
+
+  /**
+   * @brief `version` changes whenever the caster's transform does, `slots`
+   * are the slots it is drawn into this frame.
+   */
+  void SetCaster(std::size_t caster, std::uint64_t version, SlotMask slots);
+
+  SlotMask GetDirty() const;
+  bool IsDirty(int slot) const;
+
+  /**
+   * @brief `drawn` were rendered or cleared this frame and are clean now,
+   * `active` are the slots in use. The clean active slots count as
+   * skipped; dirty slots that were not drawn and slots not in use are not
+   * counted.
+   */
+  void EndFrame(SlotMask drawn, SlotMask active);
+
+  const Stats &GetStats() const;
+  void ResetStats();
+  void PrintStats(std::ostream &out) const;
+
+private:
+  struct Caster {
+    std::uint64_t version = 0;
+    SlotMask slots = 0;
+    bool known = false;
+  };
+
+  int slotCount = 0;
+  SlotMask allSlots = 0;
+  SlotMask dirty = 0;
+  std::vector<glm::mat4> lights;
+  std::vector<Caster> casters;
+
+  Stats stats;
+  std::chrono::steady_clock::time_point windowStart;
+  std::size_t windowSkipped = 0;
+};
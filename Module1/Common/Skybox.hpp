@@ -9,6 +9,10 @@ public:
 
   ~CSkybox() override;
 
+  CSkybox(CSkybox &&) = default;
+
+  CSkybox &operator=(CSkybox &&) = default;
+
   int GetTotalVertices() override;
 
   int GetTotalIndices() override;
@@ -0,0 +1,149 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "StreamingBuffer.hpp"
+// STL
+#include <cassert>
+#include <chrono>
+
+namespace {
+constexpr GLuint64 FENCE_TIMEOUT_NS = 1000000; // 1 ms per wait call
+// maps go through the copy target so the caller's `target` binding, and
+// the element buffer of a bound VAO, are left alone
+constexpr GLenum MAP_TARGET = GL_COPY_WRITE_BUFFER;
+} // namespace
+
+void CStreamingBuffer::Init(const GLenum target_, const GLsizeiptr regionSize_) {
+  target     = target_;
+  regionSize = regionSize_;
+  persistent = GLEW_ARB_buffer_storage != 0;
+  region     = 0;
+  head       = 0;
+
+  glGenBuffers(1, &bufferID);
+  glBindBuffer(MAP_TARGET, bufferID);
+  if (persistent) {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(MAP_TARGET, regionSize * REGIONS, nullptr, flags);
+    mapped = static_cast<unsigned char *>(
+        glMapBufferRange(MAP_TARGET, 0, regionSize * REGIONS, flags));
+  } else {
+    glBufferData(MAP_TARGET, regionSize * REGIONS, nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(MAP_TARGET, 0);
+}
+
+void CStreamingBuffer::Destroy() {
+  for (auto &fence : fences) {
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+  if (bufferID != 0) {
+    // deleting the buffer also unmaps it
+    glDeleteBuffers(1, &bufferID);
+  }
+  bufferID    = 0;
+  mapped      = nullptr;
+  rangeMapped = false;
+}
+
+CStreamingBuffer::Allocation CStreamingBuffer::Alloc(const GLsizeiptr size,
+                                                     const GLsizeiptr alignment) {
+  Allocation allocation;
+  if (size > regionSize) {
+    return allocation;
+  }
+  auto offset = (head + alignment - 1) / alignment * alignment;
+  if (offset + size > regionSize) {
+    ++stats.wraps;
+    NextRegion();
+    offset = 0;
+  }
+  head = offset + size;
+  allocation.offset = static_cast<GLintptr>(region) * regionSize + offset;
+
+  if (persistent) {
+    allocation.data = mapped + allocation.offset;
+  } else {
+    // only one range is mapped at a time, the fence of this region already
+    // guarantees the GPU is done with it
+    Commit();
+    glBindBuffer(MAP_TARGET, bufferID);
+    allocation.data = glMapBufferRange(
+        MAP_TARGET, allocation.offset, size,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+            GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(MAP_TARGET, 0);
+    rangeMapped = true;
+  }
+
+  ++stats.allocations;
+  stats.bytes += static_cast<std::size_t>(size);
+  return allocation;
+}
+
+void CStreamingBuffer::Commit() {
+  if (!rangeMapped) {
+    return;
+  }
+  glBindBuffer(MAP_TARGET, bufferID);
+  glUnmapBuffer(MAP_TARGET);
+  glBindBuffer(MAP_TARGET, 0);
+  rangeMapped = false;
+}
+
+void CStreamingBuffer::EndFrame() {
+  ++stats.frames;
+  NextRegion();
+}
+
+void CStreamingBuffer::NextRegion() {
+  Commit();
+  // fence everything issued so far against this region
+  glDeleteSync(fences[region]);
+  fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  region = (region + 1) % REGIONS;
+  head   = 0;
+
+  GLsync &fence = fences[region];
+  if (!fence) {
+    return;
+  }
+  // flushing on the first wait guarantees the fence eventually signals
+  GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    ++stats.stalls;
+    const auto start = std::chrono::steady_clock::now();
+    do {
+      status =
+          glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    stats.stallMs += std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  }
+  assert(status != GL_WAIT_FAILED);
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+GLuint CStreamingBuffer::GetBuffer() const { return bufferID; }
+
+GLenum CStreamingBuffer::GetTarget() const { return target; }
+
+GLsizeiptr CStreamingBuffer::GetRegionSize() const { return regionSize; }
+
+bool CStreamingBuffer::IsPersistent() const { return persistent; }
+
+const CStreamingBuffer::Stats &CStreamingBuffer::GetStats() const {
+  return stats;
+}
+
+void CStreamingBuffer::PrintStats(std::ostream &out) const {
+  out << "Streaming buffer (" << (persistent ? "persistent" : "unsynchronized")
+      << "): " << stats.bytes << " bytes in " << stats.allocations
+      << " allocations over " << stats.frames << " frames, " << stats.wraps
+      << " full regions, " << stats.stalls << " fence stalls (" << stats.stallMs
+      << " ms)\n";
+}
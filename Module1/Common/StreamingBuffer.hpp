@@ -0,0 +1,102 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <ostream>
+// GLEW
+#include <GL/glew.h>
+
+/**
+ * @brief Ring buffer for data written by the CPU every frame.
+ *
+ * The buffer is split into REGIONS equally sized regions, one per frame in
+ * flight. Alloc hands out ranges of the current region, EndFrame fences it
+ * and moves on to the next one, waiting only if the GPU still reads that
+ * region. A region that runs full moves on early the same way, so callers
+ * that never call EndFrame stay correct.
+ *
+ * With ARB_buffer_storage the whole buffer is mapped once, persistent and
+ * coherent. On plain GL 3.3 every allocation maps its range with
+ * GL_MAP_UNSYNCHRONIZED_BIT, the fences guarantee the GPU is done with it,
+ * and the range must be unmapped with Commit before a draw reads it.
+ *
+ * Init, Alloc and Commit bind the buffer to GL_COPY_WRITE_BUFFER and reset
+ * that binding to 0; bindings of `target` are never touched, the caller
+ * binds GetBuffer itself.
+ */
+class CStreamingBuffer {
+public:
+  static constexpr int REGIONS = 3;
+
+  struct Allocation {
+    void *data = nullptr; // CPU address to write to
+    GLintptr offset = 0;  // into the buffer, for draws and attribute pointers
+  };
+
+  struct Stats {
+    std::size_t frames = 0;
+    std::size_t allocations = 0;
+    std::size_t bytes = 0;
+    std::size_t wraps = 0;    // regions left early because they ran full
+    std::size_t stalls = 0;   // fence waits that were not signalled yet
+    double stallMs = 0;
+  };
+
+  /**
+   * @brief Create the buffer, `regionSize` bytes per frame in flight.
+   */
+  void Init(GLenum target, GLsizeiptr regionSize);
+
+  void Destroy();
+
+  /**
+   * @brief `size` bytes aligned to `alignment`, which need not be a power
+   * of two; a null data pointer when `size` exceeds a region.
+   */
+  Allocation Alloc(GLsizeiptr size, GLsizeiptr alignment = 4);
+
+  template <typename T> Allocation Alloc(std::size_t count) {
+    return Alloc(static_cast<GLsizeiptr>(count * sizeof(T)),
+                 static_cast<GLsizeiptr>(alignof(T)));
+  }
+
+  /**
+   * @brief Make the written allocations visible to the GPU.
+   *
+   * Unmaps the pending range on the fallback path, nothing to do when the
+   * mapping is coherent.
+   */
+  void Commit();
+
+  /**
+   * @brief Fence the region of this frame and move to the next one.
+   */
+  void EndFrame();
+
+  GLuint GetBuffer() const;
+
+  GLenum GetTarget() const;
+
+  GLsizeiptr GetRegionSize() const;
+
+  bool IsPersistent() const;
+
+  const Stats &GetStats() const;
+
+  void PrintStats(std::ostream &out) const;
+
+private:
+  void NextRegion();
+
+  GLuint bufferID = 0;
+  GLenum target = GL_ARRAY_BUFFER;
+  GLsizeiptr regionSize = 0;
+  bool persistent = false;
+  unsigned char *mapped = nullptr; // whole buffer, persistent path only
+  bool rangeMapped = false;        // fallback path
+
+  int region = 0;
+  GLintptr head = 0; // next free byte of the current region
+  GLsync fences[REGIONS] = {};
+
+  Stats stats;
+};
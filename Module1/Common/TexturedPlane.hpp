@@ -7,6 +7,10 @@ public:
 
   ~CTexturedPlane() override;
 
+  CTexturedPlane(CTexturedPlane &&) = default;
+
+  CTexturedPlane &operator=(CTexturedPlane &&) = default;
+
   int GetTotalVertices() override;
 
   int GetTotalIndices() override;
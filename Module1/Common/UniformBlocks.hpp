@@ -0,0 +1,79 @@
+#pragma once
+// GLEW
+#include <GL/glew.h>
+// GLM
+#include <glm/glm.hpp>
+
+// Binding points shared by every program, see GLSLShader::BindUniformBlock
+namespace UniformBinding {
+constexpr GLuint PER_FRAME   = 0;
+constexpr GLuint PER_DRAW    = 1;
+constexpr GLuint CASCADES    = 2;
+constexpr GLuint ATLAS       = 3;
+constexpr GLuint CUBE_SHADOW = 4;
+} // namespace UniformBinding
+
+// std140 mirrors of the GLSL blocks, only vec4/mat4 members and explicit
+// padding so the C++ layout matches the std140 one byte for byte.
+//
+// layout(std140) uniform PerFrame {
+//   mat4 V; mat4 P; mat4 S; vec4 light_position; int bIsLightPass;
+// };
+struct PerFrameBlock {
+  glm::mat4 V;             // camera view matrix
+  glm::mat4 P;             // camera projection matrix
+  glm::mat4 S;             // light bias * projection * view matrix
+  glm::vec4 lightPosition; // world space light position, w = 1
+  GLint isLightPass = 0;   // 1 while rendering the shadow map
+  GLint pad[3] = {0, 0, 0};
+};
+
+// layout(std140) uniform PerDraw {
+//   mat4 M; vec4 diffuse_color; vec4 specular_color;
+// };
+struct PerDrawBlock {
+  glm::mat4 M;                            // model matrix
+  glm::vec4 diffuseColor;                 // surface's diffuse colour, SSAO
+                                          // sets w for untextured materials
+  glm::vec4 specularColor = glm::vec4(0); // specular colour, w shininess
+};
+
+// layout(std140) uniform Cascades {
+//   mat4 cascade_VP[4]; mat4 cascade_S[4]; vec4 cascade_splits;
+//   int cascade_count;
+// };
+struct CascadeBlock {
+  glm::mat4 viewProjection[4]; // light projection * view per cascade
+  glm::mat4 shadow[4];         // bias * viewProjection per cascade
+  glm::vec4 splits;            // far view space depth of each cascade
+  GLint count = 0;
+  GLint pad[3] = {0, 0, 0};
+};
+
+// layout(std140) uniform ShadowAtlas {
+//   mat4 atlas_S[32]; vec4 atlas_tile[32]; int atlas_count;
+// };
+struct AtlasBlock {
+  glm::mat4 shadow[32]; // bias * projection * view per light
+  glm::vec4 tile[32];   // xy offset, zw scale of the light's tile in atlas
+                        // texture coordinates, zw = 0 without a tile
+  GLint count = 0;
+  GLint pad[3] = {0, 0, 0};
+};
+
+// layout(std140) uniform CubeShadow { mat4 cube_VP[6]; vec4 cube_light; };
+struct CubeShadowBlock {
+  glm::mat4 viewProjection[6]; // projection * view per cube face
+  glm::vec4 light;             // xyz world space position, w far plane
+};
+
+static_assert(sizeof(PerFrameBlock) == 3 * 64 + 16 + 16,
+              "PerFrameBlock must match the std140 layout");
+static_assert(sizeof(PerDrawBlock) == 96,
+              "PerDrawBlock must match the std140 layout");
+static_assert(sizeof(CascadeBlock) == 8 * 64 + 16 + 16,
+              "CascadeBlock must match the std140 layout");
+static_assert(sizeof(AtlasBlock) == 32 * 64 + 32 * 16 + 16,
+              "AtlasBlock must match the std140 layout");
+static_assert(sizeof(CubeShadowBlock) == 6 * 64 + 16,
+              "CubeShadowBlock must match the std140 layout");
@@ -0,0 +1,37 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "UniformBuffer.hpp"
+
+void CUniformBuffer::Init(const GLsizeiptr size_, const GLsizei count_) {
+  GLint alignment = 1;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+  size   = size_;
+  count  = count_;
+  stride = (size + alignment - 1) / alignment * alignment;
+
+  glGenBuffers(1, &uboID);
+  glBindBuffer(GL_UNIFORM_BUFFER, uboID);
+  glBufferData(GL_UNIFORM_BUFFER, stride * count, nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void CUniformBuffer::Destroy() {
+  glDeleteBuffers(1, &uboID);
+  uboID = 0;
+}
+
+void CUniformBuffer::Update(const void *data, const GLsizeiptr size_,
+                            const GLsizei slot) {
+  glBindBuffer(GL_UNIFORM_BUFFER, uboID);
+  glBufferSubData(GL_UNIFORM_BUFFER, stride * slot, size_, data);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void CUniformBuffer::Bind(const GLuint binding, const GLsizei slot) const {
+  glBindBufferRange(GL_UNIFORM_BUFFER, binding, uboID, stride * slot, size);
+}
+
+GLsizeiptr CUniformBuffer::GetStride() const { return stride; }
+
+GLsizei CUniformBuffer::GetCount() const { return count; }
@@ -0,0 +1,41 @@
+#pragma once
+// GLEW
+#include <GL/glew.h>
+
+/**
+ * @brief Uniform buffer object split into equally sized slots.
+ *
+ * Each slot starts on a GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT boundary, so a
+ * per-draw block can be uploaded for every object once and selected with
+ * a single glBindBufferRange per draw instead of a glUniform* per member.
+ */
+class CUniformBuffer {
+public:
+  /**
+   * @brief Allocate `count` slots of `size` bytes.
+   */
+  void Init(const GLsizeiptr size, const GLsizei count = 1);
+
+  void Destroy();
+
+  void Update(const void *data, const GLsizeiptr size, const GLsizei slot = 0);
+
+  template <typename T> void Update(const T &block, const GLsizei slot = 0) {
+    Update(&block, static_cast<GLsizeiptr>(sizeof(T)), slot);
+  }
+
+  /**
+   * @brief Attach one slot to an indexed binding point shared by programs.
+   */
+  void Bind(const GLuint binding, const GLsizei slot = 0) const;
+
+  GLsizeiptr GetStride() const;
+
+  GLsizei GetCount() const;
+
+private:
+  GLuint uboID      = 0;
+  GLsizeiptr size   = 0;
+  GLsizeiptr stride = 0;
+  GLsizei count     = 0;
+};
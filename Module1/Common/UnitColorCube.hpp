@@ -5,6 +5,8 @@ class CUnitColorCube : public RenderableObject {
 public:
   CUnitColorCube();
   virtual ~CUnitColorCube();
+  CUnitColorCube(CUnitColorCube &&) = default;
+  CUnitColorCube &operator=(CUnitColorCube &&) = default;
 
   int GetTotalVertices();
   int GetTotalIndices();
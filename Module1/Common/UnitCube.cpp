@@ -13,17 +13,27 @@ CUnitCube::CUnitCube(const glm::vec3 &col) {
   shader.Use();
   shader.AddAttribute("vVertex");
   shader.AddUniform("MVP");
-  shader.AddUniform("vColor");
-  glUniform3fv(shader("vColor"), 1, glm::value_ptr(color));
+  colorUniform = shader.AddUniform("vColor");
+  // the samples' cube shaders declare vColor as vec3 or as vec4
+  for (const auto &uniform : shader.GetActiveUniforms()) {
+    if (uniform.name == "vColor") {
+      colorIsVec4 = uniform.type == GL_FLOAT_VEC4;
+    }
+  }
+  SetCustomUniforms();
   shader.UnUse();
 
   Init();
 }
 
-CUnitCube& CUnitCube::operator=(const CUnitCube&) { return *this; }
+glm::vec4 CUnitCube::GetInstanceColor() const { return glm::vec4(color, 1); }
 
 void CUnitCube::SetCustomUniforms() {
-  glUniform3fv(shader("vColor"), 1, glm::value_ptr(color));
+  if (colorIsVec4) {
+    glUniform4f(shader(colorUniform), color.x, color.y, color.z, 1.0f);
+  } else {
+    glUniform3fv(shader(colorUniform), 1, glm::value_ptr(color));
+  }
 }
 
 CUnitCube::~CUnitCube() = default;
@@ -8,21 +8,22 @@ public:
 
   ~CUnitCube() override;
 
-  CUnitCube(const CUnitCube&);
+  CUnitCube(CUnitCube&&) = default;
 
-  CUnitCube(CUnitCube&&);
-
-  CUnitCube& operator=(const CUnitCube&);
-
-  CUnitCube& operator=(CUnitCube&&);
+  CUnitCube& operator=(CUnitCube&&) = default;
 
   int GetTotalVertices() override;
   int GetTotalIndices() override;
   GLenum GetPrimitiveType() override;
   void SetCustomUniforms() override;
+  glm::vec4 GetInstanceColor() const override;
 
   void FillVertexBuffer(GLfloat *pBuffer) override;
   void FillIndexBuffer(GLuint *pBuffer) override;
 
   glm::vec3 color;
+
+private:
+  UniformHandle colorUniform;
+  bool colorIsVec4 = false;
 };
@@ -0,0 +1,347 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "VertexFormat.hpp"
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+template <typename T> void Write(std::uint8_t *&out, const T &value) {
+  std::memcpy(out, &value, sizeof(T));
+  out += sizeof(T);
+}
+
+std::int16_t Snorm16(const float value) {
+  return static_cast<std::int16_t>(
+      std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+std::uint16_t Unorm16(const float value) {
+  return static_cast<std::uint16_t>(
+      std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+float SignNotZero(const float value) { return value < 0.0f ? -1.0f : 1.0f; }
+
+const GLvoid *Offset(const std::size_t bytes) {
+  return reinterpret_cast<const GLvoid *>(bytes);
+}
+} // namespace
+
+GLsizei CVertexFormat::PositionSize(const Position position) {
+  return position == Position::FLOAT3 ? 3 * sizeof(GLfloat)
+                                      : 4 * sizeof(std::uint16_t);
+}
+
+GLsizei CVertexFormat::NormalSize(const Normal normal) {
+  switch (normal) {
+  case Normal::FLOAT3:
+    return 3 * sizeof(GLfloat);
+  case Normal::OCT_SNORM16:
+    return 2 * sizeof(std::int16_t);
+  default:
+    return 0;
+  }
+}
+
+GLsizei CVertexFormat::UVSize(const UV uv) {
+  switch (uv) {
+  case UV::FLOAT2:
+    return 2 * sizeof(GLfloat);
+  case UV::UNORM16:
+    return 2 * sizeof(std::uint16_t);
+  default:
+    return 0;
+  }
+}
+
+GLsizei CVertexFormat::BytesPerVertex() const {
+  return PositionSize(position) + NormalSize(normal) + UVSize(uv);
+}
+
+GLenum CVertexFormat::IndexType(const std::size_t vertexCount) {
+  return vertexCount <= std::size_t{std::numeric_limits<std::uint16_t>::max()} + 1
+             ? GL_UNSIGNED_SHORT
+             : GL_UNSIGNED_INT;
+}
+
+GLsizei CVertexFormat::IndexSize(const GLenum indexType) {
+  return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+std::uint16_t CVertexFormat::FloatToHalf(const float value) {
+  std::uint32_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const auto sign     = static_cast<std::uint16_t>((bits >> 16) & 0x8000U);
+  const auto exponent = static_cast<std::int32_t>((bits >> 23) & 0xFFU);
+  std::uint32_t mantissa = bits & 0x7FFFFFU;
+
+  if (exponent == 0xFF) {
+    // infinity stays infinity, NaN keeps a mantissa bit
+    return static_cast<std::uint16_t>(sign | 0x7C00U | (mantissa ? 0x200U : 0U));
+  }
+  const std::int32_t halfExponent = exponent - 127 + 15;
+  if (halfExponent >= 0x1F) {
+    return static_cast<std::uint16_t>(sign | 0x7C00U); // overflow
+  }
+  if (halfExponent <= 0) {
+    if (halfExponent < -10) {
+      return sign; // too small even for a subnormal
+    }
+    // subnormal, shift the implicit one in and round to nearest even
+    mantissa |= 0x800000U;
+    const auto shift = static_cast<std::uint32_t>(14 - halfExponent);
+    std::uint32_t half = mantissa >> shift;
+    const std::uint32_t rest = mantissa & ((1U << shift) - 1U);
+    const std::uint32_t halfway = 1U << (shift - 1U);
+    if (rest > halfway || (rest == halfway && (half & 1U))) {
+      ++half;
+    }
+    return static_cast<std::uint16_t>(sign | half);
+  }
+  std::uint32_t half = (static_cast<std::uint32_t>(halfExponent) << 10) |
+                       (mantissa >> 13);
+  const std::uint32_t rest = mantissa & 0x1FFFU;
+  if (rest > 0x1000U || (rest == 0x1000U && (half & 1U))) {
+    ++half; // a carry into the exponent is still the correct rounding
+  }
+  return static_cast<std::uint16_t>(sign | half);
+}
+
+float CVertexFormat::HalfToFloat(const std::uint16_t half) {
+  const std::uint32_t sign = (half & 0x8000U) << 16;
+  std::uint32_t exponent   = (half >> 10) & 0x1FU;
+  std::uint32_t mantissa   = half & 0x3FFU;
+  std::uint32_t bits       = 0;
+  if (exponent == 0x1F) {
+    bits = sign | 0x7F800000U | (mantissa << 13);
+  } else if (exponent == 0) {
+    if (mantissa == 0) {
+      bits = sign;
+    } else {
+      // normalise the subnormal
+      exponent = 127 - 15 + 1;
+      while ((mantissa & 0x400U) == 0) {
+        mantissa <<= 1;
+        --exponent;
+      }
+      bits = sign | (exponent << 23) | ((mantissa & 0x3FFU) << 13);
+    }
+  } else {
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  }
+  float value = 0;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+bool CVertexFormat::IsExactInHalf(const glm::vec3 *positions,
+                                  const std::size_t count) {
+  return std::all_of(positions, positions + count, [](const glm::vec3 &v) {
+    for (int i = 0; i < 3; ++i) {
+      if (HalfToFloat(FloatToHalf(v[i])) != v[i]) {
+        return false;
+      }
+    }
+    return true;
+  });
+}
+
+glm::vec2 CVertexFormat::OctEncode(const glm::vec3 &normal) {
+  // project on the octahedron, fold the lower half over the diagonals
+  const float length =
+      std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+  if (length == 0.0f) {
+    return glm::vec2(0);
+  }
+  glm::vec2 encoded(normal.x / length, normal.y / length);
+  if (normal.z < 0.0f) {
+    encoded = glm::vec2((1.0f - std::fabs(encoded.y)) * SignNotZero(encoded.x),
+                        (1.0f - std::fabs(encoded.x)) * SignNotZero(encoded.y));
+  }
+  return encoded;
+}
+
+glm::vec3 CVertexFormat::OctDecode(const glm::vec2 &encoded) {
+  glm::vec3 normal(encoded.x, encoded.y,
+                   1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+  if (normal.z < 0.0f) {
+    normal.x = (1.0f - std::fabs(encoded.y)) * SignNotZero(encoded.x);
+    normal.y = (1.0f - std::fabs(encoded.x)) * SignNotZero(encoded.y);
+  }
+  return glm::normalize(normal);
+}
+
+CVertexFormat::Packed CVertexFormat::Pack(const glm::vec3 *positions,
+                                          const glm::vec3 *normals,
+                                          const glm::vec2 *uvs,
+                                          const std::size_t vertexCount,
+                                          const GLuint *indices,
+                                          const std::size_t indexCount) const {
+  Packed packed;
+
+  // UNORM16 covers the UV bounds of the mesh, the shader maps them back
+  glm::vec2 uvMin(0), uvScale(1);
+  if (uv == UV::UNORM16 && vertexCount > 0) {
+    glm::vec2 uvMax = uvs[0];
+    uvMin = uvs[0];
+    for (std::size_t i = 1; i < vertexCount; ++i) {
+      uvMin = glm::min(uvMin, uvs[i]);
+      uvMax = glm::max(uvMax, uvs[i]);
+    }
+    uvScale = uvMax - uvMin;
+    uvScale.x = uvScale.x > 0.0f ? uvScale.x : 1.0f;
+    uvScale.y = uvScale.y > 0.0f ? uvScale.y : 1.0f;
+    packed.uvTransform = glm::vec4(uvScale.x, uvScale.y, uvMin.x, uvMin.y);
+  }
+
+  // UNORM16 positions cover the bounds of the mesh the same way
+  if (position == Position::UNORM16 && vertexCount > 0) {
+    glm::vec3 positionMax = positions[0];
+    packed.positionOffset = positions[0];
+    for (std::size_t i = 1; i < vertexCount; ++i) {
+      packed.positionOffset = glm::min(packed.positionOffset, positions[i]);
+      positionMax = glm::max(positionMax, positions[i]);
+    }
+    const glm::vec3 extent = positionMax - packed.positionOffset;
+    for (int i = 0; i < 3; ++i) {
+      packed.positionScale[i] = extent[i] > 0.0f ? extent[i] : 1.0f;
+    }
+  }
+
+  const std::size_t sizes[3] = {static_cast<std::size_t>(PositionSize(position)),
+                                static_cast<std::size_t>(NormalSize(normal)),
+                                static_cast<std::size_t>(UVSize(uv))};
+  if (interleaved) {
+    packed.streams.emplace_back(vertexCount * static_cast<std::size_t>(BytesPerVertex()));
+  } else {
+    for (const auto size : sizes) {
+      if (size > 0) {
+        packed.streams.emplace_back(vertexCount * size);
+      }
+    }
+  }
+  std::vector<std::uint8_t *> out;
+  for (auto &stream : packed.streams) {
+    out.push_back(stream.data());
+  }
+  // with split streams every attribute writes to its own cursor
+  std::size_t stream = 0;
+  auto next = [&]() -> std::uint8_t *& {
+    return out[interleaved ? 0 : stream++];
+  };
+
+  for (std::size_t i = 0; i < vertexCount; ++i) {
+    stream = 0;
+    const glm::vec3 &p = positions[i];
+    if (position == Position::HALF4) {
+      auto &cursor = next();
+      Write(cursor, FloatToHalf(p.x));
+      Write(cursor, FloatToHalf(p.y));
+      Write(cursor, FloatToHalf(p.z));
+      Write(cursor, FloatToHalf(1.0f));
+    } else if (position == Position::UNORM16) {
+      const glm::vec3 t = (p - packed.positionOffset) / packed.positionScale;
+      auto &cursor = next();
+      Write(cursor, Unorm16(t.x));
+      Write(cursor, Unorm16(t.y));
+      Write(cursor, Unorm16(t.z));
+      Write(cursor, Unorm16(1.0f));
+    } else {
+      Write(next(), p);
+    }
+
+    if (normal == Normal::OCT_SNORM16) {
+      const glm::vec2 encoded = OctEncode(normals[i]);
+      auto &cursor = next();
+      Write(cursor, Snorm16(encoded.x));
+      Write(cursor, Snorm16(encoded.y));
+    } else if (normal == Normal::FLOAT3) {
+      Write(next(), normals[i]);
+    }
+
+    if (uv == UV::UNORM16) {
+      const glm::vec2 t = (uvs[i] - uvMin) / uvScale;
+      auto &cursor = next();
+      Write(cursor, Unorm16(t.x));
+      Write(cursor, Unorm16(t.y));
+    } else if (uv == UV::FLOAT2) {
+      Write(next(), uvs[i]);
+    }
+  }
+
+  packed.indexType  = IndexType(vertexCount);
+  packed.indexCount = static_cast<GLsizei>(indexCount);
+  packed.indices.resize(indexCount *
+                        static_cast<std::size_t>(IndexSize(packed.indexType)));
+  auto *cursor = packed.indices.data();
+  for (std::size_t i = 0; i < indexCount; ++i) {
+    if (packed.indexType == GL_UNSIGNED_SHORT) {
+      Write(cursor, static_cast<GLushort>(indices[i]));
+    } else {
+      Write(cursor, indices[i]);
+    }
+  }
+  return packed;
+}
+
+void CVertexFormat::SetAttributes(const std::vector<GLuint> &buffers) const {
+  std::size_t buffer = 0;
+  std::size_t offset = 0;
+  const auto stride  = interleaved ? BytesPerVertex() : 0;
+
+  auto attribute = [&](const GLuint location, const GLint components,
+                       const GLenum type, const GLboolean normalized,
+                       const GLsizei size) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[buffer]);
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, components, type, normalized, stride,
+                          Offset(offset));
+    if (interleaved) {
+      offset += static_cast<std::size_t>(size);
+    } else {
+      ++buffer;
+    }
+  };
+
+  if (position == Position::HALF4) {
+    attribute(positionLocation, 4, GL_HALF_FLOAT, GL_FALSE,
+              PositionSize(position));
+  } else if (position == Position::UNORM16) {
+    attribute(positionLocation, 4, GL_UNSIGNED_SHORT, GL_TRUE,
+              PositionSize(position));
+  } else {
+    attribute(positionLocation, 3, GL_FLOAT, GL_FALSE, PositionSize(position));
+  }
+  if (normal == Normal::OCT_SNORM16) {
+    attribute(normalLocation, 2, GL_SHORT, GL_TRUE, NormalSize(normal));
+  } else if (normal == Normal::FLOAT3) {
+    attribute(normalLocation, 3, GL_FLOAT, GL_FALSE, NormalSize(normal));
+  }
+  if (uv == UV::UNORM16) {
+    attribute(uvLocation, 2, GL_UNSIGNED_SHORT, GL_TRUE, UVSize(uv));
+  } else if (uv == UV::FLOAT2) {
+    attribute(uvLocation, 2, GL_FLOAT, GL_FALSE, UVSize(uv));
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CVertexFormat::PrintReport(std::ostream &out, const char *name,
+                                const std::size_t vertexCount,
+                                const std::size_t indexCount,
+                                const CVertexFormat &before,
+                                const GLenum beforeIndexType,
+                                const CVertexFormat &after,
+                                const GLenum afterIndexType) {
+  const auto bytes = [&](const CVertexFormat &format, const GLenum indexType) {
+    return vertexCount * static_cast<std::size_t>(format.BytesPerVertex()) +
+           indexCount * static_cast<std::size_t>(IndexSize(indexType));
+  };
+  out << name << ": " << vertexCount << " vertices, " << before.BytesPerVertex()
+      << " -> " << after.BytesPerVertex() << " bytes per vertex, "
+      << IndexSize(beforeIndexType) << " -> " << IndexSize(afterIndexType)
+      << " bytes per index, " << bytes(before, beforeIndexType) << " -> "
+      << bytes(after, afterIndexType) << " bytes\n";
+}
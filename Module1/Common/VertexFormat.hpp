@@ -0,0 +1,103 @@
+#pragma once
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+// GLEW
+#include <GL/glew.h>
+// GLM
+#include <glm/glm.hpp>
+
+/**
+ * @brief Vertex layout descriptor and encoder for packed vertex streams.
+ *
+ * Every attribute has a full precision and a packed encoding:
+ *
+ *   position  FLOAT3 (12 bytes)  or HALF4        (8 bytes, w = 1)
+ *                                or UNORM16      (8 bytes, mesh bounds)
+ *   normal    FLOAT3 (12 bytes)  or OCT_SNORM16  (4 bytes, octahedral)
+ *   uv        FLOAT2 (8 bytes)   or UNORM16      (4 bytes, mesh UV bounds)
+ *
+ * Attributes are interleaved in one buffer or split into one buffer per
+ * attribute. Packed normals arrive in the vertex shader as a vec2 in
+ * [-1, 1] for OctDecode, packed UVs as a vec2 in [0, 1] to be mapped back
+ * with `uv * uvTransform.xy + uvTransform.zw` (see Packed::uvTransform).
+ * UNORM16 positions arrive in [0, 1] as well and are mapped back with
+ * `position * positionScale + positionOffset`.
+ * Indices are 16-bit whenever every vertex can be addressed with them.
+ */
+class CVertexFormat {
+public:
+  enum class Position : std::uint8_t { FLOAT3, HALF4, UNORM16 };
+  enum class Normal : std::uint8_t { NONE, FLOAT3, OCT_SNORM16 };
+  enum class UV : std::uint8_t { NONE, FLOAT2, UNORM16 };
+
+  Position position = Position::FLOAT3;
+  Normal normal     = Normal::NONE;
+  UV uv             = UV::NONE;
+  bool interleaved  = true;
+
+  // attribute locations, the repo's shaders use 0, 1 and 2
+  GLuint positionLocation = 0;
+  GLuint normalLocation   = 1;
+  GLuint uvLocation       = 2;
+
+  struct Packed {
+    // one buffer when interleaved, otherwise position, normal, uv in order
+    std::vector<std::vector<std::uint8_t>> streams;
+    std::vector<std::uint8_t> indices;
+    GLenum indexType = GL_UNSIGNED_INT;
+    GLsizei indexCount = 0;
+    glm::vec4 uvTransform = glm::vec4(1, 1, 0, 0); // scale.xy, offset.zw
+    glm::vec3 positionScale  = glm::vec3(1);        // UNORM16 mesh extent
+    glm::vec3 positionOffset = glm::vec3(0);        // UNORM16 mesh minimum
+  };
+
+  static GLsizei PositionSize(Position position);
+  static GLsizei NormalSize(Normal normal);
+  static GLsizei UVSize(UV uv);
+
+  GLsizei BytesPerVertex() const;
+
+  /**
+   * @brief GL_UNSIGNED_SHORT when `vertexCount` vertices fit 16-bit indices.
+   */
+  static GLenum IndexType(std::size_t vertexCount);
+
+  static GLsizei IndexSize(GLenum indexType);
+
+  /**
+   * @brief Encode the attributes this format has, `normals` and `uvs` may
+   * be null when the format has none.
+   */
+  Packed Pack(const glm::vec3 *positions, const glm::vec3 *normals,
+              const glm::vec2 *uvs, std::size_t vertexCount,
+              const GLuint *indices, std::size_t indexCount) const;
+
+  /**
+   * @brief Point the attributes of the bound VAO at `buffers`, one per
+   * stream of Pack.
+   */
+  void SetAttributes(const std::vector<GLuint> &buffers) const;
+
+  static std::uint16_t FloatToHalf(float value);
+  static float HalfToFloat(std::uint16_t half);
+
+  /**
+   * @brief True when every coordinate survives the round trip through a
+   * half float, i.e. HALF4 positions lose nothing.
+   */
+  static bool IsExactInHalf(const glm::vec3 *positions, std::size_t count);
+  static glm::vec2 OctEncode(const glm::vec3 &normal);
+  static glm::vec3 OctDecode(const glm::vec2 &encoded);
+
+  /**
+   * @brief Print the vertex and index bytes of `vertexCount` vertices in
+   * the `before` and `after` formats.
+   */
+  static void PrintReport(std::ostream &out, const char *name,
+                          std::size_t vertexCount, std::size_t indexCount,
+                          const CVertexFormat &before, GLenum beforeIndexType,
+                          const CVertexFormat &after, GLenum afterIndexType);
+};
@@ -0,0 +1,90 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+#include "WorkerPool.hpp"
+// STL
+#include <algorithm>
+
+CWorkerPool &CWorkerPool::Instance() {
+  static CWorkerPool pool(std::max(1U, std::thread::hardware_concurrency()) - 1);
+  return pool;
+}
+
+CWorkerPool::CWorkerPool(const unsigned workerCount) {
+  workers.reserve(workerCount);
+  for (unsigned i = 0; i < workerCount; ++i) {
+    workers.emplace_back(&CWorkerPool::WorkerLoop, this);
+  }
+}
+
+CWorkerPool::~CWorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+unsigned CWorkerPool::GetThreadCount() const {
+  return static_cast<unsigned>(workers.size()) + 1;
+}
+
+void CWorkerPool::ParallelFor(const std::size_t count_, const Task &task_) {
+  if (workers.empty() || count_ < 2) {
+    for (std::size_t i = 0; i < count_; ++i) {
+      task_(i);
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> run(runMutex);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    task  = &task_;
+    count = count_;
+    next  = 0;
+    ++generation;
+  }
+  wake.notify_all();
+  RunTasks();
+
+  // every index is taken, wait for the workers still running one; workers
+  // that wake up after this find no task and go back to sleep
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this] { return busy == 0; });
+  task = nullptr;
+}
+
+void CWorkerPool::WorkerLoop() {
+  std::size_t seen = 0;
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    wake.wait(lock, [&] { return quit || generation != seen; });
+    if (quit) {
+      return;
+    }
+    seen = generation;
+    if (!task) {
+      continue;
+    }
+    ++busy;
+    lock.unlock();
+    RunTasks();
+    lock.lock();
+    if (--busy == 0) {
+      done.notify_one();
+    }
+  }
+}
+
+void CWorkerPool::RunTasks() {
+  for (;;) {
+    const std::size_t i = next.fetch_add(1);
+    if (i >= count) {
+      return;
+    }
+    (*task)(i);
+  }
+}
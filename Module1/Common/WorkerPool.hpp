@@ -0,0 +1,65 @@
+#pragma once
+// STL
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Persistent worker threads for the per-frame parallel loops of the
+ * CPU cullers.
+ *
+ * The threads are created once and sleep on a condition variable between
+ * calls, so a frame pays a wake-up instead of a thread creation per batch.
+ * ParallelFor hands out chunk indices through an atomic counter and the
+ * calling thread works on them as well. Calls from different threads are
+ * serialized; a task must not call ParallelFor on the same pool.
+ */
+class CWorkerPool {
+public:
+  using Task = std::function<void(std::size_t)>;
+
+  /**
+   * @brief Shared pool with one thread less than the hardware concurrency,
+   * the caller being the last one.
+   */
+  static CWorkerPool &Instance();
+
+  explicit CWorkerPool(unsigned workerCount);
+  ~CWorkerPool();
+
+  CWorkerPool(const CWorkerPool &) = delete;
+  CWorkerPool &operator=(const CWorkerPool &) = delete;
+
+  /**
+   * @brief Threads ParallelFor runs on, the calling one included.
+   */
+  unsigned GetThreadCount() const;
+
+  /**
+   * @brief Run task(i) for every i in [0, count) and return once all of
+   * them finished.
+   */
+  void ParallelFor(std::size_t count, const Task &task);
+
+private:
+  void WorkerLoop();
+  void RunTasks();
+
+  std::vector<std::thread> workers;
+  std::mutex runMutex; // one ParallelFor at a time
+
+  // guarded by mutex, except `next` which the tasks take without it
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const Task *task = nullptr; // null once the current call returned
+  std::size_t count = 0;
+  std::atomic<std::size_t> next{0};
+  std::size_t generation = 0; // bumped by every ParallelFor
+  unsigned busy = 0;          // workers inside the current call
+  bool quit = false;
+};
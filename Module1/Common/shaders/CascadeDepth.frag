@@ -0,0 +1,6 @@
+#version 330 core
+
+//only depth is written to the cascade layers
+void main()
+{
+}
@@ -0,0 +1,64 @@
+#version 330 core
+
+layout(location=0) out vec4 vFragColor;	//fragment shader output
+
+//uniforms
+uniform sampler2DArrayShadow shadowMaps;	//one layer per cascade
+uniform bool bShowCascades;					//tint the fragments by cascade
+
+//per-pass uniforms, shared with the vertex shader
+layout(std140) uniform PerFrame {
+	mat4 V;					//view matrix
+	mat4 P;					//projection matrix
+	mat4 S;					//shadow matrix
+	vec4 light_position;	//light position in world space
+	int  bIsLightPass;		//flag to indicate the light pass
+};
+
+//per-draw uniforms, shared with the vertex shader
+layout(std140) uniform PerDraw {
+	mat4 M;					//model matrix
+	vec4 diffuse_color;		//surface's diffuse colour
+	vec4 specular_color;	//specular colour, shininess in a
+};
+
+//cascade matrices and splits (CascadeBlock in Common)
+layout(std140) uniform Cascades {
+	mat4 cascade_VP[4];		//light projection * view per cascade
+	mat4 cascade_S[4];		//bias * projection * view per cascade
+	vec4 cascade_splits;	//far view space depth of each cascade
+	int  cascade_count;		//number of cascades in use
+};
+
+//inputs from the vertex shader
+smooth in vec3 vEyeSpaceNormal;		//interpolated eye space normal
+smooth in vec3 vEyeSpacePosition;	//interpolated eye space position
+smooth in vec4 vWorldSpacePosition;	//interpolated world space position
+
+const vec3 cascadeColors[4] = vec3[4](vec3(1,0.5,0.5), vec3(0.5,1,0.5),
+									 vec3(0.5,0.5,1), vec3(1,1,0.5));
+
+void main() { 
+	//the light is directional, towards the scene centre
+	vec3 L = normalize(mat3(V)*light_position.xyz);
+	float diffuse = max(0, dot(normalize(vEyeSpaceNormal), L));
+
+	//first cascade whose far split is beyond the fragment
+	float depth = -vEyeSpacePosition.z;
+	int cascade = 0;
+	while(cascade < cascade_count && depth > cascade_splits[cascade])
+		++cascade;
+
+	vec3 tint = vec3(1);
+	if(cascade < cascade_count) {
+		vec4 coords = cascade_S[cascade]*vWorldSpacePosition;
+		//layer in the third and reference depth in the fourth component
+		float shadow = texture(shadowMaps, vec4(coords.xy, float(cascade), coords.z));
+		diffuse = mix(diffuse, diffuse*shadow, 0.5);
+		if(bShowCascades)
+			tint = cascadeColors[cascade];
+	}
+
+	//return the final colour by multiplying the diffuse colour with the diffuse component
+	vFragColor = diffuse*vec4(diffuse_color.rgb*tint, 1);	 
+}
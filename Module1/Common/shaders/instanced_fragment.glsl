@@ -0,0 +1,7 @@
+//per-instance colour written by instanced_vertex.glsl. Built with INSTANCED
+//vColor reads it, otherwise the including shader declares its own vColor
+//uniform inside #ifndef INSTANCED.
+#ifdef INSTANCED
+flat in vec4 vColorInstance;	//per-instance colour
+#define vColor vColorInstance
+#endif
@@ -0,0 +1,40 @@
+//per-instance inputs of RenderableObject::RenderInstanced, laid out as in
+//CInstanceBuffer. Built with INSTANCED the MVP uniform of the including
+//shader holds the view projection only and InstancePosition applies the
+//per-instance model matrix, otherwise both helpers do nothing.
+#ifdef INSTANCED
+layout(location = 1) in vec4 vInstanceColor;	//per-instance colour
+layout(location = 2) in mat4 mInstance;		//per-instance model matrix
+flat out vec4 vColorInstance;				//instance colour for the fragment shader
+
+vec4 InstancePosition(vec4 position)
+{
+	return mInstance*position;
+}
+
+void PassInstanceColor()
+{
+	vColorInstance = vInstanceColor;
+}
+#else
+vec4 InstancePosition(vec4 position)
+{
+	return position;
+}
+
+void PassInstanceColor()
+{
+}
+#endif
+
+//positions in the geometry pool are UNORM16 over the bounds of the mesh
+//when the including shader calls DecodePosition, which maps them back to
+//object space (see RenderableObject::Init). Float positions get a scale of
+//one and an offset of zero.
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+vec3 DecodePosition(vec3 position)
+{
+	return position*positionScale + positionOffset;
+}